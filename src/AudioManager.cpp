@@ -2,11 +2,59 @@
 #include "SD.h"
 #include "esp_system.h" // for esp_restart()
 #include "Config.h"
+#include "HeapBudget.h"
 #include "Settings.h"
 
+// Ring the decoder currently being pumped writes into. The Audio library hands
+// every decoded frame to audio_process_i2s() just before its own i2s_write();
+// we take the frame instead so the mixer can sum both decks. While a clip is
+// being pre-decoded, or a track measured, the frames go there instead.
+static AudioMixer::Ring *s_captureRing = nullptr;
+static AudioMixer *s_captureMixer = nullptr;
+static PcmClip *s_captureClip = nullptr;
+static LoudnessMeter *s_captureMeter = nullptr;
+static Audio *s_captureDeck = nullptr;
+static uint32_t *s_captureSkip = nullptr; // frames to drop before a resume point
+static PcmClip *s_captureTee = nullptr;   // copy of the ring's frames for the clip cache
+
+void audio_process_i2s(uint32_t *sample, bool *continueI2S) {
+  if (s_captureMeter) {
+    if (!s_captureMeter->started()) s_captureMeter->begin(s_captureDeck->getSampleRate());
+    s_captureMeter->add(*sample);
+    *continueI2S = false;
+    return;
+  }
+  if (s_captureClip) {
+    if (s_captureClip->sampleRate() == 0) s_captureClip->setSampleRate(s_captureDeck->getSampleRate());
+    s_captureClip->append(*sample);
+    *continueI2S = false;
+    return;
+  }
+  if (!s_captureRing) {
+    *continueI2S = true;
+    return;
+  }
+  if (s_captureSkip && *s_captureSkip) {
+    (*s_captureSkip)--;
+    *continueI2S = false;
+    return;
+  }
+  if (s_captureTee) {
+    if (s_captureTee->sampleRate() == 0) s_captureTee->setSampleRate(s_captureDeck->getSampleRate());
+    s_captureTee->append(*sample);
+  }
+  if (!s_captureRing->push(*sample) && s_captureMixer) {
+    s_captureMixer->countOverflow();
+  }
+  *continueI2S = false;
+}
+
 void AudioManager::begin(int bclk, int lrclk, int din) {
   _bclk = bclk; _lrclk = lrclk; _din = din;
   _audio.setPinout(_bclk, _lrclk, _din);
+  // Decoders run at unity; volume is the mixer's master gain
+  _audio.setVolume(21);
+  _audioB.setVolume(21);
   
   // Initialize settings and load saved volume and EQ
   Settings::begin();
@@ -14,79 +62,1014 @@ void AudioManager::begin(int bclk, int lrclk, int din) {
   loadEQSettings(); // Load equalizer settings
   
   _consecutiveFails = 0;
+  for (int i = 0; i < AudioMixer::CHANNELS; ++i) _mixer.reset(i);
+  s_captureMixer = &_mixer;
+  if (psramFound()) {
+    _clips.begin(CLIP_CACHE_PSRAM_BYTES);
+    _clipBudget = CLIP_PSRAM_BUDGET_BYTES;
+  } else {
+    _clips.begin(heapShare(CLIP_CACHE_HEAP_PERCENT, CLIP_CACHE_RAM_BYTES));
+    _clipBudget = _clips.budget() / 2 < CLIP_RAM_BUDGET_BYTES ? _clips.budget() / 2 : CLIP_RAM_BUDGET_BYTES;
+  }
+  Serial.printf("AudioManager: clip cache %u bytes, %u a clip\n", (unsigned)_clips.budget(), (unsigned)_clipBudget);
+  _chime.begin(&_clips);
+  _duckGain = LoudnessIndex::toQ15(CHIME_DUCK_DB * 100);
+  _loudness.begin(SD, LOUDNESS_INDEX_PATH);
+  _seek.begin(SD, SEEK_INDEX_DIR);
+  if (!SD.exists(CLIP_FILE_DIR)) SD.mkdir(CLIP_FILE_DIR);
   
   // Debug output
   Serial.printf("AudioManager: Initialized with volume %d, EQ (B:%d M:%d T:%d)\n", 
-                _currentVolume, _eqBass, _eqMid, _eqTreble);
+                _currentVolume.load(), getBass(), getMid(), getTreble());
 }
 
+void AudioManager::startTask() {
+  if (_task.running()) return;
+  if (!_task.start("audio", taskBody, this, AUDIO_TASK_STACK, AUDIO_TASK_PRIORITY, AUDIO_TASK_CORE)) {
+    Serial.println("AudioManager: could not start audio task, audio runs from loop()");
+    return;
+  }
+  Serial.printf("AudioManager: audio task running on core %d\n", AUDIO_TASK_CORE);
+}
+
+void AudioManager::taskBody(void *self) {
+  static_cast<AudioManager *>(self)->step();
+  AudioTask::sleepMs(1);
+}
+
+// Arduino loop: hand finished starts back to whoever asked for them
 void AudioManager::loop() {
-  _audio.loop();
+  uint32_t now = micros();
+  if (_lastLoopUs) _metrics.mainLoopUs.record(now - _lastLoopUs);
+  _lastLoopUs = now;
+
+  if (!_task.running()) step();
+  if (_eqDirty) publishEQ();
+  collectAnalysis();
+  indexPlaying();
+
+  if (_rejected.handle) {
+    StartEvent e = _rejected;
+    _rejected = {};
+    if (e.cb) e.cb(e.handle, false, 0, e.ctx);
+  }
+  StartEvent e;
+  while (_events.pop(e)) {
+    if (e.cb) e.cb(e.handle, e.ok, e.latencyMs, e.ctx);
+  }
+  TrackResult r;
+  while (_results.pop(r)) {
+    if (_resultCb) _resultCb(r.path, r.ok, _resultCtx);
+  }
+}
+
+bool AudioManager::postCommand(CommandType type, uint32_t arg, const char *path,
+                               uint32_t handle, StartCallback cb, void *ctx, const ResumePoint &resume) {
+  Command c;
+  c.type = type;
+  c.arg = arg;
+  c.resume = resume;
+  c.handle = handle;
+  c.cb = cb;
+  c.ctx = ctx;
+  if (path) {
+    if (strlen(path) >= PATH_LEN) {
+      Serial.printf("AudioManager: path too long: %s\n", path);
+      return false;
+    }
+    snprintf(c.path, sizeof(c.path), "%s", path);
+  }
+  if (!_commands.push(c)) {
+    // Without the task nobody else drains the queue
+    if (!_task.running()) step();
+    if (!_commands.push(c)) {
+      Serial.println("AudioManager: command queue full");
+      return false;
+    }
+  }
+  _commandsPosted++;
+  return true;
+}
+
+// Consistent copy of the task's last published state
+AudioManager::Status AudioManager::status() const {
+  Status s;
+  while (true) {
+    uint32_t seq = _statusSeq.load(std::memory_order_acquire);
+    if (seq & 1) continue; // being written
+    s = _status;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (_statusSeq.load(std::memory_order_relaxed) == seq) return s;
+  }
+}
+
+// ---- Audio task ----
+
+// One pass: apply queued commands, run the audio, publish the new state
+void AudioManager::step() {
+  uint32_t now = micros();
+  if (_lastPassUs) _metrics.passGapUs.record(now - _lastPassUs);
+  _lastPassUs = now;
+
+  uint32_t handled = 0;
+  Command c;
+  while (!_quiesced.load() && _commands.pop(c)) {
+    runCommand(c);
+    handled++;
+  }
+  // While the loop remounts the card nothing here may touch it: the decks
+  // are stopped, and only what is already in memory is played
+  if (_quiesced.load()) {
+    updateMasterGain();
+    pumpOutput();
+  } else {
+    service();
+  }
+  publishStatus();
+  if (handled) _commandsDone.fetch_add(handled);
+}
+
+void AudioManager::runCommand(const Command &c) {
+  switch (c.type) {
+  case CMD_START: engineStart(c.path, (int32_t)c.arg, c.handle, c.cb, c.ctx, c.resume); break;
+  case CMD_STOP: engineStop(); break;
+  case CMD_EQ:
+    _eq.setTable(&_eqTables[c.arg]);
+    _eqApplied.fetch_add(1);
+    break;
+  case CMD_CROSSFADE: engineCrossfade(c.path, (int32_t)c.arg, c.handle); break;
+  case CMD_PREFETCH: enginePrefetch(c.path, (int32_t)c.arg); break;
+  case CMD_ANALYZE: startAnalysis(c.path); break;
+  case CMD_FORGET: forgetClip(c.path); break;
+  case CMD_CONVERT: queueConvert(c.path); break;
+  case CMD_GREETING: enginePlayGreeting(c.arg); break;
+  case CMD_PREPARE_CHIME: enginePrepareChime((int)c.arg); break;
+  case CMD_CHIME: enginePlayChime((int)c.arg); break;
+  case CMD_DUCK_CHIME: engineDuckChime((int)c.arg); break;
+  case CMD_QUIESCE: engineQuiesce(); break;
+  }
+}
+
+void AudioManager::publishStatus() {
+  // Only changes when the clip cache does
+  if (_chimeReadyVersion != _clips.version()) {
+    _chimeReadyVersion = _clips.version();
+    _chimeReady = 0;
+    for (int h = 1; h <= 12; ++h) {
+      if (_chime.ready(h)) _chimeReady |= (uint16_t)(1u << h);
+    }
+    const PcmClip *bell = _clips.peek(BELL_PATH);
+    _chimeRate = bell ? bell->sampleRate() : 0;
+  }
+  uint32_t rate = _chimeReady ? duckRate() : 0;
+
+  _statusSeq.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  _status.running = engineRunning();
+  _status.starting = _start.step != SJ_IDLE;
+  _status.crossfading = _isCrossfading;
+  _status.prefetched = _queued >= 0;
+  _status.wantsPrefetch = engineWantsPrefetch();
+  _status.chimeReady = _chimeReady;
+  _status.chimeDuckable = rate && rate == _chimeRate ? _chimeReady : 0;
+  _status.chiming = _chimeActive;
+  _status.gapLastUs = _gapLastUs;
+  _status.gapMaxUs = _gapMaxUs;
+  _status.gapCount = _gapCount;
+  _status.gapSeamless = _gapSeamless;
+  _status.greetLastUs = _greetLastUs;
+  _status.greetMaxUs = _greetMaxUs;
+  _status.startLastMs = _startLastMs;
+  _status.startMaxMs = _startMaxMs;
+  _status.positionFrames = heardFrame();
+  // Only what is new since the last pass, so resetMetrics() can clear it
+  uint32_t overflows = _mixer.getOverflows();
+  if (overflows != _overflowsSeen) {
+    _metrics.ringOverflows.fetch_add(overflows - _overflowsSeen, std::memory_order_relaxed);
+    _overflowsSeen = overflows;
+  }
+  snprintf(_status.path, sizeof(_status.path), "%s", _currentPath.c_str());
+  _statusSeq.fetch_add(1, std::memory_order_release);
+}
+
+void AudioManager::service() {
+  if (_start.step != SJ_IDLE) advanceStart();
+  if (_afterFade != FA_NONE && fadedOut()) runAfterFade();
+  if (_chimeActive && !_mixer.clipPlaying()) endChime();
+  updateMasterGain();
+  pumpDecoders();
+  pumpClipFiles();
   
   // Handle crossfade updates
   if (_isCrossfading) {
     updateCrossfade();
   }
+
+  pumpOutput();
 }
 
-// Equalizer functions
-void AudioManager::setBass(int level) {
-  if (level < -12) level = -12;
-  if (level > 12) level = 12;
-  _eqBass = level;
-  applyEQ();
-  saveEQSettings();
+// Let each running deck decode while its ring has room for another burst
+void AudioManager::pumpDecoders() {
+  for (int i = 0; i < AudioMixer::DECKS; ++i) {
+    Audio &d = deck(i);
+    bool running = d.isRunning();
+
+    // A deck decoding a clip feeds that clip, not the mixer
+    if (i == _jobDeck) {
+      if (running) {
+        s_captureClip = _jobClip;
+        s_captureMeter = _jobMeter;
+        s_captureDeck = &d;
+        d.loop();
+        s_captureClip = nullptr;
+        s_captureMeter = nullptr;
+        s_captureDeck = nullptr;
+      }
+      bool full = _jobClip && _jobClip->full();
+      unsigned long limit = _jobMeter ? LOUDNESS_DECODE_TIMEOUT_MS : CLIP_DECODE_TIMEOUT_MS;
+      bool timedOut = millis() - _jobStart > limit;
+      if (!d.isRunning() || full || timedOut) {
+        // A clip cut short by the budget or the timeout is no use
+        finishJob(!d.isRunning() && !full);
+      }
+      continue;
+    }
+
+    if (running && _mixer.ring(i).freeSpace() >= DECODE_HEADROOM_FRAMES) {
+      s_captureRing = &_mixer.ring(i);
+      s_captureSkip = &_skipFrames[i];
+      s_captureTee = _tee[i];
+      s_captureDeck = &d;
+      uint32_t t0 = micros();
+      d.loop();
+      _metrics.decodeUs.record(micros() - t0);
+      s_captureRing = nullptr;
+      s_captureSkip = nullptr;
+      s_captureTee = nullptr;
+      s_captureDeck = nullptr;
+      running = d.isRunning();
+    }
+    // Too long to keep, or decoded to the end
+    if (_tee[i] && (_tee[i]->full() || !running)) endTee(i, !_tee[i]->full());
+    _mixer.setFeeding(i, running);
+  }
 }
 
-void AudioManager::setMid(int level) {
-  if (level < -12) level = -12;
-  if (level > 12) level = 12;
-  _eqMid = level;
-  applyEQ();
+// Move mixed frames into the I2S DMA buffers (or the output standing in for
+// them) without blocking
+void AudioManager::pumpOutput() {
+  uint32_t rate = _mixer.clipPlaying() ? _mixer.clipRate() : deck(_active).getSampleRate();
+  if (rate > 0 && rate != _outRate) {
+    _out->setSampleRate(rate);
+    _eq.setSampleRate(rate);
+    _outRate = rate;
+  }
+
+  while (true) {
+    if (_outOffset >= _outBytes) {
+      size_t frames = _mixer.render(_outBuf, OUT_CHUNK_FRAMES);
+      if (frames > 0) {
+        _eq.process(_outBuf, frames);
+        _silencePad = 0;
+      } else if (_silencePad > 0) {
+        // Flush the DMA ring with silence after a stop, so it can't replay old audio
+        frames = _silencePad < OUT_CHUNK_FRAMES ? _silencePad : OUT_CHUNK_FRAMES;
+        memset(_outBuf, 0, frames * sizeof(uint32_t));
+        _silencePad -= frames;
+      } else {
+        break;
+      }
+      _outBytes = frames * sizeof(uint32_t);
+      _outOffset = 0;
+    }
+    size_t written = _out->write((const char *)_outBuf + _outOffset, _outBytes - _outOffset);
+    _outOffset += written;
+    trackDma(written / sizeof(uint32_t), _outOffset < _outBytes);
+    if (_firstSamplePending && written > 0 && _mixer.isStarted(_active)) {
+      _firstSamplePending = false;
+      _metrics.firstSampleUs.record(micros() - _firstFrameUs);
+    }
+    if (_latencyPending && written > 0 && _mixer.isStarted(AudioMixer::CLIP_CH)) {
+      _latencyPending = false;
+      _greetLastUs = micros() - _triggerUs;
+      if (_greetLastUs > _greetMaxUs) _greetMaxUs = _greetLastUs;
+      Serial.printf("AudioManager: motion-to-sound %lu us%s\n", (unsigned long)_greetLastUs,
+                    _greetLastUs > GREETING_LATENCY_TARGET_US ? " (over target)" : "");
+    }
+    if (_outOffset < _outBytes) break; // DMA full, try again next pass
+  }
+
+  int to;
+  bool primed;
+  if (_mixer.takeHandover(to, primed)) onHandover(to, primed);
+
+  // Time the silence between a track running out and the next one sounding
+  bool has = _mixer.hasAudio();
+  if (_hadAudio && !has && !_gapPending) {
+    _gapPending = true;
+    _gapStartUs = micros();
+  }
+  _hadAudio = has;
+  if (!has && _silencePad == 0) _dmaPrimed = false; // running dry now is expected
+  if (_gapPending && _mixer.isStarted(_active)) {
+    recordGap(micros() - _gapStartUs);
+  }
+}
+
+// Estimate when the DMA ring runs dry from what has been written to it. A
+// write that finds it already dry while audio is playing is an underrun: the
+// listener heard a dropout. A write that fills the ring resyncs the estimate.
+void AudioManager::trackDma(size_t frames, bool full) {
+  uint32_t now = micros();
+  uint32_t rate = _outRate ? _outRate : 44100;
+  if (frames > 0) {
+    if (_dmaPrimed && (int32_t)(now - _dmaDryUs) > (int32_t)UNDERRUN_SLACK_US) {
+      _metrics.underruns.fetch_add(1, std::memory_order_relaxed);
+      _metrics.lastUnderrunMs.store(millis(), std::memory_order_relaxed);
+    }
+    uint32_t base = (int32_t)(now - _dmaDryUs) > 0 ? now : _dmaDryUs;
+    _dmaDryUs = base + (uint32_t)((uint64_t)frames * 1000000 / rate);
+    _dmaPrimed = true;
+  }
+  if (full) _dmaDryUs = now + (uint32_t)((uint64_t)DMA_RING_FRAMES * 1000000 / rate);
+}
+
+// Frame of the current track being heard right now: what the mixer has taken
+// from its deck, less what is still queued ahead of the DAC
+uint32_t AudioManager::heardFrame() const {
+  uint32_t queued = (_outBytes - _outOffset) / sizeof(uint32_t);
+  int32_t ahead = (int32_t)(_dmaDryUs - micros());
+  if (_dmaPrimed && ahead > 0) {
+    uint32_t rate = _outRate ? _outRate : 44100;
+    queued += (uint32_t)((uint64_t)ahead * rate / 1000000);
+  }
+  uint32_t played = _mixer.played(_active);
+  return _baseFrame[_active] + (played > queued ? played - queued : 0);
+}
+
+// The prefetched deck took over from the one that just ran out
+void AudioManager::onHandover(int to, bool primed) {
+  stopDeck(_active);
+  _active = to;
+  _queued = -1;
+  _currentPath = _nextPath;
+  _nextPath = String();
+
+  if (primed) {
+    recordGap(0);
+  } else {
+    _gapPending = true;
+    _gapStartUs = micros();
+  }
+  Serial.printf("AudioManager: gapless handover to %s (%s)\n", _currentPath.c_str(),
+                primed ? "seamless" : "not primed");
+}
+
+void AudioManager::recordGap(uint32_t us) {
+  _gapPending = false;
+  _gapLastUs = us;
+  if (us > _gapMaxUs) _gapMaxUs = us;
+  _gapCount++;
+  if (us == 0) _gapSeamless++;
+}
+
+void AudioManager::stopDeck(int i) {
+  // Abandon a background decode; it is run again when next needed
+  if (i == _jobDeck) finishJob(false, true);
+  if (_tee[i]) endTee(i, false);
+  if (deck(i).isRunning()) deck(i).stopSong();
+  _mixer.reset(i);
+  _baseFrame[i] = 0;
+  _skipFrames[i] = 0;
+  if (_queued == i) {
+    _queued = -1;
+    _nextPath = String();
+  }
+}
+
+void AudioManager::stopAll() {
+  // A background clip decode keeps its deck
+  for (int i = 0; i < AudioMixer::DECKS; ++i) {
+    if (i != _jobDeck) stopDeck(i);
+  }
+  _mixer.reset(AudioMixer::CLIP_CH);
+  _latencyPending = false;
+  _outBytes = _outOffset = 0;
+  _hadAudio = false;
+  _gapPending = false;
+  _fadeOut = -1;
+  _isCrossfading = false;
+  _chimeActive = false;
+  _duck = DUCK_NONE;
+  _mixer.rampDecks(AudioMixer::UNITY, 0);
+}
+
+// Frames in one de-click ramp at the current output rate
+uint32_t AudioManager::rampFrames() const {
+  uint32_t rate = _outRate ? _outRate : 44100;
+  return (uint32_t)((uint64_t)VOLUME_RAMP_MS * rate / 1000);
+}
+
+// Volume is the master gain. Every change, and the fade-out before a stop or
+// a switch, ramps over VOLUME_RAMP_MS instead of stepping.
+void AudioManager::updateMasterGain() {
+  int32_t want;
+  if (_afterFade != FA_NONE || _start.step == SJ_FADE) want = 0;
+  else want = volumeGain(_chimeActive ? CHIME_VOLUME : _currentVolume.load());
+  if (want != _mixer.getMasterTarget()) _mixer.rampMaster(want, rampFrames());
+  // A ducked track follows volume changes made during the chime
+  if (_duck != DUCK_NONE) {
+    int32_t share = deckShare(_duck == DUCK_DOWN);
+    if (share != _mixer.getDecksTarget()) _mixer.rampDecks(share, rampFrames());
+  }
+}
+
+// The fade-out has reached silence and its last samples are in the DMA buffers
+bool AudioManager::fadedOut() const {
+  bool silent = !_mixer.hasAudio() || (_mixer.masterRampDone() && _mixer.getMasterTarget() == 0);
+  return silent && _outOffset >= _outBytes;
+}
+
+// Fade out whatever is playing, then run `what`. A later request replaces
+// an earlier one that is still waiting.
+void AudioManager::fadeThen(AfterFade what, uint32_t arg) {
+  cancelStart();
+  _afterFade = what;
+  _afterFadeArg = arg;
+  if (!_mixer.hasAudio()) runAfterFade();
+}
+
+void AudioManager::runAfterFade() {
+  AfterFade what = _afterFade;
+  _afterFade = FA_NONE;
+  stopAll();
+  _mixer.rampMaster(volumeGain(_currentVolume), 0); // nothing is playing now
+
+  switch (what) {
+  case FA_STOP:
+    _silencePad = DMA_RING_FRAMES;
+    break;
+  case FA_GREETING:
+    beginGreeting(_afterFadeArg);
+    break;
+  case FA_CHIME:
+    beginChime((int)_afterFadeArg);
+    break;
+  default:
+    break;
+  }
+}
+
+// Bring a channel in from silence over one ramp
+void AudioManager::fadeIn(int ch) {
+  _mixer.rampTo(ch, 0, 0);
+  _mixer.rampTo(ch, AudioMixer::UNITY, rampFrames());
+}
+
+// Q15 gain for a 0..21 volume step, same curve as the library's volume table
+int32_t AudioManager::volumeGain(int v) {
+  static const uint8_t table[22] = {0,  1,  2,  3,  4,  6,  8,  10, 12, 14, 17,
+                                    20, 23, 27, 30, 34, 38, 43, 48, 52, 58, 64};
+  if (v < 0) v = 0;
+  if (v > 21) v = 21;
+  return (int32_t)table[v] << 9; // 64 -> UNITY
+}
+
+// Deck a background decode can borrow: the one not carrying, fading or
+// queueing a track. -1 if it is busy.
+int AudioManager::freeJobDeck() {
+  if (_jobDeck >= 0) return -1;
+  int d = 1 - _active;
+  if (deck(d).isRunning() || _mixer.isLive(d) || _queued == d || _fadeOut == d) return -1;
+  return d;
+}
+
+// Start decoding a whole file into a clip on the deck not carrying the
+// current track. The job runs a little per pass alongside playback; returns
+// false if that deck is busy or the file can't be opened.
+bool AudioManager::startClipJob(const char *path, const char *keep) {
+  if (_loadClip) return false;
+  File f = SD.open(path);
+  uint32_t size = f ? f.size() : 0;
+  if (f) f.close();
+  if (loadClipFile(path, size, keep)) return true;
+
+  int d = freeJobDeck();
+  if (d < 0) return false;
+
+  PcmClip *clip = _clips.reserve(path, clipBytes(), _mixer.clipSeq(), keep);
+  if (!clip) return false;
+  if (!deck(d).connecttoFS(SD, path)) {
+    _clips.loaded(path, false, 0);
+    return false;
+  }
+  _clips.countMiss();
+  _jobClip = clip;
+  _jobPath = path;
+  _jobFileBytes = deck(d).getFileSize();
+  _jobDeck = d;
+  _jobStart = millis();
+  return true;
+}
+
+// Most one decoded clip may take, set in begin()
+size_t AudioManager::clipBytes() const { return _clipBudget; }
+
+// A short file started for playback is decoded once anyway; keep a copy
+void AudioManager::endTee(int i, bool ok) {
+  if (ok) _clips.loaded(_teePath[i].c_str(), true, _teeFileBytes[i]);
+  else if (_tee[i]->full()) _clips.loaded(_teePath[i].c_str(), false, 0); // too long to cache
+  else _clips.cancel(_teePath[i].c_str());
+  if (ok) {
+    Serial.printf("AudioManager: %s kept decoded in the clip cache\n", _teePath[i].c_str());
+    queueConvert(_teePath[i].c_str());
+  }
+  _tee[i] = nullptr;
+  _teePath[i] = String();
+}
+
+// Measure a track's loudness on the free deck, same way as a clip decode
+void AudioManager::startAnalysis(const char *path) {
+  int d = freeJobDeck();
+  if (d < 0) {
+    _analysis = AN_BUSY; // asked again later
+    return;
+  }
+  _meter = LoudnessMeter();
+  if (!deck(d).connecttoFS(SD, path)) {
+    _analysis = AN_FAILED;
+    return;
+  }
+  _jobMeter = &_meter;
+  _jobDeck = d;
+  _jobStart = millis();
+}
+
+// `cancelled`: the deck was needed for playback, not a decode problem
+void AudioManager::finishJob(bool ok, bool cancelled) {
+  Audio &d = deck(_jobDeck);
+  if (d.isRunning()) d.stopSong();
+  _jobDeck = -1;
+
+  if (_jobMeter) {
+    int16_t gain = 0;
+    _jobMeter = nullptr;
+    if (cancelled) {
+      _analysis = AN_BUSY;
+    } else if (ok && _meter.gainCentiDb(LOUDNESS_TARGET_DB, -LOUDNESS_MAX_CUT_DB, LOUDNESS_MAX_BOOST_DB, gain)) {
+      _analysisGain = gain;
+      _analysis = AN_DONE;
+    } else {
+      _analysis = AN_FAILED;
+    }
+    return;
+  }
+
+  if (cancelled) _clips.cancel(_jobPath.c_str());
+  else _clips.loaded(_jobPath.c_str(), ok, _jobFileBytes);
+  if (ok && !cancelled && _jobFileBytes <= CLIP_CACHE_MAX_FILE_BYTES) queueConvert(_jobPath.c_str());
+  _jobClip = nullptr;
+  _jobPath = String();
+}
+
+// A short file saved earlier as a clip file is read back into the cache
+// instead of being decoded. False if there is none, or no room.
+bool AudioManager::loadClipFile(const char *path, uint32_t sourceBytes, const char *keep) {
+  if (sourceBytes == 0 || sourceBytes > CLIP_CACHE_MAX_FILE_BYTES) return false;
+  if (_loadClip) endClipLoad(false, true); // a start takes over from a background load
+  String file = ClipFile::pathFor(CLIP_FILE_DIR, path);
+  if (!_clipLoad.beginLoad(SD, file.c_str(), sourceBytes)) return false;
+  PcmClip *clip = _clips.reserve(path, clipBytes(), _mixer.clipSeq(), keep);
+  if (!clip) {
+    _clipLoad.abort();
+    return false;
+  }
+  _clips.countMiss();
+  _loadClip = clip;
+  _loadPath = path;
+  _loadFileBytes = sourceBytes;
+  return true;
+}
+
+// A clip file that fails to load is removed; the MP3 is decoded next time
+// and saved again
+void AudioManager::endClipLoad(bool ok, bool cancelled) {
+  _clipLoad.abort();
+  if (ok) {
+    _clips.loaded(_loadPath.c_str(), true, _loadFileBytes);
+    dropConvert(_loadPath.c_str()); // already saved
+  } else {
+    _clips.cancel(_loadPath.c_str());
+    if (!cancelled) SD.remove(ClipFile::pathFor(CLIP_FILE_DIR, _loadPath.c_str()));
+  }
+  _loadClip = nullptr;
+  _loadPath = String();
+}
+
+void AudioManager::queueConvert(const char *path) {
+  for (int i = 0; i < _converts; ++i) {
+    if (_convertQueue[i] == path) return;
+  }
+  if (_converts < CONVERT_QUEUE) _convertQueue[_converts++] = path; // else when next decoded
+}
+
+void AudioManager::dropConvert(const char *path) {
+  for (int i = 0; i < _converts; ++i) {
+    if (_convertQueue[i] != path) continue;
+    for (int k = i + 1; k < _converts; ++k) _convertQueue[k - 1] = _convertQueue[k];
+    _convertQueue[--_converts] = String();
+    return;
+  }
+}
+
+void AudioManager::beginConvert(const char *path) {
+  const PcmClip *clip = _clips.peek(path);
+  File f = SD.open(path);
+  uint32_t size = f ? f.size() : 0;
+  if (f) f.close();
+  String file = ClipFile::pathFor(CLIP_FILE_DIR, path);
+  if (clip && size && _clipSave.beginSave(SD, file.c_str(), *clip, size)) {
+    _saveClip = clip;
+    _savePath = path;
+  }
+}
+
+// Clip files are read and written a few blocks per pass, alongside playback
+void AudioManager::pumpClipFiles() {
+  if (_loadClip) {
+    int blocks = _start.step == SJ_LOAD ? CLIP_FILE_START_BLOCKS : CLIP_FILE_LOAD_BLOCKS;
+    ClipFile::Result r = _clipLoad.load(*_loadClip, blocks);
+    if (r != ClipFile::BUSY) endClipLoad(r == ClipFile::DONE);
+  }
+
+  if (_saveClip) {
+    // Evicted or being replaced: saved again when next decoded
+    if (_clips.peek(_savePath.c_str()) != _saveClip) _clipSave.abort();
+    else _clipSave.save(*_saveClip, CLIP_FILE_SAVE_BLOCKS);
+    if (!_clipSave.busy()) {
+      _saveClip = nullptr;
+      _savePath = String();
+    }
+    return;
+  }
+  if (_converts == 0) return;
+
+  String path = _convertQueue[0];
+  switch (_clips.state(path.c_str())) {
+  case ClipCache::READY:
+    dropConvert(path.c_str());
+    beginConvert(path.c_str());
+    break;
+  case ClipCache::LOADING:
+    break; // saved once decoded
+  case ClipCache::FAILED:
+    dropConvert(path.c_str()); // too long, or doesn't decode
+    break;
+  case ClipCache::EMPTY:
+    // Not played yet (an upload): decode it on the idle deck first
+    if (_loadClip || freeJobDeck() < 0) break;
+    if (!startClipJob(path.c_str())) dropConvert(path.c_str());
+    break;
+  }
+}
+
+// The file was deleted or replaced
+void AudioManager::forgetClip(const char *path) {
+  if (_loadClip && _loadPath == path) endClipLoad(false, true);
+  if (_saveClip && _savePath == path) {
+    _clipSave.abort();
+    _saveClip = nullptr;
+    _savePath = String();
+  }
+  dropConvert(path);
+  _clips.remove(path, _mixer.clipSeq());
+  SD.remove(ClipFile::pathFor(CLIP_FILE_DIR, path));
+}
+
+bool AudioManager::convertClip(const String &path) {
+  return postCommand(CMD_CONVERT, 0, path.c_str());
+}
+
+// Blocking variant for boot, before anything plays and before startTask()
+const PcmClip *AudioManager::decodeToClip(const char *path) {
+  if (_task.running()) return nullptr;
+  if (!startClipJob(path)) return nullptr;
+  while (_jobClip || _loadClip) {
+    pumpDecoders();
+    if (_loadClip) pumpClipFiles();
+    yield();
+  }
+  return _clips.peek(path);
+}
+
+bool AudioManager::cacheGreeting(const char *path) {
+  unsigned long t0 = millis();
+  const PcmClip *clip = decodeToClip(path);
+  if (!clip) {
+    Serial.printf("AudioManager: could not cache %s, greeting will stream from SD\n", path);
+    return false;
+  }
+  _clips.pin(path);
+  _greeting = clip;
+  _greetingPath = path;
+  _greetingSeq.clear();
+  _greetingSeq.add(_greeting);
+  Serial.printf("AudioManager: greeting cached: %u ms, %u bytes %s in %s, decoded in %lu ms\n",
+                (unsigned)_greeting->durationMs(), (unsigned)_greeting->bytes(),
+                _greeting->format() == PcmClip::STEREO16 ? "stereo16" : "mulaw",
+                _greeting->inPsram() ? "PSRAM" : "RAM", millis() - t0);
+  return true;
+}
+
+bool AudioManager::playGreeting(unsigned long triggerUs) {
+  if (!_greeting) return false;
+  return postCommand(CMD_GREETING, (uint32_t)triggerUs);
+}
+
+bool AudioManager::enginePlayGreeting(unsigned long triggerUs) {
+  if (!_greeting) return false;
+  _currentPath = _greetingPath;
+  fadeThen(FA_GREETING, (uint32_t)triggerUs);
+  return true;
+}
+
+void AudioManager::beginGreeting(unsigned long triggerUs) {
+  fadeIn(AudioMixer::CLIP_CH);
+  _mixer.playClip(&_greetingSeq);
+  _clips.get(_greetingPath.c_str());
+  _currentPath = _greetingPath;
+  _triggerUs = triggerUs;
+  _latencyPending = true;
+
+  // Hand the first samples to I2S right away instead of on the next pass
+  pumpOutput();
+}
+
+bool AudioManager::prepareChime(int h12) {
+  if (h12 < 1 || h12 > 12) return false;
+  if (status().chimeReady & (1u << h12)) return true;
+  if (!commandsPending()) postCommand(CMD_PREPARE_CHIME, (uint32_t)h12);
+  return false;
+}
+
+bool AudioManager::playChime(int h12) {
+  if (h12 < 1 || h12 > 12) return false;
+  if (!(status().chimeReady & (1u << h12))) return false;
+  return postCommand(CMD_CHIME, (uint32_t)h12);
+}
+
+// Decode whatever the chime for this hour still needs, one clip at a time
+bool AudioManager::enginePrepareChime(int h12) {
+  if (h12 < 1 || h12 > 12) return false;
+  if (_chime.ready(h12)) return true;
+  if (_jobMeter) stopDeck(_jobDeck); // the chime comes first; measured again later
+  if (_jobDeck >= 0) return false;
+
+  int slot = _chime.nextToLoad(h12);
+  if (slot < 0) return false; // a clip is missing or failed to decode
+
+  // The other clip of this chime must not be evicted to make room
+  char path[48], other[48];
+  _chime.pathFor(slot, path, sizeof(path));
+  _chime.pathFor(slot == ChimeComposer::BELL ? h12 : ChimeComposer::BELL, other, sizeof(other));
+  if (startClipJob(path, other)) {
+    Serial.printf("AudioManager: decoding chime clip %s\n", path);
+  }
+  return false;
+}
+
+bool AudioManager::duckChime(int h12) {
+  if (h12 < 1 || h12 > 12) return false;
+  if (!(status().chimeDuckable & (1u << h12))) return false;
+  return postCommand(CMD_DUCK_CHIME, (uint32_t)h12);
+}
+
+bool AudioManager::enginePlayChime(int h12) {
+  if (!_chime.ready(h12)) {
+    Serial.printf("AudioManager: chime %d no longer ready\n", h12);
+    return false;
+  }
+  _currentPath = String();
+  fadeThen(FA_CHIME, (uint32_t)h12);
+  return true;
+}
+
+void AudioManager::beginChime(int h12) {
+  const ClipSequence *seq = _chime.compose(h12);
+  if (!seq) return;
+
+  // Played at CHIME_VOLUME whatever the volume setting; the master gain
+  // goes back to the setting when the chime ends
+  _chimeActive = true;
+  _mixer.rampMaster(volumeGain(CHIME_VOLUME), 0);
+  fadeIn(AudioMixer::CLIP_CH);
+  _mixer.playClip(seq);
+  _chime.played(h12);
+  pumpOutput();
+
+  // Give clips that failed earlier another chance for the next hour
+  _clips.clearFailures();
+  Serial.printf("AudioManager: chime %d as one stream, %u ms\n", h12, (unsigned)seq->durationMs());
+}
+
+// Sample rate of a track the chime could be mixed over, 0 if there is none.
+// Only the clip channel can carry the chime, and only one output rate runs.
+uint32_t AudioManager::duckRate() {
+  if (_start.step != SJ_IDLE || _afterFade != FA_NONE || _isCrossfading || _mixer.clipPlaying()) return 0;
+  if (!_mixer.isLive(_active) || !deck(_active).isRunning()) return 0;
+  return deck(_active).getSampleRate();
+}
+
+// Deck gain that keeps the track at the volume setting while the master
+// gain is at CHIME_VOLUME, CHIME_DUCK_DB lower if `ducked`
+int32_t AudioManager::deckShare(bool ducked) const {
+  int32_t chime = volumeGain(CHIME_VOLUME);
+  if (chime == 0) return 0;
+  int64_t share = ((int64_t)volumeGain(_currentVolume) << 15) / chime;
+  if (ducked) share = (share * _duckGain) >> 15;
+  return share > AudioMixer::UNITY ? AudioMixer::UNITY : (int32_t)share;
+}
+
+bool AudioManager::engineDuckChime(int h12) {
+  const ClipSequence *seq = _chime.ready(h12) ? _chime.compose(h12) : nullptr;
+  uint32_t rate = duckRate();
+  if (!seq || !rate || rate != seq->rate) {
+    // Changed since the status said it could: interrupt the track instead
+    Serial.printf("AudioManager: chime %d can't be ducked, stopping the track\n", h12);
+    return enginePlayChime(h12);
+  }
+
+  // Master gain to CHIME_VOLUME and the decks down by the same factor on
+  // one sample, so the track doesn't change level, then ramp the track down
+  uint32_t frames = (uint32_t)((uint64_t)CHIME_DUCK_RAMP_MS * rate / 1000);
+  _chimeActive = true;
+  _duck = DUCK_DOWN;
+  _mixer.rampMaster(volumeGain(CHIME_VOLUME), 0);
+  _mixer.rampDecks(deckShare(false), 0);
+  _mixer.rampDecks(deckShare(true), frames);
+  fadeIn(AudioMixer::CLIP_CH);
+  _mixer.playClip(seq);
+  _chime.played(h12);
+  pumpOutput();
+
+  _clips.clearFailures();
+  Serial.printf("AudioManager: chime %d mixed over %s, %u ms\n", h12, _currentPath.c_str(),
+                (unsigned)seq->durationMs());
+  return true;
+}
+
+// The chime has played out. A ducked track ramps back up first; then the
+// master gain and the deck gain swap back on one sample. The deck ramp only
+// moves while something is mixed, so once the track has ended under the
+// chime there is nothing to ramp and the swap happens right away.
+void AudioManager::endChime() {
+  bool mixing = _mixer.hasAudio();
+  if (_duck == DUCK_DOWN) {
+    uint32_t rate = _outRate ? _outRate : 44100;
+    uint32_t frames = mixing ? (uint32_t)((uint64_t)CHIME_DUCK_RAMP_MS * rate / 1000) : 0;
+    _mixer.rampDecks(deckShare(false), frames);
+    _duck = DUCK_RESTORE;
+    if (mixing) return;
+  }
+  if (_duck == DUCK_RESTORE) {
+    if (!_mixer.decksRampDone() && mixing) return;
+    _mixer.rampMaster(volumeGain(_currentVolume), 0);
+    _mixer.rampDecks(AudioMixer::UNITY, 0);
+    _duck = DUCK_NONE;
+  }
+  _chimeActive = false;
+}
+
+// Loudness normalisation
+int32_t AudioManager::trackTrim(const String &path) const {
+  return LoudnessIndex::toQ15(_loudness.gainCentiDb(path));
+}
+
+bool AudioManager::analyzeLoudness(const String &path) {
+  if (_analysis.load() != AN_IDLE) return false;
+  _analysisPath = path;
+  _analysis = AN_PENDING;
+  if (!postCommand(CMD_ANALYZE, 0, path.c_str())) {
+    _analysis = AN_IDLE;
+    return false;
+  }
+  return true;
+}
+
+// Store the result of a finished measurement. A track that could not be
+// measured is stored at 0 dB so it isn't tried again.
+void AudioManager::collectAnalysis() {
+  uint8_t st = _analysis.load();
+  if (st == AN_DONE || st == AN_FAILED) {
+    int16_t gain = st == AN_DONE ? _analysisGain.load() : 0;
+    _loudness.put(_analysisPath, gain, st == AN_DONE);
+    _loudness.save();
+    if (st == AN_DONE) {
+      Serial.printf("AudioManager: loudness gain for %s: %+.1f dB\n", _analysisPath.c_str(), gain / 100.0f);
+    } else {
+      Serial.printf("AudioManager: could not measure %s, playing it unchanged\n", _analysisPath.c_str());
+    }
+  }
+  if (st == AN_DONE || st == AN_FAILED || st == AN_BUSY) _analysis = AN_IDLE;
+}
+
+void AudioManager::forgetTrack(const String &path) {
+  _seek.remove(path);
+  postCommand(CMD_FORGET, 0, path.c_str());
+  if (!_loudness.has(path)) return;
+  _loudness.remove(path);
+  _loudness.save();
+}
+
+// Build the seek index of whatever is playing, one block per loop
+void AudioManager::indexPlaying() {
+  if (_seek.building()) {
+    _seek.step();
+    return;
+  }
+  String cur = getCurrentPath();
+  if (cur == _seekChecked) return;
+  _seekChecked = cur;
+  if (cur.length() > 0) _seek.want(cur);
+}
+
+// Equalizer functions
+void AudioManager::setEQBand(int i, const Equalizer::Band &band) {
+  if (i < 0 || i >= EQ_BANDS) return;
+  Equalizer::Band b = band;
+  b.type = Equalizer::DEFAULT_BANDS[i].type; // the shape of a band is fixed
+  Equalizer::clampBand(b);
+  _eqBands[i] = b;
+  _eqDirty = true;
+  publishEQ();
   saveEQSettings();
 }
 
-void AudioManager::setTreble(int level) {
+void AudioManager::setEQGain(int i, int level) {
+  if (i < 0 || i >= EQ_BANDS) return;
   if (level < -12) level = -12;
   if (level > 12) level = 12;
-  _eqTreble = level;
-  applyEQ();
-  saveEQSettings();
+  Equalizer::Band b = _eqBands[i];
+  b.gainDb = (int8_t)level;
+  setEQBand(i, b);
 }
 
-void AudioManager::applyEQ() {
-  // Apply 3-band equalizer using the ESP32-audioI2S library
-  // The library supports setTone() with bass, mid, and treble parameters
-  
-  // Convert -12 to +12 range to library's int8_t range
-  int8_t bassLib = (int8_t)constrain(_eqBass, -12, 12);
-  int8_t midLib = (int8_t)constrain(_eqMid, -12, 12);
-  int8_t trebleLib = (int8_t)constrain(_eqTreble, -12, 12);
-  
-  // Set 3-band equalizer (low-pass = bass, band-pass = mid, high-pass = treble)
-  _audio.setTone(bassLib, midLib, trebleLib);
+// Design the current bands into the spare table and hand it to the audio
+// task. While the task has not switched to the last table yet, both are
+// spoken for; loop() tries again.
+void AudioManager::publishEQ() {
+  if (_eqApplied.load() != _eqPosted) return;
+  Equalizer::design(_eqBands, _eqTables[_eqBack]);
+  if (!postCommand(CMD_EQ, (uint32_t)_eqBack)) return;
+  _eqPosted++;
+  _eqBack ^= 1;
+  _eqDirty = false;
 }
 
 void AudioManager::loadEQSettings() {
-  _eqBass = Settings::loadInt("eq_bass", 0);
-  _eqMid = Settings::loadInt("eq_mid", 0);
-  _eqTreble = Settings::loadInt("eq_treble", 0);
-  
-  // Clamp values to valid range
-  if (_eqBass < -12) _eqBass = 0;
-  if (_eqBass > 12) _eqBass = 0;
-  if (_eqMid < -12) _eqMid = 0;
-  if (_eqMid > 12) _eqMid = 0;
-  if (_eqTreble < -12) _eqTreble = 0;
-  if (_eqTreble > 12) _eqTreble = 0;
-  
-  applyEQ();
+  char key[12];
+  for (int i = 0; i < EQ_BANDS; ++i) {
+    Equalizer::Band b = Equalizer::DEFAULT_BANDS[i];
+    snprintf(key, sizeof(key), "eq_f%d", i);
+    b.freq = (uint16_t)Settings::loadInt(key, b.freq);
+    snprintf(key, sizeof(key), "eq_q%d", i);
+    b.q10 = (uint8_t)Settings::loadInt(key, b.q10);
+
+    // Gains saved by the old 3-band control carry over
+    const char *legacy = i == EQ_BASS ? "eq_bass" : i == EQ_MID ? "eq_mid" : i == EQ_TREBLE ? "eq_treble" : nullptr;
+    int gain = legacy ? Settings::loadInt(legacy, 0) : 0;
+    snprintf(key, sizeof(key), "eq_g%d", i);
+    gain = Settings::loadInt(key, gain);
+    if (gain < -12 || gain > 12) gain = 0;
+    b.gainDb = (int8_t)gain;
+
+    Equalizer::clampBand(b);
+    _eqBands[i] = b;
+    _eqSaved[i] = b;
+  }
+  _eqDirty = true;
+  publishEQ();
 }
 
 void AudioManager::saveEQSettings() {
-  Settings::saveInt("eq_bass", _eqBass);
-  Settings::saveInt("eq_mid", _eqMid);
-  Settings::saveInt("eq_treble", _eqTreble);
+  char key[12];
+  for (int i = 0; i < EQ_BANDS; ++i) {
+    const Equalizer::Band &b = _eqBands[i];
+    Equalizer::Band &s = _eqSaved[i];
+    if (b.freq != s.freq) {
+      snprintf(key, sizeof(key), "eq_f%d", i);
+      Settings::saveInt(key, b.freq);
+    }
+    if (b.gainDb != s.gainDb) {
+      snprintf(key, sizeof(key), "eq_g%d", i);
+      Settings::saveInt(key, b.gainDb);
+    }
+    if (b.q10 != s.q10) {
+      snprintf(key, sizeof(key), "eq_q%d", i);
+      Settings::saveInt(key, b.q10);
+    }
+    s = b;
+  }
 }
 
 // Crossfade functions
@@ -94,119 +1077,395 @@ bool AudioManager::startWithCrossfade(const String &path) {
   if (!SD.exists(path)) {
     return false;
   }
-  
-  // If nothing is playing, just start normally
-  if (!_audio.isRunning()) {
-    return start(path);
+  return postCommand(CMD_CROSSFADE, (uint32_t)trackTrim(path), path.c_str(), allocHandle());
+}
+
+bool AudioManager::engineCrossfade(const char *path, int32_t trim, uint32_t handle) {
+  // If nothing is playing (or a start is still pending), just start normally
+  if (!engineRunning() || _start.step != SJ_IDLE || _afterFade != FA_NONE) {
+    engineStart(path, trim, handle, nullptr, nullptr, {});
+    return true;
   }
-  
-  // Set up crossfade
-  _nextPath = path;
+
+  // A crossfade already in progress is cut short: drop the deck fading out
+  if (_fadeOut >= 0) {
+    stopDeck(_fadeOut);
+    _fadeOut = -1;
+  }
+
+  // Open the new track on the idle deck; it joins the mix with its first frame
+  int incoming = 1 - _active;
+  stopDeck(incoming);
+  _mixer.reset(incoming, 0);
+  _mixer.setTrim(incoming, trim);
+  if (!deck(incoming).connecttoFS(SD, path)) {
+    _consecutiveFails++;
+    _metrics.failures.record(path);
+    postTrackResult(path, false);
+    return false;
+  }
+  postTrackResult(path, true);
+  _mixer.setLive(incoming, true);
+
+  uint32_t rate = deck(_active).getSampleRate();
+  if (rate == 0) rate = 44100;
+  uint32_t frames = (uint32_t)((uint64_t)_crossfadeTime.load() * rate / 1000);
+  _mixer.rampTo(_active, 0, frames);
+  _mixer.rampTo(incoming, AudioMixer::UNITY, frames);
+
+  _fadeOut = _active;
+  _active = incoming;
+  _currentPath = path;
+  _consecutiveFails = 0;
   _isCrossfading = true;
-  _crossfadeStart = millis();
-  _originalVolume = _currentVolume;
   
-  Serial.printf("AudioManager: Starting crossfade to %s\n", path.c_str());
+  Serial.printf("AudioManager: Starting crossfade to %s\n", path);
   return true;
 }
 
 void AudioManager::updateCrossfade() {
   if (!_isCrossfading) return;
-  
-  unsigned long elapsed = millis() - _crossfadeStart;
-  float progress = (float)elapsed / (float)_crossfadeTime;
-  
-  if (progress >= 1.0) {
-    // Crossfade complete - switch to new track
-    _isCrossfading = false;
-    _audio.stopSong();
-    
-    // Small delay to ensure stop is complete
-    delay(50);
-    
-    // Start the new track
-    bool success = start(_nextPath);
-    if (success) {
-      // Restore original volume
-      _audio.setVolume(_originalVolume);
-    }
-    
-    Serial.printf("AudioManager: Crossfade complete, new track started: %s\n", success ? "OK" : "FAIL");
-    return;
+
+  // Done once the outgoing deck is silent (or its track ran out mid-fade)
+  if (_fadeOut >= 0 && _mixer.isLive(_fadeOut) && !_mixer.rampDone(_fadeOut)) return;
+
+  if (_fadeOut >= 0) stopDeck(_fadeOut);
+  _fadeOut = -1;
+  _isCrossfading = false;
+  Serial.printf("AudioManager: Crossfade complete, now playing %s\n", _currentPath.c_str());
+}
+
+bool AudioManager::isRunning() { return commandsPending() || status().running; }
+void AudioManager::stop() { postCommand(CMD_STOP); }
+
+// A deck decoding a clip in the background is not playing anything
+bool AudioManager::engineRunning() {
+  if (_start.step != SJ_IDLE || _afterFade != FA_NONE || _mixer.hasAudio()) return true;
+  for (int i = 0; i < AudioMixer::DECKS; ++i) {
+    if (i != _jobDeck && deck(i).isRunning()) return true;
   }
-  
-  // Fade out current track
-  int fadeOutVolume = _originalVolume * (1.0 - progress);
-  _audio.setVolume(fadeOutVolume);
-  
-  // When we're halfway through the crossfade, start the new track
-  if (progress >= 0.5 && _nextPath.length() > 0) {
-    // Save current state
-    String tempPath = _nextPath;
-    _nextPath = ""; // Prevent re-triggering
-    
-    // Start new track at low volume
-    if (_audio.connecttoFS(SD, tempPath.c_str())) {
-      // Fade in new track
-      int fadeInVolume = _originalVolume * ((progress - 0.5) * 2.0);
-      _audio.setVolume(fadeInVolume);
-    }
+  return false;
+}
+
+void AudioManager::engineStop() { _currentPath = String(); fadeThen(FA_STOP); }
+
+// Close every file the task has open on SD: the decks, a background decode or
+// measurement (run again later), and clip file loads and saves. A start
+// waiting on the remount stays pending and opens its file once it is done.
+void AudioManager::engineQuiesce() {
+  if (_jobDeck >= 0) finishJob(false, true);
+  stopAll();
+  if (_loadClip) endClipLoad(false, true);
+  if (_saveClip) {
+    _clipSave.abort();
+    _saveClip = nullptr;
+    _savePath = String();
   }
+  if (_start.step == SJ_IDLE) _currentPath = String();
+  _quiesced = true;
 }
 
-bool AudioManager::isRunning() { return _audio.isRunning(); }
-void AudioManager::stop() { if (_audio.isRunning()) { _audio.stopSong(); } _currentPath = String(); }
-// setVolume and getVolume are defined in the header file
-int AudioManager::getConsecutiveFails() { return _consecutiveFails; }
-void AudioManager::resetConsecutiveFails(){ _consecutiveFails = 0; }
+bool AudioManager::remountSD() {
+  _seek.cancel();
+  _seekChecked = String();
+  if (!postCommand(CMD_QUIESCE)) return false;
+  // The acknowledgement: the task has run the command and closed its files
+  unsigned long t0 = millis();
+  while (commandsPending()) {
+    if (_task.running()) delay(1);
+    else step();
+  }
+  SD.end();
+  bool ok = SD.begin(SD_CS);
+  _remountWanted = false;
+  _quiesced = false;
+  Serial.printf("AudioManager: SD remounted %s (task held off for %lu ms)\n", ok ? "ok" : "FAILED",
+                millis() - t0);
+  return ok;
+}
 
-bool AudioManager::start(const String &path) {
-  if (!SD.exists(path)) {
+bool AudioManager::wantsPrefetch() { return !commandsPending() && status().wantsPrefetch; }
+
+// Only when enginePrefetch() would take it
+bool AudioManager::engineWantsPrefetch() {
+  if (_start.step != SJ_IDLE || _afterFade != FA_NONE) return false;
+  if (_queued >= 0 || _isCrossfading || !_mixer.isLive(_active)) return false;
+  Audio &d = deck(_active);
+  if (!d.isRunning()) return false;
+
+  uint32_t pos = d.getAudioCurrentTime();
+  uint32_t dur = d.getAudioFileDuration();
+  if (dur == 0) return pos >= PREFETCH_LEAD_SEC; // length unknown, don't wait forever
+  return pos + PREFETCH_LEAD_SEC >= dur;
+}
+
+bool AudioManager::prefetch(const String &path) {
+  return postCommand(CMD_PREFETCH, (uint32_t)trackTrim(path), path.c_str());
+}
+
+bool AudioManager::enginePrefetch(const char *path, int32_t trim) {
+  if (_start.step != SJ_IDLE || _afterFade != FA_NONE || _isCrossfading || !_mixer.isLive(_active)) return false;
+
+  int next = 1 - _active;
+  if (next == _jobDeck && !_jobMeter) return false; // decoding a clip, try again later
+  stopDeck(next); // a loudness measurement gives way
+  _mixer.setTrim(next, trim);
+  if (!deck(next).connecttoFS(SD, path)) {
     _consecutiveFails++;
+    _metrics.failures.record(path);
+    postTrackResult(path, false);
     return false;
   }
+  _consecutiveFails = 0;
+  postTrackResult(path, true);
 
-  // Save current volume before stopping
-  int currentVolume = _currentVolume;
+  // The deck decodes into its ring right away but stays silent until the
+  // current track has played its last sample
+  _queued = next;
+  _nextPath = path;
+  _mixer.queueAfter(_active, next);
+  Serial.printf("AudioManager: prefetched %s\n", path);
+  return true;
+}
+void AudioManager::setVolume(int v) {
+  if (v < 0) v = 0;
+  if (v > 21) v = 21;
+  _currentVolume = v; // the audio task ramps the master gain to it
+  Settings::saveVolume(v);  // Save volume to persistent storage
+}
+
+int AudioManager::getConsecutiveFails() { return _consecutiveFails; }
+void AudioManager::resetConsecutiveFails(){ _consecutiveFails = 0; }
+
+uint32_t AudioManager::allocHandle() {
+  uint32_t handle = _nextHandle++;
+  if (_nextHandle == 0) _nextHandle = 1;
+  return handle;
+}
 
-  // If already running, ask to stop and give the library a short time to settle.
-  if (_audio.isRunning()) {
-    _audio.stopSong();
-    unsigned long t0 = millis();
-    while (_audio.isRunning() && millis() - t0 < 400) {
-      _audio.loop();
-      delay(5);
+uint32_t AudioManager::startAsync(const String &path, StartCallback cb, void *ctx, uint32_t resumeFrame) {
+  uint32_t handle = allocHandle();
+  ResumePoint resume = {};
+  if (resumeFrame > 0) {
+    if (_seek.lookup(path, resumeFrame, resume.filePos, resume.skip)) {
+      resume.frame = resumeFrame;
+    } else {
+      Serial.printf("AudioManager: no seek index for %s, playing it from the top\n", path.c_str());
     }
   }
+  if (!postCommand(CMD_START, (uint32_t)trackTrim(path), path.c_str(), handle, cb, ctx, resume)) {
+    // Report the failure from the next loop(), after the caller has the handle
+    _rejected = {cb, ctx, handle, false, 0};
+  }
+  return handle;
+}
 
-  // Restore volume before starting new track
-  _audio.setVolume(currentVolume);
+void AudioManager::engineStart(const char *path, int32_t trim, uint32_t handle, StartCallback cb, void *ctx,
+                               const ResumePoint &resume) {
+  cancelStart();
+  _afterFade = FA_NONE; // the start does its own fade-out
+  _start.step = SJ_CHECK;
+  _start.path = path;
+  _start.trim = trim;
+  _start.resume = resume;
+  _start.handle = handle;
+  _start.cb = cb;
+  _start.ctx = ctx;
+  _start.attempt = 0;
+  _start.triedFile = false;
+  _start.fileBytes = 0;
+  _start.t0 = millis();
+  _start.waitUntil = 0;
+  _currentPath = path;
+}
 
-  // Try connecttoFS with retries and SD re-init between retries.
-  const int maxTries = 3;
-  for (int attempt = 1; attempt <= maxTries; ++attempt) {
-    // small guard: yield and a brief delay to let other tasks run
-    yield();
-    delay(10);
-
-    bool ok = _audio.connecttoFS(SD, path.c_str());
-    if (ok) {
-      // allow audio library to spin a little so isRunning updates
-      for (int i=0;i<5;i++){ _audio.loop(); delay(5); }
-      _consecutiveFails = 0;
-      _currentPath = path;
-      return true;
+// One step of the stop/open/retry sequence. Each step does at most one SD
+// operation; waits between retries are timers, not delay().
+void AudioManager::advanceStart() {
+  unsigned long now = millis();
+  if (_start.waitUntil && (long)(now - _start.waitUntil) < 0) return;
+  _start.waitUntil = 0;
+
+  switch (_start.step) {
+  case SJ_CHECK:
+    // Short files played before come from memory (a resume needs the decoder)
+    _start.cached = _start.resume.frame == 0 && _clips.get(_start.path.c_str());
+    if (!_start.cached) {
+      File f = SD.open(_start.path);
+      if (!f) {
+        finishStart(false);
+        return;
+      }
+      _start.fileBytes = f.size();
+      f.close();
+    }
+    // Fade out what is playing before the decks are stopped
+    _start.step = SJ_FADE;
+    break;
+
+  case SJ_FADE:
+    if (!fadedOut()) break;
+    // Stop both decks; the mixer drops whatever they had buffered.
+    stopAll();
+    _mixer.rampMaster(volumeGain(_currentVolume), 0);
+    _start.step = SJ_OPEN;
+    break;
+
+  case SJ_OPEN:
+    if (_start.cached && playStartClip()) return;
+    // Then from a clip file, without the decoder
+    if (!_start.triedFile && _start.resume.frame == 0) {
+      _start.triedFile = true;
+      if (loadClipFile(_start.path.c_str(), _start.fileBytes)) {
+        _start.step = SJ_LOAD;
+        break;
+      }
+    }
+    _start.attempt++;
+    _start.openUs = micros();
+    if (deck(_active).connecttoFS(SD, _start.path.c_str(), _start.resume.filePos)) {
+      uint32_t opened = micros();
+      _metrics.openUs.record(opened - _start.openUs);
+      _start.openUs = opened;
+      _baseFrame[_active] = _start.resume.frame;
+      _skipFrames[_active] = _start.resume.skip;
+      teeStart();
+      _mixer.setTrim(_active, _start.trim);
+      fadeIn(_active);
+      _mixer.setLive(_active, true);
+      _start.step = SJ_PRIME;
     } else {
-      _consecutiveFails++;
-      // attempt re-init SD before retrying
-      SD.end();
-      delay(40);
-      SD.begin(SD_CS);
-      // short delay before next attempt
-      delay(80);
+      if (_start.attempt >= START_MAX_TRIES) {
+        finishStart(false);
+        return;
+      }
+      // Ask the loop to remount SD before retrying; it owns the card
+      _remountWanted = true;
+      _start.step = SJ_REMOUNT;
+      _start.waitUntil = now + 40;
+    }
+    break;
+
+  case SJ_LOAD:
+    // pumpClipFiles() fills the clip; a clip file that fails falls back to the MP3
+    if (_loadClip) break;
+    if (playStartClip()) return;
+    _start.step = SJ_OPEN;
+    break;
+
+  case SJ_REMOUNT:
+    // Remounted (this pass only runs once the task is let go again), or the
+    // loop did not get to it in time
+    if (_remountWanted.load() && now - _start.t0 < START_REMOUNT_WAIT_MS) {
+      _start.waitUntil = now + 40;
+      break;
+    }
+    // short pause before next attempt
+    _start.step = SJ_BACKOFF;
+    _start.waitUntil = now + 80;
+    break;
+
+  case SJ_BACKOFF:
+    _start.step = SJ_OPEN;
+    break;
+
+  case SJ_PRIME:
+    // Done once the decoder has produced its first frame
+    if (_mixer.buffered(_active) > 0 || _mixer.isStarted(_active)) {
+      _firstFrameUs = micros();
+      _metrics.firstFrameUs.record(_firstFrameUs - _start.openUs);
+      _firstSamplePending = true;
+      finishStart(true);
+    } else if (!deck(_active).isRunning()) {
+      finishStart(false);
+    } else if (now - _start.t0 > START_PRIME_TIMEOUT_MS) {
+      finishStart(true); // running, just slow to decode
     }
+    break;
+
+  default:
+    break;
   }
+}
 
-  _currentPath = String();
-  return false;
+// Serve a start from the clip cache: no SD access, no decoder
+bool AudioManager::playStartClip() {
+  const PcmClip *clip = _clips.peek(_start.path.c_str());
+  if (!clip) return false; // evicted since the check, open it from SD
+  _startSeq.clear();
+  _startSeq.add(clip);
+  _mixer.setTrim(AudioMixer::CLIP_CH, _start.trim);
+  fadeIn(AudioMixer::CLIP_CH);
+  _mixer.playClip(&_startSeq);
+  finishStart(true);
+  return true;
+}
+
+// A short file is decoded from SD once: keep a copy of it as it plays
+void AudioManager::teeStart() {
+  if (_start.resume.frame) return;
+  uint32_t size = deck(_active).getFileSize();
+  if (size == 0 || size > CLIP_CACHE_MAX_FILE_BYTES) return;
+  PcmClip *clip = _clips.reserve(_start.path.c_str(), clipBytes(), _mixer.clipSeq());
+  if (!clip) return;
+  _clips.countMiss();
+  _tee[_active] = clip;
+  _teePath[_active] = _start.path;
+  _teeFileBytes[_active] = size;
+}
+
+void AudioManager::finishStart(bool ok) {
+  uint32_t latency = millis() - _start.t0;
+  StartCallback cb = _start.cb;
+  void *ctx = _start.ctx;
+  uint32_t handle = _start.handle;
+
+  // One failed start counts once, however many opens it tried
+  if (ok) {
+    _consecutiveFails = 0;
+    _remountWanted = false; // the card works after all
+    _startLastMs = latency;
+    if (latency > _startMaxMs) _startMaxMs = latency;
+  } else {
+    _consecutiveFails++;
+    _currentPath = String();
+    _metrics.failures.record(_start.path.c_str());
+  }
+  postTrackResult(_start.path.c_str(), ok);
+  Serial.printf("AudioManager: start %s %s after %lu ms (%d attempt%s)\n", _start.path.c_str(),
+                ok ? "ok" : "FAILED", (unsigned long)latency, _start.attempt,
+                _start.attempt == 1 ? "" : "s");
+
+  _start.step = SJ_IDLE;
+  _start.path = String();
+  _start.cb = nullptr;
+  _start.ctx = nullptr;
+  postStartEvent(cb, ctx, handle, ok, latency);
+}
+
+void AudioManager::cancelStart() {
+  if (_start.step == SJ_IDLE) return;
+  if (_start.step == SJ_LOAD && _loadClip) endClipLoad(false, true);
+  StartCallback cb = _start.cb;
+  void *ctx = _start.ctx;
+  uint32_t handle = _start.handle;
+  _start.step = SJ_IDLE;
+  _start.path = String();
+  _start.cb = nullptr;
+  _start.ctx = nullptr;
+  postStartEvent(cb, ctx, handle, false, millis() - _start.t0);
+}
+
+void AudioManager::postStartEvent(StartCallback cb, void *ctx, uint32_t handle, bool ok, uint32_t latencyMs) {
+  if (!cb) return;
+  if (!_events.push({cb, ctx, handle, ok, latencyMs})) {
+    Serial.printf("AudioManager: start %lu result dropped\n", (unsigned long)handle);
+  }
+}
+
+void AudioManager::postTrackResult(const char *path, bool ok) {
+  TrackResult r;
+  r.ok = ok;
+  snprintf(r.path, sizeof(r.path), "%s", path);
+  if (!_results.push(r)) Serial.printf("AudioManager: result for %s dropped\n", path);
 }
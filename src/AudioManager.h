@@ -3,69 +3,459 @@
 
 #include <Arduino.h>
 #include "Audio.h"
+#include "AudioMetrics.h"
+#include "AudioMixer.h"
+#include "AudioOutput.h"
+#include "AudioTask.h"
+#include "ChimeComposer.h"
+#include "ClipCache.h"
+#include "ClipFile.h"
+#include "Equalizer.h"
+#include "LoudnessIndex.h"
+#include "LoudnessMeter.h"
+#include "SeekIndex.h"
 #include "Settings.h"
+#include "SpscQueue.h"
+#include <atomic>
 
+// Playback runs on a dedicated audio task (see startTask()): decoding, mixing
+// and I2S output never wait on the web server or SD scans in the Arduino loop.
+// The public calls below are made from the Arduino loop. They post commands
+// to the audio task over a lock-free queue and read state from a snapshot the
+// task publishes after every pass; start callbacks come back through loop().
+// Until startTask() is called, loop() runs the audio work itself.
 class AudioManager {
 public:
+  ~AudioManager() { _task.stop(); } // before the members the task uses go (host builds exit)
   void begin(int bclk, int lrclk, int din);
+  void startTask();
   void loop();
   bool isRunning();
   void stop();
-  void setVolume(int v) { 
-    if (v < 0) v = 0; 
-    if (v > 21) v = 21; 
-    _currentVolume = v; 
-    _audio.setVolume(v);
-    Settings::saveVolume(v);  // Save volume to persistent storage
-  }
+  void setVolume(int v);
   void loadVolume() { // Added method to load volume from persistent storage
     _currentVolume = Settings::loadVolume();
-    _audio.setVolume(_currentVolume);
   }
   int getVolume() { return _currentVolume; } // Added getter for volume
   
-  // Equalizer functions
-  void setBass(int level);
-  void setMid(int level);
-  void setTreble(int level);
-  int getBass() { return _eqBass; }
-  int getMid() { return _eqMid; }
-  int getTreble() { return _eqTreble; }
+  // Equalizer functions. Bass, mid and treble are the gains of bands
+  // EQ_BASS, EQ_MID and EQ_TREBLE of the parametric EQ.
+  static const int EQ_BANDS = Equalizer::BANDS;
+  static const int EQ_BASS = 0, EQ_MID = 4, EQ_TREBLE = 7;
+  void setBass(int level) { setEQGain(EQ_BASS, level); }
+  void setMid(int level) { setEQGain(EQ_MID, level); }
+  void setTreble(int level) { setEQGain(EQ_TREBLE, level); }
+  int getBass() { return _eqBands[EQ_BASS].gainDb; }
+  int getMid() { return _eqBands[EQ_MID].gainDb; }
+  int getTreble() { return _eqBands[EQ_TREBLE].gainDb; }
+  void setEQBand(int i, const Equalizer::Band &band); // clamped to the valid range
+  void setEQGain(int i, int level);
+  Equalizer::Band getEQBand(int i) const { return _eqBands[i]; }
   void loadEQSettings();
-  void saveEQSettings();
+  void saveEQSettings(); // writes only the values that changed
   
   // Crossfade functions
   void setCrossfadeTime(int ms) { _crossfadeTime = ms; }
   int getCrossfadeTime() { return _crossfadeTime; }
   bool startWithCrossfade(const String &path);
-  bool isCrossfading() { return _isCrossfading; }
+  bool isCrossfading() { return status().crossfading; }
+  
+  // Gapless track change: open `path` on the idle deck so it takes over on the
+  // last sample of the current track
+  bool prefetch(const String &path);
+  bool hasPrefetch() { return status().prefetched; }
+  bool wantsPrefetch(); // current track is close enough to its end
+  
+  // Silence measured between the end of one track and the first sample of the next
+  uint32_t getLastGapMs() { return status().gapLastUs / 1000; }
+  uint32_t getMaxGapMs() { return status().gapMaxUs / 1000; }
+  uint32_t getGapCount() { return status().gapCount; }
+  uint32_t getSeamlessCount() { return status().gapSeamless; }
+  
+  // Greeting decoded once at boot (before startTask()) and played from memory
+  // on motion
+  bool cacheGreeting(const char *path);
+  bool hasGreeting() const { return _greeting != nullptr; }
+  bool playGreeting(unsigned long triggerUs);
+  const PcmClip &getGreeting() const { return *_greeting; } // only if hasGreeting()
+  uint32_t getGreetingLatencyUs() { return status().greetLastUs; }
+  uint32_t getGreetingMaxLatencyUs() { return status().greetMaxUs; }
   
-  bool start(const String &path); // improved start with retries
+  // Hourly chime as one pre-rendered stream. prepareChime() decodes the clips
+  // it needs in the background and returns true once playChime() can run.
+  bool prepareChime(int h12);
+  bool playChime(int h12);
+  // The chime mixed over the playing track instead, which keeps decoding
+  // CHIME_DUCK_DB lower underneath and ramps back up afterwards. False if
+  // there is no track to duck or it runs at another sample rate than the
+  // chime's clips; stop it and use playChime() then.
+  bool duckChime(int h12);
+  bool isChiming() { return commandsPending() || status().chiming; }
+  
+  // Non-blocking start. Returns a handle right away; the stop/open/retry
+  // sequence then runs on the audio task and the callback (if any) fires
+  // from loop() with the outcome and the request-to-first-frame latency.
+  // A newer request cancels a pending one (its callback gets ok=false).
+  // A non-zero resumeFrame picks an MP3 up at that output frame, using its
+  // seek index (from the top if it has none yet).
+  typedef void (*StartCallback)(uint32_t handle, bool ok, uint32_t latencyMs, void *ctx);
+  uint32_t startAsync(const String &path, StartCallback cb = nullptr, void *ctx = nullptr,
+                      uint32_t resumeFrame = 0);
+  bool isStarting() { return commandsPending() || status().starting; }
+  uint32_t getLastStartLatencyMs() { return status().startLastMs; }
+  uint32_t getMaxStartLatencyMs() { return status().startMaxMs; }
+  
+  // Loudness normalisation. Tracks are measured once, in the background on
+  // the idle deck; the gains live in LOUDNESS_INDEX_PATH and are applied as
+  // a mixer trim when a track starts.
+  bool needsLoudness(const char *path) const { return !_loudness.has(path); }
+  bool analyzeLoudness(const String &path); // false while a measurement is running
+  bool isAnalyzing() const { return _analysis.load() != AN_IDLE; }
+  void forgetTrack(const String &path);     // file deleted or replaced: drop everything kept about it
+  size_t getLoudnessCount() const { return _loudness.size(); }
+  float getTrackGainDb(const String &path) const { return _loudness.gainCentiDb(path) / 100.0f; }
+
+  // Output frame of the current track being heard, for a later resume
+  uint32_t getPositionFrames() { return status().positionFrames; }
   int  getConsecutiveFails();
   void resetConsecutiveFails();
-  String getCurrentPath() const { return _currentPath; }
+  // Whether each track the audio task opened (start, crossfade or prefetch)
+  // could be played, delivered from loop()
+  typedef void (*TrackResultCallback)(const char *path, bool ok, void *ctx);
+  void setTrackResultCallback(TrackResultCallback cb, void *ctx) {
+    _resultCb = cb;
+    _resultCtx = ctx;
+  }
+  String getCurrentPath() { return String(status().path); }
+
+  // The audio task never remounts the SD card: a start whose opens keep
+  // failing asks for it here, and the owner of the loop's other SD users
+  // closes their files and calls remountSD(). That has the task close
+  // everything it has open and keep off the card (a command it acknowledges),
+  // remounts, and lets the task go on; it blocks for the handshake. False if
+  // the card did not come back.
+  bool wantsRemount() const { return _remountWanted.load(); }
+  bool remountSD();
+
+  // Decode timing, underruns, start latency breakdown and per-track failures
+  const AudioMetrics &getMetrics() const { return _metrics; }
+  void resetMetrics() { _metrics.reset(); }
+
+  // Short files kept decoded in memory: budget, occupancy and hit counters
+  const ClipCache &getClipCache() const { return _clips; }
+
+  // Send the mixed output somewhere other than I2S (a WavOutput to capture
+  // it); nullptr goes back to I2S. Call before startTask().
+  void setOutput(AudioOutput *out) { _out = out ? out : &_i2sOut; }
+  // Save a short file as a clip file in the background (an upload), so it
+  // plays without the MP3 decoder
+  bool convertClip(const String &path);
 
 private:
+  static const size_t PATH_LEN = 128;
+
+  // Requests from the Arduino loop to the audio task
+  enum CommandType : uint8_t {
+    CMD_START, CMD_STOP, CMD_EQ, CMD_CROSSFADE, CMD_PREFETCH,
+    CMD_GREETING, CMD_PREPARE_CHIME, CMD_CHIME, CMD_ANALYZE, CMD_FORGET, CMD_CONVERT,
+    CMD_DUCK_CHIME, CMD_QUIESCE
+  };
+  // Where a start picks up: the output frame, the MP3 frame to open the file
+  // at, and how many decoded frames to drop to get from one to the other
+  struct ResumePoint {
+    uint32_t frame;
+    uint32_t filePos;
+    uint32_t skip;
+  };
+  struct Command {
+    CommandType type;
+    uint32_t arg = 0;
+    ResumePoint resume = {};
+    uint32_t handle = 0;
+    StartCallback cb = nullptr;
+    void *ctx = nullptr;
+    char path[PATH_LEN] = {0};
+  };
+
+  // Start outcomes from the audio task, delivered by loop()
+  struct StartEvent {
+    StartCallback cb;
+    void *ctx;
+    uint32_t handle;
+    bool ok;
+    uint32_t latencyMs;
+  };
+
+  struct TrackResult {
+    bool ok;
+    char path[PATH_LEN];
+  };
+
+  // What the Arduino loop can see of the audio task, republished every pass
+  struct Status {
+    bool running = false;
+    bool starting = false;
+    bool crossfading = false;
+    bool prefetched = false;
+    bool wantsPrefetch = false;
+    uint16_t chimeReady = 0; // bit h set once the chime for hour h can play
+    uint16_t chimeDuckable = 0; // and can be mixed over what is playing
+    bool chiming = false;
+    uint32_t gapLastUs = 0;
+    uint32_t gapMaxUs = 0;
+    uint32_t gapCount = 0;
+    uint32_t gapSeamless = 0;
+    uint32_t greetLastUs = 0;
+    uint32_t greetMaxUs = 0;
+    uint32_t startLastMs = 0;
+    uint32_t startMaxMs = 0;
+    uint32_t positionFrames = 0;
+    char path[PATH_LEN] = {0};
+  };
+
+  AudioTask _task;
+  SpscQueue<Command, 8> _commands;
+  SpscQueue<StartEvent, 16> _events;
+  SpscQueue<TrackResult, 8> _results;
+  TrackResultCallback _resultCb = nullptr;
+  void *_resultCtx = nullptr;
+  uint32_t _commandsPosted = 0;            // Arduino loop only
+  StartEvent _rejected = {};               // start that never reached the task
+  std::atomic<uint32_t> _commandsDone{0};  // advanced by the audio task
+  Status _status;
+  std::atomic<uint32_t> _statusSeq{0};     // odd while _status is being written
+
+  // Two decoders feed the mixer; deck 0 owns the I2S pins, deck 1 only decodes
   Audio _audio;
+  Audio _audioB{false, 3, I2S_NUM_1};
+  AudioMixer _mixer;
+  int _active = 0;   // deck carrying the current track
+  int _fadeOut = -1; // deck fading out during a crossfade
+  int _queued = -1;  // deck holding a prefetched next track
+  String _nextPath;
+
+  // Mixed output waiting for room in the I2S DMA buffers
+  static const size_t OUT_CHUNK_FRAMES = 256;
+  static const size_t DECODE_HEADROOM_FRAMES = 2304; // two MP3 frames
+  static const int START_MAX_TRIES = 3;
+  static const unsigned long START_PRIME_TIMEOUT_MS = 1000;
+  static const unsigned long START_REMOUNT_WAIT_MS = 2000; // then the open is tried again anyway
+  I2sOutput _i2sOut{I2S_NUM_0};
+  AudioOutput *_out = &_i2sOut;
+  uint32_t _outBuf[OUT_CHUNK_FRAMES];
+  size_t _outBytes = 0;
+  size_t _outOffset = 0;
+  uint32_t _outRate = 0;
+  static const size_t DMA_RING_FRAMES = 8192; // what the I2S DMA buffers hold
+  static const uint32_t UNDERRUN_SLACK_US = 2000;
+  size_t _silencePad = 0;
+  uint32_t _dmaDryUs = 0;  // when the DMA ring is estimated to run out
+  bool _dmaPrimed = false; // audio is flowing, running out would be heard
+  uint32_t _baseFrame[AudioMixer::DECKS] = {};  // track frame each deck started at
+  uint32_t _skipFrames[AudioMixer::DECKS] = {}; // decoded frames still to drop
+
+  // Switches wait for the output to fade to silence before they cut
+  enum AfterFade : uint8_t { FA_NONE, FA_STOP, FA_GREETING, FA_CHIME };
+  AfterFade _afterFade = FA_NONE;
+  uint32_t _afterFadeArg = 0;
+  bool _chimeActive = false; // master gain held at CHIME_VOLUME
+  // A track ducked under the chime: down while it plays, then back up before
+  // the master gain returns to the volume setting
+  enum Duck : uint8_t { DUCK_NONE, DUCK_DOWN, DUCK_RESTORE };
+  Duck _duck = DUCK_NONE;
+  int32_t _duckGain = AudioMixer::UNITY; // CHIME_DUCK_DB in Q15
+
+  // Pending asynchronous start, advanced one step per pass of the audio task
+  enum StartStep : uint8_t { SJ_IDLE, SJ_CHECK, SJ_FADE, SJ_OPEN, SJ_LOAD, SJ_REMOUNT, SJ_BACKOFF, SJ_PRIME };
+  struct StartJob {
+    StartStep step = SJ_IDLE;
+    String path;
+    uint32_t handle = 0;
+    StartCallback cb = nullptr;
+    void *ctx = nullptr;
+    int32_t trim = AudioMixer::UNITY;
+    ResumePoint resume = {};
+    bool cached = false; // played from the clip cache, not SD
+    bool triedFile = false; // clip file tried, decode the MP3
+    uint32_t fileBytes = 0;
+    uint32_t openUs = 0; // micros() when the open began, then when it finished
+    int attempt = 0;
+    unsigned long t0 = 0;
+    unsigned long waitUntil = 0;
+  };
+  StartJob _start;
+  uint32_t _nextHandle = 1;
+  uint32_t _startLastMs = 0;
+  uint32_t _startMaxMs = 0;
+
+  // Pipeline instrumentation
+  AudioMetrics _metrics;
+  uint32_t _lastLoopUs = 0; // Arduino loop
+  uint32_t _lastPassUs = 0; // audio task
+  uint32_t _overflowsSeen = 0; // mixer ring overflows already in _metrics
+  uint32_t _firstFrameUs = 0;
+  bool _firstSamplePending = false;
+
+  // Resident greeting (pinned in the clip cache) and motion-to-first-sample latency
+  const PcmClip *_greeting = nullptr;
+  ClipSequence _greetingSeq;
+  String _greetingPath;
+  bool _latencyPending = false;
+  unsigned long _triggerUs = 0;
+  uint32_t _greetLastUs = 0;
+  uint32_t _greetMaxUs = 0;
+
+  // Decoded short clips, the chime built from them, and the background job
+  // decoding a clip on the idle deck
+  ClipCache _clips;
+  size_t _clipBudget = 0;                 // for one clip
+  ChimeComposer _chime;
+  ClipSequence _startSeq;                 // a started file served from the cache
+  uint16_t _chimeReady = 0;
+  uint32_t _chimeRate = 0;                // of the bell; the hour numbers must match it
+  uint32_t _chimeReadyVersion = 0;
+  PcmClip *_jobClip = nullptr;            // set while _jobDeck is decoding a clip
+  String _jobPath;
+  uint32_t _jobFileBytes = 0;
+  int _jobDeck = -1;
+  unsigned long _jobStart = 0;
+  // A short file decoded for playback is copied into the cache as it plays
+  PcmClip *_tee[AudioMixer::DECKS] = {};
+  String _teePath[AudioMixer::DECKS];
+  uint32_t _teeFileBytes[AudioMixer::DECKS] = {};
+  // Short files saved as clip files in CLIP_FILE_DIR, read into the cache
+  // without the decoder. Loads and saves run a few blocks per pass.
+  static const int CONVERT_QUEUE = 8;
+  ClipFile _clipLoad;
+  PcmClip *_loadClip = nullptr;           // set while _clipLoad fills a cache clip
+  String _loadPath;
+  uint32_t _loadFileBytes = 0;
+  ClipFile _clipSave;
+  const PcmClip *_saveClip = nullptr;     // set while _clipSave writes it out
+  String _savePath;
+  String _convertQueue[CONVERT_QUEUE];    // decoded (or to decode), then saved
+  int _converts = 0;
+
+  // Loudness measurement, handed between the Arduino loop and the audio task
+  enum AnalysisState : uint8_t { AN_IDLE, AN_PENDING, AN_DONE, AN_FAILED, AN_BUSY };
+  LoudnessIndex _loudness;                 // Arduino loop
+  String _analysisPath;                    // Arduino loop
+  std::atomic<uint8_t> _analysis{AN_IDLE};
+  std::atomic<int16_t> _analysisGain{0};   // 1/100 dB, valid with AN_DONE
+  LoudnessMeter _meter;
+  LoudnessMeter *_jobMeter = nullptr;      // set while _jobDeck is measuring
+
+  // Seek indexes for resuming, built on the Arduino loop for what plays
+  SeekIndex _seek;
+  String _seekChecked;
+
+  // Inter-track gap measurement
+  bool _hadAudio = false;
+  bool _gapPending = false;
+  unsigned long _gapStartUs = 0;
+  uint32_t _gapLastUs = 0;
+  uint32_t _gapMaxUs = 0;
+  uint32_t _gapCount = 0;
+  uint32_t _gapSeamless = 0;
+
   int _bclk=0, _lrclk=0, _din=0;
-  int _currentVolume = 21;
-  int _consecutiveFails = 0;
+  // Written by the Arduino loop, read by the audio task
+  std::atomic<int> _currentVolume{21};
+  std::atomic<int> _consecutiveFails{0};
+  // SD remount handshake: the task asks, the loop remounts while the task
+  // holds off the card
+  std::atomic<bool> _remountWanted{false};
+  std::atomic<bool> _quiesced{false};
   String _currentPath;
   
-  // Equalizer variables (range: -12 to +12)
-  int _eqBass = 0;
-  int _eqMid = 0;
-  int _eqTreble = 0;
+  // Equalizer. Bands are edited in the Arduino loop, which designs the
+  // coefficients into the table the audio task is not using and posts it.
+  Equalizer::Band _eqBands[Equalizer::BANDS];
+  Equalizer::Band _eqSaved[Equalizer::BANDS]; // as stored in NVS
+  Equalizer::Table _eqTables[2];
+  int _eqBack = 0;                     // table the next design goes into
+  bool _eqDirty = false;
+  uint32_t _eqPosted = 0;
+  std::atomic<uint32_t> _eqApplied{0}; // tables the audio task switched to
+  Equalizer _eq;                       // audio task
   
   // Crossfade variables
-  int _crossfadeTime = 2000; // 2 seconds default
+  std::atomic<int> _crossfadeTime{2000}; // 2 seconds default
   bool _isCrossfading = false;
-  String _nextPath;
-  unsigned long _crossfadeStart = 0;
-  int _originalVolume = 0;
   
-  // Private methods
-  void applyEQ();
+  // Arduino loop side
+  bool postCommand(CommandType type, uint32_t arg = 0, const char *path = nullptr,
+                   uint32_t handle = 0, StartCallback cb = nullptr, void *ctx = nullptr,
+                   const ResumePoint &resume = {});
+  uint32_t allocHandle();
+  bool commandsPending() const { return _commandsPosted != _commandsDone.load(); }
+  Status status() const;
+  void indexPlaying();
+
+  // Audio task side
+  static void taskBody(void *self);
+  void step();
+  void runCommand(const Command &c);
+  void publishStatus();
+  void service();
+  bool engineRunning();
+  bool engineWantsPrefetch();
+  void engineStart(const char *path, int32_t trim, uint32_t handle, StartCallback cb, void *ctx,
+                   const ResumePoint &resume);
+  bool engineCrossfade(const char *path, int32_t trim, uint32_t handle);
+  bool enginePrefetch(const char *path, int32_t trim);
+  bool enginePlayGreeting(unsigned long triggerUs);
+  bool enginePrepareChime(int h12);
+  bool enginePlayChime(int h12);
+  void engineStop();
+  void engineQuiesce();
+  uint32_t rampFrames() const;
+  void updateMasterGain();
+  bool fadedOut() const;
+  void fadeThen(AfterFade what, uint32_t arg = 0);
+  void runAfterFade();
+  void fadeIn(int ch);
+  void beginGreeting(unsigned long triggerUs);
+  void beginChime(int h12);
+  bool engineDuckChime(int h12);
+  void endChime();
+  uint32_t duckRate();
+  int32_t deckShare(bool ducked) const;
+  void postStartEvent(StartCallback cb, void *ctx, uint32_t handle, bool ok, uint32_t latencyMs);
+  void postTrackResult(const char *path, bool ok);
+
+  Audio &deck(int i) { return i == 0 ? _audio : _audioB; }
+  void stopDeck(int i);
+  void stopAll();
+  void advanceStart();
+  void finishStart(bool ok);
+  bool playStartClip();
+  void teeStart();
+  void cancelStart();
+  int freeJobDeck();
+  size_t clipBytes() const;
+  bool startClipJob(const char *path, const char *keep = nullptr);
+  void endTee(int i, bool ok);
+  bool loadClipFile(const char *path, uint32_t sourceBytes, const char *keep = nullptr);
+  void endClipLoad(bool ok, bool cancelled = false);
+  void queueConvert(const char *path);
+  void dropConvert(const char *path);
+  void beginConvert(const char *path);
+  void pumpClipFiles();
+  void forgetClip(const char *path);
+  void startAnalysis(const char *path);
+  void finishJob(bool ok, bool cancelled = false);
+  int32_t trackTrim(const String &path) const;
+  void collectAnalysis();
+  const PcmClip *decodeToClip(const char *path);
+  static int32_t volumeGain(int v);
+  void pumpDecoders();
+  void pumpOutput();
+  void trackDma(size_t frames, bool full);
+  uint32_t heardFrame() const;
+  void onHandover(int to, bool primed);
+  void recordGap(uint32_t us);
+  void publishEQ();
   void updateCrossfade();
 };
 
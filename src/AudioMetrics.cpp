@@ -0,0 +1,152 @@
+#include "AudioMetrics.h"
+
+uint32_t LatencyHistogram::percentile(float p) const {
+  uint32_t total = count();
+  if (total == 0) return 0;
+  uint32_t want = (uint32_t)(total * p);
+  uint32_t seen = 0;
+  for (int i = 0; i < BUCKETS; ++i) {
+    seen += _buckets[i].load(std::memory_order_relaxed);
+    if (seen > want) return (2u << i) - 1;
+  }
+  return max();
+}
+
+void LatencyHistogram::reset() {
+  for (int i = 0; i < BUCKETS; ++i) _buckets[i].store(0, std::memory_order_relaxed);
+  _count.store(0, std::memory_order_relaxed);
+  _max.store(0, std::memory_order_relaxed);
+  _last.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::appendJson(String &out) const {
+  out += "{\"count\":";
+  out += count();
+  out += ",\"last\":";
+  out += _last.load(std::memory_order_relaxed);
+  out += ",\"p50\":";
+  out += percentile(0.5f);
+  out += ",\"p99\":";
+  out += percentile(0.99f);
+  out += ",\"max\":";
+  out += max();
+  // Trailing empty buckets are left out
+  int top = BUCKETS - 1;
+  while (top > 0 && _buckets[top].load(std::memory_order_relaxed) == 0) top--;
+  out += ",\"buckets\":[";
+  for (int i = 0; i <= top; ++i) {
+    if (i) out += ",";
+    out += _buckets[i].load(std::memory_order_relaxed);
+  }
+  out += "]}";
+}
+
+void TrackFailures::record(const char *path) {
+  uint32_t h = 2166136261u; // FNV-1a
+  for (const char *p = path; *p; ++p) {
+    h ^= (uint8_t)*p;
+    h *= 16777619u;
+  }
+
+  // Same track, else an empty slot, else the one that failed longest ago
+  int slot = -1;
+  for (int i = 0; i < SLOTS && slot < 0; ++i) {
+    if (_slots[i].fails && _slots[i].hash == h) slot = i;
+  }
+  for (int i = 0; i < SLOTS && slot < 0; ++i) {
+    if (!_slots[i].fails) slot = i;
+  }
+  if (slot < 0) {
+    slot = 0;
+    for (int i = 1; i < SLOTS; ++i) {
+      if ((int32_t)(_slots[i].lastMs - _slots[slot].lastMs) < 0) slot = i;
+    }
+  }
+
+  _seq.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  Slot &s = _slots[slot];
+  if (s.fails && s.hash == h) {
+    s.fails++;
+  } else {
+    s.hash = h;
+    s.fails = 1;
+    snprintf(s.name, sizeof(s.name), "%s", path);
+  }
+  s.lastMs = millis();
+  _seq.fetch_add(1, std::memory_order_release);
+}
+
+void TrackFailures::reset() {
+  _seq.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (int i = 0; i < SLOTS; ++i) _slots[i].fails = 0;
+  _seq.fetch_add(1, std::memory_order_release);
+}
+
+void TrackFailures::appendJson(String &out) const {
+  Slot copy[SLOTS];
+  while (true) {
+    uint32_t seq = _seq.load(std::memory_order_acquire);
+    if (seq & 1) continue;
+    memcpy(copy, _slots, sizeof(copy));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (_seq.load(std::memory_order_relaxed) == seq) break;
+  }
+
+  out += "[";
+  bool first = true;
+  for (int i = 0; i < SLOTS; ++i) {
+    if (!copy[i].fails) continue;
+    copy[i].name[NAME_LEN - 1] = 0;
+    if (!first) out += ",";
+    first = false;
+    out += "{\"path\":\"";
+    out += copy[i].name;
+    out += "\",\"fails\":";
+    out += copy[i].fails;
+    out += ",\"lastMs\":";
+    out += copy[i].lastMs;
+    out += "}";
+  }
+  out += "]";
+}
+
+void AudioMetrics::reset() {
+  decodeUs.reset();
+  passGapUs.reset();
+  mainLoopUs.reset();
+  openUs.reset();
+  firstFrameUs.reset();
+  firstSampleUs.reset();
+  underruns.store(0);
+  lastUnderrunMs.store(0);
+  ringOverflows.store(0);
+  failures.reset();
+}
+
+void AudioMetrics::appendJson(String &out) const {
+  out += "{\"uptimeMs\":";
+  out += (uint32_t)millis();
+  out += ",\"underruns\":";
+  out += underruns.load();
+  out += ",\"lastUnderrunMs\":";
+  out += lastUnderrunMs.load();
+  out += ",\"ringOverflows\":";
+  out += ringOverflows.load();
+  out += ",\"decodeUs\":";
+  decodeUs.appendJson(out);
+  out += ",\"audioPassGapUs\":";
+  passGapUs.appendJson(out);
+  out += ",\"mainLoopUs\":";
+  mainLoopUs.appendJson(out);
+  out += ",\"start\":{\"openUs\":";
+  openUs.appendJson(out);
+  out += ",\"firstFrameUs\":";
+  firstFrameUs.appendJson(out);
+  out += ",\"firstSampleUs\":";
+  firstSampleUs.appendJson(out);
+  out += "},\"trackFailures\":";
+  failures.appendJson(out);
+  out += "}";
+}
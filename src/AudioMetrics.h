@@ -0,0 +1,77 @@
+#ifndef AUDIO_METRICS_H
+#define AUDIO_METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Timing histogram with power-of-two buckets: bucket i counts values in
+// [2^i, 2^(i+1)) microseconds (bucket 0 also takes 0). Updated by one task,
+// read by any other; every field is an atomic, nothing is allocated.
+class LatencyHistogram {
+public:
+  static const int BUCKETS = 24; // up to ~16 s
+
+  void record(uint32_t us) {
+    int b = us ? 31 - __builtin_clz(us) : 0;
+    if (b >= BUCKETS) b = BUCKETS - 1;
+    _buckets[b].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    if (us > _max.load(std::memory_order_relaxed)) _max.store(us, std::memory_order_relaxed);
+    _last.store(us, std::memory_order_relaxed);
+  }
+
+  uint32_t count() const { return _count.load(std::memory_order_relaxed); }
+  uint32_t max() const { return _max.load(std::memory_order_relaxed); }
+  // Upper edge of the bucket holding the given fraction of samples
+  uint32_t percentile(float p) const;
+  void reset();
+  void appendJson(String &out) const;
+
+private:
+  std::atomic<uint32_t> _buckets[BUCKETS] = {};
+  std::atomic<uint32_t> _count{0};
+  std::atomic<uint32_t> _max{0};
+  std::atomic<uint32_t> _last{0};
+};
+
+// Start failures per track, for the tracks that failed most recently.
+// Written by the audio task; readers take a consistent copy via a sequence
+// counter.
+class TrackFailures {
+public:
+  static const int SLOTS = 16;
+  static const int NAME_LEN = 48;
+
+  void record(const char *path);
+  void reset();
+  void appendJson(String &out) const;
+
+private:
+  struct Slot {
+    uint32_t hash;
+    uint32_t fails;
+    uint32_t lastMs;
+    char name[NAME_LEN];
+  };
+  Slot _slots[SLOTS] = {};
+  std::atomic<uint32_t> _seq{0}; // odd while a slot is being written
+};
+
+// Everything the playback pipeline measures about itself, for /api/metrics
+struct AudioMetrics {
+  LatencyHistogram decodeUs;      // one Audio::loop() call on a playing deck
+  LatencyHistogram passGapUs;     // between passes of the audio task
+  LatencyHistogram mainLoopUs;    // between AudioManager::loop() calls (web, SD, motion)
+  LatencyHistogram openUs;        // start: opening the file
+  LatencyHistogram firstFrameUs;  // start: file open to first decoded frame
+  LatencyHistogram firstSampleUs; // start: first frame to first sample handed to I2S
+  std::atomic<uint32_t> underruns{0};      // I2S DMA estimated to have run dry mid-track
+  std::atomic<uint32_t> lastUnderrunMs{0}; // millis() of the last one
+  std::atomic<uint32_t> ringOverflows{0};  // decoded frames dropped for lack of ring space
+  TrackFailures failures;
+
+  void reset();
+  void appendJson(String &out) const;
+};
+
+#endif // AUDIO_METRICS_H
@@ -0,0 +1,229 @@
+#include "AudioMixer.h"
+
+AudioMixer::AudioMixer() {
+  for (int i = 0; i < DECKS; ++i) _ch[i].ring = &_rings[i];
+}
+
+void AudioMixer::reset(int ch, int32_t gain) {
+  Channel &c = _ch[ch];
+  if (c.ring) c.ring->clear();
+  c.seq = nullptr;
+  c.cursor.rewind();
+  c.gain = gain;
+  c.target = gain;
+  c.step = 0;
+  c.rampLeft = 0;
+  c.trim = UNITY;
+  c.eff = gain;
+  c.played = 0;
+  c.live = false;
+  c.started = false;
+  c.feeding = false;
+  c.next = -1;
+  for (int i = 0; i < CHANNELS; ++i) {
+    if (_ch[i].next == ch) _ch[i].next = -1;
+  }
+  if (_handoverTo == ch) _handoverTo = -1;
+}
+
+void AudioMixer::setLive(int ch, bool live) {
+  _ch[ch].live = live;
+  // Assume a decoder is behind a channel going live until told otherwise
+  if (live) _ch[ch].feeding = (_ch[ch].seq == nullptr);
+  else _ch[ch].started = false;
+}
+
+void AudioMixer::queueAfter(int from, int to) {
+  if (!_ch[from].live) {
+    setLive(to, true);
+    return;
+  }
+  _ch[from].next = (int8_t)to;
+}
+
+void AudioMixer::playClip(const ClipSequence *seq) {
+  Channel &c = _ch[CLIP_CH];
+  c.seq = seq;
+  c.cursor.rewind();
+  c.live = true;
+  c.started = false;
+  c.feeding = false; // everything is already in memory
+}
+
+bool AudioMixer::isQueued(int ch) const {
+  for (int i = 0; i < CHANNELS; ++i) {
+    if (_ch[i].next == ch) return true;
+  }
+  return false;
+}
+
+bool AudioMixer::takeHandover(int &to, bool &primed) {
+  if (_handoverTo < 0) return false;
+  to = _handoverTo;
+  primed = _handoverPrimed;
+  _handoverTo = -1;
+  return true;
+}
+
+void AudioMixer::setTrim(int ch, int32_t trim) {
+  Channel &c = _ch[ch];
+  if (trim < 0) trim = 0;
+  if (trim > 65535) trim = 65535; // keeps sample * gain inside 32 bits
+  c.trim = trim;
+  c.eff = applyTrim(c.gain, trim);
+}
+
+void AudioMixer::rampTo(int ch, int32_t target, uint32_t frames) {
+  Channel &c = _ch[ch];
+  c.target = target;
+  if (frames == 0 || target == c.gain) {
+    c.gain = target;
+    c.eff = applyTrim(c.gain, c.trim);
+    c.step = 0;
+    c.rampLeft = 0;
+    return;
+  }
+  c.step = rampStep(target - c.gain, frames);
+  c.rampLeft = frames;
+}
+
+void AudioMixer::rampMaster(int32_t target, uint32_t frames) {
+  if (target < 0) target = 0;
+  if (target > UNITY) target = UNITY;
+  _masterTarget = target;
+  if (frames == 0 || target == _master) {
+    _master = target;
+    _masterStep = 0;
+    _masterLeft = 0;
+    return;
+  }
+  _masterStep = rampStep(target - _master, frames);
+  _masterLeft = frames;
+}
+
+void AudioMixer::rampDecks(int32_t target, uint32_t frames) {
+  if (target < 0) target = 0;
+  if (target > UNITY) target = UNITY;
+  _decksTarget = target;
+  if (frames == 0 || target == _decks) {
+    _decks = target;
+    _decksStep = 0;
+    _decksLeft = 0;
+    return;
+  }
+  _decksStep = rampStep(target - _decks, frames);
+  _decksLeft = frames;
+}
+
+bool AudioMixer::hasAudio() const {
+  for (int i = 0; i < CHANNELS; ++i) {
+    const Channel &c = _ch[i];
+    if (c.live && (c.feeding || c.avail() > 0)) return true;
+  }
+  return false;
+}
+
+size_t AudioMixer::render(uint32_t *out, size_t maxFrames) {
+  size_t total = 0;
+  while (total < maxFrames) {
+    total += mixOnce(out + total, maxFrames - total);
+    // Keep going only if a queued channel just took over
+    if (!retireDrained()) break;
+  }
+  return total;
+}
+
+size_t AudioMixer::mixOnce(uint32_t *out, size_t maxFrames) {
+  // Work out how many frames every contributing channel can supply
+  size_t n = maxFrames;
+  size_t drainMax = 0;
+  bool clocked = false;
+  for (int i = 0; i < CHANNELS; ++i) {
+    Channel &c = _ch[i];
+    if (!c.live) continue;
+    size_t avail = c.avail();
+    if (!c.started) {
+      if (avail == 0) continue; // still priming, don't hold the others back
+      c.started = true;
+    }
+    if (c.feeding) {
+      clocked = true;
+      if (avail < n) n = avail;
+    } else if (avail > drainMax) {
+      drainMax = avail;
+    }
+  }
+  if (!clocked && drainMax < n) n = drainMax;
+  if (n == 0) return 0;
+
+  for (size_t i = 0; i < n; ++i) {
+    int32_t l = 0, r = 0;
+    for (int k = 0; k < CHANNELS; ++k) {
+      // Decks summed, duck them before the clip channel goes on top
+      if (k == CLIP_CH) {
+        if (_decks != UNITY) {
+          l = (int32_t)(((int64_t)l * _decks) >> 15);
+          r = (int32_t)(((int64_t)r * _decks) >> 15);
+        }
+        if (_decksLeft) {
+          _decks += _decksStep;
+          if (--_decksLeft == 0 || reached(_decks, _decksStep, _decksTarget)) {
+            _decks = _decksTarget;
+            _decksLeft = 0;
+          }
+        }
+      }
+      Channel &c = _ch[k];
+      if (!c.started || c.avail() == 0) continue;
+      uint32_t f = c.pop();
+      c.played++;
+      int32_t g = c.eff;
+      l += ((int32_t)(int16_t)(f & 0xFFFF) * g) >> 15;
+      r += ((int32_t)(int16_t)(f >> 16) * g) >> 15;
+      if (c.rampLeft) {
+        c.gain += c.step;
+        if (--c.rampLeft == 0 || reached(c.gain, c.step, c.target)) {
+          c.gain = c.target;
+          c.rampLeft = 0;
+        }
+        c.eff = applyTrim(c.gain, c.trim);
+      }
+    }
+    if (_master != UNITY) {
+      l = (int32_t)(((int64_t)l * _master) >> 15);
+      r = (int32_t)(((int64_t)r * _master) >> 15);
+    }
+    if (_masterLeft) {
+      _master += _masterStep;
+      if (--_masterLeft == 0 || reached(_master, _masterStep, _masterTarget)) {
+        _master = _masterTarget;
+        _masterLeft = 0;
+      }
+    }
+    out[i] = (uint32_t)(uint16_t)clamp16(l) | ((uint32_t)(uint16_t)clamp16(r) << 16);
+  }
+  return n;
+}
+
+// Channels whose decoder finished and whose ring is now empty go idle and
+// hand over to whatever was queued behind them
+bool AudioMixer::retireDrained() {
+  bool promoted = false;
+  for (int k = 0; k < CHANNELS; ++k) {
+    Channel &c = _ch[k];
+    if (c.live && !c.feeding && c.avail() == 0) {
+      c.live = false;
+      c.started = false;
+      c.seq = nullptr;
+      if (c.next >= 0) {
+        int to = c.next;
+        c.next = -1;
+        setLive(to, true);
+        _handoverTo = (int8_t)to;
+        _handoverPrimed = _ch[to].avail() > 0;
+        promoted = true;
+      }
+    }
+  }
+  return promoted;
+}
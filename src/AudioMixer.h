@@ -0,0 +1,156 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "PcmRing.h"
+#include "ClipSequence.h"
+
+// Sums the PCM of several decoder channels per sample, each with its own
+// fixed-point gain ramp, into one stereo stream for I2S, then applies the
+// master gain (also ramped per sample, so volume changes never step).
+//
+// A channel can also be queued behind another one: it decodes into its ring
+// but stays silent until the first channel has played its last sample, then
+// takes over within the same render call (gapless track change).
+//
+// Decoder channels read from a PCM ring; the clip channel plays a
+// ClipSequence straight from memory.
+//
+// A channel is mixed once it is live and has produced its first frame, so a
+// decoder that is still opening its file never holds back the others. Live
+// channels that are still decoding act as the clock: a render never runs
+// past the shortest of them, so their samples stay aligned.
+class AudioMixer {
+public:
+  static const int DECKS = 2;               // decoder channels 0..DECKS-1
+  static const int CLIP_CH = DECKS;         // in-memory clip channel
+  static const int CHANNELS = DECKS + 1;
+  static const size_t RING_FRAMES = 4096;   // ~93 ms at 44.1 kHz
+  static const int32_t UNITY = 32768;       // Q15 gain 1.0
+
+  typedef PcmRing<RING_FRAMES> Ring;
+
+  AudioMixer();
+
+  // Drop buffered audio and make the channel idle at the given gain
+  void reset(int ch, int32_t gain = UNITY);
+
+  // Include a channel in the mix. `feeding` tells whether a decoder is still
+  // producing into its ring; once false the channel drains and goes idle.
+  void setLive(int ch, bool live);
+  void setFeeding(int ch, bool feeding) { _ch[ch].feeding = feeding; }
+  bool isLive(int ch) const { return _ch[ch].live; }
+  bool isStarted(int ch) const { return _ch[ch].started; }
+
+  // Make `to` live the moment `from` runs dry (or right away if it already has)
+  void queueAfter(int from, int to);
+  bool isQueued(int ch) const;
+
+  // Report a queued channel that took over since the last call. `primed` is
+  // true if it already had frames buffered, i.e. the change was sample-exact.
+  bool takeHandover(int &to, bool &primed);
+
+  // Linear gain ramp to `target` over `frames` mixed frames (0 = jump)
+  void rampTo(int ch, int32_t target, uint32_t frames);
+  bool rampDone(int ch) const { return _ch[ch].rampLeft == 0; }
+  int32_t getGain(int ch) const { return _ch[ch].gain; }
+
+  // Fixed per-track gain (loudness normalisation) on top of the ramped gain,
+  // Q15, at most +6 dB. reset() puts it back to UNITY.
+  void setTrim(int ch, int32_t trim);
+
+  // Output gain after the sum (volume, fades), Q15 up to UNITY, ramped
+  // linearly per sample like the channel gains
+  void rampMaster(int32_t target, uint32_t frames);
+  bool masterRampDone() const { return _masterLeft == 0; }
+  int32_t getMasterTarget() const { return _masterTarget; }
+
+  // Gain on the sum of the decoder channels only, before the master: lowers
+  // a track under a clip mixed over it (ducking). Q15 up to UNITY, ramped
+  // per sample.
+  void rampDecks(int32_t target, uint32_t frames);
+  bool decksRampDone() const { return _decksLeft == 0; }
+  int32_t getDecksTarget() const { return _decksTarget; }
+
+  // Play clips from memory on the clip channel (they must outlive playback)
+  void playClip(const ClipSequence *seq);
+  bool clipPlaying() const { return _ch[CLIP_CH].live; }
+  uint32_t clipRate() const { return _ch[CLIP_CH].seq ? _ch[CLIP_CH].seq->rate : 0; }
+  const ClipSequence *clipSeq() const { return _ch[CLIP_CH].seq; }
+
+  Ring &ring(int ch) { return *_ch[ch].ring; }
+  size_t buffered(int ch) const { return _ch[ch].avail(); }
+  // Frames mixed from a channel since its last reset()
+  uint32_t played(int ch) const { return _ch[ch].played; }
+  bool hasAudio() const;
+
+  // Mix up to maxFrames into out; returns frames produced (0 = nothing ready)
+  size_t render(uint32_t *out, size_t maxFrames);
+
+  uint32_t getOverflows() const { return _overflows; }
+  void countOverflow() { _overflows++; }
+
+private:
+  size_t mixOnce(uint32_t *out, size_t maxFrames);
+  bool retireDrained();
+
+  struct Channel {
+    Ring *ring = nullptr;              // decoder channels
+    const ClipSequence *seq = nullptr; // clip channel
+    ClipSequence::Cursor cursor;
+    int32_t gain = UNITY;
+    int32_t target = UNITY;
+    int32_t step = 0;
+    uint32_t rampLeft = 0;
+    int32_t trim = UNITY;
+    int32_t eff = UNITY; // gain with trim applied, what the mix uses
+    uint32_t played = 0;
+    bool live = false;
+    bool started = false;
+    bool feeding = false;
+    int8_t next = -1; // channel queued to follow this one
+
+    size_t avail() const {
+      if (seq) return seq->totalFrames - cursor.done;
+      return ring ? ring->size() : 0;
+    }
+    uint32_t pop() { return seq ? cursor.next(*seq) : ring->pop(); }
+  };
+
+  Ring _rings[DECKS];
+  Channel _ch[CHANNELS];
+  int32_t _master = UNITY;
+  int32_t _masterTarget = UNITY;
+  int32_t _masterStep = 0;
+  uint32_t _masterLeft = 0;
+  int32_t _decks = UNITY;
+  int32_t _decksTarget = UNITY;
+  int32_t _decksStep = 0;
+  uint32_t _decksLeft = 0;
+  int8_t _handoverTo = -1;
+  bool _handoverPrimed = false;
+  uint32_t _overflows = 0;
+
+  static inline int32_t applyTrim(int32_t gain, int32_t trim) {
+    return trim == UNITY ? gain : (int32_t)(((int64_t)gain * trim) >> 15);
+  }
+
+  // Per-frame step, rounded away from zero so the ramp lands on the target
+  // (a truncated step would leave a jump of up to `frames` at the end)
+  static inline int32_t rampStep(int32_t diff, uint32_t frames) {
+    int32_t f = (int32_t)frames;
+    return diff > 0 ? (diff + f - 1) / f : (diff - f + 1) / f;
+  }
+  static inline bool reached(int32_t v, int32_t step, int32_t target) {
+    return step > 0 ? v >= target : v <= target;
+  }
+
+  static inline int16_t clamp16(int32_t v) {
+    if (v > 32767) return 32767;
+    if (v < -32768) return -32768;
+    return (int16_t)v;
+  }
+};
+
+#endif // AUDIO_MIXER_H
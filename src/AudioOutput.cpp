@@ -0,0 +1,65 @@
+#include "AudioOutput.h"
+#include <Arduino.h>
+
+bool WavOutput::open(const char *path) {
+  close();
+  _f = fopen(path, "wb");
+  if (!_f) {
+    Serial.printf("WavOutput: cannot create %s\n", path);
+    return false;
+  }
+  _frames = 0;
+  writeHeader(); // placeholder until close()
+  return true;
+}
+
+void WavOutput::close() {
+  if (!_f) return;
+  fseek(_f, 0, SEEK_SET);
+  writeHeader();
+  fclose(_f);
+  _f = nullptr;
+}
+
+void WavOutput::setSampleRate(uint32_t rate) {
+  if (_rate && rate != _rate) {
+    Serial.printf("WavOutput: rate changed %lu -> %lu Hz, file stays at the first\n",
+                  (unsigned long)_rate, (unsigned long)rate);
+    return;
+  }
+  _rate = rate;
+}
+
+size_t WavOutput::write(const void *data, size_t bytes) {
+  if (!_f) return bytes; // nowhere to go, don't stall the pipeline
+  size_t n = fwrite(data, 1, bytes, _f);
+  _frames += n / 4;
+  return n;
+}
+
+// 44-byte canonical header, little-endian like the samples
+void WavOutput::writeHeader() {
+  uint32_t rate = _rate ? _rate : 44100;
+  uint32_t data = _frames * 4;
+  uint8_t h[44];
+  auto put32 = [&](int at, uint32_t v) {
+    for (int i = 0; i < 4; ++i) h[at + i] = (uint8_t)(v >> (8 * i));
+  };
+  auto put16 = [&](int at, uint16_t v) {
+    h[at] = (uint8_t)v;
+    h[at + 1] = (uint8_t)(v >> 8);
+  };
+  memcpy(h, "RIFF", 4);
+  put32(4, 36 + data);
+  memcpy(h + 8, "WAVEfmt ", 8);
+  put32(16, 16);
+  put16(20, 1); // PCM
+  put16(22, 2);
+  put32(24, rate);
+  put32(28, rate * 4);
+  put16(32, 4);
+  put16(34, 16);
+  memcpy(h + 36, "data", 4);
+  put32(40, data);
+  fwrite(h, 1, sizeof(h), _f);
+}
@@ -0,0 +1,54 @@
+#ifndef AUDIO_OUTPUT_H
+#define AUDIO_OUTPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "driver/i2s.h"
+
+// Where AudioManager sends mixed 16-bit stereo frames. On the device that
+// is the I2S DMA ring; a WAV file can stand in for it to capture exactly
+// what would have been heard, e.g. when running the pipeline off-target.
+class AudioOutput {
+public:
+  virtual ~AudioOutput() {}
+  virtual void setSampleRate(uint32_t rate) = 0;
+  // Take up to `bytes` without blocking; returns how many were taken
+  virtual size_t write(const void *data, size_t bytes) = 0;
+};
+
+class I2sOutput : public AudioOutput {
+public:
+  explicit I2sOutput(i2s_port_t port) : _port(port) {}
+  void setSampleRate(uint32_t rate) override { i2s_set_sample_rates(_port, rate); }
+  size_t write(const void *data, size_t bytes) override {
+    size_t written = 0;
+    i2s_write(_port, (const char *)data, bytes, &written, 0);
+    return written;
+  }
+
+private:
+  i2s_port_t _port;
+};
+
+// Takes everything at once. A rate change mid-stream is logged and the
+// header keeps the first rate; the length fields are filled in by close().
+class WavOutput : public AudioOutput {
+public:
+  ~WavOutput() { close(); }
+
+  bool open(const char *path);
+  void close();
+  void setSampleRate(uint32_t rate) override;
+  size_t write(const void *data, size_t bytes) override;
+  uint32_t frames() const { return _frames; }
+
+private:
+  FILE *_f = nullptr;
+  uint32_t _rate = 0;
+  uint32_t _frames = 0;
+
+  void writeHeader();
+};
+
+#endif // AUDIO_OUTPUT_H
@@ -0,0 +1,56 @@
+#include "AudioTask.h"
+
+void AudioTask::run() {
+  while (!_stop.load()) _body(_arg);
+  _running = false;
+}
+
+#ifdef ARDUINO
+
+void AudioTask::trampoline(void *self) {
+  static_cast<AudioTask *>(self)->run();
+  vTaskDelete(nullptr); // FreeRTOS tasks must not return
+}
+
+bool AudioTask::start(const char *name, Body body, void *arg, uint32_t stackBytes, int priority, int core) {
+  if (_running) return false;
+  _body = body;
+  _arg = arg;
+  _stop = false;
+  _running = true;
+  if (xTaskCreatePinnedToCore(trampoline, name, stackBytes, this, priority, &_handle, core) != pdPASS) {
+    _running = false;
+    return false;
+  }
+  return true;
+}
+
+void AudioTask::stop() {
+  _stop = true;
+  while (_running) vTaskDelay(1);
+  _handle = nullptr;
+}
+
+void AudioTask::sleepMs(uint32_t ms) { vTaskDelay(pdMS_TO_TICKS(ms) ? pdMS_TO_TICKS(ms) : 1); }
+
+#else
+
+bool AudioTask::start(const char *name, Body body, void *arg, uint32_t stackBytes, int priority, int core) {
+  (void)name; (void)stackBytes; (void)priority; (void)core; // no affinity on the host
+  if (_running) return false;
+  _body = body;
+  _arg = arg;
+  _stop = false;
+  _running = true;
+  _thread = std::thread([this]() { run(); });
+  return true;
+}
+
+void AudioTask::stop() {
+  _stop = true;
+  if (_thread.joinable()) _thread.join();
+}
+
+void AudioTask::sleepMs(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef AUDIO_TASK_H
+#define AUDIO_TASK_H
+
+#include <stdint.h>
+#include <atomic>
+#ifdef ARDUINO
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#else
+#include <thread>
+#endif
+
+// A long-running worker: a FreeRTOS task pinned to one core on the ESP32, a
+// std::thread on the host. The body is called repeatedly until stop().
+class AudioTask {
+public:
+  typedef void (*Body)(void *arg);
+
+  ~AudioTask() { stop(); }
+
+  bool start(const char *name, Body body, void *arg, uint32_t stackBytes, int priority, int core);
+  void stop();
+  bool running() const { return _running.load(); }
+
+  static void sleepMs(uint32_t ms);
+
+private:
+  Body _body = nullptr;
+  void *_arg = nullptr;
+  std::atomic<bool> _running{false};
+  std::atomic<bool> _stop{false};
+#ifdef ARDUINO
+  TaskHandle_t _handle = nullptr;
+  static void trampoline(void *self);
+#else
+  std::thread _thread;
+#endif
+
+  void run();
+};
+
+#endif // AUDIO_TASK_H
@@ -0,0 +1,59 @@
+#include "ChimeComposer.h"
+#include "Config.h"
+
+void ChimeComposer::pathFor(int slot, char *buf, size_t len) const {
+  if (slot == BELL) snprintf(buf, len, "%s", BELL_PATH);
+  else snprintf(buf, len, "%s%d.mp3", HOURS_DIR, slot);
+}
+
+ClipCache::State ChimeComposer::state(int slot) const {
+  char path[48];
+  pathFor(slot, path, sizeof(path));
+  return _cache->state(path);
+}
+
+int ChimeComposer::nextToLoad(int h12) const {
+  if (state(BELL) == ClipCache::EMPTY) return BELL;
+  if (state(h12) == ClipCache::EMPTY) return h12;
+  return -1;
+}
+
+const ClipSequence *ChimeComposer::compose(int h12) {
+  if (h12 < 1 || h12 > 12) return nullptr;
+
+  ClipSequence &seq = _seq[h12 - 1];
+  if (_seqBuilt[h12 - 1] && _seqVersion[h12 - 1] == _cache->version()) return &seq;
+
+  char bellPath[48], hourPath[48];
+  pathFor(BELL, bellPath, sizeof(bellPath));
+  pathFor(h12, hourPath, sizeof(hourPath));
+  const PcmClip *bell = _cache->peek(bellPath);
+  const PcmClip *hour = _cache->peek(hourPath);
+
+  // bell x N, then the hour number twice, all on one sample clock
+  seq.clear();
+  _seqBuilt[h12 - 1] = false;
+  bool ok = bell && hour;
+  for (int i = 0; i < h12 && ok; ++i) {
+    ok = seq.add(bell, i == 0 ? 0 : CHIME_BELL_GAP_MS);
+  }
+  for (int i = 0; i < 2 && ok; ++i) {
+    ok = seq.add(hour, CHIME_NUMBER_GAP_MS);
+  }
+  if (!ok) {
+    // Missing, or clips at different sample rates can't share one stream
+    seq.clear();
+    return nullptr;
+  }
+  _seqBuilt[h12 - 1] = true;
+  _seqVersion[h12 - 1] = _cache->version();
+  return &seq;
+}
+
+void ChimeComposer::played(int h12) {
+  char path[48];
+  pathFor(BELL, path, sizeof(path));
+  _cache->get(path, (uint32_t)h12);
+  pathFor(h12, path, sizeof(path));
+  _cache->get(path, 2);
+}
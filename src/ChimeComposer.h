@@ -0,0 +1,35 @@
+#ifndef CHIME_COMPOSER_H
+#define CHIME_COMPOSER_H
+
+#include <Arduino.h>
+#include "ClipCache.h"
+#include "ClipSequence.h"
+
+// Strings the decoded bell and hour-number clips into one bell x N + hour x 2
+// sequence with fixed spacing. The clips live in the ClipCache (decoded by
+// AudioManager); the sequence for each hour is built once and rebuilt only
+// if the cache has changed since.
+class ChimeComposer {
+public:
+  static const int BELL = 0; // slot 0 is the bell, slots 1..12 the hour numbers
+  static const int SLOTS = 13;
+
+  void begin(ClipCache *cache) { _cache = cache; }
+  void pathFor(int slot, char *buf, size_t len) const;
+
+  bool ready(int h12) const { return state(BELL) == ClipCache::READY && state(h12) == ClipCache::READY; }
+  int nextToLoad(int h12) const; // slot still to decode for this hour, -1 if none
+  const ClipSequence *compose(int h12);
+  // Count the plays of the chime's clips with the cache (and keep them warm)
+  void played(int h12);
+
+private:
+  ClipCache *_cache = nullptr;
+  ClipSequence _seq[12];
+  uint32_t _seqVersion[12] = {};
+  bool _seqBuilt[12] = {};
+
+  ClipCache::State state(int slot) const;
+};
+
+#endif // CHIME_COMPOSER_H
@@ -0,0 +1,171 @@
+#include "ClipCache.h"
+
+int ClipCache::find(const char *path) const {
+  for (int i = 0; i < ENTRIES; ++i) {
+    if (_e[i].state != EMPTY && !_e[i].stale && strcmp(_e[i].path, path) == 0) return i;
+  }
+  return -1;
+}
+
+const PcmClip *ClipCache::get(const char *path, uint32_t uses) {
+  int i = find(path);
+  if (i < 0 || _e[i].state != READY) return nullptr;
+  _e[i].lastUse = ++_clock;
+  _hits.fetch_add(uses, std::memory_order_relaxed);
+  _savedBytes += (uint64_t)_e[i].fileBytes * uses;
+  _savedKB.store((uint32_t)(_savedBytes / 1024), std::memory_order_relaxed);
+  return &_e[i].clip;
+}
+
+const PcmClip *ClipCache::peek(const char *path) const {
+  int i = find(path);
+  return i >= 0 && _e[i].state == READY ? &_e[i].clip : nullptr;
+}
+
+ClipCache::State ClipCache::state(const char *path) const {
+  int i = find(path);
+  return i >= 0 ? _e[i].state : EMPTY;
+}
+
+bool ClipCache::inUse(const ClipSequence *seq, const PcmClip *clip) {
+  if (!seq) return false;
+  for (int k = 0; k < seq->count; ++k) {
+    if (seq->seg[k].clip == clip) return true;
+  }
+  return false;
+}
+
+// A removed clip that has stopped playing, else the least recently used
+// clip that may go; -1 if none
+int ClipCache::victim(const ClipSequence *playing, const char *keep) const {
+  int lru = -1;
+  for (int i = 0; i < ENTRIES; ++i) {
+    const Entry &e = _e[i];
+    if (e.state != READY || e.pinned || inUse(playing, &e.clip)) continue;
+    if (e.stale) return i;
+    if (keep && strcmp(e.path, keep) == 0) continue;
+    if (lru < 0 || (int32_t)(e.lastUse - _e[lru].lastUse) < 0) lru = i;
+  }
+  return lru;
+}
+
+PcmClip *ClipCache::reserve(const char *path, size_t maxBytes, const ClipSequence *playing,
+                            const char *keep) {
+  if (strlen(path) >= PATH_LEN || maxBytes > _budget) return nullptr;
+  int i = find(path);
+  if (i >= 0) {
+    if (_e[i].state == LOADING || _e[i].pinned) return nullptr;
+    drop(i, playing);
+  }
+
+  // Room in the budget, then a free entry, oldest clips first
+  while (true) {
+    size_t used = 0;
+    int free = -1;
+    for (int k = 0; k < ENTRIES; ++k) {
+      const Entry &e = _e[k];
+      if (e.state == LOADING) used += e.reserved;
+      else if (e.state == READY) used += e.clip.bytes();
+      else if (free < 0 || (_e[free].state == FAILED && e.state == EMPTY)) free = k;
+    }
+    if (used + maxBytes <= _budget && free >= 0) {
+      i = free;
+      break;
+    }
+    int v = victim(playing, keep);
+    if (v < 0) return nullptr;
+    if (!_e[v].stale) {
+      Serial.printf("ClipCache: evicting %s (%u bytes)\n", _e[v].path, (unsigned)_e[v].clip.bytes());
+      _evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+    release(v);
+  }
+
+  Entry &e = _e[i];
+  if (!e.clip.allocate(maxBytes)) {
+    Serial.printf("ClipCache: no memory to decode %s (%u bytes)\n", path, (unsigned)maxBytes);
+    e.state = EMPTY;
+    return nullptr;
+  }
+  snprintf(e.path, sizeof(e.path), "%s", path);
+  e.state = LOADING;
+  e.pinned = false;
+  e.lastUse = ++_clock;
+  e.fileBytes = 0;
+  e.reserved = maxBytes;
+  changed();
+  return &e.clip;
+}
+
+void ClipCache::loaded(const char *path, bool ok, uint32_t fileBytes) {
+  int i = find(path);
+  if (i < 0 || _e[i].state != LOADING) return;
+  Entry &e = _e[i];
+  if (ok) e.clip.finish();
+  if (ok && e.clip.valid()) {
+    e.state = READY;
+    e.fileBytes = fileBytes;
+  } else {
+    e.clip.release();
+    e.state = FAILED;
+  }
+  e.reserved = 0;
+  changed();
+}
+
+void ClipCache::cancel(const char *path) {
+  int i = find(path);
+  if (i >= 0 && _e[i].state == LOADING) release(i);
+}
+
+void ClipCache::pin(const char *path) {
+  int i = find(path);
+  if (i >= 0) _e[i].pinned = true;
+}
+
+void ClipCache::remove(const char *path, const ClipSequence *playing) {
+  int i = find(path);
+  if (i >= 0 && _e[i].state != LOADING && !_e[i].pinned) drop(i, playing);
+}
+
+void ClipCache::clearFailures() {
+  for (int i = 0; i < ENTRIES; ++i) {
+    if (_e[i].state == FAILED) _e[i].state = EMPTY;
+  }
+  changed();
+}
+
+// The mixer may be reading a clip right now: that one is set aside instead
+void ClipCache::drop(int i, const ClipSequence *playing) {
+  if (_e[i].state == READY && inUse(playing, &_e[i].clip)) {
+    _e[i].stale = true;
+    changed();
+  } else {
+    release(i);
+  }
+}
+
+void ClipCache::release(int i) {
+  Entry &e = _e[i];
+  e.clip.release();
+  e.state = EMPTY;
+  e.pinned = false;
+  e.stale = false;
+  e.reserved = 0;
+  changed();
+}
+
+void ClipCache::changed() {
+  _version++;
+  size_t used = 0;
+  uint32_t n = 0;
+  for (int i = 0; i < ENTRIES; ++i) {
+    if (_e[i].state == LOADING) used += _e[i].reserved;
+    if (_e[i].state == READY) {
+      used += _e[i].clip.bytes();
+      n++;
+    }
+  }
+  _bytes.store((uint32_t)used, std::memory_order_relaxed);
+  _count.store(n, std::memory_order_relaxed);
+}
@@ -0,0 +1,93 @@
+#ifndef CLIP_CACHE_H
+#define CLIP_CACHE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "PcmClip.h"
+#include "ClipSequence.h"
+
+// Short files (bell, hour numbers, greeting, anything small that gets
+// started) kept decoded in memory under one byte budget, so each is read
+// from SD and decoded once. When a new clip needs room the least recently
+// used ones go first; pinned clips, clips still loading and clips the mixer
+// is playing are never evicted.
+//
+// Used from the audio task only (and at boot before it starts); the
+// counters can be read from anywhere.
+class ClipCache {
+public:
+  enum State : uint8_t { EMPTY, LOADING, READY, FAILED };
+  static const int ENTRIES = 24;
+  static const size_t PATH_LEN = 64;
+
+  void begin(size_t budgetBytes) { _budget = budgetBytes; }
+
+  // Decoded clip for `path`, or nullptr. get() marks it used and counts
+  // `uses` hits (a chime plays the bell several times); peek() doesn't.
+  const PcmClip *get(const char *path, uint32_t uses = 1);
+  const PcmClip *peek(const char *path) const;
+  State state(const char *path) const;
+  void countMiss() { _misses.fetch_add(1, std::memory_order_relaxed); }
+
+  // Clip to decode `path` into, with maxBytes of room made by evicting.
+  // `playing` and `keep` are spared; an older copy of `path` that is playing
+  // is set aside like remove() does. nullptr if no room can be made.
+  PcmClip *reserve(const char *path, size_t maxBytes, const ClipSequence *playing,
+                   const char *keep = nullptr);
+  // Decoding finished: READY, or FAILED so it isn't tried again. fileBytes
+  // is what each later hit saves reading from SD.
+  void loaded(const char *path, bool ok, uint32_t fileBytes);
+  // Decoding abandoned (deck needed elsewhere); tried again when next wanted
+  void cancel(const char *path);
+  void pin(const char *path); // never evicted
+  // File deleted or replaced. A clip `playing` still reads is only set aside:
+  // nothing finds it any more, and it is released once it has stopped, when
+  // room is next made.
+  void remove(const char *path, const ClipSequence *playing);
+  void clearFailures();
+
+  // Changes whenever a clip comes or goes; sequences built earlier may point
+  // at clips that no longer exist
+  uint32_t version() const { return _version; }
+
+  size_t budget() const { return _budget; }
+  uint32_t bytes() const { return _bytes.load(std::memory_order_relaxed); }
+  uint32_t count() const { return _count.load(std::memory_order_relaxed); }
+  uint32_t hits() const { return _hits.load(std::memory_order_relaxed); }
+  uint32_t misses() const { return _misses.load(std::memory_order_relaxed); }
+  uint32_t evictions() const { return _evictions.load(std::memory_order_relaxed); }
+  uint32_t savedKB() const { return _savedKB.load(std::memory_order_relaxed); }
+
+private:
+  struct Entry {
+    char path[PATH_LEN];
+    PcmClip clip;
+    State state = EMPTY;
+    bool pinned = false;
+    bool stale = false; // removed while playing
+    uint32_t lastUse = 0;
+    uint32_t fileBytes = 0;
+    size_t reserved = 0; // held while LOADING, before the clip is trimmed
+  };
+
+  Entry _e[ENTRIES];
+  size_t _budget = 0;
+  uint32_t _clock = 0;
+  uint32_t _version = 0;
+  std::atomic<uint32_t> _bytes{0};
+  std::atomic<uint32_t> _count{0};
+  std::atomic<uint32_t> _hits{0};
+  std::atomic<uint32_t> _misses{0};
+  std::atomic<uint32_t> _evictions{0};
+  std::atomic<uint32_t> _savedKB{0};
+  uint64_t _savedBytes = 0; // SD reads avoided by hits
+
+  int find(const char *path) const;
+  int victim(const ClipSequence *playing, const char *keep) const;
+  void release(int i);
+  void drop(int i, const ClipSequence *playing);
+  void changed();
+  static bool inUse(const ClipSequence *seq, const PcmClip *clip);
+};
+
+#endif // CLIP_CACHE_H
@@ -0,0 +1,223 @@
+#include "ClipFile.h"
+
+static const int16_t STEPS[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,    19,    21,    23,
+    25,    28,    31,    34,    37,    41,    45,    50,    55,    60,    66,    73,    80,
+    88,    97,    107,   118,   130,   143,   157,   173,   190,   209,   230,   253,   279,
+    307,   337,   371,   408,   449,   494,   544,   598,   658,   724,   796,   876,   963,
+    1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,  2272,  2499,  2749,  3024,  3327,
+    3660,  4026,  4428,  4871,  5358,  5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+static const int8_t INDEX_ADJUST[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+// One block at a time, on the audio task (or at boot)
+static uint8_t s_block[4096];
+
+int16_t ClipFile::Adpcm::decode(uint8_t nibble) {
+  int32_t step = STEPS[index];
+  int32_t diff = step >> 3;
+  if (nibble & 4) diff += step;
+  if (nibble & 2) diff += step >> 1;
+  if (nibble & 1) diff += step >> 2;
+  predictor += (nibble & 8) ? -diff : diff;
+  if (predictor > 32767) predictor = 32767;
+  if (predictor < -32768) predictor = -32768;
+  index += INDEX_ADJUST[nibble & 7];
+  if (index < 0) index = 0;
+  if (index > 88) index = 88;
+  return (int16_t)predictor;
+}
+
+uint8_t ClipFile::Adpcm::encode(int16_t s) {
+  int32_t step = STEPS[index];
+  int32_t diff = s - predictor;
+  uint8_t nibble = 0;
+  if (diff < 0) {
+    nibble = 8;
+    diff = -diff;
+  }
+  if (diff >= step) {
+    nibble |= 4;
+    diff -= step;
+  }
+  step >>= 1;
+  if (diff >= step) {
+    nibble |= 2;
+    diff -= step;
+  }
+  step >>= 1;
+  if (diff >= step) nibble |= 1;
+  decode(nibble); // track exactly what the decoder will reconstruct
+  return nibble;
+}
+
+// FNV-1a of the source path names the file
+String ClipFile::pathFor(const char *dir, const char *source) {
+  uint32_t h = 2166136261u;
+  for (const char *p = source; *p; ++p) {
+    h ^= (uint8_t)*p;
+    h *= 16777619u;
+  }
+  char name[16];
+  snprintf(name, sizeof(name), "/%08lx.clp", (unsigned long)h);
+  return String(dir) + name;
+}
+
+// ADPCM: per channel a 4-byte state (predictor, step index) then two
+// samples a byte. PCM16: interleaved samples.
+size_t ClipFile::blockBytes(uint8_t channels, uint8_t codec) {
+  if (codec == PCM16) return (size_t)BLOCK_FRAMES * channels * 2;
+  return (size_t)channels * (4 + BLOCK_FRAMES / 2);
+}
+
+bool ClipFile::beginLoad(fs::FS &fs, const char *file, uint32_t sourceBytes) {
+  abort();
+  _f = fs.open(file, FILE_READ);
+  if (!_f) return false;
+  Header h;
+  bool ok = _f.read((uint8_t *)&h, sizeof(h)) == sizeof(h) && h.magic == MAGIC &&
+            h.sourceBytes == sourceBytes && (h.channels == 1 || h.channels == 2) &&
+            h.codec <= IMA_ADPCM && h.blockFrames == BLOCK_FRAMES && h.rate > 0 && h.frames > 0;
+  if (!ok) {
+    _f.close();
+    fs.remove(file);
+    Serial.printf("ClipFile: %s is stale or damaged, removed\n", file);
+    return false;
+  }
+  _fs = &fs;
+  _file = file;
+  _rate = h.rate;
+  _frames = h.frames;
+  _channels = h.channels;
+  _codec = h.codec;
+  _next = 0;
+  _mode = LOADING;
+  return true;
+}
+
+ClipFile::Result ClipFile::load(PcmClip &clip, int blocks) {
+  if (_mode != LOADING) return FAILED;
+  if (_next == 0) clip.setSampleRate(_rate);
+  size_t bytes = blockBytes(_channels, _codec);
+  size_t half = 4 + BLOCK_FRAMES / 2; // ADPCM bytes per channel
+
+  for (int b = 0; b < blocks && _next < _frames; ++b) {
+    if (_f.read(s_block, bytes) != bytes) {
+      Serial.printf("ClipFile: %s is truncated\n", _file.c_str());
+      abort();
+      return FAILED;
+    }
+    // Each ADPCM block starts from the state in its header
+    Adpcm st[2];
+    for (int c = 0; c < _channels && _codec == IMA_ADPCM; ++c) {
+      const uint8_t *p = s_block + c * half;
+      st[c].predictor = (int16_t)(p[0] | (p[1] << 8));
+      st[c].index = p[2] > 88 ? 88 : p[2];
+    }
+    uint32_t n = _frames - _next < BLOCK_FRAMES ? _frames - _next : BLOCK_FRAMES;
+    for (uint32_t i = 0; i < n; ++i) {
+      int16_t s[2];
+      for (int c = 0; c < _channels; ++c) {
+        if (_codec == PCM16) {
+          const uint8_t *p = s_block + (i * _channels + c) * 2;
+          s[c] = (int16_t)(p[0] | (p[1] << 8));
+        } else {
+          uint8_t v = s_block[c * half + 4 + i / 2];
+          s[c] = st[c].decode((i & 1) ? v >> 4 : v & 0x0F);
+        }
+      }
+      if (_channels == 1) s[1] = s[0];
+      if (!clip.append((uint32_t)(uint16_t)s[0] | ((uint32_t)(uint16_t)s[1] << 16))) {
+        abort(); // longer than the clip may be
+        return FAILED;
+      }
+    }
+    _next += n;
+  }
+  if (_next < _frames) return BUSY;
+  _f.close();
+  _mode = IDLE;
+  return DONE;
+}
+
+bool ClipFile::beginSave(fs::FS &fs, const char *file, const PcmClip &clip, uint32_t sourceBytes) {
+  abort();
+  if (!clip.valid()) return false;
+  _fs = &fs;
+  _file = file;
+  _f = fs.open(_file + ".tmp", FILE_WRITE);
+  if (!_f) {
+    Serial.printf("ClipFile: cannot write %s.tmp\n", file);
+    return false;
+  }
+  _channels = clip.format() == PcmClip::MULAW_MONO ? 1 : 2;
+  _codec = IMA_ADPCM;
+  _frames = (uint32_t)clip.frames();
+  Header h = {MAGIC, sourceBytes, clip.sampleRate(), _frames, _channels, _codec, BLOCK_FRAMES};
+  if (_f.write((const uint8_t *)&h, sizeof(h)) != sizeof(h)) {
+    _f.close();
+    fs.remove(_file + ".tmp");
+    return false;
+  }
+  _state[0] = Adpcm();
+  _state[1] = Adpcm();
+  _next = 0;
+  _mode = SAVING;
+  return true;
+}
+
+ClipFile::Result ClipFile::save(const PcmClip &clip, int blocks) {
+  if (_mode != SAVING) return FAILED;
+  size_t bytes = blockBytes(_channels, IMA_ADPCM);
+  size_t half = 4 + BLOCK_FRAMES / 2;
+
+  for (int b = 0; b < blocks && _next < _frames; ++b) {
+    memset(s_block, 0, bytes);
+    for (int c = 0; c < _channels; ++c) {
+      uint8_t *p = s_block + c * half;
+      p[0] = (uint8_t)(_state[c].predictor & 0xFF);
+      p[1] = (uint8_t)((_state[c].predictor >> 8) & 0xFF);
+      p[2] = (uint8_t)_state[c].index;
+    }
+    // The last block is padded with silence
+    for (uint32_t i = 0; i < BLOCK_FRAMES; ++i) {
+      uint32_t k = _next + i;
+      uint32_t frame = k < _frames ? clip.frameAt(k) : 0;
+      for (int c = 0; c < _channels; ++c) {
+        int16_t s = (int16_t)(c == 0 ? frame & 0xFFFF : frame >> 16);
+        uint8_t nibble = _state[c].encode(s);
+        s_block[c * half + 4 + i / 2] |= (i & 1) ? nibble << 4 : nibble;
+      }
+    }
+    if (_f.write(s_block, bytes) != bytes) {
+      Serial.printf("ClipFile: write to %s.tmp failed\n", _file.c_str());
+      abort();
+      return FAILED;
+    }
+    _next += BLOCK_FRAMES;
+  }
+  if (_next < _frames) return BUSY;
+  return finishSave() ? DONE : FAILED;
+}
+
+// Swap the complete file in for any earlier version
+bool ClipFile::finishSave() {
+  _f.close();
+  _mode = IDLE;
+  String tmp = _file + ".tmp";
+  _fs->remove(_file);
+  if (!_fs->rename(tmp, _file)) {
+    Serial.printf("ClipFile: cannot rename %s\n", tmp.c_str());
+    _fs->remove(tmp);
+    return false;
+  }
+  Serial.printf("ClipFile: wrote %s, %u frames\n", _file.c_str(), (unsigned)_frames);
+  return true;
+}
+
+void ClipFile::abort() {
+  if (_mode == IDLE) return;
+  _f.close();
+  if (_mode == SAVING) _fs->remove(_file + ".tmp");
+  _mode = IDLE;
+}
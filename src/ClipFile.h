@@ -0,0 +1,78 @@
+#ifndef CLIP_FILE_H
+#define CLIP_FILE_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "PcmClip.h"
+
+// Short sounds saved in a native form that loads without the MP3 decoder:
+// a 20-byte header, then blocks of raw 16-bit PCM or IMA-ADPCM (4 bits a
+// sample, a few shifts and adds each to decode). AudioManager writes ADPCM
+// the first time it decodes a short MP3 and loads that from then on; raw
+// PCM files made elsewhere load too.
+//
+// Files live in one directory, named by a hash of the source path, and
+// record the source's size so a replaced MP3 is converted again. Both
+// directions run a few blocks at a time so playback never waits on them;
+// one ClipFile does one transfer at a time.
+class ClipFile {
+public:
+  enum Codec : uint8_t { PCM16 = 0, IMA_ADPCM = 1 };
+  enum Result : uint8_t { BUSY, DONE, FAILED };
+
+  static String pathFor(const char *dir, const char *source);
+
+  // Open `file` for reading. False if it is missing; one made from another
+  // version of the source, or damaged, is also deleted.
+  bool beginLoad(fs::FS &fs, const char *file, uint32_t sourceBytes);
+  // Append the next `blocks` blocks to `clip` (allocated, empty, the same
+  // clip every call). The caller finishes the clip on DONE.
+  Result load(PcmClip &clip, int blocks);
+
+  // Write `clip` as ADPCM to a temporary file that replaces `file` once
+  // complete. The clip must stay alive, unchanged, until DONE.
+  bool beginSave(fs::FS &fs, const char *file, const PcmClip &clip, uint32_t sourceBytes);
+  Result save(const PcmClip &clip, int blocks);
+
+  void abort();
+  bool busy() const { return _mode != IDLE; }
+
+private:
+  struct Header {
+    uint32_t magic;
+    uint32_t sourceBytes;
+    uint32_t rate;
+    uint32_t frames;
+    uint8_t channels;
+    uint8_t codec;
+    uint16_t blockFrames;
+  };
+  static const uint32_t MAGIC = 0x31504C43; // "CLP1"
+  static const uint16_t BLOCK_FRAMES = 1024;
+
+  // ADPCM coder state for one channel
+  struct Adpcm {
+    int32_t predictor = 0;
+    int32_t index = 0;
+    uint8_t encode(int16_t s);
+    int16_t decode(uint8_t nibble);
+  };
+
+  enum Mode : uint8_t { IDLE, LOADING, SAVING };
+
+  fs::FS *_fs = nullptr;
+  File _f;
+  String _file;
+  Mode _mode = IDLE;
+  uint32_t _next = 0;   // next frame to transfer
+  uint32_t _frames = 0;
+  uint32_t _rate = 0;
+  uint8_t _channels = 0;
+  uint8_t _codec = IMA_ADPCM;
+  Adpcm _state[2];      // encoder, carried from block to block
+
+  bool finishSave();
+  static size_t blockBytes(uint8_t channels, uint8_t codec);
+};
+
+#endif // CLIP_FILE_H
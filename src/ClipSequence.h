@@ -0,0 +1,75 @@
+#ifndef CLIP_SEQUENCE_H
+#define CLIP_SEQUENCE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "PcmClip.h"
+
+// In-memory clips strung together with exact silences between them, played
+// by the mixer as one continuous stream. A single clip is a one-segment
+// sequence. The clips are referenced, not copied, so building one is cheap.
+struct ClipSequence {
+  static const int MAX_SEGMENTS = 16;
+
+  struct Segment {
+    const PcmClip *clip;
+    uint32_t leadFrames; // silence before the clip
+  };
+
+  Segment seg[MAX_SEGMENTS];
+  int count = 0;
+  uint32_t rate = 0;
+  size_t totalFrames = 0;
+
+  void clear() {
+    count = 0;
+    rate = 0;
+    totalFrames = 0;
+  }
+
+  // All clips must share one sample rate; leadMs is converted at that rate
+  bool add(const PcmClip *clip, uint32_t leadMs = 0) {
+    if (!clip || !clip->valid() || count >= MAX_SEGMENTS) return false;
+    if (rate == 0) rate = clip->sampleRate();
+    if (clip->sampleRate() != rate) return false;
+    uint32_t lead = (uint32_t)((uint64_t)leadMs * rate / 1000);
+    seg[count].clip = clip;
+    seg[count].leadFrames = lead;
+    count++;
+    totalFrames += lead + clip->frames();
+    return true;
+  }
+
+  uint32_t durationMs() const { return rate ? (uint32_t)((uint64_t)totalFrames * 1000 / rate) : 0; }
+
+  // Sequential read position
+  struct Cursor {
+    int index = 0;
+    size_t pos = 0; // within the current segment, lead included
+    size_t done = 0;
+
+    void rewind() { index = 0; pos = 0; done = 0; }
+
+    uint32_t next(const ClipSequence &s) {
+      while (index < s.count) {
+        const Segment &g = s.seg[index];
+        if (pos < g.leadFrames) {
+          pos++;
+          done++;
+          return 0;
+        }
+        size_t k = pos - g.leadFrames;
+        if (k < g.clip->frames()) {
+          pos++;
+          done++;
+          return g.clip->frameAt(k);
+        }
+        index++;
+        pos = 0;
+      }
+      return 0;
+    }
+  };
+};
+
+#endif // CLIP_SEQUENCE_H
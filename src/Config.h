@@ -14,6 +14,7 @@
 #define SD_SCK 25
 #define SD_MISO 32
 #define SD_MOSI 33
+#define SD_MOUNT "/sd" // where SD.begin() puts the card in the VFS
 
 // Motion Sensor
 #define PIR_PIN 26
@@ -35,17 +36,128 @@
 #define DEFAULT_VOLUME 11
 #define DHUN_SESSION_TIMEOUT_MS (5UL * 60UL * 1000UL)
 #define STATE_CHECK_INTERVAL_MS 120
+#define PREFETCH_LEAD_SEC 15 // open the next dhun this long before the current one ends
 
 // Hourly chime config
 #define CHIME_START_HOUR 6 // inclusive, 24h format
 #define CHIME_END_HOUR 23  // inclusive, 24h format
 #define CHIME_WINDOW_SEC 5 // trigger window at top of hour (seconds)
+#define CHIME_PREPARE_MINUTE 55 // start decoding the next chime's clips
+#define CHIME_BELL_GAP_MS 250   // silence between bells
+#define CHIME_NUMBER_GAP_MS 600 // silence before each hour number
+#define CHIME_VOLUME 21
+#define CHIME_DUCK_DB -15     // a playing track is lowered this much under the chime
+#define CHIME_DUCK_RAMP_MS 400 // and ramped down and back up over this long
+#define VOLUME_RAMP_MS 20 // de-click ramp for volume changes, starts and stops
 
 // Audio file paths (must exist on SD)
 #define GREETING_PATH "/jay-swaminarayan.mp3"
 #define BELL_PATH "/digital_clock/bell.mp3"
 #define HOURS_DIR "/digital_clock/hours/"
 
+// Without PSRAM the RAM budgets below are sized at boot (HeapBudget.h):
+// HEAP_RESERVE_BYTES of the free heap is left for what is allocated later
+// (two MP3 decoders, the web server and its connections, SD buffers), and
+// each budget takes its *_HEAP_PERCENT of the rest, up to its *_RAM_BYTES.
+// An esp32dev with WiFi up has ~230 KB free when the budgets are set, so
+// ~134 KB is shared out.
+#define HEAP_RESERVE_BYTES (96 * 1024)
+
+// Clips decoded into memory, at most this much each. Without PSRAM they are
+// stored compact, and one may take up to half the clip cache.
+#define CLIP_RAM_BUDGET_BYTES (64 * 1024)
+#define CLIP_PSRAM_BUDGET_BYTES (1024 * 1024)
+#define CLIP_DECODE_TIMEOUT_MS 10000
+#define GREETING_LATENCY_TARGET_US 50000 // PIR edge to first I2S sample
+
+// All decoded clips together (greeting, bell, hour numbers, other short
+// files), least recently used evicted first
+#define CLIP_CACHE_RAM_BYTES (160 * 1024)
+#define CLIP_CACHE_HEAP_PERCENT 35
+#define CLIP_CACHE_PSRAM_BYTES (3 * 1024 * 1024)
+#define CLIP_CACHE_MAX_FILE_BYTES (256 * 1024) // files up to this size are kept decoded once played
+
+// Short files are also saved as ADPCM clip files the first time they are
+// decoded, and load from those without the MP3 decoder. Blocks of 1024
+// frames moved per pass of the audio task.
+#define CLIP_FILE_DIR "/clips"
+#define CLIP_FILE_LOAD_BLOCKS 4
+#define CLIP_FILE_START_BLOCKS 32 // a start waits on the load, nothing else plays
+#define CLIP_FILE_SAVE_BLOCKS 2
+
+// Folders in the library; the first is where uploads go
+#define DHUN_DIR "/dhun"
+#define LIBRARY_FOLDERS {DHUN_DIR, "/bhajan", "/kirtan", "/festival"}
+// Which folder plays from each hour until the next entry's (wrapping past
+// midnight); a folder with nothing in it falls back to DHUN_DIR
+#define PLAYLIST_SCHEDULE {{5, "/bhajan"}, {9, DHUN_DIR}, {18, "/kirtan"}, {21, DHUN_DIR}}
+
+// Shuffle: each track of the folder plays once before any repeats, and none
+// comes back within SHUFFLE_NO_REPEAT plays (half the folder, if fewer) when
+// the next round starts.
+// Files copied on in the last SHUFFLE_NEW_DAYS are weighted to come up sooner.
+#define SHUFFLE_DIR "/shuffle"
+#define SHUFFLE_NO_REPEAT 8
+#define SHUFFLE_NEW_DAYS 7
+#define SHUFFLE_NEW_WEIGHT 4.0f
+
+// Play history: a ring of 16-byte records on SD (256 KB), written a batch at
+// a time; a batch still in RAM after HISTORY_FLUSH_MS is written anyway
+#define HISTORY_PATH "/history.log"
+#define HISTORY_MAX_RECORDS 16384
+#define HISTORY_BATCH 16
+#define HISTORY_FLUSH_MS (5 * 60 * 1000UL)
+#define HISTORY_NAME_PROBE 8 // list entries either side of where a track was, looked at to name it
+
+// A track that fails to start this many times in a row is left out of random
+// play until it plays, is uploaded again or is released on /api/quarantine
+#define HEALTH_PATH "/health.idx"
+#define HEALTH_QUARANTINE_FAILS 3
+
+// What is known about each dhun (size, date, length, bitrate, rate), so a
+// boot lists the folder instead of opening every file
+#define LIBRARY_INDEX_PATH "/library.idx"
+// The list in memory, ~45 bytes a file plus its tags: ~700 files in RAM
+// (more on a board with heap to spare), 5000+ with PSRAM.
+// A scan builds a second list, so it briefly needs up to twice this.
+#define LIBRARY_RAM_BYTES (64 * 1024)
+#define LIBRARY_HEAP_PERCENT 25 // each list
+#define LIBRARY_PSRAM_BYTES (512 * 1024)
+// Scans run a slice per loop: at most this many names listed, new files
+// probed, or index records written
+#define LIBRARY_SCAN_NAMES_PER_STEP 32
+#define LIBRARY_SCAN_PROBES_PER_STEP 2
+#define LIBRARY_SAVE_RECORDS_PER_STEP 64
+#define LIBRARY_PUBLISH_EVERY 16 // with no index, new files appear this many at a time
+// Search index over names and tags. Without room for it (or while it is
+// rebuilt after a change) a search checks every entry, still in memory.
+#define LIBRARY_SEARCH_RAM_BYTES (24 * 1024)
+#define LIBRARY_SEARCH_HEAP_PERCENT 10
+#define LIBRARY_SEARCH_PSRAM_BYTES (512 * 1024)
+// Uploads and deletes since the index was written; it is rewritten after
+// this many
+#define LIBRARY_JOURNAL_PATH "/library.jnl"
+#define LIBRARY_JOURNAL_MAX 64
+
+// Loudness normalisation: each dhun is measured once in the background and
+// played back at this mean level
+#define LOUDNESS_INDEX_PATH "/loudness.idx"
+#define LOUDNESS_TARGET_DB -18.0f // dBFS
+#define LOUDNESS_MAX_BOOST_DB 6.0f
+#define LOUDNESS_MAX_CUT_DB 12.0f
+#define LOUDNESS_DECODE_TIMEOUT_MS (5UL * 60UL * 1000UL)
+#define LOUDNESS_SCAN_INTERVAL_MS 5000
+
+// Seek indexes, one per MP3, built the first time a track plays so the chime
+// can resume it where it broke off
+#define SEEK_INDEX_DIR "/seek"
+#define SEEK_MAX_DISCARD_SEC 5 // decode at most this much ahead of a resume point
+
+// Audio task: decoding, mixing and I2S output, off the Arduino loop (core 1)
+#define AUDIO_TASK_CORE 0
+#define AUDIO_TASK_PRIORITY 10
+#define AUDIO_TASK_STACK 12288
+
 // WiFi Configuration
 #define WIFI_SSID "error"          // Replace with your WiFi network name
 #define WIFI_PASSWORD "bharat@123" // Replace with your WiFi password
@@ -0,0 +1,39 @@
+#include "DirReader.h"
+#include <sys/stat.h>
+
+bool DirReader::open(const char *mount, const char *path) {
+  close();
+  char full[256];
+  int n = snprintf(full, sizeof(full), "%s%s", mount, path);
+  if (n < 0 || (size_t)n >= sizeof(full)) return false;
+  struct stat st;
+  if (::stat(full, &st) != 0 || !S_ISDIR(st.st_mode)) return false;
+  _dir = opendir(full);
+  if (!_dir) return false;
+  memcpy(_path, full, n + 1);
+  _pathLen = n;
+  return true;
+}
+
+void DirReader::close() {
+  if (_dir) closedir(_dir);
+  _dir = nullptr;
+}
+
+const char *DirReader::next(bool &isDir) {
+  if (!_dir) return nullptr;
+  struct dirent *e = readdir(_dir);
+  if (!e) return nullptr;
+  isDir = e->d_type == DT_DIR;
+  return e->d_name;
+}
+
+bool DirReader::stat(const char *name, uint32_t &size, uint32_t &mtime) const {
+  char full[sizeof(_path) + 128];
+  if (!_dir || (size_t)snprintf(full, sizeof(full), "%s/%s", _path, name) >= sizeof(full)) return false;
+  struct stat st;
+  if (::stat(full, &st) != 0) return false;
+  size = (uint32_t)st.st_size;
+  mtime = (uint32_t)st.st_mtime;
+  return true;
+}
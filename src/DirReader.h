@@ -0,0 +1,33 @@
+#ifndef DIR_READER_H
+#define DIR_READER_H
+
+#include <Arduino.h>
+#include <dirent.h>
+
+// A directory's names straight from its entries: readdir() on the VFS mount,
+// which is f_readdir underneath. Unlike File::openNextFile() nothing is
+// opened for an entry and nothing is allocated; a name is only valid until
+// the next call.
+class DirReader {
+public:
+  ~DirReader() { close(); }
+
+  // `path` as the FS sees it, under `mount` (where the FS is in the VFS)
+  bool open(const char *mount, const char *path);
+  void close();
+  bool isOpen() const { return _dir != nullptr; }
+
+  // The next entry's name, nullptr at the end
+  const char *next(bool &isDir);
+
+  // Size and last write of an entry of the open directory, from a stat() of
+  // it: FAT looks the name up in the directory, nothing is opened
+  bool stat(const char *name, uint32_t &size, uint32_t &mtime) const;
+
+private:
+  DIR *_dir = nullptr;
+  char _path[256] = ""; // mount and path, as opened
+  size_t _pathLen = 0;
+};
+
+#endif // DIR_READER_H
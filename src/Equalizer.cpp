@@ -0,0 +1,150 @@
+#include "Equalizer.h"
+#include <math.h>
+
+const uint32_t Equalizer::RATE_LIST[RATES] = {8000, 11025, 16000, 22050, 24000, 32000, 44100, 48000};
+
+// Bass, mid and treble of the old 3-band control are bands 0, 4 and 7
+const Equalizer::Band Equalizer::DEFAULT_BANDS[BANDS] = {
+  {60, 0, 7, LOW_SHELF},
+  {170, 0, 10, PEAK},
+  {310, 0, 10, PEAK},
+  {600, 0, 10, PEAK},
+  {1000, 0, 10, PEAK},
+  {3000, 0, 10, PEAK},
+  {6000, 0, 10, PEAK},
+  {12000, 0, 7, HIGH_SHELF},
+};
+
+static int32_t toQ28(double v) { return (int32_t)lrint(v * (double)(1 << 28)); }
+
+void Equalizer::clampBand(Band &b) {
+  if (b.freq < 20) b.freq = 20;
+  if (b.freq > 20000) b.freq = 20000;
+  if (b.gainDb < -12) b.gainDb = -12;
+  if (b.gainDb > 12) b.gainDb = 12;
+  if (b.q10 < 3) b.q10 = 3;
+  if (b.q10 > 80) b.q10 = 80;
+}
+
+// RBJ audio EQ cookbook biquads, computed for every rate in RATE_LIST
+void Equalizer::design(const Band *bands, Table &t) {
+  t.active = 0;
+  for (int i = 0; i < BANDS; ++i) {
+    const Band &b = bands[i];
+    if (b.gainDb != 0) t.active |= (uint8_t)(1u << i);
+
+    for (int r = 0; r < RATES; ++r) {
+      Coeffs &c = t.c[r][i];
+      double fs = RATE_LIST[r];
+      if (b.gainDb == 0 || b.freq >= fs * 0.45) {
+        // Flat, or too close to Nyquist to shape at this rate
+        c.b0 = toQ28(1.0);
+        c.b1 = c.b2 = c.a1 = c.a2 = 0;
+        continue;
+      }
+
+      double A = pow(10.0, b.gainDb / 40.0);
+      double w0 = 2.0 * M_PI * b.freq / fs;
+      double cw = cos(w0);
+      double alpha = sin(w0) / (2.0 * (b.q10 / 10.0));
+      double b0, b1, b2, a0, a1, a2;
+
+      switch (b.type) {
+      case LOW_SHELF: {
+        double sq = 2.0 * sqrt(A) * alpha;
+        b0 = A * ((A + 1) - (A - 1) * cw + sq);
+        b1 = 2 * A * ((A - 1) - (A + 1) * cw);
+        b2 = A * ((A + 1) - (A - 1) * cw - sq);
+        a0 = (A + 1) + (A - 1) * cw + sq;
+        a1 = -2 * ((A - 1) + (A + 1) * cw);
+        a2 = (A + 1) + (A - 1) * cw - sq;
+        break;
+      }
+      case HIGH_SHELF: {
+        double sq = 2.0 * sqrt(A) * alpha;
+        b0 = A * ((A + 1) + (A - 1) * cw + sq);
+        b1 = -2 * A * ((A - 1) + (A + 1) * cw);
+        b2 = A * ((A + 1) + (A - 1) * cw - sq);
+        a0 = (A + 1) - (A - 1) * cw + sq;
+        a1 = 2 * ((A - 1) - (A + 1) * cw);
+        a2 = (A + 1) - (A - 1) * cw - sq;
+        break;
+      }
+      default:
+        b0 = 1 + alpha * A;
+        b1 = -2 * cw;
+        b2 = 1 - alpha * A;
+        a0 = 1 + alpha / A;
+        a1 = -2 * cw;
+        a2 = 1 - alpha / A;
+        break;
+      }
+
+      c.b0 = toQ28(b0 / a0);
+      c.b1 = toQ28(b1 / a0);
+      c.b2 = toQ28(b2 / a0);
+      c.a1 = toQ28(a1 / a0);
+      c.a2 = toQ28(a2 / a0);
+    }
+  }
+}
+
+void Equalizer::setTable(const Table *t) {
+  uint8_t was = _table ? _table->active : 0;
+  _table = t;
+  uint8_t now = t ? t->active : 0;
+  for (int i = 0; i < BANDS; ++i) {
+    if ((now & (1u << i)) && !(was & (1u << i))) {
+      _state[i][0] = State();
+      _state[i][1] = State();
+    }
+  }
+}
+
+void Equalizer::setSampleRate(uint32_t rate) {
+  // Nearest supported rate
+  int best = 0;
+  uint32_t bestDiff = UINT32_MAX;
+  for (int r = 0; r < RATES; ++r) {
+    uint32_t d = rate > RATE_LIST[r] ? rate - RATE_LIST[r] : RATE_LIST[r] - rate;
+    if (d < bestDiff) {
+      bestDiff = d;
+      best = r;
+    }
+  }
+  if (best != _rateIdx) {
+    _rateIdx = best;
+    reset();
+  }
+}
+
+void Equalizer::reset() {
+  for (int i = 0; i < BANDS; ++i) {
+    _state[i][0] = State();
+    _state[i][1] = State();
+  }
+}
+
+void Equalizer::process(uint32_t *frames, size_t n) {
+  if (!_table || !_table->active || _rateIdx < 0) return;
+  const Coeffs *row = _table->c[_rateIdx];
+  uint8_t active = _table->active;
+
+  for (size_t k = 0; k < n; ++k) {
+    uint32_t f = frames[k];
+    int32_t l = (int32_t)(int16_t)(f & 0xFFFF) << 8;
+    int32_t r = (int32_t)(int16_t)(f >> 16) << 8;
+    for (int i = 0; i < BANDS; ++i) {
+      if (!(active & (1u << i))) continue;
+      l = run(row[i], _state[i][0], l);
+      r = run(row[i], _state[i][1], r);
+    }
+    l >>= 8;
+    r >>= 8;
+    if (l > 32767) l = 32767;
+    if (l < -32768) l = -32768;
+    if (r > 32767) r = 32767;
+    if (r < -32768) r = -32768;
+    frames[k] = (uint32_t)(uint16_t)l | ((uint32_t)(uint16_t)r << 16);
+  }
+}
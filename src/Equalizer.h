@@ -0,0 +1,74 @@
+#ifndef EQUALIZER_H
+#define EQUALIZER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Parametric equalizer on the mixed output: a cascade of biquads in fixed
+// point (Q28 coefficients, 64-bit accumulate, samples carried with 8 extra
+// bits), one filter state per stereo channel.
+//
+// Coefficients are designed with floating point by the control side, for
+// every supported sample rate at once, into a Table. The audio side only
+// looks up the row for its rate and runs integer math; bands at 0 dB are
+// skipped, so a flat EQ costs nothing.
+class Equalizer {
+public:
+  static const int BANDS = 8;
+  static const int RATES = 8;
+
+  enum Type : uint8_t { PEAK, LOW_SHELF, HIGH_SHELF };
+
+  struct Band {
+    uint16_t freq;  // Hz
+    int8_t gainDb;  // -12..12
+    uint8_t q10;    // Q x 10, 3..80
+    Type type;
+  };
+
+  struct Coeffs {
+    int32_t b0, b1, b2, a1, a2; // Q28, a0 normalised to 1
+  };
+
+  struct Table {
+    Coeffs c[RATES][BANDS];
+    uint8_t active = 0; // bit i set when band i is not flat
+  };
+
+  static const uint32_t RATE_LIST[RATES];
+  static const Band DEFAULT_BANDS[BANDS];
+
+  // Not for the audio path: uses sin/cos/pow
+  static void design(const Band *bands, Table &t);
+  static void clampBand(Band &b);
+
+  // Switch to a new table; filters that were bypassed start from silence
+  void setTable(const Table *t);
+  void setSampleRate(uint32_t rate);
+  void reset();
+
+  // In place, packed 16-bit stereo frames
+  void process(uint32_t *frames, size_t n);
+
+private:
+  struct State {
+    int32_t x1, x2, y1, y2;
+  };
+
+  const Table *_table = nullptr;
+  int _rateIdx = -1;
+  State _state[BANDS][2] = {};
+
+  static inline int32_t run(const Coeffs &c, State &s, int32_t x) {
+    int64_t acc = (int64_t)c.b0 * x + (int64_t)c.b1 * s.x1 + (int64_t)c.b2 * s.x2 -
+                  (int64_t)c.a1 * s.y1 - (int64_t)c.a2 * s.y2;
+    int32_t y = (int32_t)(acc >> 28);
+    s.x2 = s.x1;
+    s.x1 = x;
+    s.y2 = s.y1;
+    s.y1 = y;
+    return y;
+  }
+};
+
+#endif // EQUALIZER_H
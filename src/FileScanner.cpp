@@ -1,102 +1,772 @@
 #include "FileScanner.h"
 #include "SD.h"
+#include "Config.h"
+#include "SeekIndex.h"
+#include "HeapBudget.h"
+#include "LoudnessIndex.h"
+#include "esp_heap_caps.h"
+#include <algorithm>
 
-// Ensure valid normalized absolute path
-String FileScanner::normalize(const String &dir, const String &name) {
-  String d = dir;
-  if (!d.startsWith("/")) d = "/" + d;
-  if (d.endsWith("/")) d.remove(d.length() - 1, 1);
-
-  String n = name;
-  if (n.startsWith("/")) n = n.substring(1);
-
-  // If name starts with "dhun/" then remove prefix, so result becomes "/dhun/file.mp3"
-  int slashPos = n.indexOf('/');
-  if (slashPos > 0) {
-    String first = n.substring(0, slashPos);
-    if (first.equalsIgnoreCase("dhun")) {
-      n = n.substring(slashPos + 1);
-    }
+String FileScanner::PathView::str() const {
+  String s;
+  s.reserve(strlen(dir) + 1 + strlen(name));
+  s += dir;
+  s += '/';
+  s += name;
+  return s;
+}
+
+bool FileScanner::PathView::copy(char *buf, size_t len) const {
+  int n = snprintf(buf, len, "%s/%s", dir, name);
+  return n >= 0 && (size_t)n < len;
+}
+
+FileScanner::~FileScanner() {
+  _dir.close();
+  if (_out) _out.close();
+  clear(_gens[0]);
+  clear(_gens[1]);
+}
+
+void FileScanner::begin(fs::FS &fs, const char *mount) {
+  _fs = &fs;
+  _mount = mount;
+  _psram = psramFound();
+  _budget = _psram ? LIBRARY_PSRAM_BYTES : heapShare(LIBRARY_HEAP_PERCENT, LIBRARY_RAM_BYTES);
+  size_t search = _psram ? LIBRARY_SEARCH_PSRAM_BYTES : heapShare(LIBRARY_SEARCH_HEAP_PERCENT, LIBRARY_SEARCH_RAM_BYTES);
+  _search.begin(_psram, search);
+  Serial.printf("FileScanner: %u bytes for each list, %u for search\n", (unsigned)_budget, (unsigned)search);
+}
+
+bool FileScanner::isMp3(const char *name, size_t len) {
+  return len > 4 && strcasecmp(name + len - 4, ".mp3") == 0;
+}
+
+void FileScanner::clear(Generation &g) {
+  free(g.entries);
+  free(g.pool);
+  g.entries = nullptr;
+  g.pool = nullptr;
+  g.count = g.cap = 0;
+  g.poolUsed = g.poolCap = 0;
+  for (int f = 0; f < MAX_FOLDERS; ++f) g.first[f] = g.runs[f] = 0;
+}
+
+void *FileScanner::resize(void *p, size_t bytes) {
+  return _psram ? heap_caps_realloc(p, bytes, MALLOC_CAP_SPIRAM) : realloc(p, bytes);
+}
+
+// Room for `entries` entries and `poolBytes` of names, doubling as needed
+// but never past the budget
+bool FileScanner::reserve(Generation &g, int entries, size_t poolBytes) {
+  int cap = g.cap ? g.cap : 64;
+  while (cap < entries) cap *= 2;
+  size_t poolCap = g.poolCap ? g.poolCap : 2048;
+  while (poolCap < poolBytes) poolCap *= 2;
+  if (cap * sizeof(Entry) + poolCap > _budget) {
+    // What is left, exactly
+    cap = entries > g.cap ? entries : g.cap;
+    poolCap = poolBytes > g.poolCap ? poolBytes : g.poolCap;
+    if (cap * sizeof(Entry) + poolCap > _budget) return false;
+  }
+  if (cap != g.cap) {
+    Entry *e = (Entry *)resize(g.entries, cap * sizeof(Entry));
+    if (!e) return false;
+    g.entries = e;
+    g.cap = cap;
+  }
+  if (poolCap != g.poolCap) {
+    char *p = (char *)resize(g.pool, poolCap);
+    if (!p) return false;
+    g.pool = p;
+    g.poolCap = poolCap;
   }
+  return true;
+}
 
-  return d + "/" + n;
+// Four NUL-terminated strings, exactly `len` bytes, the name not empty
+bool FileScanner::validRecord(const char *rec, size_t len) {
+  size_t at = 0;
+  for (int k = 0; k < 4; ++k) {
+    const char *end = (const char *)memchr(rec + at, 0, len - at);
+    if (!end || (k == 0 && end == rec)) return false;
+    at = end - rec + 1;
+    if (k < 3 && at >= len) return false;
+  }
+  return at == len;
 }
 
-void FileScanner::scanFolder(const char *dirname) {
+size_t FileScanner::recordLen(const char *rec) {
+  const char *p = rec;
+  for (int k = 0; k < 4; ++k) p += strlen(p) + 1;
+  return p - rec;
+}
+
+// `out` has room for MAX_RECORD bytes; the name fits in MAX_PATH_LEN
+size_t FileScanner::packRecord(char *out, const char *name, const Id3Tags &tags) {
+  size_t n = 0;
+  const char *parts[4] = {name, tags.title, tags.artist, tags.album};
+  for (const char *s : parts) {
+    size_t k = strlen(s) + 1;
+    memcpy(out + n, s, k);
+    n += k;
+  }
+  return n;
+}
+
+bool FileScanner::append(Generation &g, int folder, const char *rec, size_t n, const TrackInfo &info) {
+  if (g.poolUsed + n > OFFSET_MASK) return false;
+  if (!reserve(g, g.count + 1, g.poolUsed + n)) return false;
+  memcpy(g.pool + g.poolUsed, rec, n);
+  g.entries[g.count].name = (uint32_t)g.poolUsed | ((uint32_t)folder << FOLDER_SHIFT);
+  g.entries[g.count].info = info;
+  g.poolUsed += n;
+  g.count++;
+  return true;
+}
+
+// Where `name` is, or would go, in the folder's (sorted) run: a binary
+// search. An empty folder's place is after the last folder before it.
+int FileScanner::lowerBound(const Generation &g, int folder, const char *name) const {
+  int lo = 0, hi = 0;
+  if (g.runs[folder]) {
+    lo = g.first[folder];
+    hi = lo + g.runs[folder];
+  } else {
+    for (int f = 0; f < folder; ++f)
+      if (g.runs[f]) lo = hi = g.first[f] + g.runs[f];
+  }
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (strcmp(nameAt(g, mid), name) < 0) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+int FileScanner::find(const Generation &g, int folder, const char *name) const {
+  int i = lowerBound(g, folder, name);
+  bool hit = i < g.first[folder] + g.runs[folder] && g.runs[folder] && strcmp(nameAt(g, i), name) == 0;
+  return hit ? i : -1;
+}
+
+// Into its place in a sorted list (replacing one of the same name, in the
+// same place); the record goes on the end of the pool. Nothing changes if
+// that doesn't fit, so a replaced entry is never lost to the budget.
+bool FileScanner::insertEntry(Generation &g, int folder, const char *rec, size_t len, const TrackInfo &info) {
+  int old = find(g, folder, rec);
+  if (!append(g, folder, rec, len, info)) return false;
+  Entry e = g.entries[--g.count];
+  if (old >= 0) {
+    g.entries[old] = e;
+    return true;
+  }
+  int at = lowerBound(g, folder, rec);
+  memmove(&g.entries[at + 1], &g.entries[at], (g.count - at) * sizeof(Entry));
+  g.entries[at] = e;
+  g.count++;
+  if (!g.runs[folder]) g.first[folder] = at;
+  g.runs[folder]++;
+  for (int f = folder + 1; f < MAX_FOLDERS; ++f) g.first[f]++;
+  return true;
+}
+
+// Its name stays in the pool until the list is next packed
+bool FileScanner::removeEntry(Generation &g, int folder, const char *name) {
+  int i = find(g, folder, name);
+  if (i < 0) return false;
+  memmove(&g.entries[i], &g.entries[i + 1], (g.count - 1 - i) * sizeof(Entry));
+  g.count--;
+  g.runs[folder]--;
+  for (int f = folder + 1; f < MAX_FOLDERS; ++f) g.first[f]--;
+  return true;
+}
+
+// Sort by folder and name, pack the names into a fresh pool in list order
+// and note where each folder's run is
+void FileScanner::sortAndPack(Generation &g) {
+  const char *pool = g.pool;
+  std::sort(g.entries, g.entries + g.count, [pool](const Entry &a, const Entry &b) {
+    if ((a.name >> FOLDER_SHIFT) != (b.name >> FOLDER_SHIFT)) return a.name < b.name;
+    return strcmp(pool + (a.name & OFFSET_MASK), pool + (b.name & OFFSET_MASK)) < 0;
+  });
+
+  for (int f = 0; f < MAX_FOLDERS; ++f) g.first[f] = g.runs[f] = 0;
+  size_t bytes = 0;
+  for (int i = 0; i < g.count; ++i) {
+    int f = folderAt(g, i);
+    if (!g.runs[f]) g.first[f] = i;
+    g.runs[f]++;
+    bytes += recordLen(nameAt(g, i));
+  }
+
+  char *packed = (char *)(_psram ? ps_malloc(bytes ? bytes : 1) : malloc(bytes ? bytes : 1));
+  if (!packed) return; // the old pool, gaps and all, still holds every name
+  size_t pos = 0;
+  for (int i = 0; i < g.count; ++i) {
+    size_t n = recordLen(nameAt(g, i));
+    memcpy(packed + pos, nameAt(g, i), n);
+    g.entries[i].name = (uint32_t)pos | (g.entries[i].name & ~OFFSET_MASK);
+    pos += n;
+  }
+  free(g.pool);
+  g.pool = packed;
+  g.poolUsed = bytes;
+  g.poolCap = bytes ? bytes : 1;
+}
+
+size_t FileScanner::memoryUsed() const {
+  return (_gens[0].cap + _gens[1].cap) * sizeof(Entry) + _gens[0].poolCap + _gens[1].poolCap + _search.memoryUsed();
+}
+
+// Readers see a new list: the search index is rebuilt for it once the
+// scanner is idle, and searches check every entry until then
+void FileScanner::published() {
+  _search.clear();
+  _searchStale = true;
+}
+
+int FileScanner::addFolder(const char *dirname) {
+  String path = dirname;
+  while (path.length() > 1 && path.endsWith("/")) path.remove(path.length() - 1);
+  int id = folderId(path.c_str());
+  if (id >= 0) return id;
+  if (_folderCount == MAX_FOLDERS) {
+    Serial.printf("FileScanner: no room for folder %s\n", path.c_str());
+    return -1;
+  }
+  _folders[_folderCount].path = path;
+  _folders[_folderCount].count = 0;
+  _folders[_folderCount].nameHash = 0;
+  return _folderCount++;
+}
+
+int FileScanner::folderId(const char *dirname) const {
+  for (int f = 0; f < _folderCount; ++f)
+    if (_folders[f].path == dirname) return f;
+  return -1;
+}
+
+const char *FileScanner::folderPath(int folder) const {
+  return validFolder(folder) ? _folders[folder].path.c_str() : "";
+}
+
+// The index is read with the first request, so the list is whole from the
+// start when there is one
+void FileScanner::requestScan(uint32_t folders) {
   if (!_fs) return;
+  if (!_indexLoaded) {
+    _indexLoaded = true;
+    loadIndex();
+    loadJournal();
+  }
+  _pending |= folders;
+}
 
-  String d = String(dirname);
-  Serial.print("Scanning folder: ");
-  Serial.println(d);
+void FileScanner::scanFolder(const char *dirname) {
+  int id = addFolder(dirname);
+  if (id >= 0) requestScan(1u << id);
+}
 
-  File root = _fs->open(d);
-  if (!root || !root.isDirectory()) {
-    Serial.println("  ❌ Cannot open directory");
+void FileScanner::rescan() {
+  // The first folder is where uploads go; make sure it exists
+  if (_fs && _folderCount && !_fs->exists(_folders[0].path)) {
+    Serial.printf("  %s missing → creating...\n", _folders[0].path.c_str());
+    _fs->mkdir(_folders[0].path);
+  }
+
+  requestScan((1u << _folderCount) - 1);
+}
+
+void FileScanner::loop() {
+  if (_phase == PHASE_IDLE && _pending) startScan();
+  if (_phase == PHASE_IDLE && _journalCount >= LIBRARY_JOURNAL_MAX) {
+    _phase = PHASE_SAVE; // fold the journal into the index
+    _saveAt = -1;
+  }
+  if (_phase == PHASE_IDLE && !_pending && _searchStale) {
+    _searchStale = false;
+    _search.build(_pub->count, searchText, this);
     return;
   }
+  if (_phase == PHASE_LIST) listStep();
+  else if (_phase == PHASE_SAVE) saveStep();
+}
+
+void FileScanner::closeFiles() {
+  if (_phase == PHASE_LIST) {
+    _dir.close();
+    _pending |= _scanning;
+    clear(*_build);
+    _phase = PHASE_IDLE;
+  } else if (_phase == PHASE_SAVE) {
+    if (_out) _out.close();
+    _saveAt = -1;
+  }
+}
 
-  File file = root.openNextFile();
-  while (file) {
-    if (!file.isDirectory()) {
-      String raw  = String(file.name());
-      String full = normalize(d, raw);
+// The new list starts with what is kept of the published one: every folder
+// not being scanned, as it is
+void FileScanner::startScan() {
+  _scanning = _pending;
+  _pending = 0;
+  _known = _pub->count > 0;
+  _before = _kept = _added = _skipped = _sincePublish = 0;
+  _changed = false;
+  _t0 = millis();
+  clear(*_build);
+  for (int i = 0; i < _pub->count; ++i) {
+    int f = folderAt(*_pub, i);
+    if (_scanning & (1u << f)) _before++;
+    else if (!append(*_build, f, nameAt(*_pub, i), recordLen(nameAt(*_pub, i)), _pub->entries[i].info)) _skipped++;
+  }
+  _phase = PHASE_LIST;
+  _folder = -1;
+  nextFolder();
+}
 
-      Serial.print("  file: ");
-      Serial.println(full);
+// Open the next folder of the scan, or finish the list when there is none
+void FileScanner::nextFolder() {
+  _dir.close();
+  while (++_folder < _folderCount) {
+    if (!(_scanning & (1u << _folder))) continue;
+    Folder &dir = _folders[_folder];
+    if (_dir.open(_mount, dir.path.c_str())) {
+      _listCount = _listHash = 0;
+      return;
+    }
+    Serial.printf("FileScanner: cannot open %s\n", dir.path.c_str());
+  }
+  finishList();
+}
+
+// Names from the directory entries, and a stat() of each file the published
+// list already has: nothing is opened (or allocated) for one whose size and
+// date haven't changed. A call lists at most
+// LIBRARY_SCAN_NAMES_PER_STEP names and probes at most
+// LIBRARY_SCAN_PROBES_PER_STEP new or changed files.
+void FileScanner::listStep() {
+  int probes = 0;
+  for (int n = 0; n < LIBRARY_SCAN_NAMES_PER_STEP && probes < LIBRARY_SCAN_PROBES_PER_STEP; ++n) {
+    bool isDir = false;
+    const char *name = _dir.next(isDir);
+    if (!name) {
+      endFolder();
+      nextFolder();
+      return;
+    }
+    if (isDir || !isMp3(name, strlen(name))) continue;
+    _listCount++;
+    _listHash += LoudnessIndex::hashPath(name);
 
-      if (full.endsWith(".mp3") || full.endsWith(".MP3")) {
-        if (_dhunCount < MAX_DHUN) {
-          _dhunFiles[_dhunCount++] = full;
-          Serial.print("    🎵 Added: ");
-          Serial.println(full);
-        } else {
-          Serial.println("    ⚠ dhun list full, skipping");
-        }
+    // A known name is only kept if the file is the one probed: a file
+    // copied over another of the same name is probed again
+    int i = _known ? find(*_pub, _folder, name) : -1;
+    uint32_t size, mtime;
+    const TrackInfo *was = i >= 0 ? &_pub->entries[i].info : nullptr;
+    if (was && (!_dir.stat(name, size, mtime) || size != was->size || mtime != was->mtime)) i = -1;
+    bool ok;
+    if (i >= 0) {
+      const char *rec = nameAt(*_pub, i);
+      ok = append(*_build, _folder, rec, recordLen(rec), _pub->entries[i].info);
+      if (ok) _kept++;
+    } else {
+      TrackInfo info;
+      Id3Tags tags;
+      char rec[MAX_RECORD];
+      char path[MAX_PATH_LEN];
+      int len = snprintf(path, sizeof(path), "%s/%s", _folders[_folder].path.c_str(), name);
+      if (len < 0 || (size_t)len >= sizeof(path)) continue; // too long to be played
+      probes++;
+      if (!probe(path, info, tags)) continue; // unreadable
+      ok = append(*_build, _folder, rec, packRecord(rec, name, tags), info);
+      if (ok) {
+        _added++;
+        _sincePublish++;
       }
     }
+    if (!ok) _skipped++;
+  }
+  if (!_known && _sincePublish >= LIBRARY_PUBLISH_EVERY) publishPartial();
+}
 
-    file.close();
-    file = root.openNextFile();
+// The folder was listed to its end: if it doesn't hold the names it held
+// last time, the index no longer describes it, whatever the list made of it
+// (files too long to play or unreadable are counted too)
+void FileScanner::endFolder() {
+  Folder &dir = _folders[_folder];
+  if (_listCount != dir.count || _listHash != dir.nameHash) {
+    dir.count = _listCount;
+    dir.nameHash = _listHash;
+    _changed = true;
   }
+}
+
+// A copy of what has been found so far, for a boot with no index
+void FileScanner::publishPartial() {
+  _sincePublish = 0;
+  clear(*_pub);
+  if (!reserve(*_pub, _build->count, _build->poolUsed)) return;
+  memcpy(_pub->entries, _build->entries, _build->count * sizeof(Entry));
+  memcpy(_pub->pool, _build->pool, _build->poolUsed);
+  _pub->count = _build->count;
+  _pub->poolUsed = _build->poolUsed;
+  sortAndPack(*_pub);
+  published();
+}
 
-  Serial.print("Scan finished. dhunCount = ");
-  Serial.println(_dhunCount);
+// Every folder listed: the new list replaces the published one
+void FileScanner::finishList() {
+  sortAndPack(*_build);
+  Generation *old = _pub;
+  _pub = _build;
+  _build = old;
+  clear(*_build);
+  published();
 
-  root.close();
+  int removed = _before - _kept;
+  if (_skipped) Serial.printf("FileScanner: library budget full, %d files skipped\n", _skipped);
+  for (int f = 0; f < _folderCount; ++f) {
+    if (_scanning & (1u << f)) Serial.printf("FileScanner: %s has %d files\n", _folders[f].path.c_str(), _pub->runs[f]);
+  }
+  Serial.printf("FileScanner: %d files (%d kept, %d new, %d gone), %u bytes, %lu ms\n",
+                _pub->count, _kept, _added, removed, (unsigned)memoryUsed(), millis() - _t0);
+
+  if (_added || removed || _changed) {
+    _phase = PHASE_SAVE;
+    _saveAt = -1;
+  } else {
+    _phase = PHASE_IDLE;
+  }
 }
 
-void FileScanner::rescan() {
-  _dhunCount = 0;
+// Size and date from the directory entry, format and length from the first
+// MP3 frame (and its Xing/Info or VBRI header if it is VBR), tags from ID3
+bool FileScanner::probe(const char *path, TrackInfo &info, Id3Tags &tags) {
+  File f = _fs->open(path, FILE_READ);
+  if (!f) return false;
+  if (f.isDirectory()) {
+    f.close();
+    return false;
+  }
+  info = TrackInfo();
+  info.size = f.size();
+  info.mtime = (uint32_t)f.getLastWrite();
+  tags.read(f);
+  info.durationMs = tags.lengthMs; // unless the frames say otherwise
+
+  // Find a frame whose successor also syncs, to skip false syncs in junk
+  uint32_t start = SeekIndex::audioStart(f);
+  uint8_t buf[1024];
+  size_t len = f.seek(start) ? f.read(buf, sizeof(buf)) : 0;
+  SeekIndex::FrameInfo fi = {};
+  size_t at = 0;
+  bool found = false;
+  while (!found && at + SeekIndex::PEEK <= len) {
+    if (SeekIndex::parseFrame(buf + at, fi)) {
+      SeekIndex::FrameInfo next;
+      found = at + fi.length + SeekIndex::PEEK > len || SeekIndex::parseFrame(buf + at + fi.length, next);
+    }
+    if (!found) at++;
+  }
+  f.close();
+  if (!found || info.size <= start + at) return true; // listed, length unknown
+
+  info.rate = (uint16_t)fi.rate;
+  info.kbps = (uint16_t)fi.kbps;
+  uint32_t audioBytes = info.size - start - at;
+
+  // VBR files say how many frames they have: "Xing"/"Info" after the side
+  // info, "VBRI" 32 bytes after the header
+  uint32_t frames = 0;
+  for (size_t k = at + 4; k + 12 <= len && k < at + 48; ++k) {
+    const uint8_t *p = buf + k;
+    if ((memcmp(p, "Xing", 4) == 0 || memcmp(p, "Info", 4) == 0) && (p[7] & 1)) {
+      frames = ((uint32_t)p[8] << 24) | ((uint32_t)p[9] << 16) | ((uint32_t)p[10] << 8) | p[11];
+      break;
+    }
+  }
+  if (at + 36 + 18 <= len && memcmp(buf + at + 36, "VBRI", 4) == 0) {
+    const uint8_t *p = buf + at + 36 + 14;
+    frames = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+  }
+
+  if (frames) {
+    info.durationMs = (uint32_t)((uint64_t)frames * fi.samples * 1000 / fi.rate);
+    if (info.durationMs) info.kbps = (uint16_t)((uint64_t)audioBytes * 8 / info.durationMs);
+  } else if (fi.kbps) {
+    info.durationMs = (uint32_t)((uint64_t)audioBytes * 8 / fi.kbps);
+  }
+  return true;
+}
+
+// "/dhun/x.mp3" into the folder's id and "x.mp3"; `path` is cut at the slash
+bool FileScanner::split(char *path, int &folder, const char *&name) const {
+  char *slash = strrchr(path, '/');
+  if (!slash || slash == path || !slash[1]) return false;
+  *slash = 0;
+  folder = folderId(path);
+  name = slash + 1;
+  return folder >= 0;
+}
+
+bool FileScanner::addFile(const char *path) {
+  char buf[MAX_PATH_LEN];
+  int folder;
+  const char *name;
+  if (!_fs || strlen(path) >= sizeof(buf)) return false;
+  strcpy(buf, path);
+  if (!split(buf, folder, name)) return false;
+  TrackInfo info;
+  Id3Tags tags;
+  char rec[MAX_RECORD];
+  if (!probe(path, info, tags)) return false;
+  size_t len = packRecord(rec, name, tags);
+  if (!insertEntry(*_pub, folder, rec, len, info)) return false;
+  journal(JOURNAL_ADD, path, &info, rec, len);
+  changed(folder);
+  return true;
+}
+
+bool FileScanner::removeFile(const char *path) {
+  char buf[MAX_PATH_LEN];
+  int folder;
+  const char *name;
+  if (!_fs || strlen(path) >= sizeof(buf)) return false;
+  strcpy(buf, path);
+  if (!split(buf, folder, name) || !removeEntry(*_pub, folder, name)) return false;
+  journal(JOURNAL_REMOVE, path, nullptr, nullptr, 0);
+  changed(folder);
+  return true;
+}
 
-  Serial.println("Rescanning SD...");
+// After a change to the published list: a scan in progress may have listed
+// the folder before it, so the folder is listed again after; an index being
+// written starts over
+void FileScanner::changed(int folder) {
+  published();
+  if (_phase == PHASE_LIST) _pending |= 1u << folder;
+  if (_phase == PHASE_SAVE) {
+    if (_out) _out.close();
+    _saveAt = -1;
+  }
+}
 
-  // Ensure folder exists
-  if (_fs && !_fs->exists("/dhun")) {
-    Serial.println("  /dhun missing → creating...");
-    _fs->mkdir("/dhun");
+// One record on the end of the journal
+void FileScanner::journal(uint8_t op, const char *path, const TrackInfo *info, const char *rec, size_t len) {
+  File f = _fs->open(LIBRARY_JOURNAL_PATH, FILE_APPEND);
+  uint8_t n = (uint8_t)strlen(path);
+  uint16_t recLen = (uint16_t)len;
+  bool ok = f && f.write(&op, 1) == 1 && f.write(&n, 1) == 1 && f.write((const uint8_t *)path, n) == n;
+  if (ok && info) {
+    ok = f.write((const uint8_t *)info, sizeof(TrackInfo)) == sizeof(TrackInfo) &&
+         f.write((const uint8_t *)&recLen, 2) == 2 && f.write((const uint8_t *)rec, len) == len;
   }
+  if (f) f.close();
+  if (!ok) Serial.println("FileScanner: could not write the library journal");
+  _journalCount++;
+}
 
-  scanFolder("/dhun");
+// Changes since the index was written, applied over it. Replaying one twice
+// does no harm, so a journal the index already includes is fine too.
+void FileScanner::loadJournal() {
+  File f = _fs->open(LIBRARY_JOURNAL_PATH, FILE_READ);
+  if (!f) return;
+  char path[256];
+  char rec[MAX_RECORD];
+  int n = 0;
+  while (true) {
+    uint8_t op = 0, len = 0;
+    uint16_t recLen = 0;
+    TrackInfo info;
+    if (f.read(&op, 1) != 1 || f.read(&len, 1) != 1 || f.read((uint8_t *)path, len) != len) break;
+    path[len] = 0;
+    if (op == JOURNAL_ADD &&
+        (f.read((uint8_t *)&info, sizeof(info)) != sizeof(info) || f.read((uint8_t *)&recLen, 2) != 2 ||
+         recLen > sizeof(rec) || f.read((uint8_t *)rec, recLen) != recLen || !validRecord(rec, recLen)))
+      break;
+    int folder;
+    const char *name;
+    if (split(path, folder, name)) {
+      if (op == JOURNAL_ADD) insertEntry(*_pub, folder, rec, recLen, info);
+      else removeEntry(*_pub, folder, name);
+    }
+    n++;
+  }
+  f.close();
+  _journalCount = n;
+  if (n) published();
+  if (n) Serial.printf("FileScanner: %d changes from the library journal\n", n);
+}
 
-  Serial.print("Rescan complete. Total dhun files = ");
-  Serial.println(_dhunCount);
+// One sequential pass over the file, a record at a time. Folders the
+// index has but the library no longer does are dropped.
+bool FileScanner::loadIndex() {
+  File f = _fs->open(LIBRARY_INDEX_PATH, FILE_READ);
+  if (!f) return false;
+  IndexHeader h;
+  bool ok = f.read((uint8_t *)&h, sizeof(h)) == sizeof(h) && h.magic == INDEX_MAGIC &&
+            h.folders <= MAX_FOLDERS && h.bytes >= h.count * (sizeof(TrackInfo) + 3 + 5);
+
+  char name[256];
+  char rec[MAX_RECORD];
+  int map[MAX_FOLDERS];
+  for (uint32_t i = 0; ok && i < h.folders; ++i) {
+    uint32_t count = 0, hash = 0;
+    uint8_t n = 0;
+    ok = f.read((uint8_t *)&count, 4) == 4 && f.read((uint8_t *)&hash, 4) == 4 && f.read(&n, 1) == 1 && n > 0 &&
+         f.read((uint8_t *)name, n) == n;
+    if (!ok) break;
+    name[n] = 0;
+    map[i] = folderId(name);
+    if (map[i] >= 0) {
+      _folders[map[i]].count = count;
+      _folders[map[i]].nameHash = hash;
+    }
+  }
+  // The records take the entry bytes less the fixed part
+  Generation &g = *_build;
+  clear(g);
+  ok = ok && reserve(g, (int)h.count, h.bytes - h.count * (sizeof(TrackInfo) + 3));
+
+  for (uint32_t i = 0; ok && i < h.count; ++i) {
+    TrackInfo info;
+    uint8_t folder = 0;
+    uint16_t n = 0;
+    ok = f.read((uint8_t *)&info, sizeof(info)) == sizeof(info) && f.read(&folder, 1) == 1 &&
+         folder < h.folders && f.read((uint8_t *)&n, 2) == 2 && n <= sizeof(rec) &&
+         f.read((uint8_t *)rec, n) == n && validRecord(rec, n);
+    if (!ok) break;
+    if (map[folder] >= 0) ok = append(g, map[folder], rec, n, info);
+  }
+  f.close();
+  if (!ok) {
+    Serial.println("FileScanner: library index unreadable, scanning everything");
+    clear(g);
+    for (int i = 0; i < _folderCount; ++i) _folders[i].count = _folders[i].nameHash = 0;
+    return false;
+  }
+  sortAndPack(g); // written sorted; this only checks
+  _build = _pub;
+  _pub = &g;
+  clear(*_build);
+  published();
+  return true;
 }
 
-int FileScanner::getCount(const char *dirname) {
-  if (String(dirname) == "/dhun") {
-    return _dhunCount;
+// To a temporary file that then replaces the old one, at most
+// LIBRARY_SAVE_RECORDS_PER_STEP records a call. The published list stays as
+// it is meanwhile: the next scan waits for this.
+void FileScanner::saveStep() {
+  String tmp = String(LIBRARY_INDEX_PATH) + ".tmp";
+  const Generation &g = *_pub;
+  if (_saveAt < 0) {
+    uint32_t bytes = 0;
+    for (int i = 0; i < g.count; ++i) bytes += sizeof(TrackInfo) + 3 + recordLen(nameAt(g, i));
+    _out = _fs->open(tmp, FILE_WRITE);
+    _saveOk = (bool)_out;
+    if (_saveOk) {
+      IndexHeader h = {INDEX_MAGIC, (uint32_t)g.count, (uint32_t)_folderCount, bytes};
+      _saveOk = _out.write((const uint8_t *)&h, sizeof(h)) == sizeof(h);
+    }
+    for (int i = 0; i < _folderCount && _saveOk; ++i) {
+      const Folder &dir = _folders[i];
+      uint8_t n = (uint8_t)dir.path.length();
+      _saveOk = _out.write((const uint8_t *)&dir.count, 4) == 4 && _out.write((const uint8_t *)&dir.nameHash, 4) == 4 &&
+                _out.write(&n, 1) == 1 &&
+                _out.write((const uint8_t *)dir.path.c_str(), n) == n;
+    }
+    _saveAt = 0;
+  }
+  for (int k = 0; k < LIBRARY_SAVE_RECORDS_PER_STEP && _saveOk && _saveAt < g.count; ++k, ++_saveAt) {
+    const char *rec = nameAt(g, _saveAt);
+    uint8_t folder = (uint8_t)folderAt(g, _saveAt);
+    uint16_t n = (uint16_t)recordLen(rec);
+    _saveOk = _out.write((const uint8_t *)&g.entries[_saveAt].info, sizeof(TrackInfo)) == sizeof(TrackInfo) &&
+              _out.write(&folder, 1) == 1 && _out.write((const uint8_t *)&n, 2) == 2 &&
+              _out.write((const uint8_t *)rec, n) == n;
+  }
+  if (_saveOk && _saveAt < g.count) return;
+
+  if (_out) _out.close();
+  _fs->remove(LIBRARY_INDEX_PATH);
+  if (!_saveOk || !_fs->rename(tmp, LIBRARY_INDEX_PATH)) {
+    Serial.println("FileScanner: could not write the library index");
+    _fs->remove(tmp);
+    _journalCount = 0; // kept, but not retried until the next scan
+  } else {
+    _fs->remove(LIBRARY_JOURNAL_PATH); // the index has it all now
+    _journalCount = 0;
   }
-  return 0;
+  _phase = PHASE_IDLE;
 }
 
-const String &FileScanner::getPath(const char *dirname, int index) {
-  static String empty = String();
+int FileScanner::getCount(int folder) const {
+  return validFolder(folder) ? _pub->runs[folder] : 0;
+}
 
-  if (String(dirname) == "/dhun") {
-    if (index >= 0 && index < _dhunCount)
-      return _dhunFiles[index];
-    return empty;
+FileScanner::PathView FileScanner::getPath(int folder, int index) const {
+  if (!validFolder(folder) || index < 0 || index >= _pub->runs[folder]) return PathView();
+  return pathAt(_pub->first[folder] + index);
+}
+
+const FileScanner::TrackInfo *FileScanner::getInfo(int folder, int index) const {
+  if (!validFolder(folder) || index < 0 || index >= _pub->runs[folder]) return nullptr;
+  return &_pub->entries[_pub->first[folder] + index].info;
+}
+
+const FileScanner::TrackInfo *FileScanner::infoAt(int index) const {
+  return index >= 0 && index < _pub->count ? &_pub->entries[index].info : nullptr;
+}
+
+FileScanner::TrackTags FileScanner::tagsAt(int index) const {
+  TrackTags t;
+  if (index >= 0 && index < _pub->count) {
+    const char *p = nameAt(*_pub, index);
+    t.title = p + strlen(p) + 1;
+    t.artist = t.title + strlen(t.title) + 1;
+    t.album = t.artist + strlen(t.artist) + 1;
   }
+  return t;
+}
 
-  return empty;
+int FileScanner::search(const char *query, int *out, int max) const {
+  return _search.search(query, _pub->count, searchText, (void *)this, out, max);
+}
+
+// What a search looks at: the folder, the name without its extension, and
+// the tags
+size_t FileScanner::searchText(int index, char *buf, size_t len, void *ctx) {
+  const FileScanner *s = static_cast<const FileScanner *>(ctx);
+  const Generation &g = *s->_pub;
+  const char *rec = nameAt(g, index);
+  char name[MAX_PATH_LEN];
+  snprintf(name, sizeof(name), "%s", rec);
+  char *dot = strrchr(name, '.');
+  if (dot) *dot = 0;
+
+  buf[0] = 0;
+  size_t n = SearchIndex::fold(s->_folders[folderAt(g, index)].path.c_str(), buf, len, 0);
+  n = SearchIndex::fold(name, buf, len, n);
+  for (const char *p = rec + strlen(rec) + 1, *end = rec + recordLen(rec); p < end; p += strlen(p) + 1)
+    n = SearchIndex::fold(p, buf, len, n);
+  return n;
+}
+
+int FileScanner::indexOf(const char *path) const {
+  char buf[MAX_PATH_LEN];
+  int folder;
+  const char *name;
+  if (strlen(path) >= sizeof(buf)) return -1;
+  strcpy(buf, path);
+  return split(buf, folder, name) ? find(*_pub, folder, name) : -1;
+}
+
+FileScanner::PathView FileScanner::pathAt(int index) const {
+  PathView v;
+  if (index >= 0 && index < _pub->count) {
+    v.dir = _folders[folderAt(*_pub, index)].path.c_str();
+    v.name = nameAt(*_pub, index);
+  }
+  return v;
 }
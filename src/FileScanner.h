@@ -3,26 +3,221 @@
 
 #include <Arduino.h>
 #include "FS.h"
+#include "DirReader.h"
+#include "Id3Tags.h"
+#include "SearchIndex.h"
 
+// The library: every file in a set of folders (dhun, bhajan, ...). What is
+// known about each file is kept in LIBRARY_INDEX_PATH, so a boot reads one
+// small file and lists the folders' names instead of opening every file;
+// only files the index doesn't know, or whose size or date has changed, are
+// opened and probed. Probing reads the
+// ID3 tags too, so title, artist and album come from the index as well, and
+// search() answers from memory.
+//
+// Folders are known by a small id (their order in addFolder). In memory the
+// list is two blocks, however many files there are: entries sorted by
+// folder then name, and one pool holding every name (without the folder,
+// which is kept once) and its title, artist and album, NUL-terminated. Both grow by doubling within
+// the budget set in begin() (see LIBRARY_HEAP_PERCENT). Each folder's entries are one
+// run of the list, so a count or a path by folder id is a lookup.
+//
+// Scans run in the background, a bounded slice per loop(). A scan builds a
+// second list and publishes it in one step when it is done, so readers
+// always see a whole list, never one half-built. With no index to start
+// from, the files found so far are published as the scan goes, so playback
+// can start before it finishes.
+//
+// Single files (an upload, a delete) are added and removed in place, without
+// a scan: a binary search and a move within the list, and one record
+// appended to LIBRARY_JOURNAL_PATH, which is replayed over the index at boot
+// and folded into it whenever the index is next written.
 class FileScanner {
 public:
-  static const int MAX_DHUN = 200;   // change if needed
+  static const size_t MAX_PATH_LEN = 128;
+  static const int MAX_FOLDERS = 16;
 
-  void begin(fs::FS &fs) { _fs = &fs; }
+  struct TrackInfo {
+    uint32_t size;
+    uint32_t mtime;
+    uint32_t durationMs; // 0 if no MP3 frame could be found
+    uint16_t kbps;       // average over the file
+    uint16_t rate;       // Hz
+  };
 
-  void scanFolder(const char *dirname);
-  void rescan();
+  // Title, artist and album from the file's tags, "" where there is none;
+  // valid as long as a PathView
+  struct TrackTags {
+    const char *title = "";
+    const char *artist = "";
+    const char *album = "";
+  };
 
-  int getCount(const char *dirname);
-  const String &getPath(const char *dirname, int index);
+  // A path in the list, without copying it: valid until the next loop(),
+  // addFile() or removeFile()
+  struct PathView {
+    const char *dir = "";  // no trailing slash
+    const char *name = "";
+    bool empty() const { return !*name; }
+    String str() const;
+    // NUL-terminated; false (and nothing usable) if it doesn't fit
+    bool copy(char *buf, size_t len) const;
+  };
+
+  ~FileScanner();
+  // `mount` is where `fs` is in the VFS, for listing folders without the FS
+  void begin(fs::FS &fs, const char *mount);
+
+  // Id of the folder (no trailing slash), added if new; -1 if the table is
+  // full. Add every folder before the first scan so the index keeps them.
+  int addFolder(const char *dirname);
+  int folderId(const char *dirname) const; // -1 if not in the library
+  int folderCount() const { return _folderCount; }
+  const char *folderPath(int folder) const;
+
+  // Queue a scan; the first one also loads the index
+  void scanFolder(const char *dirname); // adds it if new
+  void rescan();                        // every folder
+  void loop();                          // a slice of the scan, if one is running
+  bool scanning() const { return _phase != PHASE_IDLE || _pending; }
+  // Close what the scan has open (the card is about to be remounted): a
+  // listing starts over from the next loop(), an index being written too
+  void closeFiles();
+
+  // One file, by full path, added (or its details refreshed) or removed. False
+  // if it isn't in a library folder, or can't be read to be added.
+  bool addFile(const char *path);
+  bool removeFile(const char *path);
+
+  int getCount(int folder) const;
+  PathView getPath(int folder, int index) const;
+  const TrackInfo *getInfo(int folder, int index) const;
+  // The whole library, folder by folder
+  int totalCount() const { return _pub->count; }
+  PathView pathAt(int index) const;
+  int indexOf(const char *path) const; // for pathAt(), -1 if not listed
+  const TrackInfo *infoAt(int index) const;
+  TrackTags tagsAt(int index) const;
+  size_t memoryUsed() const;
+
+  // Entries with every word of `query` in their folder, name or tags (see
+  // SearchIndex), as indexes for pathAt(): up to `max` in `out`; returns how
+  // many match in all
+  int search(const char *query, int *out, int max) const;
 
 private:
+  struct Entry {
+    uint32_t name; // offset into the pool of its record, and folder id
+    TrackInfo info;
+  };
+  // A record is the name, title, artist and album, each NUL-terminated
+  static const size_t MAX_RECORD = MAX_PATH_LEN + 3 * Id3Tags::MAX_LEN;
+  static const uint32_t OFFSET_MASK = 0x00FFFFFFu;
+  static const int FOLDER_SHIFT = 24;
+
+  // What the folder held when last listed: its MP3 names, counted and
+  // hashed. FAT leaves a directory's date alone when entries come and go,
+  // so this is how a listing tells the index is stale.
+  struct Folder {
+    String path;
+    uint32_t count;
+    uint32_t nameHash; // sum of the names' hashes, whatever their order
+  };
+
+  struct Generation {
+    Entry *entries = nullptr;
+    int count = 0;
+    int cap = 0;
+    char *pool = nullptr;
+    size_t poolUsed = 0;
+    size_t poolCap = 0;
+    int first[MAX_FOLDERS] = {}; // each folder's run of the list
+    int runs[MAX_FOLDERS] = {};
+  };
+
+  enum Phase { PHASE_IDLE, PHASE_LIST, PHASE_SAVE };
+
   fs::FS *_fs = nullptr;
+  const char *_mount = "";
+  Folder _folders[MAX_FOLDERS];
+  int _folderCount = 0;
+  size_t _budget = 0; // for each list
+  bool _psram = false;
+  Generation _gens[2];
+  Generation *_pub = &_gens[0];   // what readers see
+  Generation *_build = &_gens[1]; // what the scan is building
+  bool _indexLoaded = false;
+
+  // The scan in progress
+  Phase _phase = PHASE_IDLE;
+  uint32_t _pending = 0;  // folders waiting for a scan, a bit each
+  uint32_t _scanning = 0; // folders in this one
+  int _folder = -1;       // being listed
+  DirReader _dir;
+  bool _known = false;    // the published list was whole when it started
+  bool _changed = false;
+  uint32_t _listCount = 0; // of the folder being listed
+  uint32_t _listHash = 0;
+  int _before = 0; // published entries of the folders being scanned
+  int _kept = 0;   // of those, still there
+  int _added = 0;
+  int _skipped = 0;
+  int _sincePublish = 0;
+  unsigned long _t0 = 0;
+  File _out; // index being written
+  int _saveAt = 0;
+  bool _saveOk = false;
+  int _journalCount = 0; // records since the index was written
+  SearchIndex _search;
+  bool _searchStale = false; // the list changed since it was built
 
-  String _dhunFiles[MAX_DHUN];
-  int    _dhunCount = 0;
+  struct IndexHeader {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t folders;
+    uint32_t bytes; // of the records that follow the folder table
+  };
+  // The folder table is the folder's MP3 count and name hash, a length byte
+  // and the path for each folder; each entry then is a TrackInfo, a folder
+  // byte, a 16-bit length and its record
+  static const uint32_t INDEX_MAGIC = 0x3542494C; // "LIB5"
+  // Each journal record is '+' or '-', a length byte and the full path; an
+  // addition then has a TrackInfo, a 16-bit length and the entry's record
+  static const uint8_t JOURNAL_ADD = '+';
+  static const uint8_t JOURNAL_REMOVE = '-';
 
-  String normalize(const String &dir, const String &name);
+  static const char *nameAt(const Generation &g, int i) { return g.pool + (g.entries[i].name & OFFSET_MASK); }
+  static int folderAt(const Generation &g, int i) { return (int)(g.entries[i].name >> FOLDER_SHIFT); }
+  bool validFolder(int folder) const { return folder >= 0 && folder < _folderCount; }
+  static bool isMp3(const char *name, size_t len);
+  static size_t recordLen(const char *rec);
+  static bool validRecord(const char *rec, size_t len);
+  static size_t packRecord(char *out, const char *name, const Id3Tags &tags);
+  static size_t searchText(int index, char *buf, size_t len, void *ctx);
+  bool append(Generation &g, int folder, const char *rec, size_t len, const TrackInfo &info);
+  bool reserve(Generation &g, int entries, size_t poolBytes);
+  void *resize(void *p, size_t bytes);
+  void clear(Generation &g);
+  void sortAndPack(Generation &g);
+  int lowerBound(const Generation &g, int folder, const char *name) const;
+  int find(const Generation &g, int folder, const char *name) const;
+  bool insertEntry(Generation &g, int folder, const char *rec, size_t len, const TrackInfo &info);
+  bool removeEntry(Generation &g, int folder, const char *name);
+  bool split(char *path, int &folder, const char *&name) const;
+  void changed(int folder);
+  void published();
+  void journal(uint8_t op, const char *path, const TrackInfo *info, const char *rec, size_t len);
+  void loadJournal();
+  void requestScan(uint32_t folders);
+  void startScan();
+  void nextFolder();
+  void endFolder();
+  void listStep();
+  void finishList();
+  void publishPartial();
+  void saveStep();
+  bool loadIndex();
+  bool probe(const char *path, TrackInfo &info, Id3Tags &tags);
 };
 
 #endif // FILE_SCANNER_H
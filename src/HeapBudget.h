@@ -0,0 +1,22 @@
+#ifndef HEAP_BUDGET_H
+#define HEAP_BUDGET_H
+
+#include <Arduino.h>
+#include "esp_heap_caps.h"
+#include "Config.h"
+
+// A RAM budget for a board without PSRAM, sized at boot from what the heap
+// has to spare: `percent` of the free heap less HEAP_RESERVE_BYTES, no more
+// than the largest free block, and at most `cap`. Budgets are limits, not
+// allocations, so each takes its share of the same spare heap whichever
+// begin() runs first.
+inline size_t heapShare(int percent, size_t cap) {
+  size_t free = ESP.getFreeHeap();
+  size_t spare = free > HEAP_RESERVE_BYTES ? free - HEAP_RESERVE_BYTES : 0;
+  size_t share = spare / 100 * percent;
+  size_t block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  if (share > block) share = block;
+  return share < cap ? share : cap;
+}
+
+#endif // HEAP_BUDGET_H
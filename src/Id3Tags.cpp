@@ -0,0 +1,155 @@
+#include "Id3Tags.h"
+
+namespace {
+
+// Append one code point as UTF-8 if it fits (with the NUL) in MAX_LEN
+void putUtf8(char *out, size_t &n, uint32_t cp) {
+  char b[4];
+  size_t k;
+  if (cp < 0x80) {
+    b[0] = (char)cp;
+    k = 1;
+  } else if (cp < 0x800) {
+    b[0] = (char)(0xC0 | (cp >> 6));
+    b[1] = (char)(0x80 | (cp & 0x3F));
+    k = 2;
+  } else {
+    b[0] = (char)(0xE0 | (cp >> 12));
+    b[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    b[2] = (char)(0x80 | (cp & 0x3F));
+    k = 3;
+  }
+  if (n + k >= Id3Tags::MAX_LEN) return;
+  memcpy(out + n, b, k);
+  n += k;
+  out[n] = 0;
+}
+
+uint32_t syncsafe(const uint8_t *p) {
+  return ((uint32_t)(p[0] & 0x7F) << 21) | ((uint32_t)(p[1] & 0x7F) << 14) | ((uint32_t)(p[2] & 0x7F) << 7) |
+         (p[3] & 0x7F);
+}
+
+uint32_t be32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Trailing spaces, which v1 pads with
+void trim(char *s) {
+  size_t n = strlen(s);
+  while (n && s[n - 1] == ' ') s[--n] = 0;
+}
+
+} // namespace
+
+void Id3Tags::clear() {
+  title[0] = artist[0] = album[0] = 0;
+  lengthMs = 0;
+}
+
+bool Id3Tags::read(File &f) {
+  clear();
+  bool v2 = readV2(f);
+  bool v1 = (!title[0] || !artist[0] || !album[0]) && readV1(f);
+  return v2 || v1;
+}
+
+bool Id3Tags::readV2(File &f) {
+  uint8_t buf[V2_READ];
+  if (!f.seek(0) || f.read(buf, 10) != 10 || memcmp(buf, "ID3", 3) != 0) return false;
+  uint8_t ver = buf[3];
+  uint8_t flags = buf[5];
+  if (ver < 2 || ver > 4 || (flags & 0x80)) return false; // unsynchronised tags are rare; not worth undoing
+  uint32_t size = syncsafe(buf + 6);
+  size_t len = f.read(buf, size < V2_READ ? size : V2_READ);
+
+  size_t at = 0;
+  if ((flags & 0x40) && ver >= 3 && len >= 4) {
+    // Extended header: v2.4 counts itself, v2.3 doesn't
+    at = ver == 4 ? syncsafe(buf) : be32(buf) + 4;
+  }
+  size_t head = ver == 2 ? 6 : 10;
+  bool any = false;
+  while (at + head <= len && buf[at]) {
+    char id[5] = {};
+    uint32_t n;
+    if (ver == 2) {
+      memcpy(id, buf + at, 3);
+      n = ((uint32_t)buf[at + 3] << 16) | ((uint32_t)buf[at + 4] << 8) | buf[at + 5];
+    } else {
+      memcpy(id, buf + at, 4);
+      n = ver == 4 ? syncsafe(buf + at + 4) : be32(buf + at + 4);
+    }
+    at += head;
+    if (n > len - at) break; // past what was read: text frames come first, so stop
+    frame(id, buf + at, n);
+    any = true;
+    at += n;
+  }
+  return any;
+}
+
+void Id3Tags::frame(const char *id, const uint8_t *p, size_t len) {
+  if (!strcmp(id, "TIT2") || !strcmp(id, "TT2")) text(p, len, title);
+  else if (!strcmp(id, "TPE1") || !strcmp(id, "TP1")) text(p, len, artist);
+  else if (!strcmp(id, "TALB") || !strcmp(id, "TAL")) text(p, len, album);
+  else if (!strcmp(id, "TLEN") || !strcmp(id, "TLE")) {
+    char s[MAX_LEN];
+    text(p, len, s);
+    lengthMs = (uint32_t)strtoul(s, nullptr, 10);
+  }
+}
+
+// A text frame: an encoding byte, then ISO-8859-1, UTF-16 with a BOM,
+// UTF-16BE or UTF-8. Only the first string of a list is kept.
+void Id3Tags::text(const uint8_t *p, size_t len, char *out) {
+  out[0] = 0;
+  if (len < 2) return;
+  uint8_t enc = p[0];
+  p++;
+  len--;
+  size_t n = 0;
+  if (enc == 0) {
+    latin1(p, len, out);
+  } else if (enc == 3) {
+    while (n < len && p[n] && n + 1 < MAX_LEN) n++;
+    // Don't cut a character in two
+    while (n && n < len && p[n] && (p[n] & 0xC0) == 0x80) n--;
+    memcpy(out, p, n);
+    out[n] = 0;
+  } else {
+    bool le = false;
+    if (enc == 1 && len >= 2) {
+      le = p[0] == 0xFF && p[1] == 0xFE;
+      p += 2;
+      len -= 2;
+    }
+    for (size_t i = 0; i + 1 < len; i += 2) {
+      uint32_t cp = le ? (p[i] | (p[i + 1] << 8)) : ((p[i] << 8) | p[i + 1]);
+      if (!cp) break;
+      if (cp >= 0xD800 && cp <= 0xDFFF) cp = '?'; // outside the BMP
+      putUtf8(out, n, cp);
+    }
+  }
+  trim(out);
+}
+
+void Id3Tags::latin1(const uint8_t *p, size_t len, char *out) {
+  size_t n = 0;
+  out[0] = 0;
+  for (size_t i = 0; i < len && p[i]; ++i) putUtf8(out, n, p[i]);
+  trim(out);
+}
+
+// The last 128 bytes: "TAG", then title, artist and album, 30 bytes each
+bool Id3Tags::readV1(File &f) {
+  size_t size = f.size();
+  uint8_t tag[128];
+  if (size < sizeof(tag) || !f.seek(size - sizeof(tag)) || f.read(tag, sizeof(tag)) != sizeof(tag) ||
+      memcmp(tag, "TAG", 3) != 0)
+    return false;
+  if (!title[0]) latin1(tag + 3, 30, title);
+  if (!artist[0]) latin1(tag + 33, 30, artist);
+  if (!album[0]) latin1(tag + 63, 30, album);
+  return true;
+}
@@ -0,0 +1,35 @@
+#ifndef ID3_TAGS_H
+#define ID3_TAGS_H
+
+#include <Arduino.h>
+#include "FS.h"
+
+// Title, artist and album of an MP3, from its ID3v2 tag (v2.2 to v2.4) or,
+// for what that doesn't have, its ID3v1 tag. Text is converted to UTF-8 and
+// cut to MAX_LEN - 1 bytes. Only the start of the v2 tag is read, where the
+// text frames are; pictures and the like after them are never loaded.
+class Id3Tags {
+public:
+  static const size_t MAX_LEN = 64;
+
+  char title[MAX_LEN];
+  char artist[MAX_LEN];
+  char album[MAX_LEN];
+  uint32_t lengthMs; // TLEN, 0 if there is none
+
+  Id3Tags() { clear(); }
+  void clear();
+  // Leaves the file position anywhere; false if there is no tag at all
+  bool read(File &f);
+
+private:
+  static const size_t V2_READ = 2048;
+
+  bool readV2(File &f);
+  bool readV1(File &f);
+  void frame(const char *id, const uint8_t *p, size_t len);
+  static void text(const uint8_t *p, size_t len, char *out);
+  static void latin1(const uint8_t *p, size_t len, char *out);
+};
+
+#endif // ID3_TAGS_H
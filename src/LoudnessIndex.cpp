@@ -0,0 +1,103 @@
+#include "LoudnessIndex.h"
+#include <math.h>
+
+void LoudnessIndex::begin(fs::FS &fs, const char *path) {
+  _fs = &fs;
+  _path = path;
+  _entries.clear();
+
+  File f = _fs->open(_path, FILE_READ);
+  if (!f) return;
+  uint32_t header[2];
+  if (f.read((uint8_t *)header, sizeof(header)) != sizeof(header) || header[0] != MAGIC) {
+    Serial.printf("LoudnessIndex: %s is not an index, ignoring it\n", path);
+    f.close();
+    return;
+  }
+  // The count must match the file's size exactly, and the hashes be sorted
+  size_t room = (f.size() - sizeof(header)) / sizeof(Entry);
+  if (header[1] != room || f.size() != sizeof(header) + room * sizeof(Entry)) {
+    Serial.printf("LoudnessIndex: %s holds %u entries, its header says %lu; ignoring it\n", path,
+                  (unsigned)room, (unsigned long)header[1]);
+    f.close();
+    return;
+  }
+  _entries.resize(room);
+  size_t want = room * sizeof(Entry);
+  bool ok = f.read((uint8_t *)_entries.data(), want) == want;
+  for (size_t i = 1; ok && i < room; ++i) ok = _entries[i - 1].hash < _entries[i].hash;
+  if (!ok) {
+    Serial.printf("LoudnessIndex: %s is damaged, ignoring it\n", path);
+    _entries.clear();
+  }
+  f.close();
+  Serial.printf("LoudnessIndex: %u tracks\n", (unsigned)_entries.size());
+}
+
+// FNV-1a
+uint32_t LoudnessIndex::hashPath(const char *track) {
+  uint32_t h = 2166136261u;
+  for (const char *p = track; *p; ++p) {
+    h ^= (uint8_t)*p;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+int LoudnessIndex::find(uint32_t hash) const {
+  int lo = 0, hi = (int)_entries.size();
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (_entries[mid].hash < hash) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo < (int)_entries.size() && _entries[lo].hash == hash) return lo;
+  return -(lo + 1);
+}
+
+bool LoudnessIndex::has(const char *track) const { return find(hashPath(track)) >= 0; }
+
+int16_t LoudnessIndex::gainCentiDb(const String &track) const {
+  int i = find(hashPath(track));
+  return i >= 0 ? _entries[i].centiDb : 0;
+}
+
+int32_t LoudnessIndex::toQ15(int16_t centiDb) {
+  return (int32_t)lroundf(32768.0f * powf(10.0f, centiDb / 2000.0f));
+}
+
+void LoudnessIndex::put(const String &track, int16_t centiDb, bool measured) {
+  Entry e = {hashPath(track), centiDb, (uint16_t)(measured ? FLAG_MEASURED : 0)};
+  int i = find(e.hash);
+  if (i >= 0) _entries[i] = e;
+  else _entries.insert(_entries.begin() + (-i - 1), e);
+}
+
+void LoudnessIndex::remove(const String &track) {
+  int i = find(hashPath(track));
+  if (i >= 0) _entries.erase(_entries.begin() + i);
+}
+
+// To a temporary file that then replaces the old one, so a cut leaves one
+// or the other whole
+bool LoudnessIndex::save() {
+  if (!_fs) return false;
+  String tmp = _path + ".tmp";
+  File f = _fs->open(tmp, FILE_WRITE);
+  if (!f) {
+    Serial.printf("LoudnessIndex: cannot write %s\n", tmp.c_str());
+    return false;
+  }
+  uint32_t header[2] = {MAGIC, (uint32_t)_entries.size()};
+  size_t bytes = _entries.size() * sizeof(Entry);
+  bool ok = f.write((const uint8_t *)header, sizeof(header)) == sizeof(header) &&
+            f.write((const uint8_t *)_entries.data(), bytes) == bytes;
+  f.close();
+  _fs->remove(_path);
+  if (!ok || !_fs->rename(tmp, _path)) {
+    Serial.printf("LoudnessIndex: could not write %s\n", _path.c_str());
+    _fs->remove(tmp);
+    return false;
+  }
+  return true;
+}
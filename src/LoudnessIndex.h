@@ -0,0 +1,47 @@
+#ifndef LOUDNESS_INDEX_H
+#define LOUDNESS_INDEX_H
+
+#include <Arduino.h>
+#include <vector>
+#include "FS.h"
+
+// Per-track normalisation gains, kept in one small binary file on SD so each
+// track is analysed only once. Tracks are keyed by a hash of their path; an
+// entry is 8 bytes and lookups are a binary search.
+class LoudnessIndex {
+public:
+  void begin(fs::FS &fs, const char *path);
+
+  bool has(const String &track) const { return has(track.c_str()); }
+  bool has(const char *track) const;
+  // Gain in 1/100 dB; 0 for tracks not analysed (or not analysable)
+  int16_t gainCentiDb(const String &track) const;
+  // Q15 factor for the mixer, UNITY-based (32768 = 0 dB)
+  static int32_t toQ15(int16_t centiDb);
+
+  void put(const String &track, int16_t centiDb, bool measured);
+  void remove(const String &track);
+  size_t size() const { return _entries.size(); }
+  bool save();
+
+  // The key for a track; ShuffleBag uses it for paths too
+  static uint32_t hashPath(const String &track) { return hashPath(track.c_str()); }
+  static uint32_t hashPath(const char *track);
+
+private:
+  struct Entry {
+    uint32_t hash;
+    int16_t centiDb;
+    uint16_t flags; // FLAG_MEASURED, or 0 if the track could not be analysed
+  };
+  static const uint16_t FLAG_MEASURED = 1;
+  static const uint32_t MAGIC = 0x3158444C; // "LDX1"
+
+  fs::FS *_fs = nullptr;
+  String _path;
+  std::vector<Entry> _entries; // sorted by hash
+
+  int find(uint32_t hash) const; // index of the entry, or insertion point as -(i + 1)
+};
+
+#endif // LOUDNESS_INDEX_H
@@ -0,0 +1,67 @@
+#include "LoudnessMeter.h"
+#include <math.h>
+
+static const float FULL_SCALE_SQ = 32768.0f * 32768.0f;
+
+void LoudnessMeter::begin(uint32_t rate) {
+  _blockFrames = rate ? rate / 10 : 4410;
+  _n = 0;
+  _sum = 0;
+  _peak = 0;
+  _blocks = 0;
+  for (int i = 0; i < HOPS; ++i) _block[i] = 0;
+  for (int i = 0; i < BINS; ++i) _hist[i] = 0;
+}
+
+void LoudnessMeter::closeBlock() {
+  _block[_blocks % HOPS] = (float)_sum / (2.0f * _n * FULL_SCALE_SQ);
+  _blocks++;
+  _n = 0;
+  _sum = 0;
+  if (_blocks < HOPS) return;
+
+  float ms = 0;
+  for (int i = 0; i < HOPS; ++i) ms += _block[i];
+  ms /= HOPS;
+  if (ms <= 0) return;
+  float db = 10.0f * log10f(ms);
+  if (db < -70.0f) return; // absolute gate
+  int bin = (int)((db + 70.0f) * 2.0f);
+  if (bin >= BINS) bin = BINS - 1;
+  _hist[bin]++;
+}
+
+bool LoudnessMeter::gainCentiDb(float targetDb, float minDb, float maxDb, int16_t &out) const {
+  // Mean energy of the windows past the absolute gate
+  double energy = 0;
+  uint32_t count = 0;
+  for (int i = 0; i < BINS; ++i) {
+    if (!_hist[i]) continue;
+    energy += _hist[i] * pow(10.0, (i * 0.5 - 70.0 + 0.25) / 10.0);
+    count += _hist[i];
+  }
+  if (count < 10) return false; // under ~1 s of measurable audio
+
+  // Relative gate
+  double gate = 10.0 * log10(energy / count) - 10.0;
+  energy = 0;
+  count = 0;
+  for (int i = 0; i < BINS; ++i) {
+    double db = i * 0.5 - 70.0 + 0.25;
+    if (!_hist[i] || db < gate) continue;
+    energy += _hist[i] * pow(10.0, db / 10.0);
+    count += _hist[i];
+  }
+  if (!count) return false;
+  float loudness = (float)(10.0 * log10(energy / count));
+
+  float gain = targetDb - loudness;
+  if (_peak > 0) {
+    float headroom = -20.0f * log10f(_peak / 32768.0f);
+    if (gain > headroom) gain = headroom;
+  }
+  if (gain < minDb) gain = minDb;
+  if (gain > maxDb) gain = maxDb;
+  out = (int16_t)lroundf(gain * 100.0f);
+  return true;
+}
@@ -0,0 +1,49 @@
+#ifndef LOUDNESS_METER_H
+#define LOUDNESS_METER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Integrated loudness of a whole track, fed one packed stereo frame at a time
+// while the track is decoded. Follows the EBU R128 recipe without the
+// K-weighting filter: mean square over 400 ms windows (100 ms hop), windows
+// quieter than -70 dBFS dropped, then windows more than 10 dB below the
+// resulting average dropped. The window levels go into a 0.5 dB histogram, so
+// memory stays fixed whatever the track length.
+class LoudnessMeter {
+public:
+  void begin(uint32_t rate);
+  bool started() const { return _blockFrames != 0; }
+
+  inline void add(uint32_t frame) {
+    int32_t l = (int16_t)(frame & 0xFFFF);
+    int32_t r = (int16_t)(frame >> 16);
+    _sum += (int64_t)(l * l) + (int64_t)(r * r);
+    int32_t a = l < 0 ? -l : l;
+    int32_t b = r < 0 ? -r : r;
+    if (a > _peak) _peak = a;
+    if (b > _peak) _peak = b;
+    if (++_n >= _blockFrames) closeBlock();
+  }
+
+  // Gain in 1/100 dB that brings the track to targetDb (dBFS), limited so the
+  // peak stays below full scale and to minDb..maxDb. False if the track was
+  // too short or silent to measure.
+  bool gainCentiDb(float targetDb, float minDb, float maxDb, int16_t &out) const;
+
+private:
+  static const int BINS = 140; // -70..0 dBFS in 0.5 dB steps
+  static const int HOPS = 4;   // 100 ms blocks per 400 ms window
+
+  uint32_t _blockFrames = 0;
+  uint32_t _n = 0;
+  int64_t _sum = 0;
+  int32_t _peak = 0;
+  float _block[HOPS] = {0};  // mean square of the last blocks
+  uint32_t _blocks = 0;
+  uint32_t _hist[BINS] = {0};
+
+  void closeBlock();
+};
+
+#endif // LOUDNESS_METER_H
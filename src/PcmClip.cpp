@@ -0,0 +1,106 @@
+#include "PcmClip.h"
+#include <Arduino.h>
+#include "esp_heap_caps.h"
+
+int16_t PcmClip::s_ulaw[256];
+
+// G.711 mu-law decode table, built once
+void PcmClip::initTable() {
+  static bool done = false;
+  if (done) return;
+  for (int i = 0; i < 256; ++i) {
+    uint8_t u = ~(uint8_t)i;
+    int t = (((u & 0x0F) << 3) + 0x84) << ((u & 0x70) >> 4);
+    s_ulaw[i] = (int16_t)((u & 0x80) ? (0x84 - t) : (t - 0x84));
+  }
+  done = true;
+}
+
+uint8_t PcmClip::encodeMulaw(int16_t s) {
+  const int BIAS = 0x84, CLIP = 32635;
+  int sign = (s < 0) ? 0x80 : 0;
+  int v = (s < 0) ? -(int)s : s;
+  if (v > CLIP) v = CLIP;
+  v += BIAS;
+  int exp = 7;
+  for (int mask = 0x4000; (v & mask) == 0 && exp > 0; mask >>= 1) exp--;
+  int mant = (v >> (exp + 3)) & 0x0F;
+  return (uint8_t)~(sign | (exp << 4) | mant);
+}
+
+bool PcmClip::allocate(size_t maxBytes) {
+  release();
+  initTable();
+
+  _psram = psramFound();
+  _data = (uint8_t *)(_psram ? ps_malloc(maxBytes) : malloc(maxBytes));
+  if (!_data) {
+    _psram = false;
+    return false;
+  }
+  _capacity = maxBytes;
+  _format = _psram ? STEREO16 : MULAW_MONO;
+  return true;
+}
+
+void PcmClip::release() {
+  if (_data) free(_data);
+  _data = nullptr;
+  _capacity = _used = _frames = 0;
+  _rate = 0;
+  _format = NONE;
+  _decim = 1;
+  _havePending = false;
+  _full = false;
+}
+
+void PcmClip::setSampleRate(uint32_t rate) {
+  _rate = rate;
+  _decim = (_format == MULAW_MONO && rate >= 32000) ? 2 : 1;
+}
+
+bool PcmClip::append(uint32_t frame) {
+  if (!_data || _full) return false;
+
+  if (_format == STEREO16) {
+    if (_used + 4 > _capacity) {
+      _full = true;
+      return false;
+    }
+    memcpy(_data + _used, &frame, 4);
+    _used += 4;
+    _frames++;
+    return true;
+  }
+
+  int32_t mono = ((int32_t)(int16_t)(frame & 0xFFFF) + (int16_t)(frame >> 16)) >> 1;
+  if (_decim == 2 && !_havePending) {
+    _pending = mono;
+    _havePending = true;
+    return true;
+  }
+  if (_used >= _capacity) {
+    _full = true;
+    return false;
+  }
+  if (_decim == 2) {
+    mono = (mono + _pending) >> 1;
+    _havePending = false;
+  }
+  _data[_used++] = encodeMulaw((int16_t)mono);
+  _frames += _decim;
+  return true;
+}
+
+void PcmClip::finish() {
+  if (!_data || _used == _capacity) return;
+  if (_used == 0) {
+    release();
+    return;
+  }
+  void *p = _psram ? heap_caps_realloc(_data, _used, MALLOC_CAP_SPIRAM) : realloc(_data, _used);
+  if (p) {
+    _data = (uint8_t *)p;
+    _capacity = _used;
+  }
+}
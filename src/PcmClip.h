@@ -0,0 +1,69 @@
+#ifndef PCM_CLIP_H
+#define PCM_CLIP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Decoded audio held in memory so it can be played without touching SD or
+// the MP3 decoder. Filled one packed stereo frame at a time (the format
+// audio_process_i2s() delivers) and read back the same way.
+//
+// With PSRAM the clip is kept as 16-bit stereo. Without it the clip is stored
+// compact: mono mu-law, and at half rate for 32 kHz and above (interpolated
+// back on playback), which is 8x smaller than stereo at 44.1 kHz.
+class PcmClip {
+public:
+  enum Format : uint8_t { NONE, STEREO16, MULAW_MONO };
+
+  ~PcmClip() { release(); }
+
+  // Reserve up to maxBytes; PSRAM is used when present
+  bool allocate(size_t maxBytes);
+  void release();
+
+  // Must be set before the first append()
+  void setSampleRate(uint32_t rate);
+  bool append(uint32_t frame);  // false once the buffer is full
+  void finish();                // trim the buffer to what was used
+
+  bool valid() const { return _data != nullptr && _frames > 0; }
+  bool full() const { return _full; }
+  Format format() const { return _format; }
+  bool inPsram() const { return _psram; }
+  uint32_t sampleRate() const { return _rate; }
+  size_t bytes() const { return _used; }
+  size_t frames() const { return _frames; }
+  uint32_t durationMs() const { return _rate ? (uint32_t)((uint64_t)_frames * 1000 / _rate) : 0; }
+
+  uint32_t frameAt(size_t i) const {
+    if (_format == STEREO16) return ((const uint32_t *)_data)[i];
+    int16_t s;
+    if (_decim == 1) {
+      s = s_ulaw[_data[i]];
+    } else {
+      size_t j = i >> 1;
+      s = s_ulaw[_data[j]];
+      if ((i & 1) && j + 1 < _used) s = (int16_t)(((int32_t)s + s_ulaw[_data[j + 1]]) >> 1);
+    }
+    return (uint32_t)(uint16_t)s | ((uint32_t)(uint16_t)s << 16);
+  }
+
+private:
+  uint8_t *_data = nullptr;
+  size_t _capacity = 0; // bytes
+  size_t _used = 0;     // bytes
+  size_t _frames = 0;   // playback frames at _rate
+  uint32_t _rate = 0;
+  Format _format = NONE;
+  uint8_t _decim = 1;   // stored samples per playback frame (compact only)
+  int32_t _pending = 0; // first half of a decimated pair
+  bool _havePending = false;
+  bool _psram = false;
+  bool _full = false;
+
+  static int16_t s_ulaw[256];
+  static void initTable();
+  static uint8_t encodeMulaw(int16_t s);
+};
+
+#endif // PCM_CLIP_H
@@ -0,0 +1,40 @@
+#ifndef PCM_RING_H
+#define PCM_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Fixed-size ring of packed stereo frames (two int16 samples in one uint32,
+// same layout the Audio library hands to audio_process_i2s()).
+// Capacity must be a power of two.
+template <size_t N>
+class PcmRing {
+public:
+  static_assert((N & (N - 1)) == 0, "PcmRing size must be a power of two");
+
+  void clear() { _head = _tail = 0; }
+  size_t size() const { return _head - _tail; }
+  size_t freeSpace() const { return N - size(); }
+  bool empty() const { return _head == _tail; }
+  static size_t capacity() { return N; }
+
+  bool push(uint32_t frame) {
+    if (size() >= N) return false;
+    _buf[_head & (N - 1)] = frame;
+    _head++;
+    return true;
+  }
+
+  uint32_t pop() {
+    uint32_t f = _buf[_tail & (N - 1)];
+    _tail++;
+    return f;
+  }
+
+private:
+  uint32_t _buf[N];
+  size_t _head = 0;
+  size_t _tail = 0;
+};
+
+#endif // PCM_RING_H
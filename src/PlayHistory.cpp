@@ -0,0 +1,123 @@
+#include "PlayHistory.h"
+
+static_assert(sizeof(PlayHistory::Record) == 16, "history records are 16 bytes on the card");
+
+void PlayHistory::begin(fs::FS &fs, const char *path) {
+  _fs = &fs;
+  _path = path;
+  _pending = 0;
+
+  File f = _fs->open(_path, FILE_READ);
+  bool ok = f && f.read((uint8_t *)&_header, sizeof(_header)) == sizeof(_header) && _header.magic == MAGIC &&
+            _header.capacity == HISTORY_MAX_RECORDS && _header.head < _header.capacity &&
+            _header.count <= _header.capacity && f.size() >= slotOffset(_header.count);
+  if (f) f.close();
+  if (!ok && !create()) {
+    Serial.printf("PlayHistory: can't create %s, nothing will be kept\n", _path.c_str());
+    _fs = nullptr;
+    return;
+  }
+  Serial.printf("PlayHistory: %lu records in %s\n", (unsigned long)_header.count, _path.c_str());
+}
+
+bool PlayHistory::create() {
+  _header = {MAGIC, HISTORY_MAX_RECORDS, 0, 0};
+  File f = _fs->open(_path, FILE_WRITE);
+  if (!f) return false;
+  bool ok = f.write((const uint8_t *)&_header, sizeof(_header)) == sizeof(_header);
+  f.close();
+  return ok;
+}
+
+void PlayHistory::log(Event event, uint32_t time, uint32_t track, uint32_t playedMs, Reason reason, int index) {
+  if (!_fs) return;
+  if (_pending == 0) _firstPendingMs = millis();
+  Record &r = _batch[_pending++];
+  r.time = time;
+  r.track = track;
+  r.playedMs = playedMs;
+  r.event = event;
+  r.reason = reason;
+  r.hint = index >= 0 && index < 0xFFFF ? (uint16_t)(index + 1) : 0;
+  if (_pending == HISTORY_BATCH) flush();
+}
+
+void PlayHistory::loop() {
+  if (_pending && millis() - _firstPendingMs >= HISTORY_FLUSH_MS) flush();
+}
+
+// The batch in at most two sequential writes (it may wrap past the last
+// slot), then the header. A cut in between loses the batch, nothing older.
+void PlayHistory::flush() {
+  if (!_fs || !_pending) return;
+  File f = _fs->open(_path, "r+");
+  if (!f) {
+    Serial.printf("PlayHistory: can't open %s, %u records dropped\n", _path.c_str(), (unsigned)_pending);
+    _pending = 0;
+    return;
+  }
+  Header h = _header;
+  size_t done = 0;
+  bool ok = true;
+  while (ok && done < _pending) {
+    size_t n = _pending - done;
+    if (n > h.capacity - h.head) n = h.capacity - h.head;
+    size_t bytes = n * sizeof(Record);
+    ok = f.seek(slotOffset(h.head)) && f.write((const uint8_t *)(_batch + done), bytes) == bytes;
+    h.head = (h.head + n) % h.capacity;
+    done += n;
+  }
+  h.count = h.count + _pending > h.capacity ? h.capacity : h.count + _pending;
+  if (ok) ok = f.seek(0) && f.write((const uint8_t *)&h, sizeof(h)) == sizeof(h);
+  f.close();
+  if (ok) _header = h;
+  else Serial.printf("PlayHistory: write to %s failed, %u records dropped\n", _path.c_str(), (unsigned)_pending);
+  _pending = 0;
+}
+
+PlayHistory::Reader PlayHistory::reader(uint32_t last) {
+  flush();
+  Reader r;
+  if (!_fs || !_header.count) return r;
+  r._f = _fs->open(_path, FILE_READ);
+  if (!r._f) return r;
+  uint32_t n = last && last < _header.count ? last : _header.count;
+  r._capacity = _header.capacity;
+  r._slot = (_header.head + _header.capacity - n) % _header.capacity;
+  r._left = n;
+  return r;
+}
+
+size_t PlayHistory::Reader::read(Record *out, size_t max) {
+  if (!_left || !_f) return 0;
+  size_t n = max < _left ? max : _left;
+  if (n > _capacity - _slot) n = _capacity - _slot;
+  size_t bytes = n * sizeof(Record);
+  if (!_f.seek(slotOffset(_slot)) || _f.read((uint8_t *)out, bytes) != bytes) {
+    _left = 0;
+    return 0;
+  }
+  _slot = (_slot + n) % _capacity;
+  _left -= n;
+  return n;
+}
+
+const char *PlayHistory::eventName(uint8_t event) {
+  switch (event) {
+  case EV_BOOT: return "boot";
+  case EV_MOTION: return "motion";
+  case EV_TRACK: return "track";
+  case EV_CHIME: return "chime";
+  default: return "unknown";
+  }
+}
+
+const char *PlayHistory::reasonName(uint8_t reason) {
+  switch (reason) {
+  case R_END: return "end";
+  case R_TIMEOUT: return "timeout";
+  case R_CHIME: return "chime";
+  case R_USER: return "user";
+  default: return "";
+  }
+}
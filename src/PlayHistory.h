@@ -0,0 +1,89 @@
+#ifndef PLAY_HISTORY_H
+#define PLAY_HISTORY_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "Config.h"
+
+// What played when: one 16-byte record per event in a file of fixed size on
+// SD, the oldest overwritten once it holds HISTORY_MAX_RECORDS. Records are
+// collected in RAM and written HISTORY_BATCH at a time (or after
+// HISTORY_FLUSH_MS), as one sequential write and a header update, so the card
+// sees a write every few tracks rather than on each. Records still in RAM are
+// lost on a power cut.
+//
+// The file is a 16-byte header (next slot, records held) and then the slots;
+// nothing is rewritten except the header and the slot being filled.
+class PlayHistory {
+public:
+  enum Event : uint8_t {
+    EV_BOOT = 0,
+    EV_MOTION = 1, // a session started on motion
+    EV_TRACK = 2,  // a library track stopped; track is its path hash
+    EV_CHIME = 3,  // track is the hour announced
+  };
+  enum Reason : uint8_t {
+    R_NONE = 0,
+    R_END = 1,     // played out, or the next track took over
+    R_TIMEOUT = 2, // no motion for DHUN_SESSION_TIMEOUT_MS
+    R_CHIME = 3,   // stopped for a chime (and resumed after it)
+    R_USER = 4,    // from the web page
+  };
+  struct Record {
+    uint32_t time;     // RTC unixtime, 0 if the clock wasn't set
+    uint32_t track;    // LoudnessIndex::hashPath() of the file
+    uint32_t playedMs; // from start to stop
+    uint8_t event;
+    uint8_t reason;
+    uint16_t hint;     // 1 + the track's FileScanner::pathAt() index when logged, 0 if none
+  };
+
+  // Records oldest first, straight from the file
+  class Reader {
+  public:
+    // Up to `max` records into `out`; 0 at the end
+    size_t read(Record *out, size_t max);
+    uint32_t remaining() const { return _left; }
+
+  private:
+    friend class PlayHistory;
+    File _f;
+    uint32_t _slot = 0;
+    uint32_t _left = 0;
+    uint32_t _capacity = 1;
+  };
+
+  void begin(fs::FS &fs, const char *path);
+  void log(Event event, uint32_t time, uint32_t track = 0, uint32_t playedMs = 0, Reason reason = R_NONE,
+           int index = -1);
+  void loop();  // writes the batch once it is HISTORY_FLUSH_MS old
+  void flush();
+  uint32_t count() const { return _header.count + _pending; }
+
+  // The last `last` records (all if 0), after writing out the batch
+  Reader reader(uint32_t last = 0);
+
+  static const char *eventName(uint8_t event);
+  static const char *reasonName(uint8_t reason);
+
+private:
+  struct Header {
+    uint32_t magic;
+    uint32_t capacity;
+    uint32_t head; // slot the next record goes in
+    uint32_t count;
+  };
+  static const uint32_t MAGIC = 0x31545348; // "HST1"
+
+  fs::FS *_fs = nullptr;
+  String _path;
+  Header _header = {};
+  Record _batch[HISTORY_BATCH];
+  size_t _pending = 0;
+  unsigned long _firstPendingMs = 0;
+
+  bool create();
+  static size_t slotOffset(uint32_t slot) { return sizeof(Header) + slot * sizeof(Record); }
+};
+
+#endif // PLAY_HISTORY_H
@@ -0,0 +1,156 @@
+#include "SearchIndex.h"
+#include "esp_heap_caps.h"
+
+SearchIndex::~SearchIndex() { clear(); }
+
+void SearchIndex::begin(bool psram, size_t budget) {
+  _psram = psram;
+  _budget = budget;
+}
+
+void SearchIndex::clear() {
+  free(_start);
+  free(_postings);
+  _start = nullptr;
+  _postings = nullptr;
+  _postingCount = 0;
+  _count = 0;
+}
+
+size_t SearchIndex::memoryUsed() const {
+  return _postings ? (BUCKETS + 2) * sizeof(uint32_t) + _postingCount * sizeof(uint16_t) : 0;
+}
+
+size_t SearchIndex::fold(const char *in, char *out, size_t len, size_t at) {
+  if (!*in) return at;
+  bool space = at == 0 || out[at - 1] == ' ';
+  if (!space && at + 1 < len) {
+    out[at++] = ' ';
+    space = true;
+  }
+  for (; *in && at + 1 < len; ++in) {
+    uint8_t c = (uint8_t)*in;
+    if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+    else if (c < 0x80 && !isalnum(c)) c = ' '; // UTF-8 is kept as it is
+    if (c == ' ' && space) continue;
+    space = c == ' ';
+    out[at++] = (char)c;
+  }
+  out[at] = 0;
+  return at;
+}
+
+// Two passes over the text: count each bucket's entries, then fill them in
+// from the end so each list comes out in entry order
+void SearchIndex::build(int count, TextFn text, void *ctx) {
+  clear();
+  if (count <= 0 || count > 0xFFFF) return;
+  unsigned long t0 = millis();
+  uint32_t *start = (uint32_t *)calloc(BUCKETS + 2, sizeof(uint32_t));
+  uint16_t *last = (uint16_t *)malloc(BUCKETS * sizeof(uint16_t)); // an entry's trigrams count once
+  if (!start || !last) {
+    free(start);
+    free(last);
+    return;
+  }
+  char buf[MAX_TEXT];
+
+  memset(last, 0xFF, BUCKETS * sizeof(uint16_t));
+  for (int i = 0; i < count; ++i) {
+    size_t n = text(i, buf, sizeof(buf), ctx);
+    for (size_t k = 0; k + 3 <= n; ++k) {
+      if (!inWord(buf + k)) continue;
+      int b = bucket(buf + k);
+      if (last[b] == i) continue;
+      last[b] = (uint16_t)i;
+      start[b + 1]++;
+    }
+  }
+  for (int b = 1; b <= BUCKETS; ++b) start[b] += start[b - 1];
+  size_t total = start[BUCKETS];
+
+  size_t bytes = (BUCKETS + 2) * sizeof(uint32_t) + total * sizeof(uint16_t);
+  uint16_t *postings = nullptr;
+  if (bytes <= _budget)
+    postings = (uint16_t *)(_psram ? ps_malloc(total * sizeof(uint16_t) + 1) : malloc(total * sizeof(uint16_t) + 1));
+  if (!postings) {
+    Serial.printf("SearchIndex: %u bytes needed, over budget; searches check every entry\n", (unsigned)bytes);
+    free(start);
+    free(last);
+    return;
+  }
+
+  // start[b + 1] is the end of bucket b; counting down leaves it the start
+  // of bucket b
+  memset(last, 0xFF, BUCKETS * sizeof(uint16_t));
+  for (int i = count - 1; i >= 0; --i) {
+    size_t n = text(i, buf, sizeof(buf), ctx);
+    for (size_t k = 0; k + 3 <= n; ++k) {
+      if (!inWord(buf + k)) continue;
+      int b = bucket(buf + k);
+      if (last[b] == i) continue;
+      last[b] = (uint16_t)i;
+      postings[--start[b + 1]] = (uint16_t)i;
+    }
+  }
+  start[BUCKETS + 1] = total;
+  free(last);
+  _start = start;
+  _postings = postings;
+  _postingCount = total;
+  _count = count;
+  Serial.printf("SearchIndex: %d entries, %u bytes, %lu ms\n", count, (unsigned)memoryUsed(), millis() - t0);
+}
+
+// `word` at the start of a word of `text`, or anywhere in it if it is long
+// enough to have a trigram
+bool SearchIndex::hasWord(const char *text, const char *word) {
+  bool anywhere = strlen(word) >= 3;
+  for (const char *p = strstr(text, word); p; p = strstr(p + 1, word)) {
+    if (anywhere || p == text || p[-1] == ' ') return true;
+  }
+  return false;
+}
+
+int SearchIndex::search(const char *query, int count, TextFn text, void *ctx, int *out, int max) const {
+  char q[MAX_TEXT];
+  size_t qn = fold(query, q, sizeof(q), 0);
+  const char *words[MAX_WORDS];
+  int nwords = 0;
+  for (size_t k = 0; k < qn && nwords < MAX_WORDS;) {
+    words[nwords++] = q + k;
+    while (k < qn && q[k] != ' ') k++;
+    q[k++] = 0;
+  }
+  if (!nwords) return 0;
+
+  // The rarest trigram of any word, if there is an index for this list
+  const uint16_t *cand = nullptr;
+  size_t candCount = 0;
+  if (_postings && _count == count) {
+    for (int w = 0; w < nwords; ++w) {
+      for (const char *p = words[w]; p[0] && p[1] && p[2]; ++p) {
+        int b = bucket(p);
+        size_t n = _start[b + 2] - _start[b + 1];
+        if (!cand || n < candCount) {
+          cand = _postings + _start[b + 1];
+          candCount = n;
+        }
+      }
+    }
+  }
+
+  char buf[MAX_TEXT];
+  int found = 0;
+  size_t n = cand ? candCount : (size_t)count;
+  for (size_t j = 0; j < n; ++j) {
+    int i = cand ? cand[j] : (int)j;
+    text(i, buf, sizeof(buf), ctx);
+    bool all = true;
+    for (int w = 0; w < nwords && all; ++w) all = hasWord(buf, words[w]);
+    if (!all) continue;
+    if (found < max) out[found] = i;
+    found++;
+  }
+  return found;
+}
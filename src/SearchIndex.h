@@ -0,0 +1,58 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <Arduino.h>
+
+// Word search over the library without touching the card. Each entry's text
+// (folder, file name, title, artist, album) is folded to lower case with
+// punctuation as spaces; a query matches entries that have every one of its
+// words, words of one or two characters as the start of a word and longer
+// ones anywhere.
+//
+// The index maps each trigram within a word (hashed to a bucket) to the
+// entries that have it, in two blocks: bucket offsets and one list of entry
+// numbers. A query looks only at the entries under its rarest trigram and
+// checks each against its text. Without an index (too big for the budget, or
+// not rebuilt yet after a change) every entry is checked; that is still
+// memory only.
+class SearchIndex {
+public:
+  static const size_t MAX_TEXT = 512;
+  // An entry's folded text into `buf` (NUL-terminated), returning its length
+  typedef size_t (*TextFn)(int entry, char *buf, size_t len, void *ctx);
+
+  ~SearchIndex();
+  void begin(bool psram, size_t budget);
+  void build(int count, TextFn text, void *ctx);
+  void clear();
+  bool built() const { return _postings != nullptr; }
+  size_t memoryUsed() const;
+
+  // Matching entries in list order, up to `max` of them in `out`; returns
+  // how many match in all
+  int search(const char *query, int count, TextFn text, void *ctx, int *out, int max) const;
+
+  // Fold `in` onto the end of `out` (which holds `at` bytes), a space between;
+  // returns the new length
+  static size_t fold(const char *in, char *out, size_t len, size_t at);
+
+private:
+  static const int BUCKETS = 2048;
+  static const int MAX_WORDS = 8;
+
+  static int bucket(const char *p) {
+    return (((uint8_t)p[0] * 31 + (uint8_t)p[1]) * 31 + (uint8_t)p[2]) & (BUCKETS - 1);
+  }
+  static bool inWord(const char *p) { return p[0] != ' ' && p[1] != ' ' && p[2] != ' '; }
+  static bool hasWord(const char *text, const char *word);
+
+  bool _psram = false;
+  size_t _budget = 0;
+  int _count = 0;
+  // Bucket b's entries are _postings[_start[b + 1]] up to _postings[_start[b + 2]]
+  uint32_t *_start = nullptr;
+  uint16_t *_postings = nullptr;
+  size_t _postingCount = 0;
+};
+
+#endif // SEARCH_INDEX_H
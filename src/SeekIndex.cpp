@@ -0,0 +1,246 @@
+#include "SeekIndex.h"
+#include "Config.h"
+
+void SeekIndex::begin(fs::FS &fs, const char *dir) {
+  _fs = &fs;
+  _dir = dir;
+  if (!_fs->exists(_dir)) _fs->mkdir(_dir);
+  _fs->remove(_dir + "/build.tmp"); // left by a build cut short by a reboot
+}
+
+// FNV-1a of the path names the index file
+String SeekIndex::indexPath(const String &track) const {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < track.length(); ++i) {
+    h ^= (uint8_t)track[i];
+    h *= 16777619u;
+  }
+  char name[16];
+  snprintf(name, sizeof(name), "/%08lx.idx", (unsigned long)h);
+  return _dir + name;
+}
+
+// Open the index of `track` if there is one and it matches the file as it is now
+bool SeekIndex::openIndex(const String &track, File &f, Header &h) {
+  File t = _fs->open(track, FILE_READ);
+  if (!t) return false;
+  uint32_t size = t.size();
+  t.close();
+
+  f = _fs->open(indexPath(track), FILE_READ);
+  if (!f) return false;
+  if (f.read((uint8_t *)&h, sizeof(h)) != sizeof(h) || h.magic != MAGIC || h.fileSize != size ||
+      h.count == 0) {
+    f.close();
+    return false;
+  }
+  return true;
+}
+
+void SeekIndex::want(const String &track) {
+  if (!_fs || !(track.endsWith(".mp3") || track.endsWith(".MP3"))) return;
+  if (_building && track == _track) return;
+
+  File f;
+  Header h;
+  if (openIndex(track, f, h)) {
+    f.close();
+    return;
+  }
+  if (_building) finish(false);
+
+  _src = _fs->open(track, FILE_READ);
+  if (!_src) return;
+  _out = _fs->open(_dir + "/build.tmp", FILE_WRITE);
+  if (!_out) {
+    Serial.printf("SeekIndex: cannot write in %s\n", _dir.c_str());
+    _src.close();
+    return;
+  }
+  h = {0, 0, 0, 0}; // filled in once the build completes
+  _out.write((const uint8_t *)&h, sizeof(h));
+
+  _track = track;
+  _size = _src.size();
+  _pos = audioStart(_src);
+  _frames = 0;
+  _output = 0;
+  _count = 0;
+  _lastKey = 0;
+  _rate = 0;
+  _keyInStride = false;
+  _building = true;
+}
+
+// Skip any ID3v2 tags at the start of the file
+uint32_t SeekIndex::audioStart(File &f) {
+  uint32_t pos = 0;
+  uint8_t tag[10];
+  while (f.seek(pos) && f.read(tag, sizeof(tag)) == sizeof(tag) && tag[0] == 'I' &&
+         tag[1] == 'D' && tag[2] == '3') {
+    uint32_t len = ((uint32_t)(tag[6] & 0x7F) << 21) | ((uint32_t)(tag[7] & 0x7F) << 14) |
+                   ((uint32_t)(tag[8] & 0x7F) << 7) | (tag[9] & 0x7F);
+    pos += 10 + len + ((tag[5] & 0x10) ? 10 : 0); // footer
+  }
+  return pos;
+}
+
+// One SD read per call: every frame whose header lies in the block is indexed
+void SeekIndex::step() {
+  if (!_building) return;
+  if (_pos + PEEK > _size || !_src.seek(_pos)) {
+    finish(true);
+    return;
+  }
+  _bufStart = _pos;
+  _bufLen = _src.read(_buf, BLOCK);
+
+  size_t i = 0;
+  while (i + PEEK <= _bufLen) {
+    const uint8_t *p = _buf + i;
+    if (p[0] == 'T' && p[1] == 'A' && p[2] == 'G' && _size - (_bufStart + i) == 128) break; // ID3v1
+    FrameInfo f;
+    if (!parseFrame(p, f) || (_rate && f.rate != _rate)) {
+      i++; // lost sync, look for the next header
+      continue;
+    }
+    _rate = f.rate;
+
+    // One seek point per STRIDE frames, plus the first key frame of the
+    // stride if its first frame wasn't one
+    bool strideStart = _frames % STRIDE == 0;
+    if (strideStart) _keyInStride = false;
+    if (strideStart || (f.key && !_keyInStride)) {
+      if (f.key) {
+        _lastKey = _count;
+        _keyInStride = true;
+      }
+      Entry e = {_output, _bufStart + (uint32_t)i, _lastKey};
+      if (_out.write((const uint8_t *)&e, sizeof(e)) != sizeof(e)) {
+        finish(false);
+        return;
+      }
+      _count++;
+    }
+    _frames++;
+    _output += f.samples;
+    i += f.length;
+  }
+  _pos = _bufStart + i;
+  if (_bufLen < BLOCK && i + PEEK > _bufLen) finish(true); // end of file
+}
+
+void SeekIndex::finish(bool ok) {
+  _src.close();
+  String tmp = _dir + "/build.tmp";
+  if (ok && _count > 0) {
+    Header h = {MAGIC, _size, _count, _rate};
+    _out.seek(0);
+    _out.write((const uint8_t *)&h, sizeof(h));
+    _out.close();
+    String path = indexPath(_track);
+    _fs->remove(path);
+    if (_fs->rename(tmp, path)) {
+      Serial.printf("SeekIndex: %s indexed, %lu frames, %lu seek points\n", _track.c_str(),
+                    (unsigned long)_frames, (unsigned long)_count);
+    }
+  } else {
+    _out.close();
+    _fs->remove(tmp);
+  }
+  _building = false;
+  _track = String();
+}
+
+void SeekIndex::cancel() {
+  if (_building) finish(false);
+}
+
+bool SeekIndex::readEntry(File &f, uint32_t i, Entry &e) {
+  return f.seek(sizeof(Header) + i * sizeof(Entry)) &&
+         f.read((uint8_t *)&e, sizeof(e)) == sizeof(e);
+}
+
+bool SeekIndex::lookup(const String &track, uint32_t frame, uint32_t &filePos, uint32_t &skip) {
+  if (!_fs) return false;
+  File f;
+  Header h;
+  if (!openIndex(track, f, h)) return false;
+
+  // Last entry at or before `frame`
+  bool ok = true;
+  Entry e;
+  uint32_t lo = 0, hi = h.count;
+  while (ok && lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    if (!readEntry(f, mid, e)) ok = false;
+    else if (e.frame <= frame) lo = mid + 1;
+    else hi = mid;
+  }
+  ok = ok && lo > 0 && readEntry(f, lo - 1, e);
+
+  // Start from the key frame before it unless that means decoding too much
+  // audio only to throw it away; otherwise the first frame or two may come
+  // out short of their bit reservoir
+  Entry key;
+  if (ok && e.lastKey != lo - 1 && readEntry(f, e.lastKey, key) &&
+      frame - key.frame <= (uint32_t)SEEK_MAX_DISCARD_SEC * h.rate) {
+    e = key;
+  }
+  f.close();
+  if (!ok) return false;
+
+  filePos = e.offset;
+  skip = frame - e.frame;
+  return true;
+}
+
+void SeekIndex::remove(const String &track) {
+  if (!_fs) return;
+  if (_building && track == _track) finish(false);
+  _fs->remove(indexPath(track));
+}
+
+bool SeekIndex::parseFrame(const uint8_t *p, FrameInfo &f) {
+  static const uint16_t BITRATES[5][15] = {
+      {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448}, // MPEG-1 layer I
+      {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},    // MPEG-1 layer II
+      {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},     // MPEG-1 layer III
+      {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},    // MPEG-2/2.5 layer I
+      {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},         // MPEG-2/2.5 layer II, III
+  };
+  static const uint32_t RATES[3] = {44100, 48000, 32000};
+
+  if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) return false;
+  int version = (p[1] >> 3) & 3; // 0 = 2.5, 2 = 2, 3 = 1
+  int layer = 4 - ((p[1] >> 1) & 3); // 1..3
+  int brIndex = p[2] >> 4;
+  int srIndex = (p[2] >> 2) & 3;
+  if (version == 1 || layer == 4 || brIndex == 0 || brIndex == 15 || srIndex == 3) return false;
+
+  bool mpeg1 = version == 3;
+  uint32_t kbps = BITRATES[mpeg1 ? layer - 1 : (layer == 1 ? 3 : 4)][brIndex];
+  f.rate = RATES[srIndex] >> (mpeg1 ? 0 : version == 2 ? 1 : 2);
+  f.kbps = kbps;
+  uint32_t pad = (p[2] >> 1) & 1;
+
+  if (layer == 1) {
+    f.length = (12000 * kbps / f.rate + pad) * 4;
+    f.samples = 384;
+  } else if (layer == 2 || mpeg1) {
+    f.length = 144000 * kbps / f.rate + pad;
+    f.samples = 1152;
+  } else {
+    f.length = 72000 * kbps / f.rate + pad;
+    f.samples = 576;
+  }
+
+  // Layer III frames can borrow bits from earlier ones (main_data_begin)
+  f.key = true;
+  if (layer == 3) {
+    const uint8_t *side = p + ((p[1] & 1) ? 4 : 6); // after the CRC, if any
+    uint32_t mainDataBegin = mpeg1 ? ((uint32_t)side[0] << 1) | (side[1] >> 7) : side[0];
+    f.key = mainDataBegin == 0;
+  }
+  return f.length > PEEK;
+}
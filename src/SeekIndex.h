@@ -0,0 +1,88 @@
+#ifndef SEEK_INDEX_H
+#define SEEK_INDEX_H
+
+#include <Arduino.h>
+#include "FS.h"
+
+// Seek points into MP3 files, so a track interrupted by the chime can pick up
+// on the frame it stopped at instead of from the top. Each track's index is
+// built once, a block of the file at a time, and kept in its own small file;
+// a lookup is a binary search over that file, O(log n) reads.
+//
+// An entry maps the first output frame of an MP3 frame to its file offset.
+// Frames whose side info has main_data_begin == 0 need nothing from the bit
+// reservoir and decode cleanly on their own ("key" frames); a resume starts
+// from the nearest one and discards decoded frames up to the wanted one.
+class SeekIndex {
+public:
+  void begin(fs::FS &fs, const char *dir);
+
+  // Build the index of `track` unless it has a current one (MP3 only).
+  // Replaces a build still in progress.
+  void want(const String &track);
+  // Index the next block of the track being built; call often
+  void step();
+  bool building() const { return _building; }
+  void cancel(); // drop a build in progress, closing its files
+
+  // Where to start decoding to reach output frame `frame` of `track`: the
+  // file offset of an MP3 frame, and how many decoded frames to throw away
+  bool lookup(const String &track, uint32_t frame, uint32_t &filePos, uint32_t &skip);
+  void remove(const String &track);
+
+  // MP3 frame header (plus the start of the side info, PEEK bytes) and the
+  // offset of the first frame after any ID3v2 tags; FileScanner uses these too
+  struct FrameInfo {
+    uint32_t length;
+    uint32_t samples;
+    uint32_t rate;
+    uint32_t kbps;
+    bool key;
+  };
+  static const size_t PEEK = 8; // header, CRC and the start of the side info
+  static bool parseFrame(const uint8_t *p, FrameInfo &f);
+  static uint32_t audioStart(File &f);
+
+private:
+  struct Header {
+    uint32_t magic;
+    uint32_t fileSize; // of the track, to notice it being replaced
+    uint32_t count;
+    uint32_t rate;
+  };
+  struct Entry {
+    uint32_t frame;   // output frames before this MP3 frame
+    uint32_t offset;  // of its header in the file
+    uint32_t lastKey; // index of the latest key entry at or before this one
+  };
+  static const uint32_t MAGIC = 0x31584B53; // "SKX1"
+  static const uint32_t STRIDE = 16;        // MP3 frames per seek point, ~0.4 s
+  static const size_t BLOCK = 4096;
+
+  fs::FS *_fs = nullptr;
+  String _dir;
+
+  // Build in progress
+  bool _building = false;
+  String _track;
+  File _src;
+  File _out;
+  uint32_t _size = 0;
+  uint32_t _pos = 0;      // offset of the next frame header
+  uint32_t _frames = 0;   // MP3 frames seen
+  uint32_t _output = 0;   // output frames they decode to
+  uint32_t _count = 0;    // entries written
+  uint32_t _lastKey = 0;
+  uint32_t _rate = 0;
+  bool _keyInStride = false;
+  uint8_t _buf[BLOCK];
+  uint32_t _bufStart = 0;
+  size_t _bufLen = 0;
+
+  String indexPath(const String &track) const;
+  bool openIndex(const String &track, File &f, Header &h);
+  void finish(bool ok);
+  static bool readEntry(File &f, uint32_t i, Entry &e);
+};
+
+#endif // SEEK_INDEX_H
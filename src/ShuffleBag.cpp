@@ -0,0 +1,160 @@
+#include "ShuffleBag.h"
+#include "LoudnessIndex.h"
+#include <algorithm>
+#include <math.h>
+
+ShuffleBag::~ShuffleBag() { free(_order); }
+
+void ShuffleBag::begin(fs::FS &fs, const char *dir) {
+  _fs = &fs;
+  _dir = dir;
+  if (!_fs->exists(_dir)) _fs->mkdir(_dir);
+}
+
+String ShuffleBag::fileFor(const String &folder, const char *ext) const {
+  char name[16];
+  snprintf(name, sizeof(name), "/%08x", (unsigned)LoudnessIndex::hashPath(folder.c_str()));
+  return _dir + name + ext;
+}
+
+// FNV-1a over the folder's names, in list order
+uint32_t ShuffleBag::listHash(const FileScanner &lib, int folder) {
+  uint32_t h = 2166136261u;
+  int count = lib.getCount(folder);
+  for (int i = 0; i < count; ++i) {
+    for (const char *p = lib.getPath(folder, i).name;; ++p) {
+      h = (h ^ (uint8_t)*p) * 16777619u;
+      if (!*p) break;
+    }
+  }
+  return h;
+}
+
+uint32_t ShuffleBag::pathHash(const FileScanner &lib, int folder, int index) {
+  char path[FileScanner::MAX_PATH_LEN];
+  if (!lib.getPath(folder, index).copy(path, sizeof(path))) return 0;
+  return LoudnessIndex::hashPath(path);
+}
+
+// Among the last `depth` tracks played
+bool ShuffleBag::recent(uint32_t hash, int depth) const {
+  for (int k = 1; k <= depth && (uint32_t)k <= _state.recentAt; ++k) {
+    if (_state.recent[(_state.recentAt - k) % SHUFFLE_NO_REPEAT] == hash) return true;
+  }
+  return false;
+}
+
+int ShuffleBag::next(const FileScanner &lib, int folder, WeightFn weight, void *ctx) {
+  int count = lib.getCount(folder);
+  if (count <= 0) return -1;
+  if (count > 0xFFFF) count = 0xFFFF; // the order is 16-bit
+  String path = lib.folderPath(folder);
+  uint32_t hash = listHash(lib, folder);
+
+  if (path != _folder || hash != _state.listHash || count != _count) {
+    if (!load(path, hash, count)) Serial.printf("ShuffleBag: new round of %d for %s\n", count, path.c_str());
+  }
+  if (!_order) return random(count);
+  if (_state.pos >= (uint32_t)_count) {
+    shuffle(lib, folder, weight, ctx);
+    saveOrder(path);
+  }
+
+  int index = _order[_state.pos++];
+  _state.recent[_state.recentAt++ % SHUFFLE_NO_REPEAT] = pathHash(lib, folder, index);
+  savePosition(path);
+  return index;
+}
+
+// The folder's saved order and position. The recent tracks are taken even
+// when the order is out of date; then a new round starts.
+bool ShuffleBag::load(const String &folder, uint32_t hash, int count) {
+  _folder = folder;
+  _count = count;
+  uint16_t *order = (uint16_t *)realloc(_order, count * sizeof(uint16_t));
+  if (!order) {
+    free(_order);
+    _order = nullptr;
+    return false;
+  }
+  _order = order;
+
+  Position p = {};
+  File f = _fs->open(fileFor(folder, ".pos"), FILE_READ);
+  bool ok = f && f.read((uint8_t *)&p, sizeof(p)) == sizeof(p) && p.magic == POS_MAGIC;
+  if (f) f.close();
+  if (!ok) p = Position();
+  _state = p;
+  _state.magic = POS_MAGIC;
+  _state.listHash = hash;
+  _state.pos = count; // a new round unless the order below is good
+  if (!ok || p.listHash != hash || p.pos > (uint32_t)count) return false;
+
+  BagHeader h;
+  f = _fs->open(fileFor(folder, ".bag"), FILE_READ);
+  ok = f && f.read((uint8_t *)&h, sizeof(h)) == sizeof(h) && h.magic == BAG_MAGIC && h.listHash == hash &&
+       h.count == (uint32_t)count && f.read((uint8_t *)_order, count * sizeof(uint16_t)) == count * sizeof(uint16_t);
+  if (f) f.close();
+  for (int i = 0; ok && i < count; ++i) ok = _order[i] < count;
+  if (ok) _state.pos = p.pos;
+  return ok;
+}
+
+// A new round: Fisher-Yates, or with weights a sort by random keys; then
+// the first slots are cleared of tracks played just before: slot i may not
+// hold one of the last window - i played, so nothing comes back within
+// `window` draws. Each slot has at least count - window tracks to pick
+// from, so this never fails.
+void ShuffleBag::shuffle(const FileScanner &lib, int folder, WeightFn weight, void *ctx) {
+  for (int i = 0; i < _count; ++i) _order[i] = (uint16_t)i;
+  float *key = weight ? (float *)malloc(_count * sizeof(float)) : nullptr;
+  if (key) {
+    for (int i = 0; i < _count; ++i) {
+      float w = weight(i, ctx);
+      float u = (random(0x7FFFFFFF) + 1.0f) / 2147483648.0f; // (0, 1]
+      key[i] = -logf(u) / (w > 0.01f ? w : 0.01f);
+    }
+    std::sort(_order, _order + _count, [key](uint16_t a, uint16_t b) { return key[a] < key[b]; });
+    free(key);
+  } else {
+    for (int i = _count - 1; i > 0; --i) {
+      int j = random(i + 1);
+      uint16_t t = _order[i];
+      _order[i] = _order[j];
+      _order[j] = t;
+    }
+  }
+
+  // At most half the folder is held back, so a small one still shuffles
+  int window = _count / 2 < SHUFFLE_NO_REPEAT ? _count / 2 : SHUFFLE_NO_REPEAT;
+  for (int i = 0; i < window; ++i) {
+    if (!recent(pathHash(lib, folder, _order[i]), window - i)) continue;
+    int tail = _count - i - 1;
+    int start = random(tail);
+    for (int k = 0; k < tail; ++k) {
+      int j = i + 1 + (start + k) % tail;
+      if (recent(pathHash(lib, folder, _order[j]), window - i)) continue;
+      uint16_t t = _order[i];
+      _order[i] = _order[j];
+      _order[j] = t;
+      break;
+    }
+  }
+  _state.pos = 0;
+}
+
+void ShuffleBag::saveOrder(const String &folder) {
+  BagHeader h = {BAG_MAGIC, _state.listHash, (uint32_t)_count};
+  File f = _fs->open(fileFor(folder, ".bag"), FILE_WRITE);
+  bool ok = f && f.write((const uint8_t *)&h, sizeof(h)) == sizeof(h) &&
+            f.write((const uint8_t *)_order, _count * sizeof(uint16_t)) == _count * sizeof(uint16_t);
+  if (f) f.close();
+  if (!ok) Serial.println("ShuffleBag: could not save the order");
+}
+
+void ShuffleBag::savePosition(const String &folder) {
+  File f = _fs->open(fileFor(folder, ".pos"), FILE_WRITE);
+  if (!f) return;
+  f.write((const uint8_t *)&_state, sizeof(_state));
+  f.close();
+}
@@ -0,0 +1,64 @@
+#ifndef SHUFFLE_BAG_H
+#define SHUFFLE_BAG_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "Config.h"
+#include "FileScanner.h"
+
+// Random play without repeats: every track of a folder comes up once, in a
+// shuffled order, before any comes up again, and none comes back within
+// SHUFFLE_NO_REPEAT draws (or half the folder, if that is fewer) across the
+// start of a new round. A draw is the next slot of the order.
+//
+// The order is a Fisher-Yates shuffle of the folder's list, or with weights,
+// sorted by random keys -ln(u)/w so heavier tracks tend to come up sooner
+// (still once each). Each folder's order is kept in its own file under
+// SHUFFLE_DIR, 2 bytes a track, written once per round; the position and
+// the recent tracks go in a small file rewritten on each draw, so a reboot
+// carries on where it was. A change to the folder's list starts a new round.
+class ShuffleBag {
+public:
+  // Weight of track `index` of the folder, > 0; heavier comes up sooner
+  typedef float (*WeightFn)(int index, void *ctx);
+
+  ~ShuffleBag();
+  void begin(fs::FS &fs, const char *dir);
+
+  // Next track of `folder`, as an index into its list; -1 if it is empty
+  int next(const FileScanner &lib, int folder, WeightFn weight = nullptr, void *ctx = nullptr);
+
+private:
+  struct BagHeader {
+    uint32_t magic;
+    uint32_t listHash; // of the folder's names when the order was made
+    uint32_t count;
+  };
+  struct Position {
+    uint32_t magic;
+    uint32_t listHash;
+    uint32_t pos;
+    uint32_t recentAt;
+    uint32_t recent[SHUFFLE_NO_REPEAT]; // path hashes, a ring
+  };
+  static const uint32_t BAG_MAGIC = 0x31474142; // "BAG1"
+  static const uint32_t POS_MAGIC = 0x31534F50; // "POS1"
+
+  fs::FS *_fs = nullptr;
+  String _dir;
+  String _folder; // whose order is loaded
+  uint16_t *_order = nullptr;
+  int _count = 0;
+  Position _state = {};
+
+  String fileFor(const String &folder, const char *ext) const;
+  static uint32_t listHash(const FileScanner &lib, int folder);
+  static uint32_t pathHash(const FileScanner &lib, int folder, int index);
+  bool recent(uint32_t hash, int depth) const;
+  bool load(const String &folder, uint32_t hash, int count);
+  void shuffle(const FileScanner &lib, int folder, WeightFn weight, void *ctx);
+  void saveOrder(const String &folder);
+  void savePosition(const String &folder);
+};
+
+#endif // SHUFFLE_BAG_H
@@ -1,6 +1,8 @@
 #include "StateMachine.h"
 #include "Config.h"
+#include "LoudnessIndex.h"
 #include "Settings.h"
+#include "SD.h"
 
 // Relay control methods
 void StateMachine::setRelayOn() {
@@ -39,43 +41,42 @@ bool StateMachine::isDNDTime() {
   }
 }
 
-bool StateMachine::startChime() {
-  _preemptState = _state;
-  if (_audio && _audio->isRunning()) {
-    String cur = _audio->getCurrentPath();
-    if (cur.length() > 0) {
-      _preemptPath = cur;
-      _hadPreempt = true;
-    }
-  }
+// Queue a start whose outcome periodic() waits for: onStartResult() clears
+// _startPending, and sets _startFailed if it never played
+void StateMachine::startTracked(const String &path, uint32_t frame) {
+  _startPending = true;
+  _startFailed = false;
+  _startHandle = _audio->startAsync(path, onStartResult, this, frame);
+}
 
-  // Start the first bell
-  bool ok = (_audio ? _audio->start(String(BELL_PATH)) : false);
-  if (ok) {
-    _state = GREETING; // Reuse greeting state for chime sequence
+// Put back the volume a chime saved, if it saved one
+void StateMachine::restoreVolume() {
+  if (!_volumeSaved)
+    return;
+  _volumeSaved = false;
+  if (_audio)
+    _audio->setVolume(_savedVolume);
+  Serial.printf("StateMachine: Restored volume to %d after chime\n", _savedVolume);
+}
+
+// Chime over (or abandoned): resume whatever it interrupted, or go idle
+void StateMachine::endChime() {
+  _inChime = false;
+  _chimePhase = CH_NONE;
+  _chimeBellRemaining = 0;
+  _chimeNumberRepeats = 0;
+  restoreVolume();
+  if (_hadPreempt && _audio) {
+    Serial.println("StateMachine: chime complete -> resuming preempted track");
+    _state = _preemptState;
     _isPlaying = true;
-    return true;
+    startTracked(_preemptPath, _preemptFrame);
   } else {
-    _inChime = false;
-    _chimePhase = CH_NONE;
-
-    // Try to resume preempted audio if any
-    if (_hadPreempt && _audio) {
-      if (_audio->start(_preemptPath)) {
-        _state = _preemptState;
-        _isPlaying = true;
-      } else {
-        _state = IDLE;
-        _isPlaying = false;
-      }
-    } else {
-      _state = IDLE;
-      _isPlaying = false;
-    }
-    _hadPreempt = false;
-    _preemptPath = String();
-    return false;
+    _state = IDLE;
+    _isPlaying = false;
   }
+  _hadPreempt = false;
+  _preemptPath = String();
 }
 
 void StateMachine::begin(AudioManager *am, FileScanner *fs) {
@@ -85,6 +86,7 @@ void StateMachine::begin(AudioManager *am, FileScanner *fs) {
   _state = IDLE;
   _lastTriggerAttempt = 0;
   _lastMotion = 0;
+  _shuffle.begin(SD, SHUFFLE_DIR);
 
   // Initialize Settings
   Settings::begin();
@@ -135,10 +137,49 @@ void StateMachine::begin(AudioManager *am, FileScanner *fs) {
       Serial.println("The RTC might have lost power and needs to be set");
     }
   }
+
+  _history.begin(SD, HISTORY_PATH);
+  _history.log(PlayHistory::EV_BOOT, clockTime());
+
+  _health.begin(SD, HEALTH_PATH);
+  if (_audio)
+    _audio->setTrackResultCallback(onTrackResult, this);
+}
+
+// RTC unixtime, 0 if the clock isn't set
+uint32_t StateMachine::clockTime() {
+  DateTime now;
+  return _rtc.now(now) ? now.unixtime() : 0;
+}
+
+// Library tracks as they stop, for the history. The audio task moves on to
+// the next track by itself (prefetch, crossfade), so this watches what is
+// playing; a stop is seen within STATE_CHECK_INTERVAL_MS.
+void StateMachine::watchTrack(unsigned long now) {
+  String cur = (_audio && _audio->isRunning()) ? _audio->getCurrentPath() : String();
+  if (cur == _histPath) {
+    if (!cur.length())
+      _stopReason = PlayHistory::R_NONE; // nothing was playing to stop
+    return;
+  }
+  if (_histTrack) {
+    PlayHistory::Reason reason = _stopReason != PlayHistory::R_NONE ? _stopReason : PlayHistory::R_END;
+    // Where it is in the list, for the web page to name it without a search
+    int index = _fs ? _fs->indexOf(_histPath.c_str()) : -1;
+    _history.log(PlayHistory::EV_TRACK, clockTime(), _histTrack, now - _histSince, reason, index);
+  }
+  _stopReason = PlayHistory::R_NONE;
+  _histPath = cur;
+  _histSince = now;
+  _histTrack = 0;
+  int slash = cur.lastIndexOf('/');
+  if (slash > 0 && _fs && _fs->folderId(cur.substring(0, slash).c_str()) >= 0)
+    _histTrack = LoudnessIndex::hashPath(cur.c_str());
 }
 
 void StateMachine::motionSample(bool motionHigh) {
   unsigned long now = millis();
+  unsigned long sampleUs = micros(); // start of motion-to-sound latency
 
   // update last motion time
   if (motionHigh)
@@ -162,20 +203,32 @@ void StateMachine::motionSample(bool motionHigh) {
     _lastTriggerAttempt = now;
 
     // attempt to start greeting; only set _isPlaying if start succeeded
-    startGreeting();
+    startGreeting(sampleUs);
+    if (_isPlaying)
+      _history.log(PlayHistory::EV_MOTION, clockTime());
   }
 
   _lastPirState = motionHigh;
 }
 
-void StateMachine::startGreeting() {
+void StateMachine::startGreeting(unsigned long triggerUs) {
   if (isDNDTime()) {
     _state = IDLE;
     _isPlaying = false;
     return;
   }
 
-  if (_audio && _audio->start(String("/jay-swaminarayan.mp3"))) {
+  // Play the resident copy when it was cached at boot, else stream from SD
+  bool ok = false;
+  if (_audio) {
+    if (_audio->hasGreeting()) {
+      ok = _audio->playGreeting(triggerUs);
+    } else {
+      startTracked(String(GREETING_PATH));
+      ok = true;
+    }
+  }
+  if (ok) {
     _state = GREETING;
     _isPlaying = true;
   } else {
@@ -206,30 +259,170 @@ void StateMachine::startDhunSession() {
   }
 }
 
-bool StateMachine::startRandomDhun() {
-  if (isDNDTime() || !_fs)
+// Library folder for this time of day (PLAYLIST_SCHEDULE)
+int StateMachine::playlistFolder() {
+  struct Slot {
+    int hour;
+    const char *folder;
+  };
+  static const Slot schedule[] = PLAYLIST_SCHEDULE;
+  static const int slots = sizeof(schedule) / sizeof(schedule[0]);
+  int dhun = _fs->folderId(DHUN_DIR);
+
+  DateTime now;
+  if (!_rtc.now(now))
+    return dhun;
+  int hour = now.hour();
+
+  // The latest slot started by now; before the first one, yesterday's last
+  int pick = -1, last = 0;
+  for (int i = 0; i < slots; ++i) {
+    if (schedule[i].hour <= hour && (pick < 0 || schedule[i].hour > schedule[pick].hour))
+      pick = i;
+    if (schedule[i].hour > schedule[last].hour)
+      last = i;
+  }
+  if (pick < 0)
+    pick = last;
+
+  int id = _fs->folderId(schedule[pick].folder);
+  return _fs->getCount(id) > 0 ? id : dhun;
+}
+
+// Files copied on in the last SHUFFLE_NEW_DAYS come up sooner in a round
+float StateMachine::shuffleWeight(int index, void *ctx) {
+  StateMachine *sm = static_cast<StateMachine *>(ctx);
+  const FileScanner::TrackInfo *info = sm->_fs->getInfo(sm->_shuffleFolder, index);
+  if (!info || !sm->_shuffleNow || info->mtime > sm->_shuffleNow)
+    return 1.0f;
+  return sm->_shuffleNow - info->mtime < SHUFFLE_NEW_DAYS * 86400UL ? SHUFFLE_NEW_WEIGHT : 1.0f;
+}
+
+bool StateMachine::pickRandomDhun(String &path) {
+  if (!_fs)
     return false;
 
-  int count = _fs->getCount("/dhun");
-  if (count <= 0)
+  int folder = playlistFolder();
+  _shuffleFolder = folder;
+  _shuffleNow = clockTime();
+  // Quarantined tracks are drawn and passed over, so they keep their place
+  // in the round; a whole round of them means there is nothing to play
+  int count = _fs->getCount(folder);
+  for (int tries = 0; tries < count; ++tries) {
+    int idx = _shuffle.next(*_fs, folder, shuffleWeight, this);
+    if (idx < 0)
+      return false;
+    path = _fs->getPath(folder, idx).str();
+    if (path.length() > 0 && !_health.quarantined(path.c_str()))
+      return true;
+  }
+  return false;
+}
+
+bool StateMachine::startRandomDhun() {
+  if (isDNDTime())
     return false;
 
-  // pick random file
-  int idx = random(count);
-  String path = _fs->getPath("/dhun", idx);
+  String path;
+  if (!pickRandomDhun(path))
+    return false;
 
-  if (_audio && _audio->start(path)) {
+  // Returns as soon as the start is queued; a failure shows up as the audio
+  // not running on a later tick and is counted by AudioManager
+  if (_audio) {
+    _audio->startAsync(path);
     _isPlaying = true;
     return true;
   }
   return false;
 }
 
+// Completion of a start queued by the state machine
+void StateMachine::onTrackResult(const char *path, bool ok, void *ctx) {
+  StateMachine *sm = static_cast<StateMachine *>(ctx);
+  sm->_health.record(path, ok, sm->clockTime());
+}
+
+// The card still reads: failing starts are then down to the files, which
+// get quarantined, and a reboot wouldn't help. One remount is tried first.
+// Probe the card without unmounting it: the audio task may have files open
+static bool sdResponds() {
+  File root = SD.open("/");
+  bool ok = root && root.isDirectory();
+  if (root)
+    root.close();
+  return ok && SD.cardType() != CARD_NONE;
+}
+
+// A remount only after the probe fails, and then through remountSD(), which
+// holds the audio task off the card first
+bool StateMachine::sdAlive() {
+  if (sdResponds())
+    return true;
+  return remountSD() && sdResponds();
+}
+
+// The card is remounted from the loop, where its other users run: the
+// library scan closes its files, then the audio task is held off it
+bool StateMachine::remountSD() {
+  if (_fs)
+    _fs->closeFiles();
+  return _audio && _audio->remountSD();
+}
+
+void StateMachine::onStartResult(uint32_t handle, bool ok, uint32_t latencyMs, void *ctx) {
+  StateMachine *sm = static_cast<StateMachine *>(ctx);
+  if (handle != sm->_startHandle)
+    return;
+  sm->_startPending = false;
+  if (ok)
+    return;
+  // A chime clip that never started ends the chime, from periodic()
+  if (sm->_inChime) {
+    sm->_startFailed = true;
+    return;
+  }
+  // A greeting that never started has nothing to continue into
+  if (sm->_state == GREETING && !sm->_inChime) {
+    Serial.println("StateMachine: greeting start failed -> IDLE");
+    sm->_state = IDLE;
+    sm->_isPlaying = false;
+  }
+}
+
+// Measure dhuns that have no loudness gain yet, one at a time
+void StateMachine::scheduleLoudness(unsigned long now) {
+  if (!_audio || !_fs || _inChime || _chimeSoon || _audio->isAnalyzing())
+    return;
+  if (now - _lastLoudnessCheck < LOUDNESS_SCAN_INTERVAL_MS)
+    return;
+  _lastLoudnessCheck = now;
+
+  int count = _fs->totalCount();
+  for (int n = 0; n < count; ++n) {
+    int i = (_loudnessCursor + n) % count;
+    // Copied to the stack, not the heap: this runs over the whole library
+    char path[FileScanner::MAX_PATH_LEN];
+    if (!_fs->pathAt(i).copy(path, sizeof(path)))
+      continue;
+    if (_audio->needsLoudness(path)) {
+      _loudnessCursor = i; // comes back to it if the deck was busy
+      _audio->analyzeLoudness(path);
+      return;
+    }
+  }
+}
+
 void StateMachine::periodic() {
   unsigned long now = millis();
   if (now - _lastCheck < STATE_CHECK_INTERVAL_MS)
     return;
   _lastCheck = now;
+  if (_audio && _audio->wantsRemount())
+    remountSD();
+  scheduleLoudness(now);
+  watchTrack(now);
+  _history.loop();
 
   // Hourly chime scheduler (uses DS3231 via RtcClock)
   DateTime dt;
@@ -244,21 +437,41 @@ void StateMachine::periodic() {
                   "inWindow=%d, inRange=%d, inChime=%d, lastChimeHour=%d\n",
                   hr, sec, inWindow ? 1 : 0, inRange ? 1 : 0, _inChime ? 1 : 0,
                   _lastChimeHour);
+    // Since we trigger at end of hour (e.g., 11:59), announce the NEXT hour
+    // (12)
+    int nextHr = (hr + 1) % 24;
+    int h12 = nextHr % 12;
+    if (h12 == 0)
+      h12 = 12;
+
+    // Decode the clips for the coming chime ahead of time
+    _chimeSoon = inRange && min >= CHIME_PREPARE_MINUTE;
+    if (_chimeSoon && !_inChime && _audio) {
+      _audio->prepareChime(h12);
+    }
+
+    // Preferred: mixed over the playing track, which carries on underneath
+    // with nothing to stop or resume
+    if (inRange && inWindow && !_inChime && (_lastChimeHour != hr) && _audio &&
+        _audio->duckChime(h12)) {
+      Serial.printf("StateMachine: chime mixed over '%s'\n", _audio->getCurrentPath().c_str());
+      _inChime = true;
+      _chimePhase = CH_DUCKED;
+      _lastChimeHour = hr;
+      _history.log(PlayHistory::EV_CHIME, dt.unixtime(), h12);
+    }
+
     if (inRange && inWindow && !_inChime && (_lastChimeHour != hr)) {
-      // Since we trigger at end of hour (e.g., 11:59), announce the NEXT hour
-      // (12)
-      int nextHr = (hr + 1) % 24;
-      int h12 = nextHr % 12;
-      if (h12 == 0)
-        h12 = 12;
       _inChime = true;
       _chimeHourNumber = h12;
       _chimeBellRemaining = h12;
       _chimePhase = CH_BELLS;
       _lastChimeHour = hr; // prevent re-triggering within the hour
+      _history.log(PlayHistory::EV_CHIME, dt.unixtime(), h12);
 
       // Save current volume before starting chime
       _savedVolume = _audio->getVolume();
+      _volumeSaved = true;
       Serial.printf("StateMachine: Saved volume %d for chime\n", _savedVolume);
 
       // Capture current playback to resume later
@@ -269,179 +482,82 @@ void StateMachine::periodic() {
         String cur = _audio->getCurrentPath();
         if (cur.length() > 0) {
           _preemptPath = cur;
+          _preemptFrame = _audio->getPositionFrames();
           _hadPreempt = true;
-          Serial.printf("StateMachine: preempting '%s' (state=%d) for chime\n",
-                        _preemptPath.c_str(), (int)_preemptState);
+          _stopReason = PlayHistory::R_CHIME;
+          Serial.printf("StateMachine: preempting '%s' at frame %lu (state=%d) for chime\n",
+                        _preemptPath.c_str(), (unsigned long)_preemptFrame, (int)_preemptState);
         }
       }
 
-      bool ok = (_audio ? _audio->start(String(BELL_PATH)) : false);
-      Serial.printf("StateMachine: start bell.mp3 returned %d\n", ok ? 1 : 0);
-      if (ok) {
-        _state = GREETING; // reuse GREETING state for chime sequence management
-        _isPlaying = true;
-      } else {
-        Serial.println(
-            "StateMachine: Failed to start bell.mp3, aborting chime");
-        _inChime = false;
-        _chimePhase = CH_NONE;
-        if (_hadPreempt && _audio) {
-          Serial.println(
-              "StateMachine: chime start failed -> resuming preempted track");
-          if (_audio->start(_preemptPath)) {
-            _state = _preemptState;
-            _isPlaying = true;
-          } else {
-            _state = IDLE;
-            _isPlaying = false;
-          }
-        } else {
-          _state = IDLE;
-          _isPlaying = false;
-        }
-        _hadPreempt = false;
-        _preemptPath = String();
+      // Preferred: the whole chime as one pre-rendered stream; else bell by
+      // bell, each start queued and its outcome seen on a later tick
+      if (_audio && _audio->playChime(h12)) {
+        Serial.println("StateMachine: playing pre-rendered chime");
+        _chimePhase = CH_SEQUENCE;
+      } else if (_audio) {
+        startTracked(String(BELL_PATH));
+        Serial.println("StateMachine: bell.mp3 queued");
       }
+      _state = GREETING; // reuse GREETING state for chime sequence management
+      _isPlaying = true;
     }
   } else {
     Serial.println("StateMachine: RTC now read failed");
   }
 
+  // A ducked chime ends on its own; the track under it never stopped
+  if (_inChime && _chimePhase == CH_DUCKED && !_audio->isChiming()) {
+    Serial.println("StateMachine: ducked chime finished");
+    _inChime = false;
+    _chimePhase = CH_NONE;
+  }
+
   // Core transitions
   if (_state == GREETING) {
-    if (!_audio->isRunning()) {
+    if (_startPending) {
+      // the last start hasn't reported yet: nothing has finished
+    } else if (_startFailed) {
+      _startFailed = false;
+      if (_inChime) {
+        Serial.println("StateMachine: chime clip failed to start, aborting chime");
+        endChime();
+      }
+    } else if (!_audio->isRunning()) {
       Serial.println("StateMachine: GREETING finished (audio not running)");
       if (_isPlaying) {
+        if (_inChime && _chimePhase == CH_DUCKED) {
+          // Mixed over the greeting, which ended under it: the engine ends
+          // the duck itself, and this chime never changed the volume
+          Serial.println("StateMachine: greeting ended under a ducked chime");
+          _inChime = false;
+          _chimePhase = CH_NONE;
+        }
         if (_inChime) {
-          if (_chimePhase == CH_BELLS) {
-            if (_chimeBellRemaining > 0) {
-              _chimeBellRemaining--;
-            }
-            if (_chimeBellRemaining > 0) {
-              // Set to max volume for chime (volume already saved above)
-              _audio->setVolume(21); // Max volume
-              Serial.printf("StateMachine: CHIME bell remaining=%d\n",
-                            _chimeBellRemaining);
-              bool ok = (_audio ? _audio->start(String(BELL_PATH)) : false);
-              Serial.printf("StateMachine: start bell.mp3 returned %d\n",
-                            ok ? 1 : 0);
-              if (ok) {
-                _isPlaying = true;
-              } else {
-                Serial.println(
-                    "StateMachine: Failed to start bell.mp3, aborting chime");
-                _inChime = false;
-                _chimePhase = CH_NONE;
-                _audio->setVolume(_savedVolume); // Restore volume on error
-                Serial.printf(
-                    "StateMachine: Restored volume to %d after bell error\n",
-                    _savedVolume);
-                _state = IDLE;
-                _isPlaying = false;
-              }
-            } else {
-              _chimePhase = CH_NUMBER;
-              char numFile[48];
-              snprintf(numFile, sizeof(numFile), "%s%d.mp3", HOURS_DIR,
-                       _chimeHourNumber);
-              Serial.printf("StateMachine: CHIME number -> %s\n", numFile);
-              bool ok = (_audio ? _audio->start(String(numFile)) : false);
-              Serial.printf("StateMachine: start number file returned %d\n",
-                            ok ? 1 : 0);
-              if (ok) {
-                _isPlaying = true;
-              } else {
-                Serial.println("StateMachine: Failed to start number file, "
-                               "aborting chime");
-                _inChime = false;
-                _chimePhase = CH_NONE;
-                _audio->setVolume(_savedVolume); // Restore volume on error
-                Serial.printf(
-                    "StateMachine: Restored volume to %d after number error\n",
-                    _savedVolume);
-                if (_hadPreempt && _audio) {
-                  Serial.println("StateMachine: number play failed -> resuming "
-                                 "preempted track");
-                  if (_audio->start(_preemptPath)) {
-                    _state = _preemptState;
-                    _isPlaying = true;
-                  } else {
-                    _state = IDLE;
-                    _isPlaying = false;
-                  }
-                } else {
-                  _state = IDLE;
-                  _isPlaying = false;
-                }
-                _hadPreempt = false;
-                _preemptPath = String();
-              }
-            }
-          } else if (_chimePhase == CH_NUMBER) {
-            static int playCount = 0;
-            playCount++;
-
-            if (playCount <= 2) { // Play the hour number twice
-              char numFile[48];
-              snprintf(numFile, sizeof(numFile), "%s%d.mp3", HOURS_DIR,
-                       _chimeHourNumber);
-              Serial.printf("StateMachine: CHIME playing number %d/2 -> %s\n",
-                            playCount, numFile);
-              if (_audio->start(String(numFile))) {
-                _isPlaying = true;
-                return; // Exit and wait for this to finish
-              }
-            }
-
-            // If we get here, both plays are done or failed
-            if (playCount >= 2) {
-              Serial.println(
-                  "StateMachine: CHIME number finished twice, ending chime");
-              playCount = 0; // Reset for next time
-              _inChime = false;
-              _chimePhase = CH_NONE;
-              // Restore original volume
-              _audio->setVolume(_savedVolume);
-              Serial.printf("StateMachine: Restored volume to %d after chime\n",
-                            _savedVolume);
-            }
-            if (_hadPreempt && _audio) {
-              Serial.println(
-                  "StateMachine: chime complete -> resuming preempted track");
-              if (_audio->start(_preemptPath)) {
-                _state = _preemptState;
-                _isPlaying = true;
-              } else {
-                _state = IDLE;
-                _isPlaying = false;
-              }
-            } else {
-              _state = IDLE;
-              _isPlaying = false;
-            }
-            _hadPreempt = false;
-            _preemptPath = String();
+          char numFile[48];
+          snprintf(numFile, sizeof(numFile), "%s%d.mp3", HOURS_DIR, _chimeHourNumber);
+          if (_chimePhase == CH_SEQUENCE) {
+            Serial.println("StateMachine: CHIME sequence finished");
+            endChime();
+          } else if (_chimePhase == CH_BELLS && _chimeBellRemaining > 1) {
+            _chimeBellRemaining--;
+            _audio->setVolume(21); // Max volume for the chime (saved above)
+            Serial.printf("StateMachine: CHIME bell remaining=%d\n", _chimeBellRemaining);
+            startTracked(String(BELL_PATH));
+          } else if (_chimePhase == CH_BELLS) {
+            // The hour number, then twice more
+            _chimeBellRemaining = 0;
+            _chimePhase = CH_NUMBER;
+            _chimeNumberRepeats = 2;
+            Serial.printf("StateMachine: CHIME number -> %s\n", numFile);
+            startTracked(String(numFile));
+          } else if (_chimePhase == CH_NUMBER && _chimeNumberRepeats > 0) {
+            _chimeNumberRepeats--;
+            Serial.printf("StateMachine: CHIME number again -> %s\n", numFile);
+            startTracked(String(numFile));
           } else {
-            Serial.println("StateMachine: CHIME unknown phase, aborting");
-            _inChime = false;
-            _chimePhase = CH_NONE;
-            _audio->setVolume(_savedVolume); // Restore volume on unknown phase
-            if (_hadPreempt && _audio) {
-              Serial.println("StateMachine: chime unknown phase -> resuming "
-                             "preempted track");
-              if (_audio->start(_preemptPath)) {
-                _state = _preemptState;
-                _isPlaying = true;
-              } else {
-                _state = IDLE;
-                _isPlaying = false;
-              }
-            } else {
-              _state = IDLE;
-              _isPlaying = false;
-            }
-            _hadPreempt = false;
-            _preemptPath = String();
+            Serial.println("StateMachine: CHIME finished");
+            endChime();
           }
         } else {
           _isPlaying = false;
@@ -457,6 +573,7 @@ void StateMachine::periodic() {
     if (now - _lastMotion > DHUN_SESSION_TIMEOUT_MS) {
       Serial.println(
           "StateMachine: DHUN session timeout (no motion) -> stopping");
+      _stopReason = PlayHistory::R_TIMEOUT;
       if (_audio)
         _audio->stop();
       setRelayOff(); // Turn off light when dhun session ends
@@ -466,20 +583,35 @@ void StateMachine::periodic() {
       return;
     }
 
-    // if current dhun finished, start another
+    // queue the next dhun on the idle decoder so it follows without a gap
+    if (_audio->wantsPrefetch() && !isDNDTime() &&
+        now - _lastPrefetchAttempt >= PREFETCH_RETRY_MS) {
+      _lastPrefetchAttempt = now;
+      String next;
+      if (pickRandomDhun(next)) {
+        Serial.printf("StateMachine: prefetching next dhun %s\n", next.c_str());
+        _audio->prefetch(next);
+      }
+    }
+
+    // if current dhun finished without a prefetched successor, start another
     if (!_audio->isRunning()) {
       Serial.println("StateMachine: DHUN track finished");
-      // try to start next dhun
-      bool ok = startRandomDhun();
-      if (!ok) {
-        Serial.println("StateMachine: failed to start dhun (increment fail)");
-        // If audio manager has many consecutive fails, reboot to recover
-        if (_audio && _audio->getConsecutiveFails() >= 5) {
+      // Many consecutive fails: reboot only if the card itself has gone
+      if (_audio->getConsecutiveFails() >= 5) {
+        if (!sdAlive()) {
           Serial.println(
-              "StateMachine: consecutive start failures >=5 -> rebooting");
+              "StateMachine: consecutive start failures >=5, SD not responding -> rebooting");
           delay(200);
           esp_restart();
         }
+        Serial.println("StateMachine: consecutive start failures >=5, SD fine -> skipping bad tracks");
+        _audio->resetConsecutiveFails();
+      }
+      // try to start next dhun
+      bool ok = startRandomDhun();
+      if (!ok) {
+        Serial.println("StateMachine: failed to start dhun (nothing to play)");
       }
     }
   } else if (_state == IDLE) {
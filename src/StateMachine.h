@@ -3,8 +3,11 @@
 
 #include "AudioManager.h"
 #include "FileScanner.h"
+#include "PlayHistory.h"
 #include "RtcClock.h"
 #include "Settings.h"
+#include "ShuffleBag.h"
+#include "TrackHealth.h"
 #include <Arduino.h>
 #include <Preferences.h>
 
@@ -19,6 +22,10 @@ public:
 
   // Public methods
   RtcClock &getRtc() { return _rtc; } // Moved to public section
+  PlayHistory &getHistory() { return _history; }
+  TrackHealth &getHealth() { return _health; }
+  // Why the playing track is about to stop, for its history record
+  void noteStop(PlayHistory::Reason reason) { _stopReason = reason; }
 
   // Relay control methods
   void setRelayOn();
@@ -60,6 +67,23 @@ private:
   unsigned long _lastTriggerAttempt = 0;
   unsigned long _minGapMs = 500; // min gap between triggers
   bool _lastPirState = false;
+  unsigned long _lastPrefetchAttempt = 0;
+  static const unsigned long PREFETCH_RETRY_MS = 2000;
+  unsigned long _lastLoudnessCheck = 0;
+  int _loudnessCursor = 0;
+  ShuffleBag _shuffle;
+  int _shuffleFolder = -1;   // for shuffleWeight
+  uint32_t _shuffleNow = 0;  // RTC time of the draw, 0 if unknown
+  bool _chimeSoon = false; // chime clips are being prepared, keep the idle deck free
+
+  // Play history: the library track playing and since when
+  PlayHistory _history;
+  String _histPath;
+  uint32_t _histTrack = 0; // path hash, 0 if not a library track
+  unsigned long _histSince = 0;
+  PlayHistory::Reason _stopReason = PlayHistory::R_NONE;
+
+  TrackHealth _health; // failing tracks, skipped by pickRandomDhun() once quarantined
 
   // RTC + chime
   RtcClock _rtc; // Single declaration of _rtc
@@ -71,20 +95,38 @@ private:
   int _dndEndHour = 6;     // Default DND end: 6 AM
   bool _dndEnabled = true; // DND enabled by default
   int _chimeWindowSec = 5; // Default chime window in seconds
-  enum ChimePhase { CH_NONE, CH_BELLS, CH_NUMBER } _chimePhase = CH_NONE;
+  enum ChimePhase { CH_NONE, CH_BELLS, CH_NUMBER, CH_SEQUENCE, CH_DUCKED } _chimePhase = CH_NONE;
 
   // Preemption tracking for resume after chime
   String _preemptPath;
+  uint32_t _preemptFrame = 0; // where it was, to resume on the same frame
   State _preemptState = IDLE;
   bool _hadPreempt = false;
   int _savedVolume = 0;
+  bool _volumeSaved = false; // by a chime that changes the volume, for endChime()
+  int _chimeNumberRepeats = 0;
+  uint32_t _startHandle = 0; // last start queued with onStartResult
+  bool _startPending = false; // its outcome not in yet
+  bool _startFailed = false;
 
   // Audio control
   bool isDNDTime();
-  void startGreeting();
+  uint32_t clockTime();
+  void watchTrack(unsigned long now);
+  void startGreeting(unsigned long triggerUs);
   void startDhunSession();
+  int playlistFolder();
+  static float shuffleWeight(int index, void *ctx);
+  bool pickRandomDhun(String &path);
   bool startRandomDhun();
-  bool startChime();
+  void scheduleLoudness(unsigned long now);
+  void startTracked(const String &path, uint32_t frame = 0);
+  void restoreVolume();
+  void endChime();
+  static void onStartResult(uint32_t handle, bool ok, uint32_t latencyMs, void *ctx);
+  static void onTrackResult(const char *path, bool ok, void *ctx);
+  bool sdAlive();
+  bool remountSD();
 
   // Save current settings to persistent storage
   void saveSettings() {
@@ -0,0 +1,134 @@
+#include "TrackHealth.h"
+#include "LoudnessIndex.h"
+
+namespace {
+
+// On the card: magic and count, then a Record and the path for each entry
+struct Record {
+  uint32_t hash;
+  uint32_t lastFail;
+  uint8_t fails;
+  uint8_t flags; // 1: quarantined
+  uint8_t pathLen;
+  uint8_t reserved;
+};
+
+} // namespace
+
+void TrackHealth::begin(fs::FS &fs, const char *path) {
+  _fs = &fs;
+  _path = path;
+  _entries.clear();
+
+  File f = _fs->open(_path, FILE_READ);
+  if (!f) return;
+  uint32_t header[2];
+  if (f.read((uint8_t *)header, sizeof(header)) != sizeof(header) || header[0] != MAGIC) {
+    Serial.printf("TrackHealth: %s is not a health table, ignoring it\n", path);
+    f.close();
+    return;
+  }
+  for (uint32_t i = 0; i < header[1]; ++i) {
+    Record r;
+    char name[256];
+    if (f.read((uint8_t *)&r, sizeof(r)) != sizeof(r) || f.read((uint8_t *)name, r.pathLen) != r.pathLen) {
+      Serial.printf("TrackHealth: %s is truncated, ignoring the rest\n", path);
+      break;
+    }
+    name[r.pathLen] = 0;
+    _entries.push_back({r.hash, r.fails, (r.flags & 1) != 0, r.lastFail, String(name)});
+  }
+  f.close();
+  Serial.printf("TrackHealth: %u failing tracks, %u quarantined\n", (unsigned)_entries.size(),
+                (unsigned)quarantinedCount());
+}
+
+int TrackHealth::find(uint32_t hash) const {
+  int lo = 0, hi = (int)_entries.size();
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (_entries[mid].hash < hash) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo < (int)_entries.size() && _entries[lo].hash == hash) return lo;
+  return -(lo + 1);
+}
+
+void TrackHealth::record(const char *path, bool ok, uint32_t time) {
+  int i = find(LoudnessIndex::hashPath(path));
+  if (ok) {
+    // Plays after all: forget it
+    if (i < 0) return;
+    if (_entries[i].quarantined) Serial.printf("TrackHealth: %s plays again, released\n", path);
+    _entries.erase(_entries.begin() + i);
+    save();
+    return;
+  }
+
+  if (i < 0) {
+    i = -i - 1;
+    _entries.insert(_entries.begin() + i, {LoudnessIndex::hashPath(path), 0, false, 0, String(path)});
+  }
+  Entry &e = _entries[i];
+  if (e.fails < 255) e.fails++;
+  e.lastFail = time;
+  if (!e.quarantined && e.fails >= HEALTH_QUARANTINE_FAILS) {
+    e.quarantined = true;
+    Serial.printf("TrackHealth: %s failed %d times in a row, quarantined\n", path, e.fails);
+  }
+  save();
+}
+
+bool TrackHealth::quarantined(const char *path) const {
+  if (_entries.empty()) return false;
+  int i = find(LoudnessIndex::hashPath(path));
+  return i >= 0 && _entries[i].quarantined;
+}
+
+bool TrackHealth::release(const char *path) {
+  int i = find(LoudnessIndex::hashPath(path));
+  if (i < 0) return false;
+  _entries.erase(_entries.begin() + i);
+  save();
+  return true;
+}
+
+void TrackHealth::releaseAll() {
+  if (_entries.empty()) return;
+  _entries.clear();
+  save();
+}
+
+size_t TrackHealth::quarantinedCount() const {
+  size_t n = 0;
+  for (const Entry &e : _entries) n += e.quarantined;
+  return n;
+}
+
+// Through a temporary file, like LoudnessIndex
+bool TrackHealth::save() {
+  if (!_fs) return false;
+  if (_entries.empty()) return !_fs->exists(_path) || _fs->remove(_path);
+  String tmp = _path + ".tmp";
+  File f = _fs->open(tmp, FILE_WRITE);
+  if (!f) {
+    Serial.printf("TrackHealth: cannot write %s\n", tmp.c_str());
+    return false;
+  }
+  uint32_t header[2] = {MAGIC, (uint32_t)_entries.size()};
+  bool ok = f.write((const uint8_t *)header, sizeof(header)) == sizeof(header);
+  for (size_t i = 0; ok && i < _entries.size(); ++i) {
+    const Entry &e = _entries[i];
+    size_t len = e.path.length() < 255 ? e.path.length() : 255;
+    Record r = {e.hash, e.lastFail, e.fails, (uint8_t)(e.quarantined ? 1 : 0), (uint8_t)len, 0};
+    ok = f.write((const uint8_t *)&r, sizeof(r)) == sizeof(r) && f.write((const uint8_t *)e.path.c_str(), len) == len;
+  }
+  f.close();
+  _fs->remove(_path);
+  if (!ok || !_fs->rename(tmp, _path)) {
+    Serial.printf("TrackHealth: could not write %s\n", _path.c_str());
+    _fs->remove(tmp);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,47 @@
+#ifndef TRACK_HEALTH_H
+#define TRACK_HEALTH_H
+
+#include <Arduino.h>
+#include <vector>
+#include "FS.h"
+#include "Config.h"
+
+// Tracks that failed to play. A track that fails HEALTH_QUARANTINE_FAILS
+// starts in a row is quarantined: random play passes it over until it plays
+// once (picked by hand), is uploaded again or is released from the web page.
+// Only failing tracks have an entry, so the table is usually empty; it is
+// kept sorted by path hash like LoudnessIndex, and saved to SD on each change.
+class TrackHealth {
+public:
+  struct Entry {
+    uint32_t hash;     // LoudnessIndex::hashPath()
+    uint8_t fails;     // in a row
+    bool quarantined;
+    uint32_t lastFail; // RTC unixtime, 0 if the clock wasn't set
+    String path;
+  };
+
+  void begin(fs::FS &fs, const char *path);
+
+  // A start of `path` played or failed
+  void record(const char *path, bool ok, uint32_t time);
+  bool quarantined(const char *path) const;
+  bool release(const char *path); // false if it had no entry
+  void releaseAll();
+
+  size_t size() const { return _entries.size(); }
+  const Entry &at(size_t i) const { return _entries[i]; }
+  size_t quarantinedCount() const;
+
+private:
+  static const uint32_t MAGIC = 0x31544C48; // "HLT1"
+
+  fs::FS *_fs = nullptr;
+  String _path;
+  std::vector<Entry> _entries; // sorted by hash
+
+  int find(uint32_t hash) const; // index of the entry, or insertion point as -(i + 1)
+  bool save();
+};
+
+#endif // TRACK_HEALTH_H
@@ -4,6 +4,7 @@
 #include "Config.h"
 #include "SD.h"
 #include "WebServer.h"
+#include "LoudnessIndex.h"
 
 WebHandler::WebHandler() : _server(nullptr), _audio(nullptr), _fs(nullptr), _sm(nullptr) {}
 WebHandler::~WebHandler() {
@@ -48,6 +49,7 @@ void WebHandler::begin(AudioManager *audio, FileScanner *fs, StateMachine *sm) {
   // --- API Handlers ---
   _server->on("/", [this]() { this->handleRoot(); });
   _server->on("/api/files", [this]() { this->handleFiles(); });
+  _server->on("/api/search", HTTP_GET, [this]() { this->handleSearch(); });
   _server->on("/api/play",  [this]() { this->handlePlay(); });
   _server->on("/api/volume",[this]() { this->handleVolume(); });
   _server->on("/api/power", [this]() { this->handlePower(); });
@@ -59,6 +61,9 @@ void WebHandler::begin(AudioManager *audio, FileScanner *fs, StateMachine *sm) {
   _server->on("/api/chime-settings", HTTP_GET, [this]() { this->handleChimeSettings(); });
   _server->on("/api/chime-settings", HTTP_POST, [this]() { this->handleChimeSettings(); });
   _server->on("/api/delete", [this]() { this->handleDelete(); });
+  _server->on("/api/metrics", HTTP_GET, [this]() { this->handleMetrics(); });
+  _server->on("/api/history", HTTP_GET, [this]() { this->handleHistory(); });
+  _server->on("/api/quarantine", HTTP_GET, [this]() { this->handleQuarantine(); });
 
   _server->on("/upload", HTTP_POST,
                [this]() { this->handleUploadPost(); },
@@ -296,7 +301,10 @@ void WebHandler::handleRoot() {
       <div class="card shadow-sm h-100">
         <div class="card-header d-flex justify-content-between align-items-center bg-white">
           <span>📂 Music Library <small class="text-muted ms-2">(/dhun)</small></span>
-          <button id="refreshFiles" class="btn btn-sm btn-outline-secondary">↻ Refresh</button>
+          <div class="d-flex">
+            <input id="dhunSearch" type="search" class="form-control form-control-sm me-2" placeholder="Search title, artist...">
+            <button id="refreshFiles" class="btn btn-sm btn-outline-secondary text-nowrap">↻ Refresh</button>
+          </div>
         </div>
         
         <div class="list-group list-group-flush playlist-container" id="dhunList">
@@ -411,9 +419,36 @@ async function refreshFiles(reset=true) {
      return;
   }
 
-  (page.dhun || []).forEach(p => {
-    const name = p.replace(/^\/dhun\//,'');
-    
+  (page.dhun || []).forEach(p => list.appendChild(dhunItem(p, p.replace(/^\/dhun\//,''))));
+
+  const total = page.total || 0;
+  dhunStart += (page.count || 0);
+  
+  const moreBtn = document.getElementById('loadMoreBtn');
+  moreBtn.style.display = (dhunStart >= total) ? 'none' : 'inline-block';
+  moreBtn.onclick = () => refreshFiles(false);
+}
+
+async function searchFiles(q) {
+  if (!q) { refreshFiles(true); return; }
+  const r = await fetch('/api/search?q=' + encodeURIComponent(q) + '&max=100');
+  if (!r.ok) return;
+  const res = await r.json();
+  const list = document.getElementById('dhunList');
+  list.innerHTML = '';
+  document.getElementById('loadMoreBtn').style.display = 'none';
+  if (!res.results.length) {
+    list.innerHTML = '<div class="p-5 text-muted text-center">Nothing matches.</div>';
+    return;
+  }
+  res.results.forEach(t => {
+    let label = t.title || t.path.replace(/^.*\//,'');
+    if (t.artist) label += ' — ' + t.artist;
+    list.appendChild(dhunItem(t.path, label));
+  });
+}
+
+function dhunItem(p, name) {
     const item = document.createElement('div');
     item.className = 'list-group-item list-group-item-action d-flex justify-content-between align-items-center py-3';
     
@@ -440,7 +475,7 @@ async function refreshFiles(reset=true) {
       e.stopPropagation(); // prevent triggering item click if we add one later
       if (!confirm('Delete ' + name + '?')) return;
       const r = await fetch('/api/delete?path='+encodeURIComponent(p));
-      if (r.ok) { refreshFiles(true); refreshStatus(); } else { alert('Delete failed'); }
+      if (r.ok) { searchFiles(document.getElementById('dhunSearch').value.trim()); refreshStatus(); } else { alert('Delete failed'); }
     };
 
     btnGroup.appendChild(playBtn);
@@ -448,15 +483,7 @@ async function refreshFiles(reset=true) {
     
     item.appendChild(nameSpan);
     item.appendChild(btnGroup);
-    list.appendChild(item);
-  });
-
-  const total = page.total || 0;
-  dhunStart += (page.count || 0);
-  
-  const moreBtn = document.getElementById('loadMoreBtn');
-  moreBtn.style.display = (dhunStart >= total) ? 'none' : 'inline-block';
-  moreBtn.onclick = () => refreshFiles(false);
+    return item;
 }
 
 async function playPath(path){
@@ -507,7 +534,12 @@ document.getElementById('power').addEventListener('change', async (e)=>{
   refreshStatus();
 });
 
-document.getElementById('refreshFiles').addEventListener('click', () => refreshFiles(true));
+document.getElementById('refreshFiles').addEventListener('click', () => {
+  document.getElementById('dhunSearch').value = '';
+  refreshFiles(true);
+});
+const debouncedSearch = debounce((q) => searchFiles(q), 250);
+document.getElementById('dhunSearch').addEventListener('input', (e) => debouncedSearch(e.target.value.trim()));
 
 // Load Initial Settings
 function loadSettings() {
@@ -808,10 +840,20 @@ static String jsonEscape(const String &s) {
   return out;
 }
 
-// GET /api/files?start=0&count=50
+// GET /api/files?folder=dhun&start=0&count=50
 void WebHandler::handleFiles() {
   if (!_server) return;
 
+  // "bhajan" or "/bhajan"; the dhun folder if not given
+  String folder = _server->hasArg("folder") ? _server->arg("folder") : String(DHUN_DIR);
+  if (!folder.startsWith("/")) folder = "/" + folder;
+  int id = _fs ? _fs->folderId(folder.c_str()) : -1;
+  if (id < 0) {
+    _server->send(404, "application/json", "{\"error\":\"unknown folder\"}");
+    return;
+  }
+  String folderJson = String("\"folder\":\"") + jsonEscape(folder) + "\",";
+
   int start = 0;
   int count = 50; // default page size
   if (_server->hasArg("start")) start = _server->arg("start").toInt();
@@ -819,13 +861,13 @@ void WebHandler::handleFiles() {
   if (count < 1) count = 1;
   if (count > 200) count = 200; // sane upper bound
 
-  int total = (_fs ? _fs->getCount("/dhun") : 0);
+  int total = _fs->getCount(id);
 
   // compute slice
   int from = start;
   if (from < 0) from = 0;
   if (from >= total) {
-    _server->send(200, "application/json", String("{\"dhun\":[],\"total\":") + total + ",\"start\":" + start + ",\"count\":" + 0 + "}");
+    _server->send(200, "application/json", String("{") + folderJson + "\"dhun\":[],\"total\":" + total + ",\"start\":" + start + ",\"count\":" + 0 + "}");
     return;
   }
   int to = from + count;
@@ -834,9 +876,11 @@ void WebHandler::handleFiles() {
   // Build JSON for just this slice (small)
   String out;
   out.reserve(256 + (to - from) * 40); // pre-reserve some heap to reduce fragmentation
-  out += "{\"dhun\":[";
+  out += "{";
+  out += folderJson;
+  out += "\"dhun\":[";
   for (int i = from; i < to; ++i) {
-    String p = _fs->getPath("/dhun", i);
+    String p = _fs->getPath(id, i).str();
     String esc = jsonEscape(p);
     out += "\"";
     out += esc;
@@ -873,14 +917,11 @@ void WebHandler::handlePlay() {
     return;
   }
   if (_audio) {
-    bool ok = _audio->start(path);
-    if (ok) {
-      _server->send(200, "application/json", "{\"ok\":true}");
-      return;
-    } else {
-      _server->send(500, "application/json", "{\"error\":\"playback failed\"}");
-      return;
-    }
+    if (_sm) _sm->noteStop(PlayHistory::R_USER);
+    // Don't hold the HTTP handler while the file opens; poll /api/status
+    uint32_t handle = _audio->startAsync(path);
+    _server->send(200, "application/json", String("{\"ok\":true,\"pending\":true,\"handle\":") + handle + "}");
+    return;
   }
   _server->send(500, "application/json", "{\"error\":\"no audio manager\"}");
 }
@@ -905,6 +946,7 @@ void WebHandler::handlePower() {
   
   // Stop audio if power is turned off
   if (!on && _audio) {
+    if (_sm) _sm->noteStop(PlayHistory::R_USER);
     _audio->stop();
   }
   
@@ -924,6 +966,37 @@ void WebHandler::handleStatus() {
   // Get crossfade settings
   int crossfadeTime = (_audio ? _audio->getCrossfadeTime() : 2000);
   bool isCrossfading = (_audio ? _audio->isCrossfading() : false);
+
+  // Inter-track gap metrics
+  uint32_t gapLast = (_audio ? _audio->getLastGapMs() : 0);
+  uint32_t gapMax = (_audio ? _audio->getMaxGapMs() : 0);
+  uint32_t gapCount = (_audio ? _audio->getGapCount() : 0);
+  uint32_t gapSeamless = (_audio ? _audio->getSeamlessCount() : 0);
+
+  // Asynchronous start status
+  bool starting = (_audio ? _audio->isStarting() : false);
+  uint32_t startLast = (_audio ? _audio->getLastStartLatencyMs() : 0);
+  uint32_t startMax = (_audio ? _audio->getMaxStartLatencyMs() : 0);
+
+  // Resident greeting and motion-to-sound latency
+  bool greetCached = (_audio ? _audio->hasGreeting() : false);
+  bool greetPsram = (greetCached ? _audio->getGreeting().inPsram() : false);
+  uint32_t greetBytes = (greetCached ? _audio->getGreeting().bytes() : 0);
+  uint32_t greetLatency = (_audio ? _audio->getGreetingLatencyUs() : 0);
+  uint32_t greetMaxLatency = (_audio ? _audio->getGreetingMaxLatencyUs() : 0);
+
+  // Loudness normalisation progress
+  uint32_t loudCount = (_audio ? _audio->getLoudnessCount() : 0);
+  bool loudBusy = (_audio ? _audio->isAnalyzing() : false);
+
+  // Decoded clip cache
+  uint32_t clipCount = (_audio ? _audio->getClipCache().count() : 0);
+  uint32_t clipBytes = (_audio ? _audio->getClipCache().bytes() : 0);
+  uint32_t clipBudget = (_audio ? _audio->getClipCache().budget() : 0);
+  uint32_t clipHits = (_audio ? _audio->getClipCache().hits() : 0);
+  uint32_t clipMisses = (_audio ? _audio->getClipCache().misses() : 0);
+  uint32_t clipEvictions = (_audio ? _audio->getClipCache().evictions() : 0);
+  uint32_t clipSavedKB = (_audio ? _audio->getClipCache().savedKB() : 0);
   
   String json = String("{\"volume\":") + vol + 
                 ",\"power\":" + (_powerState?"true":"false") + 
@@ -931,10 +1004,65 @@ void WebHandler::handleStatus() {
                 ",\"nowPlaying\":\"\"" +
                 ",\"eq\":{\"bass\":" + bass + ",\"mid\":" + mid + ",\"treble\":" + treble + "}" +
                 ",\"crossfade\":{\"time\":" + crossfadeTime + ",\"active\":" + (isCrossfading?"true":"false") + "}" +
+                ",\"gap\":{\"lastMs\":" + gapLast + ",\"maxMs\":" + gapMax +
+                ",\"count\":" + gapCount + ",\"seamless\":" + gapSeamless + "}" +
+                ",\"start\":{\"pending\":" + (starting?"true":"false") +
+                ",\"lastMs\":" + startLast + ",\"maxMs\":" + startMax + "}" +
+                ",\"greeting\":{\"cached\":" + (greetCached?"true":"false") +
+                ",\"bytes\":" + greetBytes + ",\"psram\":" + (greetPsram?"true":"false") +
+                ",\"latencyUs\":" + greetLatency + ",\"maxLatencyUs\":" + greetMaxLatency + "}" +
+                ",\"loudness\":{\"indexed\":" + loudCount + ",\"analyzing\":" + (loudBusy?"true":"false") + "}" +
+                ",\"clipCache\":{\"clips\":" + clipCount + ",\"bytes\":" + clipBytes +
+                ",\"budget\":" + clipBudget + ",\"hits\":" + clipHits + ",\"misses\":" + clipMisses +
+                ",\"evictions\":" + clipEvictions + ",\"sdSavedKB\":" + clipSavedKB + "}" +
                 "}";
   _server->send(200, "application/json", json);
 }
 
+// GET /api/search?q=ram&max=50: library entries with every word of q in
+// their folder, name, title, artist or album, from memory
+void WebHandler::handleSearch() {
+  if (!_server) return;
+  if (!_server->hasArg("q")) { _server->send(400, "application/json", "{\"error\":\"missing q\"}"); return; }
+  String q = _server->arg("q");
+  int max = _server->hasArg("max") ? _server->arg("max").toInt() : 50;
+  if (max < 1) max = 1;
+  if (max > 200) max = 200;
+
+  unsigned long t0 = micros();
+  int found[200];
+  int total = _fs ? _fs->search(q.c_str(), found, max) : 0;
+  int n = total < max ? total : max;
+
+  String out;
+  out.reserve(128 + n * 120);
+  out += "{\"q\":\"";
+  out += jsonEscape(q);
+  out += "\",\"total\":";
+  out += String(total);
+  out += ",\"results\":[";
+  for (int i = 0; i < n; ++i) {
+    FileScanner::TrackTags tags = _fs->tagsAt(found[i]);
+    const FileScanner::TrackInfo *info = _fs->infoAt(found[i]);
+    if (i) out += ",";
+    out += "{\"path\":\"";
+    out += jsonEscape(_fs->pathAt(found[i]).str());
+    out += "\",\"title\":\"";
+    out += jsonEscape(tags.title);
+    out += "\",\"artist\":\"";
+    out += jsonEscape(tags.artist);
+    out += "\",\"album\":\"";
+    out += jsonEscape(tags.album);
+    out += "\",\"durationMs\":";
+    out += String(info ? info->durationMs : 0);
+    out += "}";
+  }
+  out += "],\"us\":";
+  out += String(micros() - t0);
+  out += "}";
+  _server->send(200, "application/json", out);
+}
+
 // Delete a file: /api/delete?path=/dhun/foo.mp3
 void WebHandler::handleDelete() {
   if (!_server) return;
@@ -951,8 +1079,11 @@ void WebHandler::handleDelete() {
   }
   bool ok = SD.remove(path);
   if (ok) {
-    // Optionally: trigger a rescanning of the file list in FileScanner
-    // if (_fs) _fs->rescan(); // implement rescan if you want
+    // A new file uploaded under this name must be measured again
+    if (_audio) _audio->forgetTrack(path);
+    if (_sm) _sm->getHealth().release(path.c_str());
+    // so it can't be picked again
+    if (_fs) _fs->removeFile(path.c_str());
     _server->send(200, "application/json", "{\"ok\":true}");
   } else {
     _server->send(500, "application/json", "{\"error\":\"delete failed\"}");
@@ -1023,9 +1154,15 @@ void WebHandler::handleUploadStream() {
       Serial.print("Upload finished -> ");
       Serial.println(_uploadPath);
 
-      // update scanner so new file appears in /api/files
+      // add it to the library so it appears in /api/files
       if (_fs) {
-        _fs->rescan();
+        _fs->addFile(_uploadPath.c_str());
+      }
+      // A replaced file gets a clean record
+      if (_sm) _sm->getHealth().release(_uploadPath.c_str());
+      // Short files are saved as clip files too, which play without the decoder
+      if (_audio && upload.totalSize <= CLIP_CACHE_MAX_FILE_BYTES) {
+        _audio->convertClip(_uploadPath);
       }
     } else {
       Serial.println("Upload finished but file wasn't open");
@@ -1123,22 +1260,19 @@ void WebHandler::handleChimeSettings() {
 }
 
 // Equalizer API handler
+// GET  → {"bass","mid","treble","bands":[{"freq","gain","q","type"},...]}
+// POST → any of "bass"/"mid"/"treble", and/or "bands": [{"band":i,"freq":Hz,"gain":dB,"q":Q}, ...]
+//        (fields left out keep their current value)
 void WebHandler::handleEQ() {
   if (!_server || !_audio) {
     _server->send(500, "application/json", "{\"error\":\"audio manager not available\"}");
     return;
   }
   
-  if (_server->method() == HTTP_GET) {
-    // Return current EQ settings
-    String json = String("{\"bass\":") + _audio->getBass() + 
-                    ",\"mid\":" + _audio->getMid() + 
-                    ",\"treble\":" + _audio->getTreble() + "}";
-    _server->send(200, "application/json", json);
-  } else if (_server->method() == HTTP_POST) {
+  if (_server->method() == HTTP_POST) {
     // Set EQ settings
     String body = _server->arg("plain");
-    DynamicJsonDocument doc(512);
+    DynamicJsonDocument doc(1024);
     DeserializationError error = deserializeJson(doc, body);
     
     if (error) {
@@ -1155,12 +1289,36 @@ void WebHandler::handleEQ() {
     if (doc.containsKey("treble")) {
       _audio->setTreble(doc["treble"]);
     }
-    
-    String response = String("{\"ok\":true,\"bass\":") + _audio->getBass() + 
-                     ",\"mid\":" + _audio->getMid() + 
-                     ",\"treble\":" + _audio->getTreble() + "}";
-    _server->send(200, "application/json", response);
+    if (doc.containsKey("bands")) {
+      JsonArray bands = doc["bands"].as<JsonArray>();
+      for (size_t k = 0; k < bands.size(); ++k) {
+        JsonObject o = bands[k];
+        int i = o.containsKey("band") ? (int)o["band"] : -1;
+        if (i < 0 || i >= AudioManager::EQ_BANDS) {
+          _server->send(400, "application/json", "{\"error\":\"invalid band\"}");
+          return;
+        }
+        Equalizer::Band b = _audio->getEQBand(i);
+        if (o.containsKey("freq")) b.freq = (uint16_t)constrain((int)o["freq"], 20, 20000);
+        if (o.containsKey("gain")) b.gainDb = (int8_t)constrain((int)o["gain"], -12, 12);
+        if (o.containsKey("q")) b.q10 = (uint8_t)constrain((int)lroundf((float)o["q"] * 10.0f), 3, 80);
+        _audio->setEQBand(i, b);
+      }
+    }
   }
+
+  static const char *TYPES[] = {"peak", "lowshelf", "highshelf"};
+  String json = String("{\"ok\":true,\"bass\":") + _audio->getBass() + 
+                  ",\"mid\":" + _audio->getMid() + 
+                  ",\"treble\":" + _audio->getTreble() + ",\"bands\":[";
+  for (int i = 0; i < AudioManager::EQ_BANDS; ++i) {
+    Equalizer::Band b = _audio->getEQBand(i);
+    if (i) json += ",";
+    json += String("{\"freq\":") + b.freq + ",\"gain\":" + b.gainDb +
+            ",\"q\":" + String(b.q10 / 10.0f, 1) + ",\"type\":\"" + TYPES[b.type] + "\"}";
+  }
+  json += "]}";
+  _server->send(200, "application/json", json);
 }
 
 // Crossfade API handler
@@ -1196,6 +1354,7 @@ void WebHandler::handleCrossfade() {
     if (doc.containsKey("path")) {
       // Trigger crossfade to new track
       String path = doc["path"];
+      if (_sm) _sm->noteStop(PlayHistory::R_USER);
       bool success = _audio->startWithCrossfade(path);
       if (success) {
         _server->send(200, "application/json", "{\"ok\":true,\"crossfading\":true}");
@@ -1210,3 +1369,152 @@ void WebHandler::handleCrossfade() {
     }
   }
 }
+
+// Handle /api/metrics
+// GET: decode time, task and loop gaps, underruns, start latency breakdown
+//      and per-track failures; ?reset=1 clears them after replying
+void WebHandler::handleMetrics() {
+  if (!_server) return;
+  if (!_audio) {
+    _server->send(500, "application/json", "{\"error\":\"audio manager not available\"}");
+    return;
+  }
+
+  // Served as it was before any reset, so the numbers that prompted it aren't lost
+  String json;
+  json.reserve(2048);
+  _audio->getMetrics().appendJson(json);
+  if (_server->hasArg("reset") && _server->arg("reset") == "1") _audio->resetMetrics();
+  _server->send(200, "application/json", json);
+}
+
+namespace {
+
+// The library track a record names: the entry it was logged at, if the
+// path there still has the record's hash, else one up to HISTORY_NAME_PROBE
+// entries either side (files added or removed since); -1 if none
+int historyTrack(const FileScanner &lib, const PlayHistory::Record &r) {
+  if (r.event != PlayHistory::EV_TRACK || !r.hint) return -1;
+  char path[FileScanner::MAX_PATH_LEN];
+  auto is = [&](int i) {
+    FileScanner::PathView v = lib.pathAt(i); // empty if out of range
+    return !v.empty() && v.copy(path, sizeof(path)) && LoudnessIndex::hashPath(path) == r.track;
+  };
+  int at = r.hint - 1;
+  for (int d = 0; d <= HISTORY_NAME_PROBE; ++d) {
+    if (is(at - d)) return at - d;
+    if (d && is(at + d)) return at + d;
+  }
+  return -1;
+}
+
+String csvQuote(const String &s) {
+  String out = "\"";
+  for (size_t i = 0; i < s.length(); ++i) {
+    if (s[i] == '"') out += '"';
+    out += s[i];
+  }
+  return out + "\"";
+}
+
+} // namespace
+
+// Handle /api/history
+// GET: the play history, oldest first, as JSON (default) or ?format=csv;
+//      ?last=N for only the newest N. Sent in chunks a block of records at a
+//      time, straight from the card. A chime's track is the hour announced.
+void WebHandler::handleHistory() {
+  if (!_server) return;
+  if (!_sm) {
+    _server->send(500, "application/json", "{\"error\":\"state machine not available\"}");
+    return;
+  }
+  bool csv = _server->arg("format") == "csv";
+  long last = _server->hasArg("last") ? _server->arg("last").toInt() : 0;
+  PlayHistory::Reader reader = _sm->getHistory().reader(last > 0 ? (uint32_t)last : 0);
+
+  _server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+  _server->send(200, csv ? "text/csv" : "application/json", "");
+  String chunk;
+  chunk.reserve(4096);
+  if (csv) chunk += "time,date,event,track,path,played_ms,reason\n";
+  else chunk += String("{\"count\":") + reader.remaining() + ",\"records\":[";
+
+  PlayHistory::Record block[32];
+  bool first = true;
+  size_t n;
+  while ((n = reader.read(block, 32)) > 0) {
+    for (size_t i = 0; i < n; ++i) {
+      const PlayHistory::Record &r = block[i];
+      char date[24] = "";
+      if (r.time) {
+        DateTime t(r.time);
+        snprintf(date, sizeof(date), "%04d-%02d-%02dT%02d:%02d:%02d", t.year(), t.month(), t.day(), t.hour(),
+                 t.minute(), t.second());
+      }
+      char track[12] = "";
+      if (r.event == PlayHistory::EV_TRACK) snprintf(track, sizeof(track), "%08lx", (unsigned long)r.track);
+      else if (r.event == PlayHistory::EV_CHIME) snprintf(track, sizeof(track), "%lu", (unsigned long)r.track);
+      int index = _fs ? historyTrack(*_fs, r) : -1;
+      String path = index >= 0 ? _fs->pathAt(index).str() : String();
+
+      if (csv) {
+        chunk += String(r.time) + "," + date + "," + PlayHistory::eventName(r.event) + "," + track + "," +
+                 csvQuote(path) + "," + r.playedMs + "," + PlayHistory::reasonName(r.reason) + "\n";
+      } else {
+        chunk += first ? "{" : ",{";
+        chunk += String("\"time\":") + r.time + ",\"date\":\"" + date + "\",\"event\":\"" +
+                 PlayHistory::eventName(r.event) + "\",\"track\":\"" + track + "\",\"path\":\"" + jsonEscape(path) +
+                 "\",\"playedMs\":" + r.playedMs + ",\"reason\":\"" + PlayHistory::reasonName(r.reason) + "\"}";
+      }
+      first = false;
+    }
+    _server->sendContent(chunk);
+    chunk = "";
+  }
+  if (!csv) chunk += "]}";
+  if (chunk.length()) _server->sendContent(chunk);
+  _server->sendContent(""); // the last, empty chunk
+}
+
+// Handle /api/quarantine
+// GET: tracks that failed to start, and whether random play skips them;
+//      ?release=<path> (or all) lets them be picked again
+void WebHandler::handleQuarantine() {
+  if (!_server) return;
+  if (!_sm) {
+    _server->send(500, "application/json", "{\"error\":\"state machine not available\"}");
+    return;
+  }
+  TrackHealth &health = _sm->getHealth();
+  if (_server->hasArg("release")) {
+    String path = _server->arg("release");
+    if (path == "all") {
+      health.releaseAll();
+    } else if (!health.release(path.c_str())) {
+      _server->send(404, "application/json", "{\"error\":\"track not in the list\"}");
+      return;
+    }
+  }
+
+  String json;
+  json.reserve(64 + health.size() * 96);
+  json += "{\"quarantined\":";
+  json += String((unsigned)health.quarantinedCount());
+  json += ",\"tracks\":[";
+  for (size_t i = 0; i < health.size(); ++i) {
+    const TrackHealth::Entry &e = health.at(i);
+    if (i) json += ",";
+    json += "{\"path\":\"";
+    json += jsonEscape(e.path);
+    json += "\",\"fails\":";
+    json += String(e.fails);
+    json += ",\"quarantined\":";
+    json += e.quarantined ? "true" : "false";
+    json += ",\"lastFail\":";
+    json += String(e.lastFail);
+    json += "}";
+  }
+  json += "]}";
+  _server->send(200, "application/json", json);
+}
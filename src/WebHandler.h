@@ -36,6 +36,7 @@ private:
   // HTTP handlers
   void handleRoot();        // serve main dashboard HTML
   void handleFiles();       // GET /api/files       → JSON list of /dhun files
+  void handleSearch();      // GET /api/search      → ?q= (title, artist, album, name)
   void handlePlay();        // GET /api/play        → ?path=
   void handleVolume();      // GET /api/volume      → ?level=
   void handlePower();       // GET /api/power       → ?on=1/0
@@ -46,6 +47,9 @@ private:
   void handleUploadStream();// POST /upload (streaming chunks from client)
   void handleDelete();      // GET /api/delete      → ?path= (delete file)
   void handleChimeSettings(); // GET/POST /api/chime-settings
+  void handleMetrics();     // GET /api/metrics     → pipeline timing, ?reset=1 clears
+  void handleHistory();     // GET /api/history     → ?format=json|csv&last=N, streamed
+  void handleQuarantine();  // GET /api/quarantine  → failing tracks, ?release=path|all
 };
 
 #endif // WEB_HANDLER_H
@@ -32,12 +32,17 @@ void setup() {
       delay(1000);
   }
 
-  // scan files
-  fileScanner.begin(SD);
-  fileScanner.scanFolder("/dhun");
+  // load the library index; the folders are checked in the background
+  fileScanner.begin(SD, SD_MOUNT);
+  static const char *const folders[] = LIBRARY_FOLDERS;
+  for (const char *folder : folders)
+    fileScanner.addFolder(folder);
+  fileScanner.rescan();
 
   // init audio
   audioManager.begin(I2S_BCLK, I2S_LRCLK, I2S_DIN);
+  audioManager.cacheGreeting(GREETING_PATH);
+  audioManager.startTask(); // decoding and output run on their own core from here
   // audioManager.setVolume(DEFAULT_VOLUME);
 
   // init state machine first
@@ -59,9 +64,12 @@ void loop() {
     }
   }
 
-  // Keep audio.loop() as fast as possible
+  // Deliver audio start results (playback itself runs on the audio task)
   audioManager.loop();
 
+  // a slice of any library scan
+  fileScanner.loop();
+
   // lightweight server handling
   webHandler.handleClient();
 
@@ -0,0 +1,175 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+// Helpers shared by the host tests: checks, a scratch SD card, test tones
+// and reading back what was rendered.
+
+#include <Arduino.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "HostSim.h"
+
+static int s_failures = 0;
+
+#define CHECK(cond)                                                                                            \
+  do {                                                                                                         \
+    if (!(cond)) {                                                                                             \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond);                               \
+      s_failures++;                                                                                            \
+    }                                                                                                          \
+  } while (0)
+
+#define CHECK_LE(a, b)                                                                                         \
+  do {                                                                                                         \
+    double a_ = (double)(a), b_ = (double)(b);                                                                 \
+    if (!(a_ <= b_)) {                                                                                         \
+      fprintf(stderr, "%s:%d: CHECK failed: %s <= %s (%g > %g)\n", __FILE__, __LINE__, #a, #b, a_, b_);       \
+      s_failures++;                                                                                            \
+    }                                                                                                          \
+  } while (0)
+
+inline int testResult(const char *name) {
+  if (s_failures) fprintf(stderr, "%s: %d checks failed\n", name, s_failures);
+  else printf("%s: ok\n", name);
+  return s_failures ? 1 : 0;
+}
+
+namespace test {
+
+// A fresh directory under /tmp, mounted as the SD card
+inline std::string makeSdRoot(const char *name) {
+  std::string dir = std::string("/tmp/") + name + "-XXXXXX";
+  if (!mkdtemp(&dir[0])) {
+    perror("mkdtemp");
+    exit(2);
+  }
+  host::setSdRoot(dir.c_str());
+  return dir;
+}
+
+inline void makeDirs(const std::string &root, const char *path) {
+  std::string p = root;
+  for (const char *c = path; *c; ++c) {
+    if (*c == '/' && p.size() > root.size()) mkdir(p.c_str(), 0755);
+    p += *c;
+  }
+  mkdir(p.c_str(), 0755);
+}
+
+inline void put16(FILE *f, uint16_t v) { fputc(v & 0xff, f), fputc(v >> 8, f); }
+inline void put32(FILE *f, uint32_t v) { put16(f, v & 0xffff), put16(f, v >> 16); }
+
+// 16-bit PCM stereo WAV of `frames` frames; the host Audio decodes it
+// whatever it is called
+inline bool writeWav(const std::string &hostPath, uint32_t rate, const std::vector<int16_t> &interleaved) {
+  FILE *f = fopen(hostPath.c_str(), "wb");
+  if (!f) return false;
+  uint32_t data = (uint32_t)interleaved.size() * 2;
+  fwrite("RIFF", 1, 4, f);
+  put32(f, 36 + data);
+  fwrite("WAVEfmt ", 1, 8, f);
+  put32(f, 16);
+  put16(f, 1);
+  put16(f, 2);
+  put32(f, rate);
+  put32(f, rate * 4);
+  put16(f, 4);
+  put16(f, 16);
+  fwrite("data", 1, 4, f);
+  put32(f, data);
+  fwrite(interleaved.data(), 2, interleaved.size(), f);
+  fclose(f);
+  return true;
+}
+
+// A tone at `amplitude` (of full scale) with a small offset, so no sample
+// of it is digital silence
+inline std::vector<int16_t> tone(uint32_t rate, float seconds, float hz, float amplitude) {
+  size_t frames = (size_t)(rate * seconds);
+  std::vector<int16_t> s(frames * 2);
+  for (size_t i = 0; i < frames; ++i) {
+    float v = amplitude * 32767.0f * sinf(2.0f * (float)M_PI * hz * (float)i / (float)rate);
+    int16_t x = (int16_t)lrintf(v);
+    if (x >= 0 && x < 64) x = 64;
+    if (x < 0 && x > -64) x = -64;
+    s[2 * i] = x;
+    s[2 * i + 1] = x;
+  }
+  return s;
+}
+
+inline bool writeTone(const std::string &root, const char *path, uint32_t rate, float seconds, float hz,
+                      float amplitude = 0.5f) {
+  return writeWav(root + path, rate, tone(rate, seconds, hz, amplitude));
+}
+
+// A stereo 16-bit WAV as WavOutput writes it
+struct Wav {
+  uint32_t rate = 0;
+  std::vector<int16_t> samples; // interleaved
+  size_t frames() const { return samples.size() / 2; }
+};
+
+inline bool readWav(const char *path, Wav &out) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return false;
+  uint8_t h[44];
+  bool ok = fread(h, 1, 44, f) == 44 && !memcmp(h, "RIFF", 4) && !memcmp(h + 36, "data", 4);
+  if (ok) {
+    out.rate = h[24] | h[25] << 8 | h[26] << 16 | (uint32_t)h[27] << 24;
+    uint32_t bytes = h[40] | h[41] << 8 | h[42] << 16 | (uint32_t)h[43] << 24;
+    out.samples.resize(bytes / 2);
+    ok = fread(out.samples.data(), 2, out.samples.size(), f) == out.samples.size();
+  }
+  fclose(f);
+  return ok;
+}
+
+// What a render sounds like between its first and last audible frame
+struct Silence {
+  size_t first = 0, last = 0; // first and last frame that is not silence
+  size_t longest = 0;         // longest run of silent frames in between
+  size_t longestAt = 0;
+  int peak = 0;               // largest |sample|
+};
+
+inline Silence findSilence(const Wav &w, size_t from = 0, size_t to = SIZE_MAX) {
+  Silence s;
+  if (to > w.frames()) to = w.frames();
+  bool seen = false;
+  size_t run = 0;
+  for (size_t i = from; i < to; ++i) {
+    int l = w.samples[2 * i], r = w.samples[2 * i + 1];
+    int a = abs(l) > abs(r) ? abs(l) : abs(r);
+    if (a > s.peak) s.peak = a;
+    if (a == 0) {
+      run++;
+      continue;
+    }
+    if (!seen) s.first = i;
+    else if (run > s.longest) {
+      s.longest = run;
+      s.longestAt = i - run;
+    }
+    seen = true;
+    s.last = i;
+    run = 0;
+  }
+  return s;
+}
+
+// Process CPU time (all threads), in microseconds
+inline uint64_t cpuUs() {
+  struct rusage u;
+  getrusage(RUSAGE_SELF, &u);
+  return (uint64_t)(u.ru_utime.tv_sec + u.ru_stime.tv_sec) * 1000000ull + u.ru_utime.tv_usec + u.ru_stime.tv_usec;
+}
+
+} // namespace test
+
+#endif // HOST_TEST_H
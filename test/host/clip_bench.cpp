@@ -0,0 +1,130 @@
+// What each way of playing a short sound costs before its first sample, for
+// a 1.5 s bell at 44.1 kHz: a clip cache hit (lookup only), a clip file
+// (allocate, read and decode ADPCM from SD) and the MP3 (the decoder, which
+// the host can't run, so only its SD traffic is given). Host times are
+// medians; the SD floor is the bytes read at the 4 MHz SPI clock
+// SD.begin() runs the card at, which the host's page cache hides.
+//
+//   clip_bench [runs]
+
+#include "HostTest.h"
+#include "ClipCache.h"
+#include "ClipFile.h"
+#include "Config.h"
+#include "SD.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+const uint32_t RATE = 44100;
+const float SECONDS = 1.5f;
+const uint32_t MP3_BYTES = (uint32_t)(SECONDS * 128000 / 8); // 128 kbit/s
+const double SPI_BYTES_PER_S = 4e6 / 8;
+
+typedef std::chrono::steady_clock Clock;
+
+double medianUs(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  return v[v.size() / 2];
+}
+
+template <typename F> double timeUs(int runs, F f) {
+  std::vector<double> t;
+  for (int i = 0; i < runs; ++i) {
+    auto t0 = Clock::now();
+    f();
+    t.push_back(std::chrono::duration<double, std::micro>(Clock::now() - t0).count());
+  }
+  return medianUs(t);
+}
+
+void fill(PcmClip &c) {
+  c.setSampleRate(RATE);
+  size_t frames = (size_t)(SECONDS * RATE);
+  for (size_t i = 0; i < frames; ++i) {
+    double env = exp(-3.0 * i / frames);
+    int16_t s = (int16_t)lrint(20000 * env * sin(2 * M_PI * 880 * (double)i / RATE));
+    c.append((uint16_t)s | (uint32_t)(uint16_t)s << 16);
+  }
+  c.finish();
+}
+
+void bench(const char *board, bool psram, size_t clipBytes, int runs) {
+  host::setPsram(psram);
+  printf("%s (clip budget %u bytes)\n", board, (unsigned)clipBytes);
+
+  // The cache full of other clips, the bell somewhere in it
+  ClipCache cache;
+  cache.begin(64u * 1024 * 1024);
+  for (int i = 0; i < ClipCache::ENTRIES; ++i) {
+    String path = i == ClipCache::ENTRIES / 2 ? String(BELL_PATH) : String(HOURS_DIR) + i + ".mp3";
+    PcmClip *c = cache.reserve(path.c_str(), clipBytes, nullptr);
+    if (c) fill(*c);
+    cache.loaded(path.c_str(), c != nullptr, 16000);
+  }
+  const PcmClip *bell = cache.peek(BELL_PATH);
+  CHECK(bell != nullptr);
+  if (!bell) return;
+  volatile const void *sink;
+  double hit = timeUs(runs, [&] {
+    for (int k = 0; k < 1000; ++k) sink = cache.get(BELL_PATH);
+  }) / 1000;
+  double miss = timeUs(runs, [&] {
+    for (int k = 0; k < 1000; ++k) sink = cache.get("/clips/not-there.mp3");
+  }) / 1000;
+  (void)sink;
+
+  // Its clip file, written the way AudioManager does
+  String file = ClipFile::pathFor(CLIP_FILE_DIR, BELL_PATH);
+  ClipFile saver;
+  CHECK(saver.beginSave(SD, file.c_str(), *bell, MP3_BYTES));
+  while (saver.save(*bell, 8) == ClipFile::BUSY) {
+  }
+  File f = SD.open(file);
+  uint32_t fileBytes = f ? (uint32_t)f.size() : 0;
+  if (f) f.close();
+
+  PcmClip clip;
+  double alloc = timeUs(runs, [&] {
+    clip.allocate(clipBytes);
+    clip.release();
+  });
+  double lookup = timeUs(runs, [&] { sink = ClipFile::pathFor(CLIP_FILE_DIR, BELL_PATH).c_str(); });
+  double load = timeUs(runs, [&] {
+    ClipFile loader;
+    clip.allocate(clipBytes);
+    CHECK(loader.beginLoad(SD, file.c_str(), MP3_BYTES));
+    while (loader.load(clip, CLIP_FILE_START_BLOCKS) == ClipFile::BUSY) {
+    }
+    clip.finish();
+  });
+  CHECK(clip.frames() == bell->frames());
+  clip.release();
+
+  printf("  cache hit      %8.3f us lookup (miss %.3f us over %d entries), 0 bytes from SD\n", hit, miss,
+         ClipCache::ENTRIES);
+  printf("  clip file      %8.1f us: name %.2f us, allocate %.2f us, open+read+decode the rest; "
+         "%u bytes from SD (>= %.1f ms at 4 MHz SPI)\n",
+         load + lookup, lookup, alloc, (unsigned)fileBytes, fileBytes / SPI_BYTES_PER_S * 1000);
+  printf("  MP3            decoder not run on the host; %u bytes from SD (>= %.1f ms at 4 MHz SPI) "
+         "plus decoder start and %.1f s of MP3 decoding\n",
+         (unsigned)MP3_BYTES, MP3_BYTES / SPI_BYTES_PER_S * 1000, SECONDS);
+  printf("  in memory      %u bytes (%s), clip file %.1f KB per second of audio\n", (unsigned)bell->bytes(),
+         bell->format() == PcmClip::STEREO16 ? "stereo16" : "mu-law", fileBytes / 1024.0 / SECONDS);
+  CHECK(hit < load);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int runs = argc > 1 ? atoi(argv[1]) : 51;
+  std::string root = test::makeSdRoot("clip-bench");
+  test::makeDirs(root, CLIP_FILE_DIR);
+  CHECK(SD.begin(SD_CS));
+  host::setQuiet(true);
+  bench("no PSRAM", false, CLIP_RAM_BUDGET_BYTES, runs);
+  bench("PSRAM", true, CLIP_PSRAM_BUDGET_BYTES, runs);
+  host::setQuiet(false);
+  return testResult("clip_bench");
+}
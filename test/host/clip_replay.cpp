@@ -0,0 +1,158 @@
+// Replays a week of what the clock asks of the clip cache: the hourly chime
+// (the bell, then the hour's number), the greeting (decoded and pinned at
+// boot, as cacheGreeting() does) on every motion, now and then a short
+// upload that is played and sometimes replaced. The calls are the ones
+// AudioManager makes (get, and on a miss reserve/decode/loaded), with the
+// mixer's sequence passed as `playing` while a clip sounds. Prints hit rate,
+// evictions and SD reads saved for each budget, and checks that a clip the
+// mixer is playing is never freed or overwritten, even when it is removed or
+// replaced under it (build with -DSANITIZE=ON to have ASan watch too).
+
+#include "HostTest.h"
+#include "ClipCache.h"
+#include "ClipSequence.h"
+#include "Config.h"
+#include "HeapBudget.h"
+#include <random>
+
+namespace {
+
+const uint32_t RATE = 44100;
+
+struct Clip {
+  const char *path;
+  float seconds;
+  uint32_t fileBytes; // the MP3 on the card
+};
+
+// Roughly the files on the card: 128 kbit/s MP3s
+Clip bell = {BELL_PATH, 1.0f, 16000};
+Clip greeting = {GREETING_PATH, 1.0f, 16000};
+
+std::string hourPath(int h) { return std::string(HOURS_DIR) + std::to_string(h) + ".mp3"; }
+
+// Frame i of the file `path`: a pattern that says which file and where
+uint32_t frameOf(const char *path, size_t i) {
+  uint32_t h = 2166136261u;
+  for (const char *c = path; *c; ++c) h = (h ^ (uint8_t)*c) * 16777619u;
+  int16_t s = (int16_t)((h + i * 37) % 20000 - 10000);
+  return (uint16_t)s | (uint32_t)(uint16_t)s << 16;
+}
+
+uint64_t checksum(const PcmClip &c) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < c.frames(); ++i) sum = sum * 31 + c.frameAt(i);
+  return sum;
+}
+
+struct Replay {
+  ClipCache cache;
+  size_t clipBytes = 0;
+  ClipSequence playing; // what the mixer reads
+  uint64_t playingSum[ClipSequence::MAX_SEGMENTS];
+  uint32_t decodes = 0, noRoom = 0, corrupted = 0, plays = 0;
+
+  // AudioManager: a hit, or decode it from the file
+  const PcmClip *want(const char *path, float seconds, uint32_t fileBytes) {
+    plays++;
+    if (const PcmClip *c = cache.get(path)) return c;
+    cache.countMiss();
+    PcmClip *c = cache.reserve(path, clipBytes, &playing);
+    if (!c) {
+      noRoom++;
+      return nullptr;
+    }
+    c->setSampleRate(RATE);
+    size_t frames = (size_t)(seconds * RATE);
+    bool fit = true;
+    for (size_t i = 0; i < frames && fit; ++i) fit = c->append(frameOf(path, i));
+    decodes++;
+    // Longer than the clip budget: played from SD instead, like a track
+    cache.loaded(path, fit, fileBytes);
+    return fit ? cache.peek(path) : nullptr;
+  }
+
+  void play(const PcmClip *a, const PcmClip *b = nullptr) {
+    stop();
+    if (a) playing.add(a);
+    if (b) playing.add(b, CHIME_NUMBER_GAP_MS);
+    for (int k = 0; k < playing.count; ++k) playingSum[k] = checksum(*playing.seg[k].clip);
+  }
+
+  // The mixer reaches the end: whatever it played must be as it was decoded
+  void stop() {
+    for (int k = 0; k < playing.count; ++k) corrupted += checksum(*playing.seg[k].clip) != playingSum[k];
+    playing.clear();
+  }
+};
+
+void replay(const char *name, size_t budget, size_t clipBytes, bool psram) {
+  host::setPsram(psram);
+  Replay r;
+  r.cache.begin(budget);
+  r.clipBytes = clipBytes;
+  std::mt19937 rng(7);
+  uint32_t uploads = 0, replaced = 0;
+  if (r.want(greeting.path, greeting.seconds, greeting.fileBytes)) r.cache.pin(greeting.path);
+
+  for (int day = 0; day < 7; ++day) {
+    for (int hour = 0; hour < 24; ++hour) {
+      // The chime: bell and number as one sequence. The greeting may come
+      // in while it plays and must not take its clips.
+      int h12 = hour % 12 ? hour % 12 : 12;
+      std::string number = hourPath(h12);
+      const PcmClip *b = r.want(bell.path, bell.seconds, bell.fileBytes);
+      const PcmClip *n = r.want(number.c_str(), 0.6f, 10000);
+      r.play(b, n);
+      if (rng() % 4 == 0) r.want(greeting.path, greeting.seconds, greeting.fileBytes);
+      r.stop();
+
+      // Motion: a few greetings an hour in the day, none at night
+      int motions = hour >= 6 && hour < 22 ? (int)(rng() % 6) : 0;
+      for (int m = 0; m < motions; ++m) {
+        r.play(r.want(greeting.path, greeting.seconds, greeting.fileBytes));
+        r.stop();
+      }
+
+      // An upload of a short file, played; sometimes replaced (uploaded
+      // again) while it still plays
+      if (rng() % 8 == 0) {
+        std::string up = "/bhajan/short" + std::to_string(rng() % 5) + ".mp3";
+        uploads++;
+        r.play(r.want(up.c_str(), 0.4f + (rng() % 4) * 0.2f, 9000));
+        if (rng() % 2) {
+          r.cache.remove(up.c_str(), &r.playing); // AudioManager::forgetClip()
+          r.want(up.c_str(), 0.5f, 9000);         // the new file, decoded over the old
+          replaced++;
+        }
+        r.stop();
+      }
+    }
+  }
+
+  const ClipCache &c = r.cache;
+  uint32_t lookups = c.hits() + c.misses();
+  printf("%-20s budget %7u B, clip %6u B: %5.1f%% hits (%u of %u), %u evictions, %u decodes, %u without room, "
+         "%u KB of SD reads saved, %u uploads (%u replaced while playing)\n",
+         name, (unsigned)budget, (unsigned)clipBytes, lookups ? 100.0 * c.hits() / lookups : 0.0,
+         (unsigned)c.hits(), (unsigned)lookups, (unsigned)c.evictions(), (unsigned)r.decodes, (unsigned)r.noRoom,
+         (unsigned)c.savedKB(), (unsigned)uploads, (unsigned)replaced);
+  CHECK(replaced > 0);
+  CHECK(r.corrupted == 0);
+  CHECK_LE(c.bytes(), budget);
+  CHECK(c.hits() + c.misses() == r.plays);
+}
+
+} // namespace
+
+int main() {
+  host::setQuiet(true);
+  // esp32dev without PSRAM, as AudioManager::begin() sizes it
+  size_t cache = heapShare(CLIP_CACHE_HEAP_PERCENT, CLIP_CACHE_RAM_BYTES);
+  size_t clip = cache / 2 < CLIP_RAM_BUDGET_BYTES ? cache / 2 : CLIP_RAM_BUDGET_BYTES;
+  replay("no PSRAM (heap)", cache, clip, false);
+  replay("no PSRAM (ceiling)", CLIP_CACHE_RAM_BYTES, CLIP_RAM_BUDGET_BYTES, false);
+  replay("PSRAM", CLIP_CACHE_PSRAM_BYTES, CLIP_PSRAM_BUDGET_BYTES, true);
+  host::setQuiet(false);
+  return testResult("clip_replay");
+}
@@ -0,0 +1,130 @@
+// Crossfades rendered through AudioManager to a WAV of what the DAC played,
+// with two near-full-scale tracks: there must be no silence anywhere from
+// the first track's start to the last track's end, no sample clipped at the
+// output, and the level may dip in the middle of a fade (two unrelated
+// signals at -6 dB each) but never fall away. A second crossfade that cuts
+// into a running one is checked the same way; there the deck still fading
+// out is dropped, leaving the half-faded one, so it may dip to -6 dB.
+
+#include "HostTest.h"
+#include "AudioManager.h"
+#include "AudioOutput.h"
+#include "Config.h"
+#include "SD.h"
+
+namespace {
+
+const uint32_t RATE = 44100;
+const float LEVEL = 0.99f; // of full scale
+const int FADE_MS = 1000;
+
+AudioManager audio;
+
+void runFor(uint32_t ms) {
+  unsigned long t0 = millis();
+  while (millis() - t0 < ms) {
+    audio.loop();
+    delay(5);
+  }
+}
+
+bool waitIdle(uint32_t ms) {
+  unsigned long t0 = millis();
+  while (millis() - t0 < ms) {
+    audio.loop();
+    if (!audio.isStarting() && !audio.isRunning()) return true;
+    delay(5);
+  }
+  return false;
+}
+
+double rms(const test::Wav &w, size_t from, size_t frames) {
+  double sum = 0;
+  for (size_t i = from; i < from + frames && i < w.frames(); ++i) {
+    double l = w.samples[2 * i], r = w.samples[2 * i + 1];
+    sum += (l * l + r * r) / 2;
+  }
+  return sqrt(sum / (double)frames);
+}
+
+// Render `run` (which starts and crossfades) to `path` and check it
+void render(const char *name, const std::string &path, void (*run)(), float expectSec, float floorDb) {
+  WavOutput out;
+  CHECK(out.open(path.c_str()));
+  host::captureI2s(0, &out);
+  run();
+  CHECK(waitIdle(10000));
+  runFor(400); // the DMA ring plays out
+  host::captureI2s(0, nullptr);
+  out.close();
+
+  test::Wav w;
+  CHECK(test::readWav(path.c_str(), w));
+  test::Silence s = test::findSilence(w);
+  size_t clipped = 0;
+  for (int16_t v : w.samples) clipped += v == 32767 || v == -32768;
+
+  // The quietest 10 ms against the steady level of one track
+  const size_t win = RATE / 100;
+  double steady = LEVEL * 32767 / sqrt(2.0), quietest = 1e9;
+  size_t quietAt = 0;
+  for (size_t i = s.first + RATE / 5; i + win + RATE / 5 <= s.last; i += win / 2) { // past the fade-in and -out
+    double v = rms(w, i, win);
+    if (v < quietest) quietest = v, quietAt = i;
+  }
+  double audible = (double)(s.last - s.first + 1) / RATE;
+  printf("%-9s audible %.3f s, longest silence %.2f ms, peak %d, %u clipped samples, "
+         "quietest 10 ms %.1f dB (at %.3f s), wav %s\n",
+         name, audible, s.longest * 1000.0 / RATE, s.peak, (unsigned)clipped, 20 * log10(quietest / steady),
+         (double)quietAt / RATE, path.c_str());
+
+  CHECK_LE(s.longest, RATE / 1000);
+  CHECK(clipped == 0);
+  CHECK_LE(s.peak, LEVEL * 32767 + 1);
+  CHECK_LE(floorDb, 20 * log10(quietest / steady));
+  CHECK_LE(expectSec - 0.05, audible); // nothing cut short
+}
+
+// A plays for a second, then fades into B
+void simpleFade() {
+  audio.startAsync(String(DHUN_DIR "/a.mp3"));
+  runFor(1000);
+  CHECK(audio.startWithCrossfade(String(DHUN_DIR "/b.mp3")));
+  bool seen = false;
+  for (int i = 0; i < 100 && !seen; ++i) {
+    runFor(5);
+    seen = audio.isCrossfading();
+  }
+  CHECK(seen);
+}
+
+// Half-way through the fade into B, C cuts in
+void fadeIntoFade() {
+  audio.startAsync(String(DHUN_DIR "/a.mp3"));
+  runFor(1000);
+  CHECK(audio.startWithCrossfade(String(DHUN_DIR "/b.mp3")));
+  runFor(FADE_MS / 2);
+  CHECK(audio.startWithCrossfade(String(DHUN_DIR "/c.mp3")));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string root = test::makeSdRoot("crossfade");
+  std::string outDir = argc > 1 ? argv[1] : root;
+  test::makeDirs(root, DHUN_DIR);
+  CHECK(test::writeTone(root, DHUN_DIR "/a.mp3", RATE, 3.0f, 440, LEVEL));
+  CHECK(test::writeTone(root, DHUN_DIR "/b.mp3", RATE, 3.0f, 554, LEVEL));
+  CHECK(test::writeTone(root, DHUN_DIR "/c.mp3", RATE, 3.0f, 659, LEVEL));
+  CHECK(SD.begin(SD_CS));
+
+  host::setQuiet(true);
+  audio.begin(I2S_BCLK, I2S_LRCLK, I2S_DIN);
+  audio.setVolume(21);
+  audio.setCrossfadeTime(FADE_MS);
+  audio.startTask();
+  render("crossfade", outDir + "/crossfade.wav", simpleFade, 1.0f + 3.0f, -4.5f);
+  render("cut-in", outDir + "/cut-in.wav", fadeIntoFade, 1.0f + FADE_MS / 2000.0f + 3.0f, -8.0f);
+  host::setQuiet(false);
+  return testResult("crossfade_render");
+}
@@ -0,0 +1,138 @@
+// Listing a 1,000-file folder: File::openNextFile(), which opens every entry
+// (and the scan built a String per name on top), against DirReader, which
+// reads names straight from the directory entries. Host times are medians;
+// heap allocations are counted with the global operator new.
+//
+// The host can't mount a FAT image here (no vfat, no mkfs), so what a card
+// pays is modelled from FatFs instead: each name takes a 32-byte entry plus
+// one per 13 characters of long name, f_readdir reads the directory's
+// sectors once, and openNextFile()'s stat() and fopen() each look the name
+// up from the start of the directory, one 512-byte sector read at a time.
+// Sectors are costed at the 4 MHz SPI clock SD.begin() runs the card at.
+//
+//   dir_bench [runs]
+
+#include "HostTest.h"
+#include "DirReader.h"
+#include "Config.h"
+#include "SD.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+
+static std::atomic<uint64_t> s_news(0);
+
+void *operator new(size_t n) {
+  s_news++;
+  if (void *p = malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+const int FILES = 1000;
+const double SPI_BYTES_PER_S = 4e6 / 8;
+const size_t SECTOR = 512;
+
+struct Pass {
+  double us;
+  uint64_t news;
+  uint32_t opens;
+  int mp3s;
+};
+
+template <typename F> Pass measure(int runs, F f) {
+  std::vector<double> t;
+  Pass p = {};
+  for (int r = 0; r < runs; ++r) {
+    host::resetSdStats();
+    uint64_t n0 = s_news;
+    auto t0 = Clock::now();
+    p.mp3s = f();
+    t.push_back(std::chrono::duration<double, std::micro>(Clock::now() - t0).count());
+    p.news = s_news - n0;
+    p.opens = host::sdStats().opens;
+  }
+  std::sort(t.begin(), t.end());
+  p.us = t[t.size() / 2];
+  return p;
+}
+
+bool isMp3(const char *name) {
+  size_t len = strlen(name);
+  return len > 4 && strcasecmp(name + len - 4, ".mp3") == 0;
+}
+
+// The scan before DirReader: an open per entry, a String per name
+int openNextFile() {
+  int n = 0;
+  File root = SD.open(DHUN_DIR);
+  for (File f = root.openNextFile(); f; f = root.openNextFile()) {
+    String full = String(DHUN_DIR) + "/" + f.name();
+    if (!f.isDirectory() && (full.endsWith(".mp3") || full.endsWith(".MP3"))) n++;
+    f.close();
+  }
+  root.close();
+  return n;
+}
+
+int dirReader() {
+  int n = 0;
+  DirReader dir;
+  if (!dir.open(host::sdRoot(), DHUN_DIR)) return -1;
+  bool isDir;
+  while (const char *name = dir.next(isDir)) {
+    if (!isDir && isMp3(name)) n++;
+  }
+  return n;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int runs = argc > 1 ? atoi(argv[1]) : 11;
+  std::string root = test::makeSdRoot("dir-bench");
+  test::makeDirs(root, DHUN_DIR DHUN_DIR); // a folder among the files
+  std::vector<std::string> names;
+  char name[64];
+  for (int i = 0; i < FILES; ++i) {
+    snprintf(name, sizeof(name), i % 50 ? "Raag Yaman - Alaap %04d.mp3" : "cover %04d.jpg", i);
+    names.push_back(name);
+    FILE *f = fopen((root + DHUN_DIR "/" + std::string(name)).c_str(), "wb");
+    if (f) fclose(f);
+  }
+  int mp3s = (int)std::count_if(names.begin(), names.end(), [](const std::string &s) { return isMp3(s.c_str()); });
+  CHECK(SD.begin(SD_CS));
+
+  Pass before = measure(runs, openNextFile);
+  Pass after = measure(runs, dirReader);
+  printf("%d entries, %d of them MP3\n", FILES + 1, mp3s);
+  printf("  openNextFile  %8.1f us (%.2f us an entry), %4u opens, %5llu allocations (the shim's own included)\n",
+         before.us, before.us / FILES, (unsigned)before.opens, (unsigned long long)before.news);
+  printf("  DirReader     %8.1f us (%.2f us an entry), %4u opens, %5llu allocations\n", after.us, after.us / FILES,
+         (unsigned)after.opens, (unsigned long long)after.news);
+
+  // The same folder on FAT: "." and "..", then each entry in creation order
+  size_t at = 64, lookups = 0;
+  for (const std::string &s : names) {
+    at += 32 * (1 + (s.size() + 12) / 13);
+    lookups += 2 * ((at + SECTOR - 1) / SECTOR) + 1; // stat and fopen from the top, then readdir's sector again
+  }
+  size_t dirSectors = (at + SECTOR - 1) / SECTOR;
+  printf("  on FAT: the directory is %u sectors; f_readdir reads them once (%.0f ms at 4 MHz SPI), "
+         "openNextFile about %u sector reads (%.1f s)\n",
+         (unsigned)dirSectors, dirSectors * SECTOR / SPI_BYTES_PER_S * 1000, (unsigned)(dirSectors + lookups),
+         (dirSectors + lookups) * SECTOR / SPI_BYTES_PER_S);
+
+  CHECK(before.mp3s == mp3s);
+  CHECK(after.mp3s == mp3s);
+  CHECK(after.news == 0);
+  CHECK(after.opens == 0);
+  CHECK(before.opens >= (uint32_t)FILES);
+  CHECK(after.us < before.us);
+  return testResult("dir_bench");
+}
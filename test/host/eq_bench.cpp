@@ -0,0 +1,70 @@
+// Cost of Equalizer::process() per stereo frame with 0 to 8 bands shaped,
+// in ns and (on x86) TSC cycles, on the host. The loop is the one the audio
+// task runs; the host CPU is not the ESP32, so these numbers compare band
+// counts and changes to the filter, not the firmware's real budget.
+//
+//   eq_bench [seconds of audio per case]
+
+#include "HostTest.h"
+#include "Equalizer.h"
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+namespace {
+
+const uint32_t RATE = 44100;
+const size_t BLOCK = 256; // frames per process() call, about what one pass renders
+
+void bench(int shaped, double seconds) {
+  static Equalizer::Table t;
+  Equalizer::Band bands[Equalizer::BANDS];
+  memcpy(bands, Equalizer::DEFAULT_BANDS, sizeof(bands));
+  for (int i = 0; i < shaped; ++i) bands[i].gainDb = (int8_t)(i & 1 ? -4 : 5);
+  Equalizer::design(bands, t);
+  Equalizer eq;
+  eq.setSampleRate(RATE);
+  eq.setTable(&t);
+
+  std::vector<uint32_t> src(RATE), buf(BLOCK);
+  for (size_t i = 0; i < src.size(); ++i) {
+    int16_t s = (int16_t)lrint(8000 * sin(2 * M_PI * 440 * (double)i / RATE) + 3000 * sin(2 * M_PI * 5000 * (double)i / RATE));
+    src[i] = (uint16_t)s | (uint32_t)(uint16_t)s << 16;
+  }
+
+  size_t total = (size_t)(seconds * RATE), done = 0, at = 0;
+  uint32_t sink = 0;
+  auto t0 = std::chrono::steady_clock::now();
+#ifdef HAVE_TSC
+  uint64_t c0 = __rdtsc();
+#endif
+  while (done < total) {
+    if (at + BLOCK > src.size()) at = 0;
+    memcpy(buf.data(), &src[at], BLOCK * sizeof(uint32_t));
+    eq.process(buf.data(), BLOCK);
+    sink += buf[BLOCK / 2];
+    at += BLOCK;
+    done += BLOCK;
+  }
+#ifdef HAVE_TSC
+  double cycles = (double)(__rdtsc() - c0) / done;
+#else
+  double cycles = 0;
+#endif
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / done;
+  printf("%d bands shaped: %6.1f ns/frame", shaped, ns);
+  if (cycles > 0) printf(", %6.1f TSC cycles/frame", cycles);
+  printf(", %.3f%% of a core at %u Hz (%08x)\n", ns * RATE / 1e7, (unsigned)RATE, (unsigned)sink);
+  CHECK(ns > 0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 20.0;
+  const int cases[] = {0, 1, 2, 3, 4, 8};
+  for (int n : cases) bench(n, seconds);
+  return testResult("eq_bench");
+}
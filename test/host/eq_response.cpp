@@ -0,0 +1,114 @@
+// Frequency response of the fixed-point equalizer, measured by running
+// sines through Equalizer::process(): at each band's centre frequency a
+// peak band must give its gain, a shelf half of it, within 0.5 dB, at every
+// rate the band is shaped at. With all bands up at once, the measured gain
+// at each centre must match the response of the floating-point design.
+// A flat table must pass samples through bit for bit.
+
+#include "HostTest.h"
+#include "Equalizer.h"
+#include <complex>
+
+namespace {
+
+const double TOLERANCE_DB = 0.5;
+
+// Gain in dB at `hz` through `eq`, from a -18 dBFS sine after 0.2 s to settle
+double measure(Equalizer &eq, uint32_t rate, double hz) {
+  eq.reset();
+  const size_t settle = rate / 5, frames = rate / 5;
+  std::vector<uint32_t> buf(settle + frames);
+  double amp = 32767 * pow(10.0, -18 / 20.0), in = 0, out = 0;
+  for (size_t i = 0; i < buf.size(); ++i) {
+    int16_t s = (int16_t)lrint(amp * sin(2 * M_PI * hz * (double)i / rate));
+    buf[i] = (uint16_t)s | (uint32_t)(uint16_t)s << 16;
+    if (i >= settle) in += (double)s * s;
+  }
+  eq.process(buf.data(), buf.size());
+  for (size_t i = settle; i < buf.size(); ++i) {
+    double l = (int16_t)(buf[i] & 0xFFFF);
+    out += l * l;
+  }
+  return 10 * log10(out / in);
+}
+
+// |H| in dB of the band cascade as designed, in double precision
+double designed(const Equalizer::Band *bands, uint32_t rate, double hz) {
+  Equalizer::Table t;
+  Equalizer::design(bands, t);
+  int r = 0;
+  while (Equalizer::RATE_LIST[r] != rate) r++;
+  std::complex<double> z1 = std::polar(1.0, -2 * M_PI * hz / rate), h = 1;
+  for (int i = 0; i < Equalizer::BANDS; ++i) {
+    const Equalizer::Coeffs &c = t.c[r][i];
+    double k = 1.0 / (1 << 28);
+    std::complex<double> num = c.b0 * k + c.b1 * k * z1 + c.b2 * k * z1 * z1;
+    std::complex<double> den = 1.0 + c.a1 * k * z1 + c.a2 * k * z1 * z1;
+    h *= num / den;
+  }
+  return 20 * log10(std::abs(h));
+}
+
+void singleBands(int gainDb) {
+  static Equalizer::Table t; // the audio side keeps a pointer
+  const uint32_t rates[] = {22050, 44100, 48000};
+  for (uint32_t rate : rates) {
+    for (int i = 0; i < Equalizer::BANDS; ++i) {
+      Equalizer::Band bands[Equalizer::BANDS];
+      memcpy(bands, Equalizer::DEFAULT_BANDS, sizeof(bands));
+      bands[i].gainDb = (int8_t)gainDb;
+      if (bands[i].freq >= rate * 0.45) continue; // left flat at this rate
+      Equalizer::design(bands, t);
+      Equalizer eq;
+      eq.setSampleRate(rate);
+      eq.setTable(&t);
+      double want = bands[i].type == Equalizer::PEAK ? gainDb : gainDb / 2.0;
+      double got = measure(eq, rate, bands[i].freq);
+      printf("%5u Hz  band %d %-5s %5u Hz %+3d dB: %+6.2f dB (want %+5.1f)\n", (unsigned)rate, i,
+             bands[i].type == Equalizer::PEAK ? "peak" : "shelf", bands[i].freq, gainDb, got, want);
+      CHECK_LE(fabs(got - want), TOLERANCE_DB);
+    }
+  }
+}
+
+void allBands() {
+  static Equalizer::Table t;
+  Equalizer::Band bands[Equalizer::BANDS];
+  memcpy(bands, Equalizer::DEFAULT_BANDS, sizeof(bands));
+  const int gains[Equalizer::BANDS] = {6, -4, 3, -6, 5, -3, 4, 6};
+  for (int i = 0; i < Equalizer::BANDS; ++i) bands[i].gainDb = (int8_t)gains[i];
+  Equalizer::design(bands, t);
+  Equalizer eq;
+  eq.setSampleRate(44100);
+  eq.setTable(&t);
+  for (int i = 0; i < Equalizer::BANDS; ++i) {
+    double want = designed(bands, 44100, bands[i].freq);
+    double got = measure(eq, 44100, bands[i].freq);
+    printf("44100 Hz  all bands, at %5u Hz: %+6.2f dB (design %+6.2f)\n", bands[i].freq, got, want);
+    CHECK_LE(fabs(got - want), TOLERANCE_DB);
+  }
+}
+
+void flat() {
+  static Equalizer::Table t;
+  Equalizer::design(Equalizer::DEFAULT_BANDS, t);
+  Equalizer eq;
+  eq.setSampleRate(44100);
+  eq.setTable(&t);
+  std::vector<uint32_t> buf(4096), ref;
+  uint32_t x = 1;
+  for (uint32_t &f : buf) f = x = x * 1664525u + 1013904223u;
+  ref = buf;
+  eq.process(buf.data(), buf.size());
+  CHECK(buf == ref);
+}
+
+} // namespace
+
+int main() {
+  singleBands(6);
+  singleBands(-12);
+  allBands();
+  flat();
+  return testResult("eq_response");
+}
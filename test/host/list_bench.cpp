@@ -0,0 +1,160 @@
+// Heap and lookup cost of the library's file list against the layout it
+// replaced: a String per file holding the full path (String
+// _dhunFiles[200], looked up by folder name), each its own heap block.
+// The packed list is two blocks per list whatever the count: entries and
+// one pool of names without their folder, within the budget begin() sets.
+// Its entries also carry each file's TrackInfo and (empty here) tags, which
+// the old list didn't have. Heap is what malloc has handed out (mallinfo2),
+// so it includes the host allocator's per-block overhead, which the
+// ESP32's is close to (a sanitizer build has its own allocator, which
+// mallinfo2 doesn't see, so heap isn't compared there); lookups are medians
+// over random indices.
+//
+//   list_bench [runs]
+
+#include "HostTest.h"
+#include "FileScanner.h"
+#include "Config.h"
+#include "HeapBudget.h"
+#include "SD.h"
+#include <algorithm>
+#include <chrono>
+#include <malloc.h>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+const int LOOKUPS = 100000;
+
+size_t heapInUse() { return mallinfo2().uordblks; }
+
+// A name the way the library's files are named
+void fileName(char *buf, size_t len, int i) {
+  static const char *const raags[] = {"Yaman", "Bhairav", "Darbari Kanada", "Bageshri", "Malkauns", "Todi"};
+  snprintf(buf, len, "Raag %s - Alaap %04d.mp3", raags[i % 6], i);
+}
+
+// The list before: an array of Strings (the device's, a buffer pointer and
+// two lengths; past the cap of 200 as if it had none), each path in a
+// block of its own
+struct OldList {
+  struct DeviceString {
+    char *buffer;
+    unsigned capacity;
+    unsigned len;
+  };
+  std::vector<DeviceString> slots;
+
+  explicit OldList(int files) : slots(files > 200 ? files : 200, DeviceString()) {}
+  ~OldList() {
+    for (DeviceString &s : slots) free(s.buffer);
+  }
+  void add(int i, const char *full) {
+    DeviceString &s = slots[i];
+    s.len = s.capacity = strlen(full);
+    s.buffer = (char *)malloc(s.capacity + 1);
+    strcpy(s.buffer, full);
+  }
+  const char *getPath(const char *dirname, int index) const {
+    if (String(dirname) == DHUN_DIR && index >= 0 && index < (int)slots.size() && slots[index].buffer)
+      return slots[index].buffer;
+    return "";
+  }
+};
+
+template <typename F> double nsPerLookup(int runs, F f) {
+  std::vector<double> t;
+  for (int r = 0; r < runs; ++r) {
+    auto t0 = Clock::now();
+    f();
+    t.push_back(std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / LOOKUPS);
+  }
+  std::sort(t.begin(), t.end());
+  return t[t.size() / 2];
+}
+
+std::vector<int> randomIndices(int count) {
+  std::vector<int> v(LOOKUPS);
+  uint32_t x = 12345;
+  for (int &i : v) i = (int)((x = x * 1664525u + 1013904223u) >> 8) % count;
+  return v;
+}
+
+void bench(const std::string &root, int files, bool psram, int runs) {
+  host::setPsram(psram);
+  size_t budget = psram ? LIBRARY_PSRAM_BYTES : heapShare(LIBRARY_HEAP_PERCENT, LIBRARY_RAM_BYTES);
+  printf("%d files, %s, list budget %u bytes\n", files, psram ? "PSRAM" : "no PSRAM", (unsigned)budget);
+  char name[96], full[128];
+
+  // Before
+  size_t h0 = heapInUse();
+  OldList *old = new OldList(files);
+  for (int i = 0; i < files; ++i) {
+    fileName(name, sizeof(name), i);
+    snprintf(full, sizeof(full), "%s/%s", DHUN_DIR, name);
+    old->add(i, full);
+  }
+  size_t oldHeap = heapInUse() - h0;
+  std::vector<int> at = randomIndices(files);
+  volatile size_t sink = 0;
+  double oldNs = nsPerLookup(runs, [&] {
+    for (int i : at) sink += (size_t)old->getPath(DHUN_DIR, i)[6];
+  });
+  delete old;
+
+  // After: the list a boot builds from the folder
+  std::string dir = root + DHUN_DIR;
+  std::string cmd = "rm -rf '" + dir + "' '" + root + LIBRARY_INDEX_PATH + "'";
+  CHECK(system(cmd.c_str()) == 0);
+  test::makeDirs(root, DHUN_DIR);
+  for (int i = 0; i < files; ++i) {
+    fileName(name, sizeof(name), i);
+    FILE *f = fopen((dir + "/" + std::string(name)).c_str(), "wb");
+    if (f) fclose(f);
+  }
+  h0 = heapInUse();
+  FileScanner *scanner = new FileScanner;
+  scanner->begin(SD, host::sdRoot());
+  int folder = scanner->addFolder(DHUN_DIR);
+  scanner->rescan();
+  while (scanner->scanning()) scanner->loop();
+  size_t newHeap = heapInUse() - h0;
+  int count = scanner->getCount(folder);
+  double viewNs = nsPerLookup(runs, [&] {
+    for (int i : at) sink += (size_t)scanner->getPath(folder, i % count).name[0];
+  });
+  double copyNs = nsPerLookup(runs, [&] {
+    for (int i : at) {
+      scanner->getPath(folder, i % count).copy(full, sizeof(full));
+      sink += (size_t)full[6];
+    }
+  });
+  size_t lists = scanner->memoryUsed();
+  size_t paths = lists - count * (sizeof(FileScanner::TrackInfo) + 3); // less the info and empty tags
+  delete scanner;
+
+  printf("  before  %7u bytes of heap in %d blocks (%.1f a file), getPath %.1f ns\n", (unsigned)oldHeap, files,
+         (double)oldHeap / files, oldNs);
+  printf("  after   %7u bytes of %s with the scanner (%.1f a file), %u of them the list's 2 blocks, %u without "
+         "each file's info and tags; %d of %d files listed; getPath %.1f ns, copied out to a buffer %.1f ns\n",
+         (unsigned)newHeap, psram ? "PSRAM" : "heap", (double)newHeap / count, (unsigned)lists, (unsigned)paths, count,
+         files, viewNs, copyNs);
+  CHECK_LE(lists, budget);
+  CHECK(count == files || !psram); // without PSRAM what fits the budget is listed
+  CHECK(oldHeap == 0 || paths * files < oldHeap * count); // a path costs less, per file listed
+  CHECK(viewNs < oldNs);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int runs = argc > 1 ? atoi(argv[1]) : 21;
+  std::string root = test::makeSdRoot("list-bench");
+  CHECK(SD.begin(SD_CS));
+  host::setQuiet(true);
+  bench(root, 200, false, runs);  // the old cap
+  bench(root, 1000, false, runs);
+  bench(root, 5000, true, runs);
+  host::setQuiet(false);
+  return testResult("list_bench");
+}
@@ -0,0 +1,102 @@
+// De-click ramps rendered through AudioManager: a loud low tone is started,
+// its volume jumped down and up, and stopped mid-waveform, and what the DAC
+// played must never step by more than the tone itself moves in a sample
+// plus what a VOLUME_RAMP_MS ramp adds. A hard gain change anywhere shows
+// up as a step of thousands. The stop must also take about the ramp's
+// length to reach silence.
+
+#include "HostTest.h"
+#include "AudioManager.h"
+#include "AudioOutput.h"
+#include "Config.h"
+#include "SD.h"
+#include <algorithm>
+
+namespace {
+
+const uint32_t RATE = 44100;
+const double HZ = 100;
+const float LEVEL = 0.9f;
+
+AudioManager audio;
+
+void runFor(uint32_t ms) {
+  unsigned long t0 = millis();
+  while (millis() - t0 < ms) {
+    audio.loop();
+    delay(5);
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string root = test::makeSdRoot("ramp");
+  std::string wavPath = (argc > 1 ? std::string(argv[1]) : root) + "/ramp.wav";
+  test::makeDirs(root, DHUN_DIR);
+  CHECK(test::writeTone(root, DHUN_DIR "/low.mp3", RATE, 10.0f, HZ, LEVEL));
+  CHECK(SD.begin(SD_CS));
+
+  host::setQuiet(true);
+  audio.begin(I2S_BCLK, I2S_LRCLK, I2S_DIN);
+  audio.setVolume(21);
+  audio.startTask();
+  WavOutput out;
+  CHECK(out.open(wavPath.c_str()));
+  host::captureI2s(0, &out);
+
+  audio.startAsync(String(DHUN_DIR "/low.mp3"));
+  runFor(500);
+  audio.setVolume(3); // the chime's jumps, and a slider dragged fast
+  runFor(300);
+  audio.setVolume(21);
+  runFor(300);
+  for (int v = 21; v >= 0; v -= 4) {
+    audio.setVolume(v);
+    runFor(7);
+  }
+  audio.setVolume(21);
+  runFor(400);
+  audio.stop(); // long before the file ends: mid-waveform
+  runFor(400);
+  host::captureI2s(0, nullptr);
+  out.close();
+  host::setQuiet(false);
+
+  test::Wav w;
+  CHECK(test::readWav(wavPath.c_str(), w));
+  double amp = LEVEL * 32767;
+  double rampFrames = VOLUME_RAMP_MS * RATE / 1000.0;
+  // What the tone moves in a sample itself (the file's, which keeps clear
+  // of digital silence), plus the most a ramp adds
+  std::vector<int16_t> src = test::tone(RATE, 1.0f, HZ, LEVEL);
+  int toneStep = 0;
+  for (size_t i = 2; i < src.size(); i += 2) toneStep = std::max(toneStep, abs(src[i] - src[i - 2]));
+  double limit = toneStep + amp / rampFrames + 4;
+  int maxStep = 0;
+  size_t maxAt = 0;
+  for (size_t i = 1; i < w.frames(); ++i) {
+    for (int ch = 0; ch < 2; ++ch) {
+      int d = abs(w.samples[2 * i + ch] - w.samples[2 * (i - 1) + ch]);
+      if (d > maxStep) maxStep = d, maxAt = i;
+    }
+  }
+
+  // The stop: from the last full-level peak to the first of the silence
+  test::Silence s = test::findSilence(w);
+  size_t lastLoud = 0;
+  for (size_t i = 0; i <= s.last; ++i) {
+    if (abs(w.samples[2 * i]) > amp * 0.95) lastLoud = i;
+  }
+  double stopMs = (double)(s.last - lastLoud) * 1000 / RATE;
+
+  printf("largest step %d at %.3f s, limit %.0f (tone %.0f + ramp %.0f); stop faded out in %.1f ms "
+         "(ramp %d ms); wav %s\n",
+         maxStep, (double)maxAt / RATE, limit, (double)toneStep, amp / rampFrames, stopMs, VOLUME_RAMP_MS,
+         wavPath.c_str());
+  CHECK(s.peak > amp * 0.95);
+  CHECK_LE(maxStep, limit);
+  CHECK_LE(VOLUME_RAMP_MS * 0.8, stopMs);
+  CHECK_LE(stopMs, VOLUME_RAMP_MS + 1000.0 / HZ); // plus a period to the last peak
+  return testResult("ramp_render");
+}
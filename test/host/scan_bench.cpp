@@ -0,0 +1,172 @@
+// Boot-time library scan, before and after the on-SD index, over a folder
+// of small MP3 files: the scan the firmware had before (openNextFile() on
+// every entry, two Serial lines per file), a first boot with no index
+// (every file probed, the index written) and boots with the index (one
+// read of it, a listing of names and a stat() of each file). The host's
+// page cache hides what SD costs, so opens, bytes and Serial output are
+// given too, with the floor they put on a device: bytes at the 4 MHz SPI
+// clock SD.begin() runs the card at, Serial at 115200 baud. Directory
+// lookups (a stat(), an open) aren't in the floor.
+//
+// Also checks that folders are validated by their names: an index whose
+// folder gained a file it can't list is rewritten once, not at every boot;
+// and that a file replaced under the same name is probed again.
+//
+//   scan_bench [files]
+
+#include "HostTest.h"
+#include "FileScanner.h"
+#include "Config.h"
+#include "SD.h"
+#include <chrono>
+
+namespace {
+
+const double SPI_BYTES_PER_S = 4e6 / 8;
+const double SERIAL_BYTES_PER_S = 115200 / 10;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Cost {
+  double ms;
+  host::SdStats sd;
+  uint64_t serial;
+};
+
+// A 128 kbit/s 44.1 kHz MPEG-1 layer III header and a few frames of it
+bool writeMp3(const std::string &hostPath, int frames = 4) {
+  FILE *f = fopen(hostPath.c_str(), "wb");
+  if (!f) return false;
+  std::vector<uint8_t> frame(417);
+  frame[0] = 0xFF, frame[1] = 0xFB, frame[2] = 0x90, frame[3] = 0x00;
+  for (int i = 0; i < frames; ++i) fwrite(frame.data(), 1, frame.size(), f);
+  return fclose(f) == 0;
+}
+
+template <typename F> Cost measure(F f) {
+  host::resetSdStats();
+  uint64_t serial = host::serialBytes();
+  auto t0 = Clock::now();
+  f();
+  Cost c;
+  c.ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+  c.sd = host::sdStats();
+  c.serial = host::serialBytes() - serial;
+  return c;
+}
+
+void report(const char *name, const Cost &c) {
+  double floorMs = (c.sd.read + c.sd.written) / SPI_BYTES_PER_S * 1000 + c.serial / SERIAL_BYTES_PER_S * 1000;
+  printf("%-22s %8.2f ms on the host, %5u opens, %7llu bytes read, %6llu written, %6llu to Serial; "
+         ">= %7.1f ms on the device\n",
+         name, c.ms, (unsigned)c.sd.opens, (unsigned long long)c.sd.read, (unsigned long long)c.sd.written,
+         (unsigned long long)c.serial, floorMs);
+}
+
+// What scanFolder() did before the index: every entry opened (which the
+// floor leaves out: FAT reads directory sectors for it) and every name
+// printed twice
+int oldScan() {
+  int found = 0;
+  Serial.print("Scanning folder: ");
+  Serial.println(DHUN_DIR);
+  File root = SD.open(DHUN_DIR);
+  File file = root.openNextFile();
+  while (file) {
+    if (!file.isDirectory()) {
+      String full = String(DHUN_DIR) + "/" + file.name();
+      Serial.print("  file: ");
+      Serial.println(full);
+      if (full.endsWith(".mp3") || full.endsWith(".MP3")) {
+        found++;
+        Serial.print("    🎵 Added: ");
+        Serial.println(full);
+      }
+    }
+    file.close();
+    file = root.openNextFile();
+  }
+  Serial.print("Scan finished. dhunCount = ");
+  Serial.println(found);
+  root.close();
+  return found;
+}
+
+// A boot: the library's folders, a rescan and loop() until it is idle; the
+// size the list has for the first file
+int boot(uint32_t *firstSize = nullptr) {
+  FileScanner scanner;
+  scanner.begin(SD, host::sdRoot());
+  static const char *const folders[] = LIBRARY_FOLDERS;
+  for (const char *folder : folders) scanner.addFolder(folder);
+  scanner.rescan();
+  while (scanner.scanning()) scanner.loop();
+  const FileScanner::TrackInfo *info = scanner.getInfo(0, 0);
+  if (firstSize) *firstSize = info ? info->size : 0;
+  return scanner.getCount(0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int files = argc > 1 ? atoi(argv[1]) : 300;
+  std::string root = test::makeSdRoot("scan-bench");
+  test::makeDirs(root, DHUN_DIR);
+  char path[512];
+  for (int i = 0; i < files; ++i) {
+    snprintf(path, sizeof(path), "%s%s/Raag %03d - Alaap.mp3", root.c_str(), DHUN_DIR, i);
+    CHECK(writeMp3(path));
+  }
+  CHECK(SD.begin(SD_CS));
+  host::setQuiet(true);
+  printf("%d files in %s\n", files, DHUN_DIR);
+
+  int n = 0;
+  Cost before = measure([&] { n = oldScan(); });
+  CHECK(n == files);
+  report("before: openNextFile", before);
+
+  Cost first = measure([&] { n = boot(); });
+  CHECK(n == files);
+  CHECK(first.sd.written > 0);
+  report("first boot, no index", first);
+
+  Cost indexed = measure([&] { n = boot(); });
+  CHECK(n == files);
+  CHECK(indexed.sd.written == 0); // the index was right
+  CHECK_LE(indexed.sd.opens, 3);  // the index and the journal, no file
+  report("boot with the index", indexed);
+
+  CHECK(writeMp3(root + DHUN_DIR "/Raag new.mp3"));
+  Cost added = measure([&] { n = boot(); });
+  CHECK(n == files + 1);
+  CHECK(added.sd.written > 0);
+  report("boot, one file new", added);
+
+  // A name too long to play: not in the list, but the folder changed, so
+  // the index is written once and then trusted again
+  std::string longName = "/" + std::string(FileScanner::MAX_PATH_LEN, 'x') + ".mp3";
+  CHECK(writeMp3(root + std::string(DHUN_DIR) + longName));
+  Cost unlisted = measure([&] { n = boot(); });
+  CHECK(n == files + 1);
+  CHECK(unlisted.sd.written > 0);
+  report("boot, one name unlisted", unlisted);
+  Cost again = measure([&] { n = boot(); });
+  CHECK(again.sd.written == 0);
+  report("boot after that", again);
+
+  // The first file copied over with a longer one of the same name
+  snprintf(path, sizeof(path), "%s%s/Raag 000 - Alaap.mp3", root.c_str(), DHUN_DIR);
+  CHECK(writeMp3(path, 8));
+  uint32_t size = 0;
+  Cost replaced = measure([&] { n = boot(&size); });
+  CHECK(n == files + 1);
+  CHECK(size == 8 * 417);
+  CHECK(replaced.sd.written > 0);
+  CHECK_LE(replaced.sd.opens, 5); // the index, the journal, the file and the new index
+  report("boot, one file replaced", replaced);
+
+  host::setQuiet(false);
+  CHECK(indexed.ms < before.ms || indexed.sd.opens < before.sd.opens);
+  return testResult("scan_bench");
+}
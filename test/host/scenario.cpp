@@ -0,0 +1,200 @@
+// Plays the boot-to-motion sequence on the host, the way main.cpp and
+// StateMachine drive it: a start, a gapless change to the next track and the
+// greeting from memory, with the audio task on its own thread and I2S
+// draining at the sample rate. Then an hourly chime ducked over a track that
+// ends before the chime does, which must still end and give the volume back. What the DAC played is written to WAVs and
+// checked for gaps; start and greeting latency come from the engine's own
+// metrics, CPU from the process.
+//
+//   scenario [output dir]   (WAVs are kept there; default: the SD scratch dir)
+
+#include "HostTest.h"
+#include "AudioManager.h"
+#include "AudioOutput.h"
+#include "Config.h"
+#include "SD.h"
+
+static AudioManager audioManager;
+
+static const uint32_t RATE = 44100;
+static const float TRACK_SEC = 2.0f;
+
+static volatile bool s_started = false;
+static volatile bool s_startOk = false;
+static volatile uint32_t s_startMs = 0;
+
+static void onStart(uint32_t, bool ok, uint32_t latencyMs, void *) {
+  s_startOk = ok;
+  s_startMs = latencyMs;
+  s_started = true;
+}
+
+// The Arduino loop, for `ms`: loop() every 5 ms, prefetching the next track
+// when the engine asks for it, as StateMachine does (which retries every
+// 2 s; these tracks are shorter than that)
+static void runLoop(uint32_t ms, const char *next = nullptr, bool *prefetched = nullptr) {
+  unsigned long t0 = millis(), tried = 0;
+  while (millis() - t0 < ms) {
+    audioManager.loop();
+    if (next && prefetched && audioManager.hasPrefetch()) *prefetched = true;
+    if (next && prefetched && !*prefetched && audioManager.wantsPrefetch() && millis() - tried >= 100) {
+      tried = millis();
+      audioManager.prefetch(String(next));
+    }
+    delay(5);
+  }
+}
+
+static bool waitIdle(uint32_t ms) {
+  unsigned long t0 = millis();
+  while (millis() - t0 < ms) {
+    audioManager.loop();
+    if (!audioManager.isStarting() && !audioManager.isRunning()) return true;
+    delay(5);
+  }
+  return false;
+}
+
+struct Phase {
+  const char *name;
+  std::string wav;
+  test::Silence s;
+  uint32_t rate;
+};
+
+static void report(const Phase &p) {
+  printf("%-9s audible %6.3f s, longest gap %6.2f ms (at %.3f s), peak %d, wav %s\n", p.name,
+         (double)(p.s.last - p.s.first + 1) / p.rate, p.s.longest * 1000.0 / p.rate,
+         (double)p.s.longestAt / p.rate, p.s.peak, p.wav.c_str());
+}
+
+static bool analyze(Phase &p) {
+  test::Wav w;
+  if (!test::readWav(p.wav.c_str(), w)) return false;
+  p.rate = w.rate;
+  p.s = test::findSilence(w);
+  report(p);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  std::string root = test::makeSdRoot("scenario");
+  std::string outDir = argc > 1 ? argv[1] : root;
+  test::makeDirs(root, DHUN_DIR);
+  test::makeDirs(root, HOURS_DIR);
+  CHECK(test::writeTone(root, DHUN_DIR "/01.mp3", RATE, TRACK_SEC, 440));
+  CHECK(test::writeTone(root, DHUN_DIR "/02.mp3", RATE, TRACK_SEC, 660));
+  CHECK(test::writeTone(root, GREETING_PATH, RATE, 0.6f, 880));
+  CHECK(test::writeTone(root, DHUN_DIR "/03.mp3", RATE, 1.6f, 520));
+  CHECK(test::writeTone(root, BELL_PATH, RATE, 0.3f, 1320));
+  CHECK(test::writeTone(root, HOURS_DIR "3.mp3", RATE, 0.4f, 990));
+  CHECK(SD.begin(SD_CS));
+
+  host::setQuiet(true);
+  audioManager.begin(I2S_BCLK, I2S_LRCLK, I2S_DIN);
+  audioManager.setVolume(21);
+  CHECK(audioManager.cacheGreeting(GREETING_PATH));
+  audioManager.startTask();
+  uint64_t cpu0 = test::cpuUs();
+  unsigned long wall0 = millis();
+
+  // Start, then the next track taking over on its last sample
+  Phase gapless = {"gapless", outDir + "/gapless.wav"};
+  WavOutput gaplessOut;
+  CHECK(gaplessOut.open(gapless.wav.c_str()));
+  host::captureI2s(0, &gaplessOut);
+  uint32_t starvedBefore = host::i2sStarvedFrames(0);
+  audioManager.startAsync(String(DHUN_DIR "/01.mp3"), onStart);
+  bool prefetched = false;
+  runLoop((uint32_t)(TRACK_SEC * 1000) / 2, DHUN_DIR "/02.mp3", &prefetched);
+  CHECK(s_started && s_startOk);
+  uint32_t startMs = s_startMs;
+  CHECK(prefetched);
+  CHECK(waitIdle((uint32_t)(TRACK_SEC * 3000)));
+  runLoop(400); // let the DMA ring play out
+  uint32_t starved = host::i2sStarvedFrames(0) - starvedBefore;
+  host::captureI2s(0, nullptr);
+  gaplessOut.close();
+
+  // The greeting from memory, on motion
+  Phase greeting = {"greeting", outDir + "/greeting.wav"};
+  WavOutput greetingOut;
+  CHECK(greetingOut.open(greeting.wav.c_str()));
+  host::captureI2s(0, &greetingOut);
+  CHECK(audioManager.playGreeting(micros()));
+  runLoop(1200);
+  host::captureI2s(0, nullptr);
+  greetingOut.close();
+
+  uint64_t cpu = test::cpuUs() - cpu0;
+  unsigned long wall = millis() - wall0;
+
+  // The chime for 3 o'clock over a track at a lower volume; the track ends
+  // under it (and is too big to be kept decoded, which would evict the
+  // chime's clips). Then the next track must play at that volume again.
+  audioManager.setVolume(12);
+  unsigned long t0 = millis();
+  while (!audioManager.prepareChime(3) && millis() - t0 < 5000) runLoop(20);
+  CHECK(audioManager.prepareChime(3));
+  s_started = false;
+  audioManager.startAsync(String(DHUN_DIR "/03.mp3"), onStart);
+  bool ducked = false;
+  t0 = millis();
+  while (!ducked && millis() - t0 < 500) {
+    runLoop(10);
+    ducked = audioManager.duckChime(3);
+  }
+  CHECK(s_started && s_startOk);
+  CHECK(ducked);
+  bool chimeEnded = false;
+  t0 = millis();
+  while (!chimeEnded && millis() - t0 < 6000) {
+    runLoop(20);
+    chimeEnded = !audioManager.isChiming();
+  }
+  unsigned long chimeMs = millis() - t0;
+  runLoop(400); // the chime's last samples out of the DMA ring
+  Phase after = {"after", outDir + "/after-chime.wav"};
+  WavOutput afterOut;
+  CHECK(afterOut.open(after.wav.c_str()));
+  host::captureI2s(0, &afterOut);
+  audioManager.startAsync(String(DHUN_DIR "/02.mp3"), onStart);
+  runLoop(800);
+  host::captureI2s(0, nullptr);
+  afterOut.close();
+  host::setQuiet(false);
+
+  CHECK(analyze(gapless));
+  CHECK(analyze(greeting));
+  CHECK(analyze(after));
+  const AudioMetrics &m = audioManager.getMetrics();
+  double audioSec = (double)(gapless.s.last - gapless.s.first + greeting.s.last - greeting.s.first + 2) /
+                    (gapless.rate ? gapless.rate : RATE);
+  printf("start     latency %u ms (open p50 <%u us, first frame p50 <%u us)\n", (unsigned)startMs,
+         (unsigned)m.openUs.percentile(0.5f), (unsigned)m.firstFrameUs.percentile(0.5f));
+  printf("handover  engine gap max %u ms, %u seamless of %u\n", (unsigned)audioManager.getMaxGapMs(),
+         (unsigned)audioManager.getSeamlessCount(), (unsigned)audioManager.getGapCount());
+  printf("greeting  latency %u us (target %u us)\n", (unsigned)audioManager.getGreetingLatencyUs(),
+         (unsigned)GREETING_LATENCY_TARGET_US);
+  printf("output    %u frames starved mid-track, %u underruns, %u ring overflows\n", (unsigned)starved,
+         (unsigned)m.underruns.load(), (unsigned)m.ringOverflows.load());
+  printf("chime     ducked over a track that ended under it: %s after %lu ms\n",
+         chimeEnded ? "ended" : "still chiming", chimeMs);
+  printf("cpu       %.1f ms CPU for %.2f s of audio in %.2f s: %.1f%% of one core\n", cpu / 1000.0, audioSec,
+         wall / 1000.0, audioSec > 0 ? cpu / 1e4 / audioSec : 0.0);
+
+  // Both tracks back to back without a hole, and all of them heard
+  CHECK_LE(gapless.s.longest, gapless.rate / 1000);
+  CHECK_LE(2 * TRACK_SEC - 0.05, (double)(gapless.s.last - gapless.s.first + 1) / gapless.rate);
+  CHECK_LE(gapless.s.peak, 32767 * 0.55);
+  CHECK_LE(startMs, 200);
+  CHECK_LE(greeting.s.longest, greeting.rate / 1000); // mu-law zero crossings
+  CHECK_LE(audioManager.getGreetingLatencyUs(), GREETING_LATENCY_TARGET_US);
+  CHECK_LE(m.ringOverflows.load(), 0);
+  // The chime ended with the track gone, and the master gain is back at the
+  // volume setting, not CHIME_VOLUME (the gapless tracks played at that)
+  CHECK(chimeEnded);
+  CHECK(after.s.peak > 0);
+  CHECK_LE(after.s.peak, gapless.s.peak * 0.5);
+  return testResult("scenario");
+}
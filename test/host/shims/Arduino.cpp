@@ -0,0 +1,115 @@
+#include "Arduino.h"
+#include "HostSim.h"
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+namespace {
+
+const auto s_boot = std::chrono::steady_clock::now();
+std::mt19937 s_rng(1);
+bool s_quiet = false;
+std::atomic<uint64_t> s_serialBytes(0); // the audio task prints too
+bool s_psram = false;
+size_t s_freeHeap = 230 * 1024;
+size_t s_largestBlock = 110 * 1024;
+
+} // namespace
+
+namespace host {
+
+void setQuiet(bool quiet) { s_quiet = quiet; }
+uint64_t serialBytes() { return s_serialBytes; }
+void setPsram(bool present) { s_psram = present; }
+void setHeap(size_t freeBytes, size_t largestBlock) {
+  s_freeHeap = freeBytes;
+  s_largestBlock = largestBlock;
+}
+
+} // namespace host
+
+size_t Print::printf(const char *format, ...) {
+  char buf[512];
+  va_list ap;
+  va_start(ap, format);
+  int n = vsnprintf(buf, sizeof(buf), format, ap);
+  va_end(ap);
+  if (n < 0) return 0;
+  return write((const uint8_t *)buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t n) {
+  s_serialBytes += n;
+  if (!s_quiet) fwrite(buf, 1, n, stdout);
+  return n;
+}
+
+unsigned long millis() {
+  return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - s_boot)
+      .count();
+}
+
+// 32 bits wide like the ESP32's, so wraparound code sees the same arithmetic
+unsigned long micros() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - s_boot)
+      .count();
+}
+
+void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+void delayMicroseconds(unsigned us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+void yield() { std::this_thread::yield(); }
+
+long random(long howbig) {
+  if (howbig <= 0) return 0;
+  return (long)(s_rng() % (uint32_t)howbig);
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) return howsmall;
+  return howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) { s_rng.seed((uint32_t)seed); }
+uint32_t esp_random() { return s_rng(); }
+
+void pinMode(int, int) {}
+void digitalWrite(int, int) {}
+int digitalRead(int) { return LOW; }
+
+bool psramFound() { return s_psram; }
+void *ps_malloc(size_t size) { return s_psram ? malloc(size) : nullptr; }
+void *ps_calloc(size_t n, size_t size) { return s_psram ? calloc(n, size) : nullptr; }
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+  if ((caps & MALLOC_CAP_SPIRAM) && !s_psram) return nullptr;
+  return malloc(size);
+}
+
+void *heap_caps_realloc(void *p, size_t size, uint32_t caps) {
+  if ((caps & MALLOC_CAP_SPIRAM) && !s_psram) return nullptr;
+  return realloc(p, size);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+  if (caps & MALLOC_CAP_SPIRAM) return s_psram ? 4u << 20 : 0;
+  return s_freeHeap;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+  if (caps & MALLOC_CAP_SPIRAM) return s_psram ? 4u << 20 : 0;
+  return s_largestBlock;
+}
+
+uint32_t EspClass::getFreeHeap() { return (uint32_t)s_freeHeap; }
+
+void EspClass::restart() { esp_restart(); }
+
+void esp_restart() {
+  fflush(stdout);
+  fprintf(stderr, "esp_restart() called\n");
+  exit(3);
+}
@@ -0,0 +1,207 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// The part of the Arduino-ESP32 core the firmware uses, on the host: String
+// over std::string, Serial to stdout, the clock from std::chrono, and the
+// heap calls answered from the host heap with ESP32-sized numbers (see
+// HostSim.h to change them).
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+class String {
+public:
+  String() {}
+  String(const char *s) : _s(s ? s : "") {}
+  String(const std::string &s) : _s(s) {}
+  explicit String(char c) : _s(1, c) {}
+  explicit String(int v) : _s(std::to_string(v)) {}
+  explicit String(unsigned v) : _s(std::to_string(v)) {}
+  explicit String(long v) : _s(std::to_string(v)) {}
+  explicit String(unsigned long v) : _s(std::to_string(v)) {}
+  String(float v, unsigned decimals = 2) { setFloat(v, decimals); }
+  String(double v, unsigned decimals = 2) { setFloat(v, decimals); }
+
+  unsigned length() const { return (unsigned)_s.size(); }
+  bool isEmpty() const { return _s.empty(); }
+  const char *c_str() const { return _s.c_str(); }
+  bool reserve(unsigned n) {
+    _s.reserve(n);
+    return true;
+  }
+  // Like the core: a String always has a buffer once it exists
+  explicit operator bool() const { return true; }
+
+  bool equals(const String &o) const { return _s == o._s; }
+  bool equalsIgnoreCase(const String &o) const { return strcasecmp(c_str(), o.c_str()) == 0; }
+  bool startsWith(const String &p) const { return _s.compare(0, p._s.size(), p._s) == 0; }
+  bool endsWith(const String &p) const {
+    return _s.size() >= p._s.size() && _s.compare(_s.size() - p._s.size(), p._s.size(), p._s) == 0;
+  }
+  int indexOf(char c, unsigned from = 0) const { return pos(_s.find(c, from)); }
+  int indexOf(const String &s, unsigned from = 0) const { return pos(_s.find(s._s, from)); }
+  int lastIndexOf(char c) const { return pos(_s.rfind(c)); }
+  String substring(unsigned from) const { return from < _s.size() ? String(_s.substr(from)) : String(); }
+  String substring(unsigned from, unsigned to) const {
+    if (from > to) std::swap(from, to);
+    return from < _s.size() ? String(_s.substr(from, to - from)) : String();
+  }
+  char charAt(unsigned i) const { return i < _s.size() ? _s[i] : 0; }
+  char operator[](unsigned i) const { return charAt(i); }
+  char &operator[](unsigned i) { return _s[i]; }
+  long toInt() const { return atol(c_str()); }
+  float toFloat() const { return (float)atof(c_str()); }
+  void toLowerCase() {
+    for (char &c : _s) c = (char)tolower((unsigned char)c);
+  }
+  void toUpperCase() {
+    for (char &c : _s) c = (char)toupper((unsigned char)c);
+  }
+  void trim() {
+    size_t a = _s.find_first_not_of(" \t\r\n");
+    size_t b = _s.find_last_not_of(" \t\r\n");
+    _s = a == std::string::npos ? std::string() : _s.substr(a, b - a + 1);
+  }
+  void remove(unsigned index, unsigned count = (unsigned)-1) {
+    if (index < _s.size()) _s.erase(index, count);
+  }
+  void replace(const String &from, const String &to) {
+    if (from._s.empty()) return;
+    for (size_t at = _s.find(from._s); at != std::string::npos; at = _s.find(from._s, at + to._s.size()))
+      _s.replace(at, from._s.size(), to._s);
+  }
+  bool concat(const char *s, unsigned n) {
+    _s.append(s, n);
+    return true;
+  }
+
+  String &operator+=(const String &o) { return append(o._s); }
+  String &operator+=(const char *o) { return append(o ? o : ""); }
+  String &operator+=(char c) {
+    _s += c;
+    return *this;
+  }
+  String &operator+=(int v) { return append(std::to_string(v)); }
+  String &operator+=(unsigned v) { return append(std::to_string(v)); }
+  String &operator+=(long v) { return append(std::to_string(v)); }
+  String &operator+=(unsigned long v) { return append(std::to_string(v)); }
+  String &operator+=(float v) { return *this += String(v); }
+  String &operator+=(double v) { return *this += String(v); }
+
+  bool operator==(const String &o) const { return _s == o._s; }
+  bool operator==(const char *o) const { return _s == (o ? o : ""); }
+  bool operator!=(const String &o) const { return _s != o._s; }
+  bool operator!=(const char *o) const { return !(*this == o); }
+  bool operator<(const String &o) const { return _s < o._s; }
+
+private:
+  std::string _s;
+
+  static int pos(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+  String &append(const std::string &s) {
+    _s += s;
+    return *this;
+  }
+  void setFloat(double v, unsigned decimals) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+    _s = buf;
+  }
+};
+
+inline String operator+(const String &a, const String &b) {
+  String s(a);
+  s += b;
+  return s;
+}
+inline String operator+(const String &a, const char *b) { return a + String(b); }
+inline String operator+(const char *a, const String &b) { return String(a) + b; }
+inline String operator+(const String &a, char b) {
+  String s(a);
+  s += b;
+  return s;
+}
+template <typename T> String operator+(const String &a, T v) {
+  String s(a);
+  s += v;
+  return s;
+}
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(const uint8_t *buf, size_t n) = 0;
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t print(const String &s) { return print(s.c_str()); }
+  size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v) { return printf("%d", v); }
+  size_t print(unsigned v) { return printf("%u", v); }
+  size_t print(long v) { return printf("%ld", v); }
+  size_t print(unsigned long v) { return printf("%lu", v); }
+  size_t print(double v, int decimals = 2) { return printf("%.*f", decimals, v); }
+  template <typename T> size_t println(const T &v) { return print(v) + println(); }
+  size_t println() { return print("\n"); }
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long) {}
+  size_t write(const uint8_t *buf, size_t n) override;
+  using Print::write;
+};
+extern HardwareSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned us);
+void yield();
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+void pinMode(int, int);
+void digitalWrite(int, int);
+int digitalRead(int);
+
+bool psramFound();
+void *ps_malloc(size_t size);
+void *ps_calloc(size_t n, size_t size);
+
+template <class T, class L, class H> T constrain(T v, L lo, H hi) { return v < lo ? lo : (v > hi ? hi : v); }
+using std::max;
+using std::min;
+
+class EspClass {
+public:
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap() { return getFreeHeap(); }
+  uint32_t getPsramSize() { return psramFound() ? 4u << 20 : 0; }
+  uint32_t getFreePsram() { return getPsramSize(); }
+  void restart();
+};
+extern EspClass ESP;
+
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+
+#endif // HOST_ARDUINO_H
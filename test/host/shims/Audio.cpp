@@ -0,0 +1,119 @@
+#include "Audio.h"
+#include "HostSim.h"
+
+namespace {
+
+uint32_t s_burst = 1152;
+
+uint32_t le32(const uint8_t *p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+uint16_t le16(const uint8_t *p) { return (uint16_t)(p[0] | p[1] << 8); }
+
+} // namespace
+
+namespace host {
+
+void setDecodeBurst(uint32_t frames) { s_burst = frames ? frames : 1; }
+
+} // namespace host
+
+Audio::Audio(bool, uint8_t, uint8_t) {}
+
+bool Audio::setPinout(uint8_t, uint8_t, uint8_t, int8_t, int8_t) { return true; }
+
+// RIFF header, then the fmt and data chunks in any order
+bool Audio::parseWav() {
+  uint8_t h[12];
+  if (_file.read(h, 12) != 12 || memcmp(h, "RIFF", 4) || memcmp(h + 8, "WAVE", 4)) return false;
+  bool fmt = false;
+  while (true) {
+    uint8_t c[8];
+    if (_file.read(c, 8) != 8) return false;
+    uint32_t len = le32(c + 4);
+    uint32_t at = (uint32_t)_file.position();
+    if (!memcmp(c, "fmt ", 4)) {
+      uint8_t f[16];
+      if (len < 16 || _file.read(f, 16) != 16) return false;
+      if (le16(f) != 1 || le16(f + 14) != 16) return false; // PCM, 16-bit
+      _channels = (uint8_t)le16(f + 2);
+      _rate = le32(f + 4);
+      if (_channels < 1 || _channels > 2 || _rate == 0) return false;
+      fmt = true;
+    } else if (!memcmp(c, "data", 4)) {
+      if (!fmt) return false;
+      _dataStart = at;
+      _dataEnd = at + len < _fileSize ? at + len : _fileSize;
+      return true;
+    }
+    if (!_file.seek(at + len + (len & 1))) return false;
+  }
+}
+
+bool Audio::connecttoFS(fs::FS &fs, const char *path, uint32_t resumeFilePos) {
+  stopSong();
+  _file = fs.open(path, FILE_READ);
+  if (!_file || _file.isDirectory()) {
+    _file = File();
+    return false;
+  }
+  _fileSize = (uint32_t)_file.size();
+  if (!parseWav()) {
+    if (audio_info) audio_info("host decoder: not a 16-bit PCM WAV");
+    _file.close();
+    return false;
+  }
+  uint32_t block = 2u * _channels;
+  _pos = _dataStart;
+  if (resumeFilePos > _dataStart && resumeFilePos < _dataEnd)
+    _pos = _dataStart + (resumeFilePos - _dataStart) / block * block;
+  _file.seek(_pos);
+  _running = true;
+  return true;
+}
+
+void Audio::loop() {
+  if (!_running) return;
+  uint32_t block = 2u * _channels;
+  uint8_t buf[4096];
+  uint32_t left = s_burst;
+  while (left && _pos < _dataEnd) {
+    uint32_t frames = left;
+    if (frames > sizeof(buf) / block) frames = sizeof(buf) / block;
+    if (frames > (_dataEnd - _pos) / block) frames = (_dataEnd - _pos) / block;
+    if (frames == 0) break;
+    size_t got = _file.read(buf, frames * block) / block;
+    if (got == 0) break;
+    for (size_t i = 0; i < got; ++i) {
+      const uint8_t *p = buf + i * block;
+      uint16_t l = le16(p);
+      uint16_t r = _channels == 2 ? le16(p + 2) : l;
+      uint32_t sample = (uint32_t)r << 16 | l;
+      bool toI2s = true;
+      if (audio_process_i2s) audio_process_i2s(&sample, &toI2s);
+    }
+    _pos += (uint32_t)got * block;
+    left -= (uint32_t)got;
+  }
+  if (left && _running) {
+    // Read to the end (or the card went away): the song is over
+    _running = false;
+    _file.close();
+    if (audio_eof_mp3) audio_eof_mp3("");
+  }
+}
+
+uint32_t Audio::stopSong() {
+  uint32_t pos = _pos;
+  _running = false;
+  if (_file) _file.close();
+  return pos;
+}
+
+uint32_t Audio::getAudioFileDuration() {
+  uint32_t bytesPerSec = _rate * 2u * _channels;
+  return bytesPerSec ? (_dataEnd - _dataStart) / bytesPerSec : 0;
+}
+
+uint32_t Audio::getAudioCurrentTime() {
+  uint32_t bytesPerSec = _rate * 2u * _channels;
+  return bytesPerSec && _pos > _dataStart ? (_pos - _dataStart) / bytesPerSec : 0;
+}
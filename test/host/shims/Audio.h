@@ -0,0 +1,51 @@
+#ifndef HOST_AUDIO_H
+#define HOST_AUDIO_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "driver/i2s.h"
+
+// ESP32-audioI2S as far as the firmware uses it. There is no MP3 decoder on
+// the host: a file is played if it holds 16-bit PCM WAV data, whatever it is
+// called, and each loop() hands one MP3 frame's worth of it (1152 frames,
+// see host::setDecodeBurst()) to audio_process_i2s(), like the library does.
+class Audio {
+public:
+  Audio(bool internalDAC = false, uint8_t channelEnabled = 3, uint8_t i2sPort = I2S_NUM_0);
+
+  bool setPinout(uint8_t bclk, uint8_t lrc, uint8_t dout, int8_t din = -1, int8_t mck = -1);
+  bool connecttoFS(fs::FS &fs, const char *path, uint32_t resumeFilePos = 0);
+  void loop();
+  bool isRunning() { return _running; }
+  uint32_t stopSong();
+  void setVolume(uint8_t vol) { _volume = vol; }
+  uint8_t getVolume() { return _volume; }
+
+  uint32_t getSampleRate() { return _rate; }
+  uint8_t getBitsPerSample() { return 16; }
+  uint8_t getChannels() { return _channels; }
+  uint32_t getFileSize() { return _fileSize; }
+  uint32_t getFilePos() { return _pos; }
+  uint32_t getAudioDataStartPos() { return _dataStart; }
+  uint32_t getAudioFileDuration(); // seconds
+  uint32_t getAudioCurrentTime();  // seconds
+
+private:
+  File _file;
+  bool _running = false;
+  uint8_t _volume = 21;
+  uint32_t _rate = 0;
+  uint8_t _channels = 2;
+  uint32_t _fileSize = 0;
+  uint32_t _dataStart = 0;
+  uint32_t _dataEnd = 0;
+  uint32_t _pos = 0;
+
+  bool parseWav();
+};
+
+void audio_process_i2s(uint32_t *sample, bool *continueI2S) __attribute__((weak));
+void audio_eof_mp3(const char *info) __attribute__((weak));
+void audio_info(const char *info) __attribute__((weak));
+
+#endif // HOST_AUDIO_H
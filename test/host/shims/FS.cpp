@@ -0,0 +1,202 @@
+#include "FS.h"
+#include "SD.h"
+#include "HostSim.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SPIClass SPI;
+fs::SDFS SD;
+
+namespace {
+
+std::string s_sdRoot;
+int s_failOpens = 0;
+host::SdStats s_stats = {};
+
+std::string baseName(const std::string &path) {
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+} // namespace
+
+namespace host {
+
+void setSdRoot(const char *dir) { s_sdRoot = dir ? dir : ""; }
+const char *sdRoot() { return s_sdRoot.c_str(); }
+void failOpens(int n) { s_failOpens = n; }
+SdStats sdStats() { return s_stats; }
+void resetSdStats() { s_stats = SdStats(); }
+
+} // namespace host
+
+namespace fs {
+
+struct File::Impl {
+  std::string path;     // as the firmware named it
+  std::string hostPath;
+  std::string name;
+  FILE *fp = nullptr;
+  DIR *dir = nullptr;
+
+  ~Impl() {
+    if (fp) fclose(fp);
+    if (dir) closedir(dir);
+  }
+};
+
+File::operator bool() const { return _impl && (_impl->fp || _impl->dir); }
+const char *File::name() const { return _impl ? _impl->name.c_str() : ""; }
+const char *File::path() const { return _impl ? _impl->path.c_str() : ""; }
+bool File::isDirectory() const { return _impl && _impl->dir; }
+
+File File::openNextFile(const char *mode) {
+  if (!_impl || !_impl->dir) return File();
+  while (struct dirent *e = readdir(_impl->dir)) {
+    if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
+    std::string child = _impl->path == "/" ? "/" + std::string(e->d_name) : _impl->path + "/" + std::string(e->d_name);
+    auto impl = std::make_shared<Impl>();
+    impl->path = child;
+    impl->hostPath = _impl->hostPath + "/" + std::string(e->d_name);
+    impl->name = e->d_name;
+    struct stat st;
+    if (stat(impl->hostPath.c_str(), &st) != 0) continue;
+    if (S_ISDIR(st.st_mode)) impl->dir = opendir(impl->hostPath.c_str());
+    else impl->fp = fopen(impl->hostPath.c_str(), *mode == 'r' ? "rb" : "r+b");
+    s_stats.opens++;
+    return File(impl);
+  }
+  return File();
+}
+
+void File::rewindDirectory() {
+  if (_impl && _impl->dir) rewinddir(_impl->dir);
+}
+
+void File::close() {
+  if (!_impl) return;
+  if (_impl->fp) fclose(_impl->fp);
+  if (_impl->dir) closedir(_impl->dir);
+  _impl->fp = nullptr;
+  _impl->dir = nullptr;
+}
+
+size_t File::size() const {
+  if (!_impl || !_impl->fp) return 0;
+  fflush(_impl->fp);
+  struct stat st;
+  return fstat(fileno(_impl->fp), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+size_t File::position() const { return _impl && _impl->fp ? (size_t)ftell(_impl->fp) : 0; }
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  if (!_impl || !_impl->fp) return false;
+  int whence = mode == SeekSet ? SEEK_SET : mode == SeekCur ? SEEK_CUR : SEEK_END;
+  if (mode == SeekSet && pos > size()) return false; // like the ESP32 VFS on FAT
+  return fseek(_impl->fp, (long)pos, whence) == 0;
+}
+
+int File::available() {
+  if (!_impl || !_impl->fp) return 0;
+  size_t s = size(), p = position();
+  return p < s ? (int)(s - p) : 0;
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t File::read(uint8_t *buf, size_t n) {
+  if (!_impl || !_impl->fp || n == 0) return 0;
+  size_t got = fread(buf, 1, n, _impl->fp);
+  s_stats.read += got;
+  return got;
+}
+
+int File::peek() {
+  if (!_impl || !_impl->fp) return -1;
+  int c = fgetc(_impl->fp);
+  if (c != EOF) ungetc(c, _impl->fp);
+  return c == EOF ? -1 : c;
+}
+
+size_t File::write(const uint8_t *buf, size_t n) {
+  if (!_impl || !_impl->fp || n == 0) return 0;
+  size_t put = fwrite(buf, 1, n, _impl->fp);
+  s_stats.written += put;
+  return put;
+}
+
+void File::flush() {
+  if (_impl && _impl->fp) fflush(_impl->fp);
+}
+
+time_t File::getLastWrite() {
+  struct stat st;
+  return _impl && stat(_impl->hostPath.c_str(), &st) == 0 ? st.st_mtime : 0;
+}
+
+std::string FS::hostPath(const char *path) const {
+  std::string p = path ? path : "";
+  if (p.empty() || p[0] != '/') p = "/" + p;
+  while (p.size() > 1 && p.back() == '/') p.pop_back();
+  return root() + (p == "/" ? "" : p);
+}
+
+File FS::open(const char *path, const char *mode, bool create) {
+  (void)create;
+  if (!mounted()) return File();
+  if (s_failOpens > 0) {
+    s_failOpens--;
+    return File();
+  }
+  auto impl = std::make_shared<File::Impl>();
+  impl->path = path;
+  impl->hostPath = hostPath(path);
+  impl->name = baseName(impl->path);
+  struct stat st;
+  bool isDir = stat(impl->hostPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+  if (isDir) {
+    if (*mode != 'r') return File();
+    impl->dir = opendir(impl->hostPath.c_str());
+  } else {
+    const char *m = !strcmp(mode, "r") ? "rb" : !strcmp(mode, "w") ? "wb" : !strcmp(mode, "a") ? "ab" : "r+b";
+    impl->fp = fopen(impl->hostPath.c_str(), m);
+  }
+  if (impl->fp || impl->dir) s_stats.opens++;
+  return File(impl);
+}
+
+bool FS::exists(const char *path) {
+  struct stat st;
+  return mounted() && stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char *path) { return mounted() && unlink(hostPath(path).c_str()) == 0; }
+
+// FAT does not replace an existing file on rename; neither does this
+bool FS::rename(const char *from, const char *to) {
+  if (!mounted() || exists(to)) return false;
+  return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char *path) { return mounted() && ::mkdir(hostPath(path).c_str(), 0755) == 0; }
+bool FS::rmdir(const char *path) { return mounted() && ::rmdir(hostPath(path).c_str()) == 0; }
+
+bool SDFS::begin(uint8_t, SPIClass &, uint32_t, const char *, uint8_t, bool) {
+  struct stat st;
+  _mounted = !s_sdRoot.empty() && stat(s_sdRoot.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+  if (_mounted) _mounts++;
+  return _mounted;
+}
+
+void SDFS::end() { _mounted = false; }
+
+sdcard_type_t SDFS::cardType() { return _mounted ? CARD_SDHC : CARD_NONE; }
+
+const std::string &SDFS::root() const { return s_sdRoot; }
+
+} // namespace fs
@@ -0,0 +1,83 @@
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <Arduino.h>
+#include <memory>
+#include <time.h>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+// fs::FS and fs::File over a directory of the host: paths are relative to
+// the root the FS was given (SD's is host::setSdRoot()).
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+class File : public Print {
+public:
+  struct Impl;
+
+  File() {}
+  explicit File(std::shared_ptr<Impl> impl) : _impl(impl) {}
+
+  explicit operator bool() const;
+  const char *name() const;
+  const char *path() const;
+  bool isDirectory() const;
+  File openNextFile(const char *mode = FILE_READ);
+  void rewindDirectory();
+  void close();
+
+  size_t size() const;
+  size_t position() const;
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  int available();
+  int read();
+  size_t read(uint8_t *buf, size_t size);
+  size_t readBytes(char *buf, size_t size) { return read((uint8_t *)buf, size); }
+  int peek();
+  size_t write(const uint8_t *buf, size_t size) override;
+  using Print::write;
+  void flush();
+  time_t getLastWrite();
+
+private:
+  std::shared_ptr<Impl> _impl;
+};
+
+class FS {
+public:
+  explicit FS(const char *root = nullptr) : _root(root ? root : "") {}
+  virtual ~FS() {}
+
+  File open(const char *path, const char *mode = FILE_READ, bool create = false);
+  File open(const String &path, const char *mode = FILE_READ, bool create = false) {
+    return open(path.c_str(), mode, create);
+  }
+  bool exists(const char *path);
+  bool exists(const String &path) { return exists(path.c_str()); }
+  bool remove(const char *path);
+  bool remove(const String &path) { return remove(path.c_str()); }
+  bool rename(const char *from, const char *to);
+  bool rename(const String &from, const String &to) { return rename(from.c_str(), to.c_str()); }
+  bool mkdir(const char *path);
+  bool mkdir(const String &path) { return mkdir(path.c_str()); }
+  bool rmdir(const char *path);
+  bool rmdir(const String &path) { return rmdir(path.c_str()); }
+
+protected:
+  std::string _root;
+
+  virtual bool mounted() const { return !_root.empty(); }
+  virtual const std::string &root() const { return _root; }
+  std::string hostPath(const char *path) const;
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+
+#endif // HOST_FS_H
@@ -0,0 +1,50 @@
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class WavOutput;
+
+// Controls for the host shims, for tests and the scenario runner. Nothing
+// here exists on the device.
+namespace host {
+
+// Host directory that SD's "/" is; SD.begin() fails until it is set
+void setSdRoot(const char *dir);
+const char *sdRoot();
+// The next `n` opens on SD fail, as on a card that stopped answering
+void failOpens(int n);
+// SD traffic since the last reset: opens (directories and openNextFile()
+// entries too) and bytes read and written
+struct SdStats {
+  uint32_t opens;
+  uint64_t read;
+  uint64_t written;
+};
+SdStats sdStats();
+void resetSdStats();
+
+// Board: PSRAM or not, and what the heap reports (an esp32dev with WiFi up
+// by default: ~230 KB free, ~110 KB in one block)
+void setPsram(bool present);
+void setHeap(size_t freeBytes, size_t largestBlock);
+
+// Serial output is dropped while quiet
+void setQuiet(bool quiet);
+// Bytes written to Serial, quiet or not
+uint64_t serialBytes();
+
+// What the DAC on an I2S port plays, written to `wav` as it plays it:
+// silence included wherever the DMA ring ran dry. nullptr stops.
+void captureI2s(int port, WavOutput *wav);
+// Frames of silence the DAC played because the DMA ring was empty, since
+// the first write to the port
+uint32_t i2sStarvedFrames(int port);
+
+// Frames each Audio::loop() decodes, one MP3 frame's worth by default
+void setDecodeBurst(uint32_t frames);
+
+} // namespace host
+
+#endif // HOST_SIM_H
@@ -0,0 +1,47 @@
+#include "Preferences.h"
+
+namespace {
+
+std::map<std::string, std::map<std::string, std::vector<uint8_t>>> s_nvs;
+
+} // namespace
+
+bool Preferences::begin(const char *name, bool) {
+  _ns = &s_nvs[name];
+  return true;
+}
+
+size_t Preferences::put(const char *key, const void *v, size_t len) {
+  if (!_ns) return 0;
+  (*_ns)[key].assign((const uint8_t *)v, (const uint8_t *)v + len);
+  return len;
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t len) {
+  if (!_ns) return 0;
+  auto it = _ns->find(key);
+  if (it == _ns->end() || it->second.size() > len) return 0;
+  memcpy(buf, it->second.data(), it->second.size());
+  return it->second.size();
+}
+
+size_t Preferences::getBytesLength(const char *key) {
+  if (!_ns) return 0;
+  auto it = _ns->find(key);
+  return it == _ns->end() ? 0 : it->second.size();
+}
+
+String Preferences::getString(const char *key, const String &def) {
+  if (!_ns) return def;
+  auto it = _ns->find(key);
+  if (it == _ns->end() || it->second.empty()) return def;
+  return String((const char *)it->second.data());
+}
+
+bool Preferences::isKey(const char *key) { return _ns && _ns->count(key); }
+bool Preferences::remove(const char *key) { return _ns && _ns->erase(key); }
+
+bool Preferences::clear() {
+  if (_ns) _ns->clear();
+  return _ns != nullptr;
+}
@@ -0,0 +1,41 @@
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include <Arduino.h>
+#include <map>
+#include <vector>
+
+// NVS in memory: values live as long as the program, per namespace
+class Preferences {
+public:
+  bool begin(const char *name, bool readOnly = false);
+  void end() {}
+
+  size_t putInt(const char *key, int32_t v) { return put(key, &v, sizeof(v)); }
+  int32_t getInt(const char *key, int32_t def = 0) { return get(key, def); }
+  size_t putUInt(const char *key, uint32_t v) { return put(key, &v, sizeof(v)); }
+  uint32_t getUInt(const char *key, uint32_t def = 0) { return get(key, def); }
+  size_t putBool(const char *key, bool v) { return put(key, &v, sizeof(v)); }
+  bool getBool(const char *key, bool def = false) { return get(key, def); }
+  size_t putFloat(const char *key, float v) { return put(key, &v, sizeof(v)); }
+  float getFloat(const char *key, float def = 0) { return get(key, def); }
+  size_t putBytes(const char *key, const void *v, size_t len) { return put(key, v, len); }
+  size_t getBytes(const char *key, void *buf, size_t len);
+  size_t getBytesLength(const char *key);
+  size_t putString(const char *key, const String &v) { return put(key, v.c_str(), v.length() + 1); }
+  String getString(const char *key, const String &def = String());
+  bool isKey(const char *key);
+  bool remove(const char *key);
+  bool clear();
+
+private:
+  std::map<std::string, std::vector<uint8_t>> *_ns = nullptr;
+
+  size_t put(const char *key, const void *v, size_t len);
+  template <typename T> T get(const char *key, T def) {
+    T v;
+    return getBytes(key, &v, sizeof(v)) == sizeof(v) ? v : def;
+  }
+};
+
+#endif // HOST_PREFERENCES_H
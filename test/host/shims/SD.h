@@ -0,0 +1,40 @@
+#ifndef HOST_SD_H
+#define HOST_SD_H
+
+#include "FS.h"
+
+typedef enum { CARD_NONE, CARD_MMC, CARD_SD, CARD_SDHC, CARD_UNKNOWN } sdcard_type_t;
+
+class SPIClass {
+public:
+  void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1) {}
+};
+extern SPIClass SPI;
+
+namespace fs {
+
+// The card is the host directory set with host::setSdRoot(); begin() mounts
+// it and end() unmounts it, and opens fail while it is unmounted
+class SDFS : public FS {
+public:
+  bool begin(uint8_t ssPin = 5, SPIClass &spi = SPI, uint32_t frequency = 4000000, const char *mountpoint = "/sd",
+             uint8_t maxFiles = 5, bool formatIfEmpty = false);
+  void end();
+  sdcard_type_t cardType();
+  uint32_t mounts() const { return _mounts; } // begin() calls that mounted it
+
+protected:
+  bool mounted() const override { return _mounted; }
+  const std::string &root() const override;
+
+private:
+  bool _mounted = false;
+  uint32_t _mounts = 0;
+};
+
+} // namespace fs
+
+extern fs::SDFS SD;
+using fs::SDFS;
+
+#endif // HOST_SD_H
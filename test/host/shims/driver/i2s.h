@@ -0,0 +1,19 @@
+#ifndef HOST_DRIVER_I2S_H
+#define HOST_DRIVER_I2S_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+typedef uint32_t TickType_t;
+typedef enum { I2S_NUM_0 = 0, I2S_NUM_1 = 1, I2S_NUM_MAX } i2s_port_t;
+
+// A DMA ring that the DAC drains at the sample rate in real time, 16-bit
+// stereo; see host::captureI2s() for listening to it
+esp_err_t i2s_write(i2s_port_t port, const void *src, size_t size, size_t *bytesWritten, TickType_t ticksToWait);
+esp_err_t i2s_set_sample_rates(i2s_port_t port, uint32_t rate);
+esp_err_t i2s_zero_dma_buffer(i2s_port_t port);
+
+#endif // HOST_DRIVER_I2S_H
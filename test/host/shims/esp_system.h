@@ -0,0 +1,9 @@
+#ifndef HOST_ESP_SYSTEM_H
+#define HOST_ESP_SYSTEM_H
+
+#include <stdint.h>
+
+void esp_restart(); // exits the host program
+uint32_t esp_random();
+
+#endif // HOST_ESP_SYSTEM_H
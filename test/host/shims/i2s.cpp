@@ -0,0 +1,106 @@
+#include "driver/i2s.h"
+#include "HostSim.h"
+#include "AudioOutput.h"
+#include <Arduino.h>
+#include <atomic>
+#include <mutex>
+
+namespace {
+
+// As much as the DMA buffers the firmware sets up hold
+const size_t DMA_FRAMES = 8192;
+
+// Nothing in here has a destructor: the audio task may still be writing
+// while statics are torn down at exit
+struct Port {
+  std::mutex lock; // the audio task writes, the test captures
+  uint32_t rate = 44100;
+  bool rateSet = false;
+  uint32_t ring[DMA_FRAMES];
+  size_t head = 0; // next frame the DAC plays
+  size_t count = 0;
+  bool started = false;
+  uint32_t lastUs = 0;
+  uint64_t owedUs = 0; // microseconds x rate not yet a whole frame
+  WavOutput *capture = nullptr;
+  std::atomic<uint32_t> starved{0};
+};
+
+Port s_ports[I2S_NUM_MAX];
+
+void play(Port &p, uint32_t frame) {
+  if (p.capture) p.capture->write(&frame, sizeof(frame));
+}
+
+// The DAC takes what it would have played since the last call
+void drain(Port &p) {
+  uint32_t now = micros();
+  if (!p.started) {
+    p.lastUs = now;
+    return;
+  }
+  p.owedUs += (uint64_t)(uint32_t)(now - p.lastUs) * p.rate;
+  p.lastUs = now;
+  uint64_t frames = p.owedUs / 1000000;
+  p.owedUs -= frames * 1000000;
+  for (uint64_t i = 0; i < frames; ++i) {
+    if (p.count) {
+      play(p, p.ring[p.head]);
+      p.head = (p.head + 1) % DMA_FRAMES;
+      p.count--;
+    } else {
+      play(p, 0);
+      p.starved.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+} // namespace
+
+namespace host {
+
+void captureI2s(int port, WavOutput *wav) {
+  Port &p = s_ports[port];
+  std::lock_guard<std::mutex> hold(p.lock);
+  drain(p);
+  p.capture = wav;
+  if (wav && p.rateSet) wav->setSampleRate(p.rate);
+}
+
+uint32_t i2sStarvedFrames(int port) { return s_ports[port].starved.load(std::memory_order_relaxed); }
+
+} // namespace host
+
+esp_err_t i2s_write(i2s_port_t port, const void *src, size_t size, size_t *bytesWritten, TickType_t) {
+  Port &p = s_ports[port];
+  std::lock_guard<std::mutex> hold(p.lock);
+  drain(p);
+  p.started = true;
+  const uint32_t *in = (const uint32_t *)src;
+  size_t frames = size / sizeof(uint32_t);
+  size_t n = 0;
+  for (; n < frames && p.count < DMA_FRAMES; ++n) {
+    p.ring[(p.head + p.count) % DMA_FRAMES] = in[n];
+    p.count++;
+  }
+  if (bytesWritten) *bytesWritten = n * sizeof(uint32_t);
+  return ESP_OK;
+}
+
+esp_err_t i2s_set_sample_rates(i2s_port_t port, uint32_t rate) {
+  Port &p = s_ports[port];
+  std::lock_guard<std::mutex> hold(p.lock);
+  drain(p);
+  p.rate = rate;
+  p.rateSet = true;
+  if (p.capture) p.capture->setSampleRate(rate);
+  return ESP_OK;
+}
+
+esp_err_t i2s_zero_dma_buffer(i2s_port_t port) {
+  Port &p = s_ports[port];
+  std::lock_guard<std::mutex> hold(p.lock);
+  drain(p);
+  p.count = 0;
+  return ESP_OK;
+}
@@ -0,0 +1,183 @@
+// ShuffleBag over library folders of 2 to 40 files: every round plays each
+// track once, no track comes back within the recent window across the
+// start of a round (nor across a reboot, which reloads the bag, or a file
+// added mid-round, which starts a new one), and the order is uniform: over
+// many rounds each slot holds each track about as often. With weights,
+// heavier tracks come up sooner.
+
+#include "HostTest.h"
+#include "FileScanner.h"
+#include "ShuffleBag.h"
+#include "Config.h"
+#include "SD.h"
+#include <map>
+#include <memory>
+
+namespace {
+
+const int SIZES[] = {2, 3, 5, 9, 10, 12, 17, 40};
+const int ROUNDS = 40;
+const int DIST_SIZE = 20;
+const int DIST_ROUNDS = 3000;
+const double CHI2_19_P001 = 43.82; // chi-square, 19 degrees of freedom, p = 0.001
+
+FileScanner lib;
+std::string root;
+
+std::string folderName(int count) { return "/s" + std::to_string(count); }
+
+void addFile(const std::string &folder, const char *name) {
+  FILE *f = fopen((root + folder + "/" + name).c_str(), "wb");
+  if (f) fclose(f);
+}
+
+int windowFor(int count) { return count / 2 < SHUFFLE_NO_REPEAT ? count / 2 : SHUFFLE_NO_REPEAT; }
+
+std::string draw(ShuffleBag &bag, int folder, ShuffleBag::WeightFn weight = nullptr) {
+  int i = bag.next(lib, folder, weight);
+  CHECK(i >= 0 && i < lib.getCount(folder));
+  return lib.getPath(folder, i).name;
+}
+
+// Plays since each track's last play must exceed the window
+struct GapCheck {
+  std::map<std::string, int> last;
+  int at = 0;
+  int worst = 1 << 30;
+  void play(const std::string &name) {
+    auto it = last.find(name);
+    if (it != last.end() && at - it->second < worst) worst = at - it->second;
+    last[name] = at++;
+  }
+};
+
+void rounds(int count) {
+  int folder = lib.folderId(folderName(count).c_str());
+  int window = windowFor(count);
+  std::unique_ptr<ShuffleBag> bag(new ShuffleBag);
+  bag->begin(SD, SHUFFLE_DIR);
+  GapCheck gaps;
+  int badRounds = 0;
+  for (int r = 0; r < ROUNDS; ++r) {
+    std::map<std::string, int> seen;
+    for (int k = 0; k < count; ++k) {
+      if (r == ROUNDS / 2 && k == count / 3) { // a reboot mid-round
+        bag.reset(new ShuffleBag);
+        bag->begin(SD, SHUFFLE_DIR);
+      }
+      std::string name = draw(*bag, folder);
+      seen[name]++;
+      gaps.play(name);
+    }
+    badRounds += (int)seen.size() != count;
+  }
+  printf("%2d tracks: %d rounds, %d not a permutation, closest repeat %d draws apart (window %d)\n", count, ROUNDS,
+         badRounds, gaps.worst, window);
+  CHECK(badRounds == 0);
+  CHECK(gaps.worst > window);
+  CHECK(gaps.worst <= 2 * count - 1);
+}
+
+// A file added mid-round changes the list: a new round starts, and what
+// was just played still doesn't come back
+void listChange() {
+  int count = 12;
+  int folder = lib.folderId(folderName(count).c_str());
+  ShuffleBag bag;
+  bag.begin(SD, SHUFFLE_DIR);
+  GapCheck gaps;
+  for (int k = 0; k < count + 5; ++k) gaps.play(draw(bag, folder));
+  addFile(folderName(count), "added.mp3");
+  CHECK(lib.addFile((folderName(count) + "/added.mp3").c_str()));
+  CHECK(lib.getCount(folder) == count + 1);
+  std::map<std::string, int> seen;
+  for (int k = 0; k < count + 1; ++k) {
+    std::string name = draw(bag, folder);
+    seen[name]++;
+    gaps.play(name);
+  }
+  printf("file added mid-round: the new round has %d of %d tracks, closest repeat %d draws apart (window %d)\n",
+         (int)seen.size(), count + 1, gaps.worst, windowFor(count + 1));
+  CHECK((int)seen.size() == count + 1);
+  CHECK(gaps.worst > windowFor(count + 1));
+}
+
+// How often each track lands in each slot, against a uniform spread
+void distribution() {
+  int folder = lib.folderId(folderName(DIST_SIZE).c_str());
+  ShuffleBag bag;
+  bag.begin(SD, SHUFFLE_DIR);
+  std::map<std::string, std::vector<int>> slots; // a new folder: the first draw starts a round
+  double worst = 0;
+  int worstSlot = 0;
+  for (int r = 0; r < DIST_ROUNDS; ++r) {
+    for (int k = 0; k < DIST_SIZE; ++k) {
+      std::vector<int> &v = slots[draw(bag, folder)];
+      v.resize(DIST_SIZE);
+      v[k]++;
+    }
+  }
+  CHECK((int)slots.size() == DIST_SIZE);
+  double want = (double)DIST_ROUNDS / DIST_SIZE;
+  for (int k = 0; k < DIST_SIZE; ++k) {
+    double chi2 = 0;
+    for (auto &t : slots) chi2 += (t.second[k] - want) * (t.second[k] - want) / want;
+    if (chi2 > worst) worst = chi2, worstSlot = k;
+  }
+  printf("%d tracks, %d rounds: worst slot %d, chi-square %.1f (p = 0.001 at %.1f)\n", DIST_SIZE, DIST_ROUNDS,
+         worstSlot, worst, CHI2_19_P001);
+  CHECK_LE(worst, CHI2_19_P001);
+}
+
+// The first five tracks weigh SHUFFLE_NEW_WEIGHT, the rest 1
+float newWeight(int index, void *) { return index < 5 ? SHUFFLE_NEW_WEIGHT : 1.0f; }
+
+void weighted() {
+  int folder = lib.folderId(folderName(40).c_str());
+  ShuffleBag bag; // rounds() left it at the end of one
+  bag.begin(SD, SHUFFLE_DIR);
+  std::string heavy[5];
+  for (int i = 0; i < 5; ++i) heavy[i] = lib.getPath(folder, i).name;
+  double heavySum = 0, lightSum = 0;
+  int heavyN = 0, lightN = 0, at = 0;
+  for (int k = 0; k < 40 * 200; ++k, at = (at + 1) % 40) {
+    std::string name = draw(bag, folder, newWeight);
+    bool isHeavy = false;
+    for (const std::string &h : heavy) isHeavy |= h == name;
+    (isHeavy ? heavySum : lightSum) += at;
+    (isHeavy ? heavyN : lightN)++;
+  }
+  double heavyMean = heavySum / heavyN, lightMean = lightSum / lightN;
+  printf("weighted: mean slot %.1f for tracks of weight %.0f, %.1f for the rest\n", heavyMean, SHUFFLE_NEW_WEIGHT,
+         lightMean);
+  CHECK(heavyMean < lightMean * 0.6);
+}
+
+} // namespace
+
+int main() {
+  root = test::makeSdRoot("shuffle");
+  std::vector<int> sizes(std::begin(SIZES), std::end(SIZES));
+  sizes.push_back(DIST_SIZE);
+  char name[32];
+  for (int count : sizes) {
+    test::makeDirs(root, folderName(count).c_str());
+    for (int i = 0; i < count; ++i) {
+      snprintf(name, sizeof(name), "track %02d.mp3", i);
+      addFile(folderName(count), name);
+    }
+  }
+  CHECK(SD.begin(SD_CS));
+  host::setQuiet(true);
+  lib.begin(SD, root.c_str());
+  for (int count : sizes) lib.addFolder(folderName(count).c_str());
+  lib.rescan();
+  while (lib.scanning()) lib.loop();
+
+  for (int count : SIZES) rounds(count);
+  listChange();
+  distribution();
+  weighted();
+  host::setQuiet(false);
+  return testResult("shuffle_rounds");
+}
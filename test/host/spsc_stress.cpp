@@ -0,0 +1,183 @@
+// The loop/audio-task handshake under load. First the queues alone: one
+// thread pushes sequenced commands while the audio task (an AudioTask, as in
+// the firmware) pops them and answers on a second queue, and every item must
+// arrive once, in order, intact. Then AudioManager itself: the loop thread
+// fires starts, stops, prefetches and EQ changes at the task as fast as it
+// can while reading the published status, and every start must get exactly
+// one callback.
+
+#include "HostTest.h"
+#include "AudioManager.h"
+#include "AudioTask.h"
+#include "Config.h"
+#include "SD.h"
+#include "SpscQueue.h"
+#include <atomic>
+#include <map>
+#include <thread>
+
+namespace {
+
+struct Item {
+  uint32_t seq;
+  uint32_t check; // ~seq
+  char path[48];  // as big as the real commands get, so copies can tear
+};
+
+const uint32_t ITEMS = 1000000;
+
+struct Queues {
+  SpscQueue<Item, 8> commands;
+  SpscQueue<Item, 16> events;
+  uint32_t expected = 0;
+  uint32_t bad = 0;
+};
+
+void fill(Item &it, uint32_t seq) {
+  it.seq = seq;
+  it.check = ~seq;
+  snprintf(it.path, sizeof(it.path), "/dhun/%010u.mp3", (unsigned)seq);
+}
+
+bool intact(const Item &it) {
+  char want[48];
+  snprintf(want, sizeof(want), "/dhun/%010u.mp3", (unsigned)it.seq);
+  return it.check == ~it.seq && !strcmp(it.path, want);
+}
+
+// The task side: take what is there, answer each on the event queue
+void consume(void *arg) {
+  Queues &q = *static_cast<Queues *>(arg);
+  Item it;
+  int n = 0;
+  while (n < 64 && q.commands.pop(it)) {
+    if (it.seq != q.expected || !intact(it)) q.bad++;
+    q.expected = it.seq + 1;
+    while (!q.events.push(it)) std::this_thread::yield();
+    n++;
+  }
+  if (!n) std::this_thread::yield();
+}
+
+void queueStress() {
+  Queues q;
+  AudioTask task;
+  CHECK(task.start("audio", consume, &q, 0, 0, 0));
+
+  uint32_t sent = 0, received = 0, bad = 0, full = 0;
+  unsigned long t0 = millis();
+  while (received < ITEMS) {
+    Item it;
+    bool busy = false;
+    if (sent < ITEMS) {
+      fill(it, sent);
+      if (q.commands.push(it)) sent++, busy = true;
+      else full++;
+    }
+    while (q.events.pop(it)) {
+      if (it.seq != received || !intact(it)) bad++;
+      received++;
+      busy = true;
+    }
+    if (!busy) std::this_thread::yield(); // the task may share our core
+  }
+  task.stop();
+  printf("queues    %u commands and answers in %lu ms, queue full %u times, %u bad on the task, %u bad back\n",
+         (unsigned)ITEMS, millis() - t0, (unsigned)full, (unsigned)q.bad, (unsigned)bad);
+  CHECK(q.bad == 0);
+  CHECK(bad == 0);
+  CHECK(q.expected == ITEMS);
+  CHECK(q.commands.empty() && q.events.empty());
+}
+
+AudioManager audio;
+std::map<uint32_t, int> s_callbacks; // handle -> times called, loop thread only
+uint32_t s_ok = 0, s_failed = 0;
+
+void onStart(uint32_t handle, bool ok, uint32_t, void *) {
+  s_callbacks[handle]++;
+  (ok ? s_ok : s_failed)++;
+}
+
+void managerStress(const std::string &root) {
+  const char *tracks[] = {DHUN_DIR "/01.mp3", DHUN_DIR "/02.mp3", DHUN_DIR "/03.mp3", DHUN_DIR "/missing.mp3"};
+  test::makeDirs(root, DHUN_DIR);
+  for (int i = 0; i < 3; ++i) CHECK(test::writeTone(root, tracks[i], 44100, 1.0f, 300 + 100 * i));
+  CHECK(SD.begin(SD_CS));
+  host::setQuiet(true);
+  audio.begin(I2S_BCLK, I2S_LRCLK, I2S_DIN);
+  audio.startTask();
+
+  std::vector<uint32_t> handles;
+  uint32_t statusReads = 0, tornPaths = 0, commands = 0;
+  unsigned long t0 = millis();
+  uint32_t r = 1;
+  while (millis() - t0 < 3000) {
+    r = r * 1103515245u + 12345u;
+    const char *path = tracks[(r >> 16) % 4];
+    switch ((r >> 8) % 6) {
+    case 0:
+    case 1: handles.push_back(audio.startAsync(String(path), onStart)); break;
+    case 2: audio.prefetch(String(path)); break;
+    case 3: audio.setEQGain((r >> 4) % AudioManager::EQ_BANDS, (int)((r >> 20) % 13) - 6); break;
+    case 4: audio.stop(); break;
+    case 5: audio.startWithCrossfade(String(path)); break;
+    }
+    commands++;
+    audio.loop();
+    // A path read from the status is always one that was asked for
+    for (int i = 0; i < 20; ++i) {
+      String p = audio.getCurrentPath();
+      bool known = p.length() == 0;
+      for (const char *t : tracks) known = known || p == t;
+      tornPaths += !known;
+      statusReads++;
+    }
+    if ((r >> 12) % 4 == 0) delay(1);
+  }
+  // Nothing left wedged: a start on its own still plays
+  uint32_t okBefore = s_ok;
+  uint32_t last = audio.startAsync(String(tracks[0]), onStart);
+  handles.push_back(last);
+  unsigned long t1 = millis();
+  while (!s_callbacks.count(last) && millis() - t1 < 5000) {
+    audio.loop();
+    delay(2);
+  }
+  CHECK(s_ok == okBefore + 1);
+  audio.stop();
+  t1 = millis();
+  while ((audio.isStarting() || audio.isRunning()) && millis() - t1 < 5000) {
+    audio.loop();
+    delay(2);
+  }
+  for (int i = 0; i < 20; ++i) { // events still on their way
+    audio.loop();
+    delay(2);
+  }
+  host::setQuiet(false);
+
+  uint32_t missing = 0, repeated = 0;
+  for (uint32_t h : handles) {
+    if (!h) continue;
+    int n = s_callbacks.count(h) ? s_callbacks[h] : 0;
+    missing += n == 0;
+    repeated += n > 1;
+  }
+  printf("manager   %u commands, %u starts (%u ok, %u failed or cancelled), %u status reads, %u torn paths\n",
+         (unsigned)commands, (unsigned)handles.size(), (unsigned)s_ok, (unsigned)s_failed, (unsigned)statusReads,
+         (unsigned)tornPaths);
+  printf("manager   %u starts without a callback, %u with more than one\n", (unsigned)missing, (unsigned)repeated);
+  CHECK(missing == 0);
+  CHECK(repeated == 0);
+  CHECK(tornPaths == 0);
+  CHECK(!audio.isStarting() && !audio.isRunning());
+}
+
+} // namespace
+
+int main() {
+  queueStress();
+  managerStress(test::makeSdRoot("spsc-stress"));
+  return testResult("spsc_stress");
+}